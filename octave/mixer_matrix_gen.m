@@ -0,0 +1,74 @@
+1;
+
+% generate the normalized mixer matrices of the supported airframes, run
+% "make mixer_matrix" in src/ to rewrite src/core/controllers/mixer_matrix.h
+%
+% motor angle is measured from the nose (body x) toward the right side
+% (body y), spin direction is seen from the top: ccw = +1, cw = -1
+%
+% allocation matrix in front-right-down body frame with unit arm length
+% and unit yaw coefficient (same derivation as allocation_matrix.m):
+% [f_total; m_roll; m_pitch; m_yaw] = A * [f1; f2; ...; fn]
+% f_total = 1, m_roll = -sin(angle), m_pitch = cos(angle), m_yaw = spin
+
+function [M, scale] = mixer_matrix(angle, spin)
+	A = [ones(size(angle)); -sind(angle); cosd(angle); spin];
+	M = pinv(A);
+
+	% the allocation must reproduce the desired force and moments
+	assert(A * M, eye(4), 1e-6);
+
+	% normalize every column by its maximum magnitude, so the mixer inputs
+	% are in the same unit as the motor outputs. the scales are kept, the
+	% pseudo-inverse is M * diag(scale)
+	scale = max(abs(M));
+	M = M ./ scale;
+	M(abs(M) < 1e-9) = 0;
+endfunction
+
+function print_matrix(fd, name, type, angle, spin)
+	[M, scale] = mixer_matrix(angle, spin);
+	fprintf(fd, "#%s (SELECT_UAV_TYPE == %s)\n", name, type);
+	fprintf(fd, "#define MIXER_MOTOR_CNT %d\n", rows(M));
+	fprintf(fd, "#define MIXER_MATRIX { \\\n");
+	for i = 1:rows(M)
+		fprintf(fd, "\t{%+.6ff, %+.6ff, %+.6ff, %+.6ff}", M(i, :));
+		if i < rows(M)
+			fprintf(fd, ",");
+		endif
+		fprintf(fd, " /* m%d */ \\\n", i);
+	endfor
+	fprintf(fd, "}\n");
+	fprintf(fd, "#define MIXER_COLUMN_SCALE {%+.6ff, %+.6ff, %+.6ff, %+.6ff}\n", scale);
+endfunction
+
+%    (ccw)    (cw)
+%     m2       m1
+%          x
+%     m3       m4
+%    (cw)    (ccw)
+quad_angle = [45 -45 -135 135];
+quad_spin = [-1 1 -1 1];
+
+% m1 front-right, then counterclockwise seen from the top
+hexa_angle = [30 -30 -90 -150 150 90];
+hexa_spin = [-1 1 -1 1 -1 1];
+
+octa_angle = [22.5 -22.5 -67.5 -112.5 -157.5 157.5 112.5 67.5];
+octa_spin = [-1 1 -1 1 -1 1 -1 1];
+
+fd = fopen("../src/core/controllers/mixer_matrix.h", "w");
+
+fprintf(fd, "/* generated by octave/mixer_matrix_gen.m, do not edit */\n\n");
+fprintf(fd, "#ifndef __MIXER_MATRIX_H__\n");
+fprintf(fd, "#define __MIXER_MATRIX_H__\n\n");
+fprintf(fd, "#include \"proj_config.h\"\n\n");
+fprintf(fd, "/* columns: collective, roll, pitch, yaw. the pseudo-inverse of the allocation\n");
+fprintf(fd, " * matrix (unit arm length and yaw coefficient) is MIXER_MATRIX * diag(MIXER_COLUMN_SCALE) */\n");
+print_matrix(fd, "if", "UAV_TYPE_QUADROTOR", quad_angle, quad_spin);
+print_matrix(fd, "elif", "UAV_TYPE_HEXAROTOR", hexa_angle, hexa_spin);
+print_matrix(fd, "elif", "UAV_TYPE_OCTOROTOR", octa_angle, octa_spin);
+fprintf(fd, "#endif\n\n");
+fprintf(fd, "#endif\n");
+
+fclose(fd);
@@ -0,0 +1,17 @@
+#ifndef __CCM_H__
+#define __CCM_H__
+
+#include "proj_config.h"
+
+/* core coupled memory is only reachable by the cpu, no dma stream can read
+ * or write it. never place dma buffers or anything a dma stream reads on the
+ * stack of a task whose stack lives in ccm */
+#if (SELECT_HOT_STATE_MEMORY == HOT_STATE_IN_CCM)
+#define CCM_HOT __attribute__((section(".ccmbss")))     //zero initialized by the startup code
+#define CCM_HOT_DATA __attribute__((section(".ccmram"))) //initial values are copied from flash by the startup code
+#else
+#define CCM_HOT
+#define CCM_HOT_DATA
+#endif
+
+#endif
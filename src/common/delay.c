@@ -1,10 +1,25 @@
 #include <stdint.h>
+#include "profiler.h"
+#include "delay.h"
+
+/* busy wait on the dwt cycle counter, profiler_init() has to be called first */
+void blocked_delay_us(uint32_t us)
+{
+	uint32_t start = profiler_get_cycles();
+	uint32_t cycles = us * (PROFILER_CPU_FREQ / 1000000);
+	while((profiler_get_cycles() - start) < cycles);
+}
 
 void blocked_delay_ms(uint32_t ms)
 {
-	volatile uint32_t cnt;
-	for(cnt = ms; cnt > 0; cnt--) {
-		volatile uint32_t tweaked_delay = 22500U;
-		while(tweaked_delay--);
+	while(ms--) {
+		blocked_delay_us(1000);
 	}
 }
+
+/* non-blocking timeout for the boot state machines, valid up to the cycle
+ * counter overflow period (~23s) */
+bool delay_elapsed_ms(uint32_t start, uint32_t ms)
+{
+	return (profiler_get_cycles() - start) >= ms * (PROFILER_CPU_FREQ / 1000);
+}
@@ -2,10 +2,13 @@
 #define __DELAY_H__
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define OS_TICK 4000
 #define freertos_task_delay(ms) vTaskDelay(OS_TICK / 1000 * ms)
 
+void blocked_delay_us(uint32_t us);
 void blocked_delay_ms(uint32_t ms);
+bool delay_elapsed_ms(uint32_t start, uint32_t ms);
 
 #endif
@@ -0,0 +1,123 @@
+#ifndef __FASTMATH_H__
+#define __FASTMATH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* single precision approximations for the estimators and controllers,
+ * the error bounds are measured over every float of the stated domain
+ * against the double precision libm */
+
+#define FASTMATH_PI 3.14159265358979f
+#define FASTMATH_PI_2 1.57079632679490f
+
+/* 1 / sqrt(x), x > 0
+ * bit trick initial guess followed by two newton iterations
+ * max relative error: 4.8e-6 */
+static inline float fast_invsqrtf(float x)
+{
+	float y;
+	uint32_t i;
+
+	memcpy(&i, &x, sizeof(i));
+	i = 0x5f375a86 - (i >> 1);
+	memcpy(&y, &i, sizeof(y));
+
+	float half_x = 0.5f * x;
+	y = y * (1.5f - half_x * y * y);
+	y = y * (1.5f - half_x * y * y);
+
+	return y;
+}
+
+/* atan2(y, x), returns [-pi, +pi], atan2(0, 0) = 0
+ * odd minimax polynomial of atan() over [0, 1] (abramowitz and stegun 4.4.47)
+ * max absolute error: 1.2e-5 [rad], -0.0 is treated as +0.0 on the +-pi branch cut */
+static inline float fast_atan2f(float y, float x)
+{
+	float abs_x = x < 0.0f ? -x : x;
+	float abs_y = y < 0.0f ? -y : y;
+
+	if(abs_x == 0.0f && abs_y == 0.0f) {
+		return 0.0f;
+	}
+
+	/* reduce to a ratio in [0, 1] */
+	bool swap = abs_y > abs_x;
+	float t = swap ? (abs_x / abs_y) : (abs_y / abs_x);
+	float t2 = t * t;
+
+	float angle = t * (0.9998660f + t2 * (-0.3302995f + t2 * (0.1801410f +
+	                   t2 * (-0.0851330f + t2 * 0.0208351f))));
+
+	/* unfold the octant and the quadrant */
+	if(swap == true) angle = FASTMATH_PI_2 - angle;
+	if(x < 0.0f) angle = FASTMATH_PI - angle;
+	if(y < 0.0f) angle = -angle;
+
+	return angle;
+}
+
+/* asin(x), x is clamped into [-1, +1]
+ * pi/2 - sqrt(1 - |x|) * p(|x|) (abramowitz and stegun 4.4.46)
+ * max absolute error: 7.4e-6 [rad], dominated by fast_invsqrtf() */
+static inline float fast_asinf(float x)
+{
+	float abs_x = x < 0.0f ? -x : x;
+
+	if(abs_x >= 1.0f) {
+		return x < 0.0f ? -FASTMATH_PI_2 : FASTMATH_PI_2;
+	}
+
+	float one_minus_x = 1.0f - abs_x;
+	float sqrt_one_minus_x = one_minus_x * fast_invsqrtf(one_minus_x);
+
+	float p = 1.5707963050f + abs_x * (-0.2145988016f + abs_x * (0.0889789874f +
+	          abs_x * (-0.0501743046f + abs_x * (0.0308918810f + abs_x * (-0.0170881256f +
+	          abs_x * (0.0066700901f + abs_x * -0.0012624911f))))));
+
+	float angle = FASTMATH_PI_2 - sqrt_one_minus_x * p;
+
+	return x < 0.0f ? -angle : angle;
+}
+
+/* sin(x) and cos(x) of the same angle, |x| <= 1000 [rad]
+ * quadrant reduction with a three part pi/2, then the cephes sinf/cosf
+ * polynomials over [-pi/4, +pi/4]
+ * max absolute error: 9.4e-8 */
+static inline void fast_sincosf(float x, float *sin_x, float *cos_x)
+{
+	/* nearest multiple of pi/2 */
+	float k = x * 0.636619772367581f;
+	k = (k >= 0.0f) ? (float)(int32_t)(k + 0.5f) : (float)(int32_t)(k - 0.5f);
+	int32_t quadrant = (int32_t)k;
+
+	float r = ((x - k * 1.5703125f) - k * 4.837512969970703125e-4f) - k * 7.54978995489188216e-8f;
+	float r2 = r * r;
+
+	float s = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+	float c = 1.0f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f +
+	          r2 * 2.443315711809948e-5f));
+
+	switch(quadrant & 3) {
+	case 0:
+		*sin_x = s;
+		*cos_x = c;
+		break;
+	case 1:
+		*sin_x = c;
+		*cos_x = -s;
+		break;
+	case 2:
+		*sin_x = -s;
+		*cos_x = -c;
+		break;
+	default:
+		*sin_x = -c;
+		*cos_x = s;
+		break;
+	}
+}
+
+#endif
@@ -16,6 +16,8 @@ typedef struct {
 	vector3d_f_t accel_lpf;
 	vector3d_f_t gyro_lpf;
 	vector3d_f_t mag_lpf;
+
+	uint32_t sample_time; //dwt timestamp of the latest sample [cycles]
 } imu_t;
 
 #endif
@@ -0,0 +1,62 @@
+#include "vector.h"
+#include "imu_calib.h"
+
+static float imu_calib_poly(const float *coeff, float t)
+{
+	/* horner scheme */
+	float y = coeff[IMU_CALIB_POLY_ORDER];
+
+	int i;
+	for(i = IMU_CALIB_POLY_ORDER - 1; i >= 0; i--) {
+		y = y * t + coeff[i];
+	}
+
+	return y;
+}
+
+/* evaluates the model on the temperature grid, called once at boot, the
+ * divisions and polynomials stay out of the sample conversion */
+void imu_calib_lut_build(imu_calib_lut_t *lut, const imu_calib_model_t *model)
+{
+	int n, i, j;
+	for(n = 0; n < IMU_CALIB_LUT_SIZE; n++) {
+		imu_calib_kernel_t *kernel = &lut->entry[n];
+		float t = IMU_CALIB_LUT_TEMP_MIN + (float)n * IMU_CALIB_LUT_TEMP_STEP - IMU_CALIB_TEMP_REF;
+
+		for(j = 0; j < 3; j++) {
+			kernel->bias[j] = imu_calib_poly(model->bias[j], t);
+
+			float sens_inv = 1.0f / imu_calib_poly(model->sens[j], t);
+			for(i = 0; i < 3; i++) {
+				kernel->A[i * 3 + j] = model->misalign[i * 3 + j] * sens_inv;
+			}
+		}
+	}
+}
+
+/* linear interpolation between the grid points, clamped to the table range */
+void imu_calib_lut_lookup(const imu_calib_lut_t *lut, float temp, imu_calib_kernel_t *kernel)
+{
+	float pos = (temp - IMU_CALIB_LUT_TEMP_MIN) / IMU_CALIB_LUT_TEMP_STEP;
+
+	if(pos <= 0.0f) {
+		*kernel = lut->entry[0];
+		return;
+	} else if(pos >= (float)(IMU_CALIB_LUT_SIZE - 1)) {
+		*kernel = lut->entry[IMU_CALIB_LUT_SIZE - 1];
+		return;
+	}
+
+	int n = (int)pos;
+	float w = pos - (float)n;
+	const imu_calib_kernel_t *lo = &lut->entry[n];
+	const imu_calib_kernel_t *hi = &lut->entry[n + 1];
+
+	int i;
+	for(i = 0; i < 9; i++) {
+		kernel->A[i] = lo->A[i] + w * (hi->A[i] - lo->A[i]);
+	}
+	for(i = 0; i < 3; i++) {
+		kernel->bias[i] = lo->bias[i] + w * (hi->bias[i] - lo->bias[i]);
+	}
+}
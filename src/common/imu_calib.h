@@ -0,0 +1,57 @@
+#ifndef __IMU_CALIB_H__
+#define __IMU_CALIB_H__
+
+#include "vector.h"
+
+#define IMU_CALIB_POLY_ORDER 3
+#define IMU_CALIB_TEMP_REF 25.0f //temperature the polynomials are expanded around [degC]
+
+/* correction table grid, the operating range of the mpu6500 above -20degC */
+#define IMU_CALIB_LUT_TEMP_MIN -20.0f //[degC]
+#define IMU_CALIB_LUT_TEMP_STEP 5.0f  //[degC]
+#define IMU_CALIB_LUT_SIZE 22         //up to 85degC
+
+/* calibration model of one sensor, with t = temp - IMU_CALIB_TEMP_REF:
+ * out = misalign * diag(1 / sens(t)) * (raw - bias(t))
+ * the polynomial coefficients are in ascending powers of t */
+typedef struct {
+	float bias[3][IMU_CALIB_POLY_ORDER + 1]; //[lsb]
+	float sens[3][IMU_CALIB_POLY_ORDER + 1]; //[lsb / output unit]
+	float misalign[3 * 3];                   //row major
+} imu_calib_model_t;
+
+/* flash record of FLASH_PARAM_IMU_CALIB, written by tools/imu_calib_fit */
+typedef struct {
+	imu_calib_model_t accel; //output unit: [m/s^2]
+	imu_calib_model_t gyro;  //output unit: [deg/s]
+} imu_calib_param_t;
+
+/* fused conversion at one temperature, out = A * (raw - bias) */
+typedef struct {
+	float A[3 * 3]; //row major [output unit / lsb]
+	float bias[3];  //[lsb]
+} imu_calib_kernel_t;
+
+typedef struct {
+	imu_calib_kernel_t entry[IMU_CALIB_LUT_SIZE];
+} imu_calib_lut_t;
+
+void imu_calib_lut_build(imu_calib_lut_t *lut, const imu_calib_model_t *model);
+void imu_calib_lut_lookup(const imu_calib_lut_t *lut, float temp, imu_calib_kernel_t *kernel);
+
+/* bias, scale and misalignment of one raw sample in a single pass, inlined
+ * into the sample decoding */
+static inline void imu_calib_apply(const imu_calib_kernel_t *kernel, const vector3d_16_t *raw, vector3d_f_t *out)
+{
+	/* the bias is kept in float, subtracting it from the integer sample
+	 * would truncate the fraction */
+	float x = (float)raw->x - kernel->bias[0];
+	float y = (float)raw->y - kernel->bias[1];
+	float z = (float)raw->z - kernel->bias[2];
+
+	out->x = kernel->A[0] * x + kernel->A[1] * y + kernel->A[2] * z;
+	out->y = kernel->A[3] * x + kernel->A[4] * y + kernel->A[5] * z;
+	out->z = kernel->A[6] * x + kernel->A[7] * y + kernel->A[8] * z;
+}
+
+#endif
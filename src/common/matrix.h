@@ -2,10 +2,11 @@
 #define __MATRIX_H__
 
 #include "arm_math.h"
+#include "ccm.h"
 
 #define MAT_ALLOC(mat, row, col) \
-	arm_matrix_instance_f32 mat; \
-	float mat ## _arr[row * col]
+	arm_matrix_instance_f32 mat CCM_HOT; \
+	float mat ## _arr[row * col] CCM_HOT
 
 #define MAT_INIT(mat, row, col) \
 	arm_mat_init_f32(&mat, row, col, (float32_t *)mat ## _arr)
@@ -0,0 +1,51 @@
+#include <stdint.h>
+#include "stm32f4xx.h"
+#include "profiler.h"
+
+#define PROFILER_AVG_ALPHA 0.01f
+
+void profiler_init(void)
+{
+	/* enable the dwt cycle counter */
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void profiler_start(profiler_t *prof)
+{
+	prof->start = profiler_get_cycles();
+}
+
+void profiler_stop(profiler_t *prof)
+{
+	/* unsigned subtraction handles the counter overflow */
+	profiler_update(prof, profiler_get_cycles() - prof->start);
+}
+
+void profiler_update(profiler_t *prof, uint32_t cycles)
+{
+	prof->last = cycles;
+
+	if(cycles > prof->max) {
+		prof->max = cycles;
+	}
+
+	if(prof->avg == 0.0f) {
+		prof->avg = (float)cycles;
+	} else {
+		prof->avg = ((float)cycles * PROFILER_AVG_ALPHA) + (prof->avg * (1.0f - PROFILER_AVG_ALPHA));
+	}
+}
+
+void profiler_reset(profiler_t *prof)
+{
+	prof->last = 0;
+	prof->max = 0;
+	prof->avg = 0.0f;
+}
+
+float profiler_cycles_to_us(float cycles)
+{
+	return cycles * (1000000.0f / (float)PROFILER_CPU_FREQ);
+}
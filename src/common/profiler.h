@@ -0,0 +1,25 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <stdint.h>
+#include "stm32f4xx.h"
+
+#define PROFILER_CPU_FREQ 180000000 //[Hz], dwt cycle counter runs with the core clock
+
+#define profiler_get_cycles() (DWT->CYCCNT)
+
+typedef struct {
+	uint32_t start; //timestamp of the current measurement [cycles]
+	uint32_t last;  //latest measured duration [cycles]
+	uint32_t max;   //worst case duration [cycles]
+	float avg;      //moving average of the duration [cycles]
+} profiler_t;
+
+void profiler_init(void);
+void profiler_start(profiler_t *prof);
+void profiler_stop(profiler_t *prof);
+void profiler_update(profiler_t *prof, uint32_t cycles);
+void profiler_reset(profiler_t *prof);
+float profiler_cycles_to_us(float cycles);
+
+#endif
@@ -0,0 +1,37 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "stm32f4xx.h"
+#include "ring.h"
+
+bool ring_push(ring_t *ring, const void *data)
+{
+	uint32_t head = ring->head;
+
+	if(head - ring->tail >= ring->cnt) {
+		ring->dropped++;
+		return false;
+	}
+
+	memcpy(ring->buf + (head & (ring->cnt - 1)) * ring->size, data, ring->size);
+	__DMB();
+	ring->head = head + 1;
+
+	return true;
+}
+
+bool ring_pop(ring_t *ring, void *data)
+{
+	uint32_t tail = ring->tail;
+
+	if(tail == ring->head) {
+		return false;
+	}
+
+	__DMB();
+	memcpy(data, ring->buf + (tail & (ring->cnt - 1)) * ring->size, ring->size);
+	__DMB();
+	ring->tail = tail + 1;
+
+	return true;
+}
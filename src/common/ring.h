@@ -0,0 +1,28 @@
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* lock-free single producer single consumer ring of fixed size elements,
+ * the producer (an interrupt) only writes head and the consumer (a task)
+ * only writes tail. the element count has to be a power of two */
+typedef struct {
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	uint32_t cnt;
+	size_t size;
+	uint8_t *buf;
+	volatile uint32_t dropped; //elements lost since the ring was full
+} ring_t;
+
+#define RING_ALLOC(name, type, elem_cnt) \
+	static type name ## _buf[elem_cnt]; \
+	ring_t name = {.head = 0, .tail = 0, .cnt = elem_cnt, .size = sizeof(type), \
+	               .buf = (uint8_t *)name ## _buf, .dropped = 0}
+
+bool ring_push(ring_t *ring, const void *data);
+bool ring_pop(ring_t *ring, void *data);
+
+#endif
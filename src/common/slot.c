@@ -0,0 +1,28 @@
+#include <stdint.h>
+#include <string.h>
+#include "stm32f4xx.h"
+#include "slot.h"
+
+void slot_publish(slot_t *slot, const void *data)
+{
+	uint32_t seq = slot->seq;
+
+	memcpy(slot->buf[(seq + 1) & 1], data, slot->size);
+	__DMB();
+	slot->seq = seq + 1;
+}
+
+/* returns the publish count of the copied value, zero if nothing was published yet */
+uint32_t slot_read(slot_t *slot, void *data)
+{
+	uint32_t seq;
+
+	do {
+		seq = slot->seq;
+		__DMB();
+		memcpy(data, slot->buf[seq & 1], slot->size);
+		__DMB();
+	} while(seq != slot->seq);
+
+	return seq;
+}
@@ -0,0 +1,26 @@
+#ifndef __SLOT_H__
+#define __SLOT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* lock-free latest value slot between one writer and any number of readers
+ * running at different task priorities, neither side ever blocks:
+ * the writer fills the buffer not currently published and then advances the
+ * sequence, a reader retries whenever the sequence changed while it was
+ * copying. a single publish leaves the copied buffer intact, only a second
+ * one overwrites it, but the reader can not tell the two apart */
+typedef struct {
+	volatile uint32_t seq; //publish count, seq & 1 selects the current buffer
+	size_t size;
+	void *buf[2];
+} slot_t;
+
+#define SLOT_ALLOC(name, type) \
+	static type name ## _buf[2]; \
+	slot_t name = {.seq = 0, .size = sizeof(type), .buf = {&name ## _buf[0], &name ## _buf[1]}}
+
+void slot_publish(slot_t *slot, const void *data);
+uint32_t slot_read(slot_t *slot, void *data);
+
+#endif
@@ -0,0 +1,118 @@
+#include <stdint.h>
+#include "mixer.h"
+#include "motor.h"
+#include "bound.h"
+#include "proj_config.h"
+
+#if (MIXER_MOTOR_CNT > 6)
+#error "the airframe needs more motor outputs than the board provides"
+#endif
+
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_DSHOT600) && (MIXER_MOTOR_CNT > DSHOT_MOTOR_CNT)
+#error "dshot output only drives motor 1~4"
+#endif
+
+static const float mixer_matrix[MIXER_MOTOR_CNT][4] = MIXER_MATRIX;
+
+/* roll/pitch and yaw part of one motor, the matrix is constant so the
+ * zero and unit coefficients are folded by the compiler */
+#define MIX_MOTOR(i) \
+	do { \
+		rp[i] = mixer_matrix[i][1] * roll + mixer_matrix[i][2] * pitch; \
+		y[i] = mixer_matrix[i][3] * yaw; \
+	} while(0)
+
+static inline void mixer_kernel(float *rp, float *y, float roll, float pitch, float yaw)
+{
+	MIX_MOTOR(0);
+	MIX_MOTOR(1);
+	MIX_MOTOR(2);
+	MIX_MOTOR(3);
+#if (MIXER_MOTOR_CNT >= 6)
+	MIX_MOTOR(4);
+	MIX_MOTOR(5);
+#endif
+#if (MIXER_MOTOR_CNT >= 8)
+	MIX_MOTOR(6);
+	MIX_MOTOR(7);
+#endif
+}
+
+static void mixer_find_range(float *rp, float *y, float *min, float *max)
+{
+	*min = *max = rp[0] + y[0];
+
+	int i;
+	for(i = 1; i < MIXER_MOTOR_CNT; i++) {
+		float val = rp[i] + y[i];
+		if(val < *min) {
+			*min = val;
+		} else if(val > *max) {
+			*max = val;
+		}
+	}
+}
+
+/*
+ * mix the control commands into the motor outputs, all quantities are in
+ * the unit of the outputs (collective is the amount above output_min).
+ * if the outputs saturate, yaw is reduced first, then roll/pitch is scaled
+ * down, the collective is shifted at last to keep every motor in range.
+ * roll and pitch are therefore never traded for yaw or altitude.
+ */
+void mixer_allocate(float *outputs, float collective, float roll, float pitch, float yaw,
+                    float output_min, float output_max)
+{
+	float rp[MIXER_MOTOR_CNT], y[MIXER_MOTOR_CNT], zero[MIXER_MOTOR_CNT] = {0.0f};
+	float rp_min, rp_max, rpy_min, rpy_max;
+
+	mixer_kernel(rp, y, roll, pitch, yaw);
+
+	mixer_find_range(rp, zero, &rp_min, &rp_max);
+	mixer_find_range(rp, y, &rpy_min, &rpy_max);
+
+	float span = output_max - output_min;
+	float rp_range = rp_max - rp_min;
+	float rpy_range = rpy_max - rpy_min;
+
+	int i;
+	if(rp_range > span) {
+		/* roll/pitch alone exceeds the output range, yaw is dropped */
+		float scale = span / rp_range;
+		for(i = 0; i < MIXER_MOTOR_CNT; i++) {
+			rp[i] *= scale;
+			y[i] = 0.0f;
+		}
+		rpy_min = rp_min * scale;
+		rpy_max = rp_max * scale;
+	} else if(rpy_range > span) {
+		/* range is convex in the yaw scale, so this keeps the mix in range */
+		float scale = (span - rp_range) / (rpy_range - rp_range);
+		for(i = 0; i < MIXER_MOTOR_CNT; i++) {
+			y[i] *= scale;
+		}
+		mixer_find_range(rp, y, &rpy_min, &rpy_max);
+	}
+
+	/* shift the collective to fit the mix into the output range */
+	bound_float(&collective, span - rpy_max, -rpy_min);
+
+	for(i = 0; i < MIXER_MOTOR_CNT; i++) {
+		outputs[i] = output_min + mixer_matrix[i][0] * collective + rp[i] + y[i];
+		bound_float(&outputs[i], output_max, output_min);
+	}
+}
+
+void mixer_write_motors(float *pulses)
+{
+	set_motor_pwm_pulse(MOTOR1, (uint16_t)pulses[0]);
+	set_motor_pwm_pulse(MOTOR2, (uint16_t)pulses[1]);
+	set_motor_pwm_pulse(MOTOR3, (uint16_t)pulses[2]);
+	set_motor_pwm_pulse(MOTOR4, (uint16_t)pulses[3]);
+#if (MIXER_MOTOR_CNT >= 6)
+	set_motor_pwm_pulse(MOTOR5, (uint16_t)pulses[4]);
+	set_motor_pwm_pulse(MOTOR6, (uint16_t)pulses[5]);
+#endif
+
+	motor_output_trigger();
+}
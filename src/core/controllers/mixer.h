@@ -0,0 +1,10 @@
+#ifndef __MIXER_H__
+#define __MIXER_H__
+
+#include "mixer_matrix.h"
+
+void mixer_allocate(float *outputs, float collective, float roll, float pitch, float yaw,
+                    float output_min, float output_max);
+void mixer_write_motors(float *pulses);
+
+#endif
@@ -0,0 +1,45 @@
+/* generated by octave/mixer_matrix_gen.m, do not edit */
+
+#ifndef __MIXER_MATRIX_H__
+#define __MIXER_MATRIX_H__
+
+#include "proj_config.h"
+
+/* columns: collective, roll, pitch, yaw. the pseudo-inverse of the allocation
+ * matrix (unit arm length and yaw coefficient) is MIXER_MATRIX * diag(MIXER_COLUMN_SCALE) */
+#if (SELECT_UAV_TYPE == UAV_TYPE_QUADROTOR)
+#define MIXER_MOTOR_CNT 4
+#define MIXER_MATRIX { \
+	{+1.000000f, -1.000000f, +1.000000f, -1.000000f}, /* m1 */ \
+	{+1.000000f, +1.000000f, +1.000000f, +1.000000f}, /* m2 */ \
+	{+1.000000f, +1.000000f, -1.000000f, -1.000000f}, /* m3 */ \
+	{+1.000000f, -1.000000f, -1.000000f, +1.000000f} /* m4 */ \
+}
+#define MIXER_COLUMN_SCALE {+0.250000f, +0.353553f, +0.353553f, +0.250000f}
+#elif (SELECT_UAV_TYPE == UAV_TYPE_HEXAROTOR)
+#define MIXER_MOTOR_CNT 6
+#define MIXER_MATRIX { \
+	{+1.000000f, -0.500000f, +1.000000f, -1.000000f}, /* m1 */ \
+	{+1.000000f, +0.500000f, +1.000000f, +1.000000f}, /* m2 */ \
+	{+1.000000f, +1.000000f, +0.000000f, -1.000000f}, /* m3 */ \
+	{+1.000000f, +0.500000f, -1.000000f, +1.000000f}, /* m4 */ \
+	{+1.000000f, -0.500000f, -1.000000f, -1.000000f}, /* m5 */ \
+	{+1.000000f, -1.000000f, +0.000000f, +1.000000f} /* m6 */ \
+}
+#define MIXER_COLUMN_SCALE {+0.166667f, +0.333333f, +0.288675f, +0.166667f}
+#elif (SELECT_UAV_TYPE == UAV_TYPE_OCTOROTOR)
+#define MIXER_MOTOR_CNT 8
+#define MIXER_MATRIX { \
+	{+1.000000f, -0.414214f, +1.000000f, -1.000000f}, /* m1 */ \
+	{+1.000000f, +0.414214f, +1.000000f, +1.000000f}, /* m2 */ \
+	{+1.000000f, +1.000000f, +0.414214f, -1.000000f}, /* m3 */ \
+	{+1.000000f, +1.000000f, -0.414214f, +1.000000f}, /* m4 */ \
+	{+1.000000f, +0.414214f, -1.000000f, -1.000000f}, /* m5 */ \
+	{+1.000000f, -0.414214f, -1.000000f, +1.000000f}, /* m6 */ \
+	{+1.000000f, -1.000000f, -0.414214f, -1.000000f}, /* m7 */ \
+	{+1.000000f, -1.000000f, +0.414214f, +1.000000f} /* m8 */ \
+}
+#define MIXER_COLUMN_SCALE {+0.125000f, +0.230970f, +0.230970f, +0.125000f}
+#endif
+
+#endif
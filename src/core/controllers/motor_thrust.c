@@ -1,10 +1,9 @@
 #include <stdint.h>
 #include <bound.h>
+#include "motor_thrust.h"
 
 /* using polynomial functions for thrust curve line fitting */
 
-#define THRUST_MAX 914.0 //[g]
-
 //FIXME: Current range is 0~0.1 rather than 0%~100%
 float convert_motor_cmd_to_thrust(float percentage)
 {
@@ -29,7 +28,7 @@ float convert_motor_thrust_to_cmd(float thrust)
 	float x_squared = x * x;
 	float x_cubed = x_squared * x;
 
-	float percentage = (0.0000000027) * x_cubed + (-0.0000038811) * x_squared + (0.0023461340) * x;
+	float percentage = (0.0000000027f) * x_cubed + (-0.0000038811f) * x_squared + (0.0023461340f) * x;
 	bound_float(&percentage, 1.0f, 0.0f);
 
 	return percentage;
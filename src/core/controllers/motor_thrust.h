@@ -1,6 +1,8 @@
-#ifndef __MOTOR_TRHUST_H__
+#ifndef __MOTOR_THRUST_H__
 #define __MOTOR_THRUST_H__
 
+#define THRUST_MAX 914.0f //[g]
+
 float convert_motor_cmd_to_thrust(float percentage);
 float convert_motor_thrust_to_cmd(float thrust);
 
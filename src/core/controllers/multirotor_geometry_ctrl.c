@@ -1,14 +1,17 @@
 #include "arm_math.h"
+#include "fastmath.h"
 #include "FreeRTOS.h"
 #include "task.h"
 #include "semphr.h"
 #include "led.h"
 #include "sbus_receiver.h"
 #include "optitrack.h"
+#include "pos_kf.h"
 #include "ahrs.h"
 #include "vector.h"
 #include "matrix.h"
 #include "motor_thrust.h"
+#include "mixer.h"
 #include "motor.h"
 #include "bound.h"
 #include "lpf.h"
@@ -16,14 +19,11 @@
 #include "ahrs.h"
 #include "debug_link.h"
 
-#define dt 0.0025 //[s]
-#define gravity_accel 9.8 //gravity acceleration [m/s^2]
-#define MOTOR_TO_CG_LENGTH 16.25f //[cm]
-#define MOTOR_TO_CG_LENGTH_M (MOTOR_TO_CG_LENGTH * 0.01) //[m]
+#define gravity_accel 9.8f //gravity acceleration [m/s^2]
+#define MOTOR_TO_CG_LENGTH 22.98f //radial, 16.25cm along body x and y on the quadrotor [cm]
+#define MOTOR_TO_CG_LENGTH_M (MOTOR_TO_CG_LENGTH * 0.01f) //[m]
 #define COEFFICIENT_YAW 1.0f
 
-extern optitrack_t optitrack;
-
 MAT_ALLOC(J, 3, 3);
 MAT_ALLOC(R, 3, 3);
 MAT_ALLOC(Rd, 3, 3);
@@ -120,7 +120,7 @@ void geometry_ctrl_init(void)
 	_mat_(J)[1*3 + 1] = 0.01466f; //Iyy [kg*m^2]
 	_mat_(J)[2*3 + 2] = 0.02848f; //Izz [kg*m^2]
 
-	uav_mass = 1.0; //[kg]
+	uav_mass = 1.0f; //[kg]
 
 	/* attitude controller gains of geometry */
 	krx = 500.0f;
@@ -128,7 +128,7 @@ void geometry_ctrl_init(void)
 	krz = 1500.0f;
 	kwx = 100.25f;
 	kwy = 100.25f;
-	kwz = 300.0;
+	kwz = 300.0f;
 	yaw_rate_ctrl_gain = 2750.0f;
 
 	/* tracking controller gains*/
@@ -144,12 +144,11 @@ void euler_to_rotation_matrix(euler_t *euler, float *r, float *r_transpose)
 {
 	/* check: https://en.wikipedia.org/wiki/Conversion_between_quaternions_and_Euler_angles */
 	/* R = Rz(psi)Ry(theta)Rx(phi)*/
-	float cos_phi = arm_cos_f32(euler->roll);
-	float cos_theta = arm_cos_f32(euler->pitch);
-	float cos_psi = arm_cos_f32(euler->yaw);
-	float sin_phi = arm_sin_f32(euler->roll);
-	float sin_theta = arm_sin_f32(euler->pitch);
-	float sin_psi = arm_sin_f32(euler->yaw);
+	float cos_phi, cos_theta, cos_psi;
+	float sin_phi, sin_theta, sin_psi;
+	fast_sincosf(euler->roll, &sin_phi, &cos_phi);
+	fast_sincosf(euler->pitch, &sin_theta, &cos_theta);
+	fast_sincosf(euler->yaw, &sin_psi, &cos_psi);
 
 	//R
 	r[0*3 + 0] = cos_theta * cos_psi;
@@ -248,20 +247,19 @@ void cross_product_3x1(float *vec_a, float *vec_b, float *vec_result)
 void norm_3x1(float *vec, float *norm)
 {
 	float sq_sum = vec[0]*vec[0] + vec[1]*vec[1] + vec[2]*vec[2];
-	arm_sqrt_f32(sq_sum, norm);
+	*norm = sq_sum * fast_invsqrtf(sq_sum);
 }
 
 void normalize_3x1(float *vec)
 {
 	float sq_sum = vec[0]*vec[0] + vec[1]*vec[1] + vec[2]*vec[2];
-	float norm;
-	arm_sqrt_f32(sq_sum, &norm);
-	vec[0] /= norm;
-	vec[1] /= norm;
-	vec[2] /= norm;
+	float norm_inv = fast_invsqrtf(sq_sum);
+	vec[0] *= norm_inv;
+	vec[1] *= norm_inv;
+	vec[2] *= norm_inv;
 }
 
-void estimate_uav_dynamics(float *gyro, float *moments, float *m_rot_frame)
+void estimate_uav_dynamics(float *gyro, float *moments, float *m_rot_frame, float dt)
 {
 	static float angular_vel_last[3] = {0.0f};
 	float angular_accel[3];
@@ -273,9 +271,9 @@ void estimate_uav_dynamics(float *gyro, float *moments, float *m_rot_frame)
 	angular_vel_last[1] = gyro[1];
 	angular_vel_last[2] = gyro[2];
 
-	lpf(angular_accel[0], &_mat_(W_dot)[0], 0.01);
-	lpf(angular_accel[1], &_mat_(W_dot)[1], 0.01);
-	lpf(angular_accel[2], &_mat_(W_dot)[2], 0.01);
+	lpf(angular_accel[0], &_mat_(W_dot)[0], 0.01f);
+	lpf(angular_accel[1], &_mat_(W_dot)[1], 0.01f);
+	lpf(angular_accel[2], &_mat_(W_dot)[2], 0.01f);
 
 	//J* W_dot
 	MAT_MULT(&J, &W_dot, &JWdot);
@@ -345,9 +343,9 @@ void geometry_manual_ctrl(euler_t *rc, float *attitude_q, float *gyro, float *ou
 	//W x JW
 	MAT_MULT(&J, &W, &JW);
 	cross_product_3x1(_mat_(W), _mat_(JW), _mat_(WJW));
-	_mat_(inertia_effect)[0] = _mat_(WJW)[0] * 101.97; //[newton * m] to [gram force * m]
-	_mat_(inertia_effect)[1] = _mat_(WJW)[1] * 101.97;
-	_mat_(inertia_effect)[2] = _mat_(WJW)[2] * 101.97;
+	_mat_(inertia_effect)[0] = _mat_(WJW)[0] * 101.97f; //[newton * m] to [gram force * m]
+	_mat_(inertia_effect)[1] = _mat_(WJW)[1] * 101.97f;
+	_mat_(inertia_effect)[2] = _mat_(WJW)[2] * 101.97f;
 
 #if 0
 	/* calculate inertia effect (trajectory is defined, Wd and Wd_dot are not zero) */
@@ -417,8 +415,7 @@ void geometry_tracking_ctrl(euler_t *rc, float *attitude_q, float *gyro, float *
 	} else {
 		/* enable tracking control for x and y axis */
 		//b1d
-		_mat_(b1d)[0] = arm_cos_f32(rc->yaw);
-		_mat_(b1d)[1] = arm_sin_f32(rc->yaw);
+		fast_sincosf(rc->yaw, &_mat_(b1d)[1], &_mat_(b1d)[0]);
 		_mat_(b1d)[2] = 0.0f;
 		//b3d = -kxex_kvev_mge3_mxd_dot_dot / ||kxex_kvev_mge3_mxd_dot_dot||
 		_mat_(b3d)[0] = _mat_(kxex_kvev_mge3_mxd_dot_dot)[0] * b3d_denominator;
@@ -493,9 +490,9 @@ void geometry_tracking_ctrl(euler_t *rc, float *attitude_q, float *gyro, float *
 	//W x JW
 	MAT_MULT(&J, &W, &JW);
 	cross_product_3x1(_mat_(W), _mat_(JW), _mat_(WJW));
-	_mat_(inertia_effect)[0] = _mat_(WJW)[0] * 101.97; //[newton * m] to [gram force * m]
-	_mat_(inertia_effect)[1] = _mat_(WJW)[1] * 101.97;
-	_mat_(inertia_effect)[2] = _mat_(WJW)[2] * 101.97;
+	_mat_(inertia_effect)[0] = _mat_(WJW)[0] * 101.97f; //[newton * m] to [gram force * m]
+	_mat_(inertia_effect)[1] = _mat_(WJW)[1] * 101.97f;
+	_mat_(inertia_effect)[2] = _mat_(WJW)[2] * 101.97f;
 
 	/* control input M1, M2, M3 */
 	output_moments[0] = -krx*_mat_(eR)[0] -kwx*_mat_(eW)[0] + _mat_(inertia_effect)[0];
@@ -503,47 +500,41 @@ void geometry_tracking_ctrl(euler_t *rc, float *attitude_q, float *gyro, float *
 	output_moments[2] = -krz*_mat_(eR)[2] -kwz*_mat_(eW)[2] + _mat_(inertia_effect)[2];
 }
 
-void thrust_allocate_quadrotor(float *moments, float force_basis)
+void thrust_allocate(float *moments, float force_basis)
 {
-	float motors[4], forces[4];
+	float motors[MIXER_MOTOR_CNT], forces[MIXER_MOTOR_CNT];
 
-	static float l_div_4_pos = +0.25f * (1.0f / MOTOR_TO_CG_LENGTH_M);
-	static float l_div_4_neg = -0.25f * (1.0f / MOTOR_TO_CG_LENGTH_M);
-	static float b_div_4_pos = +0.25f * (1.0f / COEFFICIENT_YAW);
-	static float b_div_4_neg = -0.25f * (1.0f / COEFFICIENT_YAW);
+	/* the mixer matrix is normalized per column, the column scales of the
+	   pseudo-inverse bring back the moment to thrust gain of the airframe */
+	static const float mixer_scale[4] = MIXER_COLUMN_SCALE;
+	const float roll_gain = mixer_scale[1] / MOTOR_TO_CG_LENGTH_M;
+	const float pitch_gain = mixer_scale[2] / MOTOR_TO_CG_LENGTH_M;
+	const float yaw_gain = mixer_scale[3] / COEFFICIENT_YAW;
 
-	forces[0] = l_div_4_neg * moments[0] + l_div_4_pos * moments[1] + b_div_4_neg * moments[2] + force_basis;
-	forces[1] = l_div_4_pos * moments[0] + l_div_4_pos * moments[1] + b_div_4_pos * moments[2] + force_basis;
-	forces[2] = l_div_4_pos * moments[0] + l_div_4_neg * moments[1] + b_div_4_neg * moments[2] + force_basis;
-	forces[3] = l_div_4_neg * moments[0] + l_div_4_neg * moments[1] + b_div_4_pos * moments[2] + force_basis;
+	/* force_basis is the thrust of single motor */
+	mixer_allocate(forces, force_basis, roll_gain * moments[0], pitch_gain * moments[1],
+	               yaw_gain * moments[2], 0.0f, THRUST_MAX);
 
 	/* assign motor pwm */
 	float percentage_to_pwm = (MOTOR_PULSE_MAX - MOTOR_PULSE_MIN);
-	motors[0] = convert_motor_thrust_to_cmd(forces[0]) * percentage_to_pwm + MOTOR_PULSE_MIN;
-	motors[1] = convert_motor_thrust_to_cmd(forces[1]) * percentage_to_pwm + MOTOR_PULSE_MIN;
-	motors[2] = convert_motor_thrust_to_cmd(forces[2]) * percentage_to_pwm + MOTOR_PULSE_MIN;
-	motors[3] = convert_motor_thrust_to_cmd(forces[3]) * percentage_to_pwm + MOTOR_PULSE_MIN;
-
-	bound_float(&motors[0], MOTOR_PULSE_MAX, MOTOR_PULSE_MIN);
-	bound_float(&motors[1], MOTOR_PULSE_MAX, MOTOR_PULSE_MIN);
-	bound_float(&motors[2], MOTOR_PULSE_MAX, MOTOR_PULSE_MIN);
-	bound_float(&motors[3], MOTOR_PULSE_MAX, MOTOR_PULSE_MIN);
-
-	set_motor_pwm_pulse(MOTOR1, (uint16_t)(motors[0]));
-	set_motor_pwm_pulse(MOTOR2, (uint16_t)(motors[1]));
-	set_motor_pwm_pulse(MOTOR3, (uint16_t)(motors[2]));
-	set_motor_pwm_pulse(MOTOR4, (uint16_t)(motors[3]));
+	int i;
+	for(i = 0; i < MIXER_MOTOR_CNT; i++) {
+		motors[i] = convert_motor_thrust_to_cmd(forces[i]) * percentage_to_pwm + MOTOR_PULSE_MIN;
+		bound_float(&motors[i], MOTOR_PULSE_MAX, MOTOR_PULSE_MIN);
+	}
+
+	mixer_write_motors(motors);
 }
 
-void rc_mode_change_handler_geometry(radio_t *rc)
+void rc_mode_change_handler_geometry(radio_t *rc, pos_kf_state_t *pos)
 {
 	static int flight_mode_last = FLIGHT_MODE_MANUAL;
 
 	//if mode switched to hovering
 	if(rc->flight_mode == FLIGHT_MODE_HOVERING && flight_mode_last != FLIGHT_MODE_HOVERING) {
-		desired_pos[0] = optitrack.pos_x;
-		desired_pos[1] = optitrack.pos_y;
-		desired_pos[2] = optitrack.pos_z;
+		desired_pos[0] = pos->pos[0];
+		desired_pos[1] = pos->pos[1];
+		desired_pos[2] = pos->pos[2];
 		desired_vel[0] = 0.0f;
 		desired_vel[1] = 0.0f;
 		desired_vel[2] = 0.0f;
@@ -572,9 +563,12 @@ void rc_mode_change_handler_geometry(radio_t *rc)
 	flight_mode_last = rc->flight_mode;
 }
 
-void multirotor_geometry_control(imu_t *imu, ahrs_t *ahrs, radio_t *rc, float desired_heading)
+void multirotor_geometry_control(imu_t *imu, ahrs_t *ahrs, radio_t *rc, float desired_heading, float dt)
 {
-	rc_mode_change_handler_geometry(rc);
+	pos_kf_state_t pos_kf_state;
+	pos_kf_read(&pos_kf_state);
+
+	rc_mode_change_handler_geometry(rc, &pos_kf_state);
 
 	bool optitrack_present = optitrack_available();
 
@@ -596,7 +590,7 @@ void multirotor_geometry_control(imu_t *imu, ahrs_t *ahrs, radio_t *rc, float de
 
 	float throttle_force = convert_motor_cmd_to_thrust(rc->throttle / 100.0f); //FIXME
 
-	//estimate_uav_dynamics(gyro, uav_dynamics_m, uav_dynamics_m_rot_frame);
+	//estimate_uav_dynamics(gyro, uav_dynamics_m, uav_dynamics_m_rot_frame, dt);
 
 	float control_moments[3] = {0.0f}, control_force = 0.0f;
 
@@ -604,13 +598,13 @@ void multirotor_geometry_control(imu_t *imu, ahrs_t *ahrs, radio_t *rc, float de
 #if 0
 	case FLIGHT_MODE_HOVERING:
 	case FLIGHT_MODE_NAVIGATION:
-		if(optitrack_present == true) {
-			curr_pos[0] = optitrack.pos_x;
-			curr_pos[1] = optitrack.pos_y;
-			curr_pos[2] = optitrack.pos_z;
-			curr_vel[0] = optitrack.vel_lpf_x;
-			curr_vel[1] = optitrack.vel_lpf_y;
-			curr_vel[2] = optitrack.vel_lpf_z;
+		if(pos_kf_state.valid == true) {
+			curr_pos[0] = pos_kf_state.pos[0];
+			curr_pos[1] = pos_kf_state.pos[1];
+			curr_pos[2] = pos_kf_state.pos[2];
+			curr_vel[0] = pos_kf_state.vel[0];
+			curr_vel[1] = pos_kf_state.vel[1];
+			curr_vel[2] = pos_kf_state.vel[2];
 			geometry_tracking_ctrl(&desired_attitude, ahrs->q, gyro, curr_pos, desired_pos,
                             		       curr_vel, desired_vel, curr_accel, desired_accel, control_moments,
                             		       &control_force, altitude_control_only);
@@ -625,7 +619,7 @@ void multirotor_geometry_control(imu_t *imu, ahrs_t *ahrs, radio_t *rc, float de
 	if(rc->safety == false) {
 		led_on(LED_R);
 		led_off(LED_B);
-		thrust_allocate_quadrotor(control_moments, throttle_force);
+		thrust_allocate(control_moments, throttle_force);
 	} else {
 		led_on(LED_B);
 		led_off(LED_R);
@@ -1,5 +1,6 @@
 #include <string.h>
 #include "arm_math.h"
+#include "fastmath.h"
 #include "FreeRTOS.h"
 #include "task.h"
 #include "semphr.h"
@@ -19,20 +20,21 @@
 #include "multirotor_pid_ctrl.h"
 #include "multirotor_geometry_ctrl.h"
 #include "motor_thrust.h"
+#include "mixer.h"
 #include "fc_task.h"
 #include "sys_time.h"
+#include "slot.h"
+#include "ccm.h"
 #include "proj_config.h"
 
-extern optitrack_t optitrack;
-
-pid_control_t pid_roll;
-pid_control_t pid_pitch;
-pid_control_t pid_yaw_rate;
-pid_control_t pid_yaw;
-pid_control_t pid_pos_x;
-pid_control_t pid_pos_y;
-pid_control_t pid_alt;
-pid_control_t pid_alt_vel;
+pid_control_t pid_roll CCM_HOT;
+pid_control_t pid_pitch CCM_HOT;
+pid_control_t pid_yaw_rate CCM_HOT;
+pid_control_t pid_yaw CCM_HOT;
+pid_control_t pid_pos_x CCM_HOT;
+pid_control_t pid_pos_y CCM_HOT;
+pid_control_t pid_alt CCM_HOT;
+pid_control_t pid_alt_vel CCM_HOT;
 
 //the output command from position_2d_control() have to be converted to body frame
 float nav_ctl_roll_command; //body frame x direction control
@@ -40,6 +42,10 @@ float nav_ctl_pitch_command; //body frame y direction control
 
 float motor1, motor2, motor3, motor4;
 
+/* outputs handed down from the slower control loops */
+SLOT_ALLOC(position_ctl_slot, position_ctl_output_t);
+SLOT_ALLOC(attitude_ctl_slot, attitude_ctl_output_t);
+
 void multirotor_pid_controller_init(void)
 {
 	/* attitude controllers */
@@ -88,18 +94,25 @@ void multirotor_pid_controller_init(void)
 	pid_alt_vel.output_max = +100.0f;
 }
 
-void attitude_pid_control(pid_control_t *pid, float ahrs_attitude,
-                          float setpoint_attitude, float angular_velocity)
+/* attitude pid is split between the loops: the attitude loop computes the
+ * proportional and integral terms of the angle error, the rate loop adds the
+ * gyro damping term with the latest gyro sample */
+float attitude_pid_angle_control(pid_control_t *pid, float ahrs_attitude, float setpoint_attitude, float dt)
 {
 	//error = reference (setpoint) - measurement
 	pid->error_current = setpoint_attitude - ahrs_attitude;
-	pid->error_integral += (pid->error_current * pid->ki * 0.0025);
+	pid->error_integral += (pid->error_current * pid->ki * dt);
 	bound_float(&pid->error_integral, 10.0f, -10.0f);
-	pid->error_derivative = -angular_velocity; //error_derivative = 0 (setpoint) - measurement_derivative
 	pid->p_final = pid->kp * pid->error_current;
 	pid->i_final = pid->error_integral;
+	return pid->p_final + pid->i_final;
+}
+
+void attitude_pid_rate_control(pid_control_t *pid, float angle_ctl, float angular_velocity)
+{
+	pid->error_derivative = -angular_velocity; //error_derivative = 0 (setpoint) - measurement_derivative
 	pid->d_final = pid->kd * pid->error_derivative;
-	pid->output = pid->p_final + pid->i_final + pid->d_final;
+	pid->output = angle_ctl + pid->d_final;
 }
 
 void yaw_rate_p_control(pid_control_t *pid, float setpoint_yaw_rate, float angular_velocity)
@@ -115,14 +128,19 @@ void set_yaw_pd_setpoint(pid_control_t *pid, float new_setpoint)
 	pid->setpoint = new_setpoint;
 }
 
-void yaw_pd_control(pid_control_t *pid, float desired_heading, float ahrs_yaw, float yaw_rate, float loop_dt)
+float yaw_pd_heading_control(pid_control_t *pid, float desired_heading, float ahrs_yaw)
 {
 	pid->setpoint = desired_heading;
 	pid->error_current = pid->setpoint - ahrs_yaw;
-	pid->error_derivative = yaw_rate;
 	pid->p_final = pid->kp * pid->error_current;
+	return pid->p_final;
+}
+
+void yaw_pd_rate_control(pid_control_t *pid, float heading_ctl, float yaw_rate)
+{
+	pid->error_derivative = yaw_rate;
 	pid->d_final = pid->kd * pid->error_derivative;
-	pid->output = pid->p_final + pid->d_final;
+	pid->output = heading_ctl + pid->d_final;
 	bound_float(&pid->output, pid->output_max, pid->output_min);
 }
 
@@ -131,7 +149,7 @@ void reset_altitude_control_integral(pid_control_t *alt_pid)
 	alt_pid->error_integral = 0.0f;
 }
 
-void altitude_control(float alt, float alt_vel, pid_control_t *alt_vel_pid, pid_control_t *alt_pid)
+void altitude_control(float alt, float alt_vel, pid_control_t *alt_vel_pid, pid_control_t *alt_pid, float dt)
 {
 	if(alt_vel_pid->enable == false) {
 		alt_vel_pid->output = 0.0f;
@@ -140,7 +158,7 @@ void altitude_control(float alt, float alt_vel, pid_control_t *alt_vel_pid, pid_
 
 	/* altitude control (control output becomes setpoint of velocity controller) */
 	alt_pid->error_current = alt_pid->setpoint - alt;
-	alt_pid->error_integral += (alt_pid->error_current * alt_pid->ki * 0.0025);
+	alt_pid->error_integral += (alt_pid->error_current * alt_pid->ki * dt);
 	alt_pid->p_final = alt_pid->kp * alt_pid->error_current;
 	alt_pid->i_final = alt_pid->error_integral;
 	alt_pid->output = alt_pid->p_final + alt_pid->i_final;
@@ -157,8 +175,10 @@ void altitude_control(float alt, float alt_vel, pid_control_t *alt_vel_pid, pid_
 void angle_control_cmd_i2b_frame_tramsform(float yaw, float u_i_x, float u_i_y, float *u_b_x, float *u_b_y)
 {
 	float yaw_rad = deg_to_rad(yaw);
-	*u_b_x = (arm_cos_f32(-yaw_rad) * u_i_x) - (arm_sin_f32(-yaw_rad) * u_i_y);
-	*u_b_y = (arm_sin_f32(-yaw_rad) * u_i_x) + (arm_cos_f32(-yaw_rad) * u_i_y);
+	float sin_yaw, cos_yaw;
+	fast_sincosf(-yaw_rad, &sin_yaw, &cos_yaw);
+	*u_b_x = (cos_yaw * u_i_x) - (sin_yaw * u_i_y);
+	*u_b_y = (sin_yaw * u_i_x) + (cos_yaw * u_i_y);
 }
 
 void reset_position_2d_control_integral(pid_control_t *pos_pid)
@@ -166,11 +186,11 @@ void reset_position_2d_control_integral(pid_control_t *pos_pid)
 	pos_pid->error_integral = 0.0f;
 }
 
-void position_2d_control(float current_pos, float current_vel, pid_control_t *pos_pid)
+void position_2d_control(float current_pos, float current_vel, pid_control_t *pos_pid, float dt)
 {
 	pos_pid->error_current = pos_pid->setpoint - current_pos;
 	pos_pid->p_final = pos_pid->kp * pos_pid->error_current;
-	pos_pid->error_integral += (pos_pid->error_current * pos_pid->ki * 0.0025);
+	pos_pid->error_integral += (pos_pid->error_current * pos_pid->ki * dt);
 	pos_pid->error_derivative = -current_vel;
 	pos_pid->d_final = pos_pid->kd * pos_pid->error_derivative;
 	bound_float(&pos_pid->error_integral, pos_pid->output_max, pos_pid->output_min);
@@ -183,7 +203,7 @@ void position_2d_control(float current_pos, float current_vel, pid_control_t *po
 void motor_control(volatile float throttle_percentage, float throttle_ctrl_precentage, float roll_ctrl_precentage,
                    float pitch_ctrl_precentage, float yaw_ctrl_precentage)
 {
-	float percentage_to_pwm = 0.01 * (MOTOR_PULSE_MAX - MOTOR_PULSE_MIN);
+	float percentage_to_pwm = 0.01f * (MOTOR_PULSE_MAX - MOTOR_PULSE_MIN);
 
 	float power_basis = throttle_percentage * percentage_to_pwm + MOTOR_PULSE_MIN;
 
@@ -192,39 +212,26 @@ void motor_control(volatile float throttle_percentage, float throttle_ctrl_prece
 	float yaw_pwm = yaw_ctrl_precentage * (float)percentage_to_pwm;
 	float throttle_ctrl_pwm = throttle_ctrl_precentage * (float)percentage_to_pwm;
 
-	float m1_pwm, m2_pwm, m3_pwm, m4_pwm;
-
-	/* (ccw)    (cw)
+	/* airframe geometry is defined by the mixer matrix, the quadrotor is:
+	   (ccw)    (cw)
 	    m2       m1
 	         x
 	    m3       m4
 	   (cw)    (ccw) */
-	m1_pwm = power_basis + throttle_ctrl_pwm - roll_pwm + pitch_pwm - yaw_pwm;
-	m2_pwm = power_basis + throttle_ctrl_pwm + roll_pwm + pitch_pwm + yaw_pwm;
-	m3_pwm = power_basis + throttle_ctrl_pwm + roll_pwm - pitch_pwm - yaw_pwm;
-	m4_pwm = power_basis + throttle_ctrl_pwm - roll_pwm - pitch_pwm + yaw_pwm;
-	bound_float(&m1_pwm, MOTOR_PULSE_MAX, MOTOR_PULSE_MIN);
-	bound_float(&m2_pwm, MOTOR_PULSE_MAX, MOTOR_PULSE_MIN);
-	bound_float(&m3_pwm, MOTOR_PULSE_MAX, MOTOR_PULSE_MIN);
-	bound_float(&m4_pwm, MOTOR_PULSE_MAX, MOTOR_PULSE_MIN);
+	float motors_pwm[MIXER_MOTOR_CNT];
+	mixer_allocate(motors_pwm, power_basis + throttle_ctrl_pwm - MOTOR_PULSE_MIN,
+	               roll_pwm, pitch_pwm, yaw_pwm, MOTOR_PULSE_MIN, MOTOR_PULSE_MAX);
 
 	//generate debug message
-	motor1 = (m1_pwm - MOTOR_PULSE_MIN) / percentage_to_pwm;
-	motor2 = (m2_pwm - MOTOR_PULSE_MIN) / percentage_to_pwm;
-	motor3 = (m3_pwm - MOTOR_PULSE_MIN) / percentage_to_pwm;
-	motor4 = (m4_pwm - MOTOR_PULSE_MIN) / percentage_to_pwm;
-	bound_float(&motor1, 100.0f, 0.0f);
-	bound_float(&motor2, 100.0f, 0.0f);
-	bound_float(&motor3, 100.0f, 0.0f);
-	bound_float(&motor4, 100.0f, 0.0f);
-
-	set_motor_pwm_pulse(MOTOR1, (uint16_t)m1_pwm);
-	set_motor_pwm_pulse(MOTOR2, (uint16_t)m2_pwm);
-	set_motor_pwm_pulse(MOTOR3, (uint16_t)m3_pwm);
-	set_motor_pwm_pulse(MOTOR4, (uint16_t)m4_pwm);
+	motor1 = (motors_pwm[0] - MOTOR_PULSE_MIN) / percentage_to_pwm;
+	motor2 = (motors_pwm[1] - MOTOR_PULSE_MIN) / percentage_to_pwm;
+	motor3 = (motors_pwm[2] - MOTOR_PULSE_MIN) / percentage_to_pwm;
+	motor4 = (motors_pwm[3] - MOTOR_PULSE_MIN) / percentage_to_pwm;
+
+	mixer_write_motors(motors_pwm);
 }
 
-void rc_mode_change_handler_pid(radio_t *rc)
+void rc_mode_change_handler_pid(radio_t *rc, pos_kf_state_t *pos, alt_est_state_t *alt)
 {
 	static int flight_mode_last = FLIGHT_MODE_MANUAL;
 
@@ -232,11 +239,11 @@ void rc_mode_change_handler_pid(radio_t *rc)
 	if(rc->flight_mode == FLIGHT_MODE_HOVERING && flight_mode_last != FLIGHT_MODE_HOVERING) {
 		pid_alt.enable = true;
 		pid_alt_vel.enable = true;
-		pid_alt.setpoint = optitrack.pos_z;
+		pid_alt.setpoint = alt->alt;
 		pid_pos_x.enable = true;
 		pid_pos_y.enable = true;
-		pid_pos_x.setpoint = optitrack.pos_x;
-		pid_pos_y.setpoint = optitrack.pos_y;
+		pid_pos_x.setpoint = pos->pos[0];
+		pid_pos_y.setpoint = pos->pos[1];
 		reset_position_2d_control_integral(&pid_pos_x);
 		reset_position_2d_control_integral(&pid_pos_y);
 	}
@@ -245,7 +252,7 @@ void rc_mode_change_handler_pid(radio_t *rc)
 	if(rc->flight_mode == FLIGHT_MODE_NAVIGATION && flight_mode_last != FLIGHT_MODE_NAVIGATION) {
 		pid_alt.enable = true;
 		pid_alt_vel.enable = true;
-		pid_alt.setpoint = optitrack.pos_z;
+		pid_alt.setpoint = alt->alt;
 		pid_pos_x.enable = true;
 		pid_pos_y.enable = true;
 		pid_pos_x.setpoint = 0.0f; //XXX: currently we feed origin as navigation waypoint
@@ -260,8 +267,8 @@ void rc_mode_change_handler_pid(radio_t *rc)
 		pid_pos_x.enable = false;
 		pid_pos_y.enable = false;
 		reset_altitude_control_integral(&pid_alt);
-		pid_pos_x.setpoint = optitrack.pos_x;
-		pid_pos_y.setpoint = optitrack.pos_y;
+		pid_pos_x.setpoint = pos->pos[0];
+		pid_pos_y.setpoint = pos->pos[1];
 		reset_position_2d_control_integral(&pid_pos_x);
 		reset_position_2d_control_integral(&pid_pos_y);
 	}
@@ -269,47 +276,100 @@ void rc_mode_change_handler_pid(radio_t *rc)
 	flight_mode_last = rc->flight_mode;
 }
 
-void multirotor_pid_control(imu_t *imu, ahrs_t *ahrs, radio_t *rc, float desired_heading)
+/* position and altitude loop, runs at the optitrack update rate */
+void multirotor_pid_position_control(radio_t *rc, pos_kf_state_t *pos, alt_est_state_t *alt,
+                                     float ahrs_yaw, float dt)
 {
-	rc_mode_change_handler_pid(rc);
+	rc_mode_change_handler_pid(rc, pos, alt);
+
+	/* the altitude sources have different references, hold the current altitude */
+	static int alt_source_last = ALT_SOURCE_OPTITRACK;
+	if(alt->source != alt_source_last) {
+		alt_source_last = alt->source;
+		pid_alt.setpoint = alt->alt;
+	}
 
 	/* altitude control */
-	altitude_control(optitrack.pos_z, optitrack.vel_lpf_z, &pid_alt_vel, &pid_alt);
+	altitude_control(alt->alt, alt->vel, &pid_alt_vel, &pid_alt, dt);
 
 	/* position control (in ned configuration) */
-	position_2d_control(optitrack.pos_x, optitrack.vel_lpf_x, &pid_pos_x);
-	position_2d_control(optitrack.pos_y, optitrack.vel_lpf_y, &pid_pos_y);
-	angle_control_cmd_i2b_frame_tramsform(ahrs->attitude.yaw, pid_pos_x.output, pid_pos_y.output,
+	position_2d_control(pos->pos[0], pos->vel[0], &pid_pos_x, dt);
+	position_2d_control(pos->pos[1], pos->vel[1], &pid_pos_y, dt);
+	angle_control_cmd_i2b_frame_tramsform(ahrs_yaw, pid_pos_x.output, pid_pos_y.output,
 	                                      &nav_ctl_pitch_command, &nav_ctl_roll_command);
 
+	position_ctl_output_t output = {
+		.roll_cmd = nav_ctl_roll_command,
+		.pitch_cmd = nav_ctl_pitch_command,
+		.throttle_ctl = pid_alt_vel.output,
+		.enable = pid_pos_x.enable == true && pid_pos_y.enable == true
+	};
+
+	/* disable control output if the estimate is not available */
+	if(alt->valid == false) {
+		output.throttle_ctl = 0.0f;
+	}
+	if(pos->valid == false) {
+		output.enable = false;
+	}
+
+	slot_publish(&position_ctl_slot, &output);
+}
+
+/* attitude loop, runs with the attitude estimator */
+void multirotor_pid_attitude_control(ahrs_t *ahrs, radio_t *rc, float desired_heading, float dt)
+{
+	position_ctl_output_t position_ctl = {0};
+	slot_read(&position_ctl_slot, &position_ctl);
+
 	float final_roll_cmd = -rc->roll;
 	float final_pitch_cmd = -rc->pitch;
-	if(pid_pos_x.enable == true && pid_pos_y.enable == true && optitrack_available() == true) {
-		final_roll_cmd -= nav_ctl_roll_command; //y directional control
-		final_pitch_cmd -= nav_ctl_pitch_command; //x directional control
+	if(position_ctl.enable == true) {
+		final_roll_cmd -= position_ctl.roll_cmd; //y directional control
+		final_pitch_cmd -= position_ctl.pitch_cmd; //x directional control
 	}
 
-	/* attitude control */
-	attitude_pid_control(&pid_roll, ahrs->attitude.roll, final_roll_cmd, imu->gyro_lpf.x);
-	attitude_pid_control(&pid_pitch, ahrs->attitude.pitch, final_pitch_cmd, imu->gyro_lpf.y);
-	yaw_rate_p_control(&pid_yaw_rate, -rc->yaw, imu->gyro_lpf.z); //used if magnetometer/optitrack not performed
-	yaw_pd_control(&pid_yaw, desired_heading, ahrs->attitude.yaw, imu->gyro_lpf.z, 0.0025);
-
-	/* disable control output if sensor not available */
-	float yaw_ctrl_output = pid_yaw.output;
-	if(optitrack_available() == false) {
-		yaw_ctrl_output = pid_yaw_rate.output;
-		pid_alt_vel.output = 0.0f;
-	}
+	attitude_ctl_output_t output = {
+		.roll_ctl = attitude_pid_angle_control(&pid_roll, ahrs->attitude.roll, final_roll_cmd, dt),
+		.pitch_ctl = attitude_pid_angle_control(&pid_pitch, ahrs->attitude.pitch, final_pitch_cmd, dt),
+		.yaw_ctl = yaw_pd_heading_control(&pid_yaw, desired_heading, ahrs->attitude.yaw),
+		.yaw_rate_setpoint = -rc->yaw,
+		.yaw_heading = optitrack_available(), //yaw rate control if magnetometer/optitrack not performed
+		.throttle = rc->throttle,
+		.throttle_ctl = position_ctl.throttle_ctl,
+		.safety = rc->safety
+	};
 
 	if(rc->safety == false) {
 		led_on(LED_R);
 		led_off(LED_B);
-		motor_control(rc->throttle, pid_alt_vel.output, pid_roll.output, pid_pitch.output, yaw_ctrl_output);
 	} else {
 		led_on(LED_B);
 		led_off(LED_R);
 		set_yaw_pd_setpoint(&pid_yaw, ahrs->attitude.yaw);
+	}
+
+	slot_publish(&attitude_ctl_slot, &output);
+}
+
+/* inner rate loop, runs with the imu and drives the motors */
+void multirotor_pid_rate_control(imu_t *imu)
+{
+	attitude_ctl_output_t attitude_ctl;
+
+	/* no output before the attitude loop has run once */
+	if(slot_read(&attitude_ctl_slot, &attitude_ctl) == 0 || attitude_ctl.safety == true) {
 		motor_halt();
+		return;
 	}
+
+	attitude_pid_rate_control(&pid_roll, attitude_ctl.roll_ctl, imu->gyro_lpf.x);
+	attitude_pid_rate_control(&pid_pitch, attitude_ctl.pitch_ctl, imu->gyro_lpf.y);
+	yaw_rate_p_control(&pid_yaw_rate, attitude_ctl.yaw_rate_setpoint, imu->gyro_lpf.z);
+	yaw_pd_rate_control(&pid_yaw, attitude_ctl.yaw_ctl, imu->gyro_lpf.z);
+
+	float yaw_ctrl_output = attitude_ctl.yaw_heading == true ? pid_yaw.output : pid_yaw_rate.output;
+
+	motor_control(attitude_ctl.throttle, attitude_ctl.throttle_ctl, pid_roll.output,
+	              pid_pitch.output, yaw_ctrl_output);
 }
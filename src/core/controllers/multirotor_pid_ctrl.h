@@ -4,9 +4,34 @@
 #include <stdbool.h>
 #include "pid.h"
 #include "ahrs.h"
+#include "pos_kf.h"
+#include "alt_est.h"
+
+/* position loop output */
+typedef struct {
+	float roll_cmd;     //[deg], body frame
+	float pitch_cmd;    //[deg], body frame
+	float throttle_ctl; //[%]
+	bool enable;
+} position_ctl_output_t;
+
+/* attitude loop output, the rate loop adds the gyro terms */
+typedef struct {
+	float roll_ctl;
+	float pitch_ctl;
+	float yaw_ctl;
+	float yaw_rate_setpoint; //[deg/s]
+	bool yaw_heading;        //heading control if true, otherwise yaw rate control
+	float throttle;          //[%]
+	float throttle_ctl;      //[%]
+	bool safety;
+} attitude_ctl_output_t;
 
 void multirotor_pid_controller_init(void);
-void multirotor_pid_control(imu_t *imu, ahrs_t *ahrs, radio_t *rc, float desired_heading);
+void multirotor_pid_position_control(radio_t *rc, pos_kf_state_t *pos, alt_est_state_t *alt,
+                                     float ahrs_yaw, float dt);
+void multirotor_pid_attitude_control(ahrs_t *ahrs, radio_t *rc, float desired_heading, float dt);
+void multirotor_pid_rate_control(imu_t *imu);
 
 void motor_control(volatile float throttle_percentage, float throttle_ctrl_precentage, float roll_ctrl_precentage,
 		   float pitch_ctrl_precentage, float yaw_ctrl_precentage);
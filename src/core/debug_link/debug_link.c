@@ -8,19 +8,33 @@
 #include "vector.h"
 #include "matrix.h"
 #include "imu.h"
+#include "mpu6500.h"
+#include "hmc5983.h"
 #include "sbus_receiver.h"
 #include "ahrs.h"
+#include "ahrs_registry.h"
 #include "multirotor_pid_ctrl.h"
 #include "motor_thrust.h"
 #include "led.h"
 #include "optitrack.h"
 #include "multirotor_geometry_ctrl.h"
+#include "profiler.h"
+#include "rate_group.h"
+#include "sys_stats.h"
+#include "boot.h"
+#include "math_bench.h"
+#include "dshot.h"
+#include "gyro_fft.h"
+#include "dyn_notch.h"
+#include "proj_config.h"
 
 extern imu_t imu;
 extern ahrs_t ahrs;
 
 extern optitrack_t optitrack;
 
+extern ahrs_filter_t ahrs_ekf_filter;
+
 extern pid_control_t pid_roll;
 extern pid_control_t pid_pitch;
 extern pid_control_t pid_yaw_rate;
@@ -36,11 +50,20 @@ extern float motor1, motor2, motor3, motor4;
 extern float nav_ctl_roll_command;
 extern float nav_ctl_pitch_command;
 
-extern float _mat_(P)[4 * 4];
 extern float _mat_(K)[4 * 4];
 extern float _mat_(eR)[3 * 1];
 extern float _mat_(eW)[3 * 1];
 extern float _mat_(J)[3 * 3];
+extern profiler_t sample_to_pulse_profiler;
+extern rate_group_t rate_ctl_group;
+extern rate_group_t attitude_ctl_group;
+extern rate_group_t position_ctl_group;
+extern profiler_t rpm_filter_profiler;
+extern profiler_t mpu6500_convert_profiler;
+extern profiler_t madgwick_imu_profiler;
+extern profiler_t madgwick_marg_profiler;
+extern profiler_t gyro_fft_profiler;
+extern dyn_notch_t dyn_notch;
 radio_t rc;
 
 void pack_debug_debug_message_header(debug_msg_t *payload, int message_id)
@@ -132,10 +155,10 @@ void send_attitude_imu_debug_message(debug_msg_t *payload)
 void send_ekf_debug_message(debug_msg_t *payload)
 {
 	pack_debug_debug_message_header(payload, MESSAGE_ID_EKF);
-	pack_debug_debug_message_float(&_mat_(P)[0], payload);
-	pack_debug_debug_message_float(&_mat_(P)[5], payload);
-	pack_debug_debug_message_float(&_mat_(P)[10], payload);
-	pack_debug_debug_message_float(&_mat_(P)[15], payload);
+	pack_debug_debug_message_float(&_mat_(ahrs_ekf_filter.P)[0], payload);
+	pack_debug_debug_message_float(&_mat_(ahrs_ekf_filter.P)[5], payload);
+	pack_debug_debug_message_float(&_mat_(ahrs_ekf_filter.P)[10], payload);
+	pack_debug_debug_message_float(&_mat_(ahrs_ekf_filter.P)[15], payload);
 	pack_debug_debug_message_float(&_mat_(K)[0], payload);
 	pack_debug_debug_message_float(&_mat_(K)[5], payload);
 	pack_debug_debug_message_float(&_mat_(K)[10], payload);
@@ -211,6 +234,29 @@ void send_optitrack_velocity_debug_message(debug_msg_t *payload)
 	pack_debug_debug_message_float(&optitrack.vel_lpf_z, payload);
 }
 
+void send_profiler_debug_message(profiler_t *prof, debug_msg_t *payload)
+{
+	float last_us = profiler_cycles_to_us((float)prof->last);
+	float avg_us = profiler_cycles_to_us(prof->avg);
+	float max_us = profiler_cycles_to_us((float)prof->max);
+
+	pack_debug_debug_message_header(payload, MESSAGE_ID_PROFILER);
+	pack_debug_debug_message_float(&last_us, payload);
+	pack_debug_debug_message_float(&avg_us, payload);
+	pack_debug_debug_message_float(&max_us, payload);
+}
+
+void send_motor_rpm_debug_message(debug_msg_t *payload)
+{
+	pack_debug_debug_message_header(payload, MESSAGE_ID_MOTOR_RPM);
+
+	int i;
+	for(i = 0; i < DSHOT_MOTOR_CNT; i++) {
+		float rpm = dshot_get_motor_freq(i) * 60.0f;
+		pack_debug_debug_message_float(&rpm, payload);
+	}
+}
+
 void send_general_float_debug_message(float val, debug_msg_t *payload)
 {
 	pack_debug_debug_message_header(payload, MESSAGE_ID_GENERAL_FLOAT);
@@ -234,6 +280,195 @@ void send_accel_bias_calib_debug_message(void)
 	uart3_puts(s, strlen(s));
 }
 
+/* thermal soak log for tools/imu_calib_fit, one line per stationary window:
+ * temp [degC], accel x/y/z [lsb], gyro x/y/z [lsb] */
+void send_imu_thermal_calib_debug_message(void)
+{
+	static uint32_t still_seq = 0;
+	mpu6500_still_window_t still;
+	uint32_t seq = mpu6500_still_window_read(&still);
+	if(seq == still_seq) {
+		return;
+	}
+	still_seq = seq;
+
+	char s[100] = {0};
+	sprintf(s, "%.2f, %.2f, %.2f, %.2f, %.2f, %.2f, %.2f\n\r", (double)still.temp,
+	        (double)still.accel.x, (double)still.accel.y, (double)still.accel.z,
+	        (double)still.gyro.x, (double)still.gyro.y, (double)still.gyro.z);
+	uart3_puts(s, strlen(s));
+}
+
+/* hard and soft iron log for tools/mag_calib_fit, one line per magnetometer
+ * sample while the vehicle is turned through every orientation:
+ * mag x/y/z of the chip frame [lsb] */
+void send_mag_calib_debug_message(void)
+{
+	static uint32_t mag_seq = 0;
+	hmc5983_sample_t mag;
+	uint32_t seq = hmc5983_read(&mag);
+	if(seq == mag_seq) {
+		return;
+	}
+	mag_seq = seq;
+
+	char s[100] = {0};
+	sprintf(s, "%d, %d, %d\n\r", mag.raw.x, mag.raw.y, mag.raw.z);
+	uart3_puts(s, strlen(s));
+}
+
+/* one function per call: fastest call [cycles], average [cycles] */
+void send_math_bench_debug_message(void)
+{
+	static int i = 0;
+
+	char s[100] = {0};
+	sprintf(s, "%s: %lu, %.1f\n\r", math_bench[i].name, (unsigned long)math_bench[i].min,
+	        (double)math_bench[i].prof.avg);
+	uart3_puts(s, strlen(s));
+
+	i = (i + 1) % math_bench_cnt;
+}
+
+void send_sys_stats_debug_message(debug_msg_t *payload)
+{
+	sys_stats_update();
+
+	float task_cnt = sys_stats.task_cnt;
+
+	pack_debug_debug_message_header(payload, MESSAGE_ID_SYS_STATS);
+	pack_debug_debug_message_float(&task_cnt, payload);
+
+	/* task number, cpu load [%], context switch rate [1/s], free stack [words] */
+	int i;
+	for(i = 0; i < sys_stats.task_cnt; i++) {
+		float task_number = sys_stats.task[i].task_number;
+		float stack_high_water = sys_stats.task[i].stack_high_water;
+		pack_debug_debug_message_float(&task_number, payload);
+		pack_debug_debug_message_float(&sys_stats.task[i].cpu_load, payload);
+		pack_debug_debug_message_float(&sys_stats.task[i].switch_rate, payload);
+		pack_debug_debug_message_float(&stack_high_water, payload);
+	}
+
+	/* exti, uart4, uart7, usart3, tim12 load [%] */
+	for(i = 0; i < SYS_STATS_ISR_CNT; i++) {
+		pack_debug_debug_message_float(&sys_stats.isr_load[i], payload);
+	}
+
+	/* exti, uart4, uart7, usart3, tim12 worst case execution time [us] */
+	for(i = 0; i < SYS_STATS_ISR_CNT; i++) {
+		pack_debug_debug_message_float(&sys_stats.isr_max[i], payload);
+	}
+
+	/* accounting overhead [us] */
+	float isr_hook_overhead = profiler_cycles_to_us((float)sys_stats.isr_hook_overhead);
+	float update_time = profiler_cycles_to_us((float)sys_stats.update_profiler.last);
+	pack_debug_debug_message_float(&sys_stats.context_switch_rate, payload);
+	pack_debug_debug_message_float(&isr_hook_overhead, payload);
+	pack_debug_debug_message_float(&update_time, payload);
+}
+
+void send_rate_group_debug_message(rate_group_t *group, debug_msg_t *payload)
+{
+	float deadline_miss = group->deadline_miss;
+	float overrun = group->overrun;
+	float skipped = group->skipped;
+
+	pack_debug_debug_message_header(payload, MESSAGE_ID_RATE_GROUP);
+	pack_debug_debug_message_float(&deadline_miss, payload);
+	pack_debug_debug_message_float(&overrun, payload);
+	pack_debug_debug_message_float(&skipped, payload);
+
+	/* log2 histograms of the wake up jitter and the execution time */
+	int i;
+	for(i = 0; i < RATE_GROUP_HIST_BINS; i++) {
+		float cnt = group->jitter_hist[i];
+		pack_debug_debug_message_float(&cnt, payload);
+	}
+	for(i = 0; i < RATE_GROUP_HIST_BINS; i++) {
+		float cnt = group->exec_hist[i];
+		pack_debug_debug_message_float(&cnt, payload);
+	}
+}
+
+void send_boot_timing_debug_message(debug_msg_t *payload)
+{
+	pack_debug_debug_message_header(payload, MESSAGE_ID_BOOT_TIMING);
+
+	/* scheduler, imu, esc, gps, baro, mag, armable completion time [ms] */
+	int i;
+	for(i = 0; i < BOOT_PHASE_CNT; i++) {
+		pack_debug_debug_message_float(&boot_time_ms[i], payload);
+	}
+}
+
+#define GYRO_SPECTRUM_BAND_CNT 32
+
+/* one axis per message: axis, bin width [Hz], notch frequencies [Hz] and the
+ * spectrum compressed to the peak power of equally wide bands */
+void send_gyro_spectrum_debug_message(debug_msg_t *payload)
+{
+	static int axis = 0;
+
+	pack_debug_debug_message_header(payload, MESSAGE_ID_GYRO_SPECTRUM);
+
+	float axis_f = (float)axis;
+	float band_freq = gyro_fft_get_bin_freq() * (GYRO_FFT_BIN_CNT / GYRO_SPECTRUM_BAND_CNT);
+	pack_debug_debug_message_float(&axis_f, payload);
+	pack_debug_debug_message_float(&band_freq, payload);
+
+	int i, j;
+	for(i = 0; i < DYN_NOTCH_CNT; i++) {
+		float freq = dyn_notch.freq[axis][i];
+		pack_debug_debug_message_float(&freq, payload);
+	}
+
+	float *power = gyro_fft_get_spectrum(axis);
+	for(i = 0; i < GYRO_SPECTRUM_BAND_CNT; i++) {
+		float band_max = 0.0f;
+		for(j = 0; j < GYRO_FFT_BIN_CNT / GYRO_SPECTRUM_BAND_CNT; j++) {
+			float p = power[i * (GYRO_FFT_BIN_CNT / GYRO_SPECTRUM_BAND_CNT) + j];
+			if(p > band_max) band_max = p;
+		}
+		pack_debug_debug_message_float(&band_max, payload);
+	}
+
+	axis = (axis + 1) % 3;
+}
+
+/* primary estimator id, then roll, pitch, yaw [deg], average and worst case
+ * update time [us] and skipped shadow slots of every estimator */
+void send_ahrs_shadow_debug_message(debug_msg_t *payload)
+{
+	pack_debug_debug_message_header(payload, MESSAGE_ID_AHRS_SHADOW);
+
+	float primary = (float)ahrs_registry_get_primary();
+	pack_debug_debug_message_float(&primary, payload);
+
+	int i;
+	for(i = 0; i < AHRS_ESTIMATOR_CNT; i++) {
+		float q[4];
+		euler_t euler;
+		ahrs_registry_get_quat(i, q);
+		quat_to_euler(q, &euler);
+
+		profiler_t *prof = ahrs_registry_get_profiler(i);
+		float roll = rad_to_deg(euler.roll);
+		float pitch = rad_to_deg(euler.pitch);
+		float yaw = rad_to_deg(euler.yaw);
+		float avg_us = profiler_cycles_to_us(prof->avg);
+		float max_us = profiler_cycles_to_us((float)prof->max);
+		float skip_cnt = (float)ahrs_registry_get_skip_cnt(i);
+
+		pack_debug_debug_message_float(&roll, payload);
+		pack_debug_debug_message_float(&pitch, payload);
+		pack_debug_debug_message_float(&yaw, payload);
+		pack_debug_debug_message_float(&avg_us, payload);
+		pack_debug_debug_message_float(&max_us, payload);
+		pack_debug_debug_message_float(&skip_cnt, payload);
+	}
+}
+
 void task_debug_link(void *param)
 {
 	debug_msg_t payload;
@@ -245,8 +480,14 @@ void task_debug_link(void *param)
 		//send_imu_debug_message(&payload);
 		//send_attitude_euler_debug_message(&payload);
 		//send_attitude_quaternion_debug_message(&payload);
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_DSHOT600)
+		/* cost of the rpm notch bank per imu sample, it only runs with dshot */
+		send_profiler_debug_message(&rpm_filter_profiler, &payload);
+#else
 		send_attitude_imu_debug_message(&payload);
+#endif
 		//send_ekf_debug_message(&payload);
+		//send_ahrs_shadow_debug_message(&payload);
 		//send_pid_debug_message(&payload);
 		//send_motor_debug_message(&payload);
 		//send_optitrack_position_debug_message(&payload);
@@ -257,8 +498,26 @@ void task_debug_link(void *param)
 		//send_general_float_debug_message(motor_cmd[0], &payload);
 		//send_accel_calib_debug_message();
 		//send_accel_bias_calib_debug_message();
+		//send_imu_thermal_calib_debug_message();
+		//send_mag_calib_debug_message();
 		//send_geometry_ctrl_debug(&payload);
 		//send_uav_dynamics_debug(&payload);
+		//send_profiler_debug_message(&sample_to_pulse_profiler, &payload);
+		//send_profiler_debug_message(&rate_ctl_group.wake_profiler, &payload);
+		//send_general_float_debug_message(attitude_ctl_group.dt, &payload);
+		//send_profiler_debug_message(&rate_ctl_group.response_profiler, &payload);
+		//send_profiler_debug_message(&attitude_ctl_group.response_profiler, &payload);
+		//send_profiler_debug_message(&position_ctl_group.response_profiler, &payload);
+		//send_rate_group_debug_message(&rate_ctl_group, &payload);
+		//send_profiler_debug_message(&mpu6500_convert_profiler, &payload);
+		//send_profiler_debug_message(&madgwick_imu_profiler, &payload);
+		//send_profiler_debug_message(&madgwick_marg_profiler, &payload);
+		//send_profiler_debug_message(&gyro_fft_profiler, &payload);
+		//send_gyro_spectrum_debug_message(&payload);
+		//send_motor_rpm_debug_message(&payload);
+		//send_sys_stats_debug_message(&payload);
+		//send_boot_timing_debug_message(&payload);
+		//send_math_bench_debug_message();
 		send_onboard_data(payload.s, payload.len);
 		freertos_task_delay(delay_time_ms);
 	}
@@ -21,7 +21,14 @@ enum {
 	MESSAGE_ID_OPTITRACK_VELOCITY = 9,
 	MESSAGE_ID_GENERAL_FLOAT = 10,
 	MESSAGE_ID_GEOMETRY_DEBUG = 11,
-	MESSAGE_ID_UAV_DYNAMICS_DEBUG = 12
+	MESSAGE_ID_UAV_DYNAMICS_DEBUG = 12,
+	MESSAGE_ID_PROFILER = 13,
+	MESSAGE_ID_MOTOR_RPM = 14,
+	MESSAGE_ID_SYS_STATS = 15,
+	MESSAGE_ID_RATE_GROUP = 16,
+	MESSAGE_ID_BOOT_TIMING = 17,
+	MESSAGE_ID_GYRO_SPECTRUM = 18,
+	MESSAGE_ID_AHRS_SHADOW = 19
 } MESSAGE_ID;
 
 typedef struct {
@@ -1,6 +1,8 @@
 #include <math.h>
 #include <stdio.h>
+#include <stdbool.h>
 #include "arm_math.h"
+#include "fastmath.h"
 #include "led.h"
 #include "mpu6500.h"
 #include "optitrack.h"
@@ -10,22 +12,31 @@
 #include "uart.h"
 #include "matrix.h"
 #include "delay.h"
+#include "bound.h"
+#include "ud_filter.h"
 
-#define AHRS_SELECT AHRS_SELECT_CF
+#define AHRS_GYRO_BIAS_GAIN 0.05f //inverse time constant of the bias estimation [1/s]
+#define AHRS_GYRO_BIAS_MAX 0.0873f //5dps [rad/s]
 
-#define dt 0.0025 //0.0025s = 400Hz
+#define AHRS_GRAVITY_CM 980.0f //[cm/s^2]
+
+/* the cf and the ud ekf fuse the optitrack yaw, without it their measurement
+ * holds the heading at zero like the one of the ekf does */
+#if (SELECT_HEADING == HEADING_USE_OPTITRACK)
+#define AHRS_HEADING_FUSED true
+#else
+#define AHRS_HEADING_FUSED false
+#endif
 
 extern optitrack_t optitrack;
 
-MAT_ALLOC(x_priori, 4, 1);
-MAT_ALLOC(x_posteriori, 4, 1);
+/* scratch of the cf and ekf updates, shared by all ahrs_filter_t instances */
 MAT_ALLOC(dx, 4, 1);
 MAT_ALLOC(w, 3, 1);
 MAT_ALLOC(f, 4, 3);
 MAT_ALLOC(y, 4, 1);
 MAT_ALLOC(resid, 4, 1);
 MAT_ALLOC(F, 4, 4);
-MAT_ALLOC(P, 4, 4);
 MAT_ALLOC(Ft, 4, 4);
 MAT_ALLOC(FP, 4, 4);
 MAT_ALLOC(PFt, 4, 4);
@@ -34,24 +45,24 @@ MAT_ALLOC(dP, 4, 4);
 MAT_ALLOC(R, 4, 4);
 MAT_ALLOC(Q, 4, 4);
 MAT_ALLOC(K, 4, 4);
-MAT_ALLOC(dt_4x4, 4, 4) = {dt, 0, 0,0,
-                           0, dt, 0, 0,
-                           0, 0, dt, 0,
-                           0, 0, 0, dt
-                          };
+MAT_ALLOC(dt_4x4, 4, 4);
 
-void ahrs_ekf_init(vector3d_f_t init_accel)
+#define AHRS_UD_P0 100.0f
+#define AHRS_UD_Q 0.1f
+#define AHRS_UD_R 0.001f
+
+void ahrs_filter_init(ahrs_filter_t *filter, vector3d_f_t init_accel)
 {
 	//initialize matrices
-	MAT_INIT(x_priori, 4, 1);
-	MAT_INIT(x_posteriori, 4, 1);
+	MAT_INIT(filter->x_priori, 4, 1);
+	MAT_INIT(filter->x_posteriori, 4, 1);
 	MAT_INIT(dx, 4, 1);
 	MAT_INIT(w, 3, 1);
 	MAT_INIT(f, 4, 3);
 	MAT_INIT(y, 4, 1);
 	MAT_INIT(resid, 4, 1);
 	MAT_INIT(F, 4, 4);
-	MAT_INIT(P, 4, 4);
+	MAT_INIT(filter->P, 4, 4);
 	MAT_INIT(Ft, 4, 4);
 	MAT_INIT(FP, 4, 4);
 	MAT_INIT(PFt, 4, 4);
@@ -61,81 +72,76 @@ void ahrs_ekf_init(vector3d_f_t init_accel)
 	MAT_INIT(Q, 4, 4);
 	MAT_INIT(dt_4x4, 4, 4);
 
-	_mat_(P)[0] = _mat_(P)[5] = _mat_(P)[10] = _mat_(P)[15] =  100.0f;
+	_mat_(filter->P)[0] = _mat_(filter->P)[5] = _mat_(filter->P)[10] = _mat_(filter->P)[15] =  100.0f;
 	_mat_(Q)[0] = _mat_(Q)[5] = _mat_(Q)[10] = _mat_(Q)[15] = 0.1f;
-	_mat_(R)[0] = _mat_(R)[5] = _mat_(R)[10] = _mat_(R)[15] = 0.001;
+	_mat_(R)[0] = _mat_(R)[5] = _mat_(R)[10] = _mat_(R)[15] = 0.001f;
+
+	float p0[4] = {AHRS_UD_P0, AHRS_UD_P0, AHRS_UD_P0, AHRS_UD_P0};
+	ud_init(&filter->ud, 4, p0);
 
-	euler_t att_init = {0.0f, 0.0f, 0.0f};
+	/* start from the attitude the accelerometer update converges to, the
+	 * registry also restarts a starved shadow with it */
 	vector3d_normalize(&init_accel);
-	calc_attitude_use_accel(&att_init, &init_accel);
-	euler_to_quat(&att_init, &_mat_(x_priori)[0]);
-	quat_normalize(&_mat_(x_priori)[0]);
+	convert_gravity_to_quat(&init_accel, &_mat_(filter->x_priori)[0]);
 }
 
 //in: euler angle [radian], out: quaternion
 void euler_to_quat(euler_t *euler, float *q)
 {
-	float phi = euler->roll * 0.5f;
-	float theta = euler->pitch * 0.5f;
-	float psi = euler->yaw * 0.5f;
-
-	q[0] = arm_cos_f32(phi) * arm_cos_f32(theta) * arm_cos_f32(psi) +
-	       arm_sin_f32(phi) * arm_sin_f32(theta) * arm_sin_f32(psi);
-	q[1] = arm_sin_f32(phi) * arm_cos_f32(theta) * arm_cos_f32(psi) -
-	       arm_cos_f32(phi) * arm_sin_f32(theta) * arm_sin_f32(psi);
-	q[2] = arm_cos_f32(phi) * arm_sin_f32(theta) * arm_cos_f32(psi) +
-	       arm_sin_f32(phi) * arm_cos_f32(theta) * arm_sin_f32(psi);
-	q[3] = arm_cos_f32(phi) * arm_cos_f32(theta) * arm_sin_f32(psi) -
-	       arm_sin_f32(phi) * arm_sin_f32(theta) * arm_cos_f32(psi);
+	float sin_phi, cos_phi, sin_theta, cos_theta, sin_psi, cos_psi;
+	fast_sincosf(euler->roll * 0.5f, &sin_phi, &cos_phi);
+	fast_sincosf(euler->pitch * 0.5f, &sin_theta, &cos_theta);
+	fast_sincosf(euler->yaw * 0.5f, &sin_psi, &cos_psi);
+
+	q[0] = cos_phi * cos_theta * cos_psi + sin_phi * sin_theta * sin_psi;
+	q[1] = sin_phi * cos_theta * cos_psi - cos_phi * sin_theta * sin_psi;
+	q[2] = cos_phi * sin_theta * cos_psi + sin_phi * cos_theta * sin_psi;
+	q[3] = cos_phi * cos_theta * sin_psi - sin_phi * sin_theta * cos_psi;
 }
 
 void quat_normalize(float *q)
 {
 	float sq_sum = (q[0])*(q[0]) + (q[1])*(q[1]) + (q[2])*(q[2]) + (q[3])*(q[3]);
-	float norm;
-	arm_sqrt_f32(sq_sum, &norm);
-	q[0] /= norm;
-	q[1] /= norm;
-	q[2] /= norm;
-	q[3] /= norm;
+	float norm_inv = fast_invsqrtf(sq_sum);
+	q[0] *= norm_inv;
+	q[1] *= norm_inv;
+	q[2] *= norm_inv;
+	q[3] *= norm_inv;
 }
 
 //in: quaterion, out: euler angle [radian]
 void quat_to_euler(float *q, euler_t *euler)
 {
-	euler->roll = atan2(2.0*(q[0]*q[1] + q[2]*q[3]), 1.0-2.0*(q[1]*q[1] + q[2]*q[2]));
-	euler->pitch = asin(2.0*(q[0]*q[2] - q[3]*q[1]));
-	euler->yaw = atan2(2.0*(q[0]*q[3] + q[1]*q[2]), 1.0-2.0*(q[2]*q[2] + q[3]*q[3]));
+	euler->roll = fast_atan2f(2.0f*(q[0]*q[1] + q[2]*q[3]), 1.0f-2.0f*(q[1]*q[1] + q[2]*q[2]));
+	euler->pitch = fast_asinf(2.0f*(q[0]*q[2] - q[3]*q[1]));
+	euler->yaw = fast_atan2f(2.0f*(q[0]*q[3] + q[1]*q[2]), 1.0f-2.0f*(q[2]*q[2] + q[3]*q[3]));
 }
 
 void convert_gravity_to_quat(vector3d_f_t *a, float *q)
 {
-	float _sqrt;
+	/* sqrt((1 +- z) / 2) = (1 +- z) / sqrt(2 * (1 +- z)) */
+	float _sqrt_inv;
 
 	if(a->z >= 0.0f) {
+		_sqrt_inv = fast_invsqrtf(2.0f * (a->z + 1.0f));
 		//q0
-		arm_sqrt_f32(0.5f * (a->z + 1.0f), &_sqrt);
-		q[0] = _sqrt;
+		q[0] = (a->z + 1.0f) * _sqrt_inv;
 		//q1
-		arm_sqrt_f32(2.0f * (a->z + 1.0f), &_sqrt);
-		q[1] = -a->y / _sqrt;
+		q[1] = -a->y * _sqrt_inv;
 		//q2
-		arm_sqrt_f32(2.0f * (a->z + 1.0f), &_sqrt);
-		q[2] = +a->x / _sqrt;
+		q[2] = +a->x * _sqrt_inv;
 		//q3
 		q[3] = 0.0f;
 	} else {
+		_sqrt_inv = fast_invsqrtf(2.0f * (1.0f - a->z));
 		//q0
-		arm_sqrt_f32(2.0f * (1.0f - a->z), &_sqrt);
-		q[0] = -a->y / _sqrt;
+		q[0] = -a->y * _sqrt_inv;
 		//q1
-		arm_sqrt_f32((1.0f - a->z) * 0.5f, &_sqrt);
-		q[1] = +_sqrt;
+		q[1] = (1.0f - a->z) * _sqrt_inv;
 		//q2
 		q[2] = 0.0f;
 		//q3
-		arm_sqrt_f32(2.0f * (1.0f - a->z), &_sqrt);
-		q[3] = +a->x / _sqrt;
+		q[3] = +a->x * _sqrt_inv;
 	}
 
 	quat_normalize(q);
@@ -143,8 +149,8 @@ void convert_gravity_to_quat(vector3d_f_t *a, float *q)
 
 void calc_attitude_use_accel(euler_t *att_estimated, vector3d_f_t *accel)
 {
-	att_estimated->roll = asin(accel->x);
-	att_estimated->pitch = atan2(-accel->y, accel->z);
+	att_estimated->roll = fast_asinf(accel->x);
+	att_estimated->pitch = fast_atan2f(-accel->y, accel->z);
 }
 
 void quaternion_mult(float *q1, float *q2, float *q_mult)
@@ -170,10 +176,9 @@ void calc_optitrack_yaw_quaternion(float *q_yaw)
 		quat_to_euler(optitrack.q, &optitrack_euler);
 
 		float half_psi = -optitrack_euler.yaw / 2.0f;
-		q_yaw[0] = arm_cos_f32(half_psi);
+		fast_sincosf(half_psi, &q_yaw[3], &q_yaw[0]);
 		q_yaw[1] = 0.0f;
 		q_yaw[2] = 0.0f;
-		q_yaw[3] = arm_sin_f32(half_psi);
 	} else {
 		q_yaw[0] = 1.0f;
 		q_yaw[1] = 0.0f;
@@ -182,12 +187,64 @@ void calc_optitrack_yaw_quaternion(float *q_yaw)
 	}
 }
 
-void ahrs_ekf_state_predict(vector3d_f_t accel, vector3d_f_t gyro)
+/* the ahrs fuses the accelerometer as R(q) * [0; 0; 1] (see convert_gravity_to_quat()),
+ * R(q)' brings the specific force into the ahrs frame where gravity is exactly +z.
+ * the optitrack yaw is fused negated, so the ahrs frame is north-west-up.
+ * f: specific force [m/s^2], accel: north-east-up acceleration [cm/s^2] */
+void ahrs_accel_to_world(float *q, vector3d_f_t *f, float *accel)
+{
+	float r00 = 1.0f - 2.0f * (q[2] * q[2] + q[3] * q[3]);
+	float r01 = 2.0f * (q[1] * q[2] - q[0] * q[3]);
+	float r02 = 2.0f * (q[1] * q[3] + q[0] * q[2]);
+	float r10 = 2.0f * (q[1] * q[2] + q[0] * q[3]);
+	float r11 = 1.0f - 2.0f * (q[1] * q[1] + q[3] * q[3]);
+	float r12 = 2.0f * (q[2] * q[3] - q[0] * q[1]);
+	float r20 = 2.0f * (q[1] * q[3] - q[0] * q[2]);
+	float r21 = 2.0f * (q[2] * q[3] + q[0] * q[1]);
+	float r22 = 1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2]);
+
+	float north = r00 * f->x + r10 * f->y + r20 * f->z;
+	float west = r01 * f->x + r11 * f->y + r21 * f->z;
+	float up = r02 * f->x + r12 * f->y + r22 * f->z;
+
+	accel[0] = 100.0f * north;
+	accel[1] = -100.0f * west;
+	accel[2] = 100.0f * up - AHRS_GRAVITY_CM;
+}
+
+/* the measurement update corrects the rotation which the gyro integration
+ * got wrong, a persistent correction is integrated into the bias state.
+ * the measured yaw is composed on the right (see ahrs_ekf_ud_estimate()), so
+ * the heading correction is the z component of dq. a measurement without a
+ * heading pulls the yaw to zero, that is no gyro error and the z bias is
+ * left alone */
+void ahrs_gyro_bias_update(ahrs_filter_t *filter, float *q_prior, float *q_post, bool heading)
+{
+	/* body frame correction dq = conj(q_prior) * q_post */
+	float dq[4];
+	dq[0] = q_prior[0]*q_post[0] + q_prior[1]*q_post[1] + q_prior[2]*q_post[2] + q_prior[3]*q_post[3];
+	dq[1] = q_prior[0]*q_post[1] - q_post[0]*q_prior[1] - (q_prior[2]*q_post[3] - q_prior[3]*q_post[2]);
+	dq[2] = q_prior[0]*q_post[2] - q_post[0]*q_prior[2] - (q_prior[3]*q_post[1] - q_prior[1]*q_post[3]);
+	dq[3] = q_prior[0]*q_post[3] - q_post[0]*q_prior[3] - (q_prior[1]*q_post[2] - q_prior[2]*q_post[1]);
+
+	/* rotation angle of the shortest path is 2 * dq_vec */
+	float two = (dq[0] < 0.0f) ? -2.0f : 2.0f;
+
+	int axis_cnt = (heading == true) ? 3 : 2;
+
+	int i;
+	for(i = 0; i < axis_cnt; i++) {
+		filter->gyro_bias[i] -= AHRS_GYRO_BIAS_GAIN * two * dq[i + 1];
+		bound_float(&filter->gyro_bias[i], AHRS_GYRO_BIAS_MAX, -AHRS_GYRO_BIAS_MAX);
+	}
+}
+
+void ahrs_ekf_state_predict(ahrs_filter_t *filter, vector3d_f_t accel, vector3d_f_t gyro, float dt)
 {
-	float half_q0_dt = 0.5f * _mat_(x_priori)[0] * dt;
-	float half_q1_dt = 0.5f * _mat_(x_priori)[1] * dt;
-	float half_q2_dt = 0.5f * _mat_(x_priori)[2] * dt;
-	float half_q3_dt = 0.5f * _mat_(x_priori)[3] * dt;
+	float half_q0_dt = 0.5f * _mat_(filter->x_priori)[0] * dt;
+	float half_q1_dt = 0.5f * _mat_(filter->x_priori)[1] * dt;
+	float half_q2_dt = 0.5f * _mat_(filter->x_priori)[2] * dt;
+	float half_q3_dt = 0.5f * _mat_(filter->x_priori)[3] * dt;
 	_mat_(f)[0] = -half_q1_dt;
 	_mat_(f)[1] = -half_q2_dt;
 	_mat_(f)[2] = -half_q3_dt;
@@ -201,97 +258,180 @@ void ahrs_ekf_state_predict(vector3d_f_t accel, vector3d_f_t gyro)
 	_mat_(f)[10] = +half_q1_dt;
 	_mat_(f)[11] = +half_q0_dt;
 
-	_mat_(w)[0] = deg_to_rad(gyro.x);
-	_mat_(w)[1] = deg_to_rad(gyro.y);
-	_mat_(w)[2] = deg_to_rad(gyro.z);
+	_mat_(w)[0] = deg_to_rad(gyro.x) - filter->gyro_bias[0];
+	_mat_(w)[1] = deg_to_rad(gyro.y) - filter->gyro_bias[1];
+	_mat_(w)[2] = deg_to_rad(gyro.z) - filter->gyro_bias[2];
 
 	MAT_MULT(&f, &w, &dx); //calculate dx = f * w
-	MAT_ADD(&x_priori, &dx, &x_priori);  //calculate x = x + dx
+	MAT_ADD(&filter->x_priori, &dx, &filter->x_priori);  //calculate x = x + dx
 
-	quat_normalize(&_mat_(x_priori)[0]);
+	quat_normalize(&_mat_(filter->x_priori)[0]);
 
 	//P = P + dt * (FP + PF' + Q)
 	float wx = _mat_(w)[0];
 	float wy = _mat_(w)[1];
 	float wz = _mat_(w)[2];
 
-	_mat_(F)[0] = 0.0;
-	_mat_(F)[1] = -0.5 * wx;
-	_mat_(F)[2] = -0.5 * wy;
-	_mat_(F)[3] = -0.5 * wz;
-	_mat_(F)[4] = 0.5 * wx;
-	_mat_(F)[5] = 0.0;
-	_mat_(F)[6] = 0.5 * wz;
-	_mat_(F)[7] = -0.5 * wy;
-	_mat_(F)[8] = 0.5 * wy;
-	_mat_(F)[9] = -0.5 * wz;
-	_mat_(F)[10] = 0.0;
-	_mat_(F)[11] = 0.5 * wx;
-	_mat_(F)[12] = 0.5 * wz;
-	_mat_(F)[13] = 0.5 * wy;
-	_mat_(F)[14] = -0.5 * wx;
-	_mat_(F)[15] = 0.0;
-
-	MAT_TRANS(&F, &Ft);                     //calculate F'
-	MAT_MULT(&F, &P, &FP);                  //calculate F*P
-	MAT_MULT(&P, &Ft, &PFt);                //calculate P*F'
-	MAT_ADD(&FP, &PFt, &FP_PFt_Q);          //calculate F*P + P*F'
-	MAT_ADD(&FP_PFt_Q, &Q, &FP_PFt_Q);      //calculate F*P + P*F + Q
-	MAT_MULT(&dt_4x4, &FP_PFt_Q, &FP_PFt_Q) //calculate dt * (F*P + P*F + Q)
-	MAT_ADD(&P, &FP_PFt_Q, &P);             //calculate P = P + dt * (F*P + P*F + Q)
+	_mat_(F)[0] = 0.0f;
+	_mat_(F)[1] = -0.5f * wx;
+	_mat_(F)[2] = -0.5f * wy;
+	_mat_(F)[3] = -0.5f * wz;
+	_mat_(F)[4] = 0.5f * wx;
+	_mat_(F)[5] = 0.0f;
+	_mat_(F)[6] = 0.5f * wz;
+	_mat_(F)[7] = -0.5f * wy;
+	_mat_(F)[8] = 0.5f * wy;
+	_mat_(F)[9] = -0.5f * wz;
+	_mat_(F)[10] = 0.0f;
+	_mat_(F)[11] = 0.5f * wx;
+	_mat_(F)[12] = 0.5f * wz;
+	_mat_(F)[13] = 0.5f * wy;
+	_mat_(F)[14] = -0.5f * wx;
+	_mat_(F)[15] = 0.0f;
+
+	_mat_(dt_4x4)[0] = _mat_(dt_4x4)[5] = _mat_(dt_4x4)[10] = _mat_(dt_4x4)[15] = dt;
+
+	MAT_TRANS(&F, &Ft);                         //calculate F'
+	MAT_MULT(&F, &filter->P, &FP);              //calculate F*P
+	MAT_MULT(&filter->P, &Ft, &PFt);            //calculate P*F'
+	MAT_ADD(&FP, &PFt, &FP_PFt_Q);              //calculate F*P + P*F'
+	MAT_ADD(&FP_PFt_Q, &Q, &FP_PFt_Q);          //calculate F*P + P*F + Q
+	MAT_MULT(&dt_4x4, &FP_PFt_Q, &FP_PFt_Q)     //calculate dt * (F*P + P*F + Q)
+	MAT_ADD(&filter->P, &FP_PFt_Q, &filter->P); //calculate P = P + dt * (F*P + P*F + Q)
 }
 
-void ahrs_ekf_state_update(vector3d_f_t accel, vector3d_f_t gyro)
+void ahrs_ekf_state_update(ahrs_filter_t *filter, vector3d_f_t accel, vector3d_f_t gyro)
 {
 	/* convert gravity vector to quaternion */
 	vector3d_normalize(&accel); //normalize acceleromter
 	convert_gravity_to_quat(&accel, &_mat_(y)[0]);
 
 	/* calculate residual */
-	_mat_(resid)[0] = _mat_(y)[0] - _mat_(x_priori)[0];
-	_mat_(resid)[1] = _mat_(y)[1] - _mat_(x_priori)[1];
-	_mat_(resid)[2] = _mat_(y)[2] - _mat_(x_priori)[2];
-	_mat_(resid)[3] = _mat_(y)[3] - _mat_(x_priori)[3];
+	_mat_(resid)[0] = _mat_(y)[0] - _mat_(filter->x_priori)[0];
+	_mat_(resid)[1] = _mat_(y)[1] - _mat_(filter->x_priori)[1];
+	_mat_(resid)[2] = _mat_(y)[2] - _mat_(filter->x_priori)[2];
+	_mat_(resid)[3] = _mat_(y)[3] - _mat_(filter->x_priori)[3];
 
 	/* calculate kalman gain */
-	_mat_(K)[0] = _mat_(P)[0] / (_mat_(P)[0] + _mat_(R)[0]);
-	_mat_(K)[5] = _mat_(P)[5] / (_mat_(P)[5] + _mat_(R)[5]);
-	_mat_(K)[10] = _mat_(P)[10] / (_mat_(P)[10] + _mat_(R)[10]);
-	_mat_(K)[15] = _mat_(P)[15] / (_mat_(P)[15] + _mat_(R)[15]);
+	_mat_(K)[0] = _mat_(filter->P)[0] / (_mat_(filter->P)[0] + _mat_(R)[0]);
+	_mat_(K)[5] = _mat_(filter->P)[5] / (_mat_(filter->P)[5] + _mat_(R)[5]);
+	_mat_(K)[10] = _mat_(filter->P)[10] / (_mat_(filter->P)[10] + _mat_(R)[10]);
+	_mat_(K)[15] = _mat_(filter->P)[15] / (_mat_(filter->P)[15] + _mat_(R)[15]);
 
 	/* caluclate innovation */
-	_mat_(x_posteriori)[0] += (_mat_(K)[0] * _mat_(resid)[0]);
-	_mat_(x_posteriori)[1] += (_mat_(K)[5] * _mat_(resid)[1]);
-	_mat_(x_posteriori)[2] += (_mat_(K)[10] * _mat_(resid)[2]);
-	_mat_(x_posteriori)[3] += (_mat_(K)[15] * _mat_(resid)[3]);
-	quat_normalize(&_mat_(x_posteriori)[0]); //renormalize quaternion
+	_mat_(filter->x_posteriori)[0] += (_mat_(K)[0] * _mat_(resid)[0]);
+	_mat_(filter->x_posteriori)[1] += (_mat_(K)[5] * _mat_(resid)[1]);
+	_mat_(filter->x_posteriori)[2] += (_mat_(K)[10] * _mat_(resid)[2]);
+	_mat_(filter->x_posteriori)[3] += (_mat_(K)[15] * _mat_(resid)[3]);
+	quat_normalize(&_mat_(filter->x_posteriori)[0]); //renormalize quaternion
+
+	/* the measurement is gravity alone */
+	ahrs_gyro_bias_update(filter, &_mat_(filter->x_priori)[0], &_mat_(filter->x_posteriori)[0], false);
 
 	/* update old state variable */
-	_mat_(x_priori)[0] = _mat_(x_posteriori)[0];
-	_mat_(x_priori)[1] = _mat_(x_posteriori)[1];
-	_mat_(x_priori)[2] = _mat_(x_posteriori)[2];
-	_mat_(x_priori)[3] = _mat_(x_posteriori)[3];
+	_mat_(filter->x_priori)[0] = _mat_(filter->x_posteriori)[0];
+	_mat_(filter->x_priori)[1] = _mat_(filter->x_posteriori)[1];
+	_mat_(filter->x_priori)[2] = _mat_(filter->x_posteriori)[2];
+	_mat_(filter->x_priori)[3] = _mat_(filter->x_posteriori)[3];
 
 	/* update covariance matrix */
-	_mat_(P)[0] *= (1.0f - _mat_(K)[0]);
-	_mat_(P)[5] *= (1.0f - _mat_(K)[5]);
-	_mat_(P)[10] *= (1.0f - _mat_(K)[10]);
-	_mat_(P)[15] *= (1.0f - _mat_(K)[15]);
+	_mat_(filter->P)[0] *= (1.0f - _mat_(K)[0]);
+	_mat_(filter->P)[5] *= (1.0f - _mat_(K)[5]);
+	_mat_(filter->P)[10] *= (1.0f - _mat_(K)[10]);
+	_mat_(filter->P)[15] *= (1.0f - _mat_(K)[15]);
+}
+
+void ahrs_ekf_estimate(ahrs_filter_t *filter, vector3d_f_t accel, vector3d_f_t gyro, float dt)
+{
+	ahrs_ekf_state_predict(filter, accel, gyro, dt);
+	ahrs_ekf_state_update(filter, accel, gyro);
 }
 
-void ahrs_ekf_estimate(vector3d_f_t accel, vector3d_f_t gyro)
+/* quaternion kalman filter like ahrs_ekf_estimate(), but not the same model:
+ * the covariance is propagated as U * D * U' (thornton) with phi = I + F * dt
+ * and AHRS_UD_Q, and updated one quaternion component at a time (bierman)
+ * with AHRS_UD_R, which keeps it symmetric and positive definite in single
+ * precision. the measurement is the gravity quaternion composed with the
+ * optitrack yaw (HEADING_USE_OPTITRACK), sign aligned with the prediction,
+ * ahrs_ekf_estimate() measures gravity alone and has no heading */
+void ahrs_ekf_ud_estimate(ahrs_filter_t *filter, vector3d_f_t accel, vector3d_f_t gyro, float dt)
 {
-	ahrs_ekf_state_predict(accel, gyro);
-	ahrs_ekf_state_update(accel, gyro);
+	float *q = &_mat_(filter->x_priori)[0];
+
+	float wx = deg_to_rad(gyro.x) - filter->gyro_bias[0];
+	float wy = deg_to_rad(gyro.y) - filter->gyro_bias[1];
+	float wz = deg_to_rad(gyro.z) - filter->gyro_bias[2];
+
+	/* phi = I + F * dt, x = phi * x */
+	float hx = 0.5f * wx * dt;
+	float hy = 0.5f * wy * dt;
+	float hz = 0.5f * wz * dt;
+	float phi[UD_MAX_STATES][UD_MAX_STATES] = {
+		{1.0f, -hx,  -hy,  -hz},
+		{hx,   1.0f, hz,   -hy},
+		{hy,   -hz,  1.0f, hx},
+		{hz,   hy,   -hx,  1.0f}
+	};
+
+	float q_last[4] = {q[0], q[1], q[2], q[3]};
+	int i, j;
+	for(i = 0; i < 4; i++) {
+		q[i] = phi[i][0] * q_last[0] + phi[i][1] * q_last[1] +
+		       phi[i][2] * q_last[2] + phi[i][3] * q_last[3];
+	}
+	quat_normalize(q);
+
+	float q_diag[4] = {AHRS_UD_Q * dt, AHRS_UD_Q * dt, AHRS_UD_Q * dt, AHRS_UD_Q * dt};
+	ud_predict(&filter->ud, phi, q_diag);
+
+	/* measurement */
+	float q_gravity[4];
+	vector3d_normalize(&accel);
+	convert_gravity_to_quat(&accel, q_gravity);
+
+	float q_yaw[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+#if (SELECT_HEADING == HEADING_USE_OPTITRACK)
+	calc_optitrack_yaw_quaternion(q_yaw);
+#endif
+
+	float y[4];
+	quaternion_mult(q_gravity, q_yaw, y);
+
+	/* q and -q are the same attitude, compare against the closer one */
+	if(y[0] * q[0] + y[1] * q[1] + y[2] * q[2] + y[3] * q[3] < 0.0f) {
+		y[0] = -y[0];
+		y[1] = -y[1];
+		y[2] = -y[2];
+		y[3] = -y[3];
+	}
+
+	/* R is diagonal, so the four components are independent scalar updates */
+	float x[4] = {q[0], q[1], q[2], q[3]};
+	for(i = 0; i < 4; i++) {
+		float h[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+		h[i] = 1.0f;
+		ud_update(&filter->ud, x, h, AHRS_UD_R, y[i] - x[i]);
+	}
+
+	for(j = 0; j < 4; j++) {
+		_mat_(filter->x_posteriori)[j] = x[j];
+	}
+	quat_normalize(&_mat_(filter->x_posteriori)[0]);
+
+	ahrs_gyro_bias_update(filter, q, &_mat_(filter->x_posteriori)[0], AHRS_HEADING_FUSED);
+
+	for(j = 0; j < 4; j++) {
+		q[j] = _mat_(filter->x_posteriori)[j];
+	}
 }
 
-void ahrs_complementary_filter_estimate(vector3d_f_t accel, vector3d_f_t gyro)
+void ahrs_complementary_filter_estimate(ahrs_filter_t *filter, vector3d_f_t accel, vector3d_f_t gyro, float dt)
 {
 	/* construct system transition function f */
-	float half_q0_dt = 0.5f * _mat_(x_priori)[0] * dt;
-	float half_q1_dt = 0.5f * _mat_(x_priori)[1] * dt;
-	float half_q2_dt = 0.5f * _mat_(x_priori)[2] * dt;
-	float half_q3_dt = 0.5f * _mat_(x_priori)[3] * dt;
+	float half_q0_dt = 0.5f * _mat_(filter->x_priori)[0] * dt;
+	float half_q1_dt = 0.5f * _mat_(filter->x_priori)[1] * dt;
+	float half_q2_dt = 0.5f * _mat_(filter->x_priori)[2] * dt;
+	float half_q3_dt = 0.5f * _mat_(filter->x_priori)[3] * dt;
 	_mat_(f)[0] = -half_q1_dt;
 	_mat_(f)[1] = -half_q2_dt;
 	_mat_(f)[2] = -half_q3_dt;
@@ -306,21 +446,21 @@ void ahrs_complementary_filter_estimate(vector3d_f_t accel, vector3d_f_t gyro)
 	_mat_(f)[11] = +half_q0_dt;
 
 	/* angular rate from rate gyro */
-	_mat_(w)[0] = deg_to_rad(gyro.x);
-	_mat_(w)[1] = deg_to_rad(gyro.y);
-	_mat_(w)[2] = deg_to_rad(gyro.z);
+	_mat_(w)[0] = deg_to_rad(gyro.x) - filter->gyro_bias[0];
+	_mat_(w)[1] = deg_to_rad(gyro.y) - filter->gyro_bias[1];
+	_mat_(w)[2] = deg_to_rad(gyro.z) - filter->gyro_bias[2];
 
 	/* rate gyro integration */
 	MAT_MULT(&f, &w, &dx); //calculate dx = f * w
-	MAT_ADD(&x_priori, &dx, &x_priori);  //calculate x = x + dx
-	quat_normalize(&_mat_(x_priori)[0]); //renormalization
+	MAT_ADD(&filter->x_priori, &dx, &filter->x_priori);  //calculate x = x + dx
+	quat_normalize(&_mat_(filter->x_priori)[0]); //renormalization
 
 	/* convert gravity vector to quaternion */
 	float q_gravity[4] = {0};
 	vector3d_normalize(&accel); //normalize acceleromter
 	convert_gravity_to_quat(&accel, q_gravity);
 
-	float q_yaw[4];
+	float q_yaw[4] = {1.0f, 0.0f, 0.0f, 0.0f};
 
 #if (SELECT_HEADING == HEADING_USE_OPTITRACK)
 	/* fusing yaw angle with optitrack */
@@ -330,44 +470,37 @@ void ahrs_complementary_filter_estimate(vector3d_f_t accel, vector3d_f_t gyro)
 	float q_gravity_yaw[4];
 	quaternion_mult(q_gravity, q_yaw, q_gravity_yaw);
 
+	/* q and -q are the same attitude, blend with the closer one, the optitrack
+	 * yaw quaternion flips its sign where the yaw wraps around +-180deg */
+	if(q_gravity_yaw[0] * _mat_(filter->x_priori)[0] + q_gravity_yaw[1] * _mat_(filter->x_priori)[1] +
+	   q_gravity_yaw[2] * _mat_(filter->x_priori)[2] + q_gravity_yaw[3] * _mat_(filter->x_priori)[3] < 0.0f) {
+		q_gravity_yaw[0] = -q_gravity_yaw[0];
+		q_gravity_yaw[1] = -q_gravity_yaw[1];
+		q_gravity_yaw[2] = -q_gravity_yaw[2];
+		q_gravity_yaw[3] = -q_gravity_yaw[3];
+	}
+
 	/* sensors fusion */
 	float a = 0.995f;
-	_mat_(x_posteriori)[0] = (_mat_(x_priori)[0] * a) + (q_gravity_yaw[0]* (1.0 - a));
-	_mat_(x_posteriori)[1] = (_mat_(x_priori)[1] * a) + (q_gravity_yaw[1]* (1.0 - a));
-	_mat_(x_posteriori)[2] = (_mat_(x_priori)[2] * a) + (q_gravity_yaw[2]* (1.0 - a));
-	_mat_(x_posteriori)[3] = (_mat_(x_priori)[3] * a) + (q_gravity_yaw[3]* (1.0 - a));
-	quat_normalize(&_mat_(x_posteriori)[0]);
+	_mat_(filter->x_posteriori)[0] = (_mat_(filter->x_priori)[0] * a) + (q_gravity_yaw[0]* (1.0f - a));
+	_mat_(filter->x_posteriori)[1] = (_mat_(filter->x_priori)[1] * a) + (q_gravity_yaw[1]* (1.0f - a));
+	_mat_(filter->x_posteriori)[2] = (_mat_(filter->x_priori)[2] * a) + (q_gravity_yaw[2]* (1.0f - a));
+	_mat_(filter->x_posteriori)[3] = (_mat_(filter->x_priori)[3] * a) + (q_gravity_yaw[3]* (1.0f - a));
+	quat_normalize(&_mat_(filter->x_posteriori)[0]);
 
-	/* update state variables for rate gyro */
-	_mat_(x_priori)[0] = _mat_(x_posteriori)[0];
-	_mat_(x_priori)[1] = _mat_(x_posteriori)[1];
-	_mat_(x_priori)[2] = _mat_(x_posteriori)[2];
-	_mat_(x_priori)[3] = _mat_(x_posteriori)[3];
-}
+	ahrs_gyro_bias_update(filter, &_mat_(filter->x_priori)[0], &_mat_(filter->x_posteriori)[0], AHRS_HEADING_FUSED);
 
-void ahrs_init(vector3d_f_t init_accel)
-{
-	ahrs_ekf_init(init_accel);
+	/* update state variables for rate gyro */
+	_mat_(filter->x_priori)[0] = _mat_(filter->x_posteriori)[0];
+	_mat_(filter->x_priori)[1] = _mat_(filter->x_posteriori)[1];
+	_mat_(filter->x_priori)[2] = _mat_(filter->x_posteriori)[2];
+	_mat_(filter->x_priori)[3] = _mat_(filter->x_posteriori)[3];
 }
 
-void ahrs_estimate(ahrs_t *ahrs, vector3d_f_t accel, vector3d_f_t gyro)
+void ahrs_filter_get_quat(ahrs_filter_t *filter, float *q)
 {
-#if AHRS_SELECT == AHRS_SELECT_EKF
-	ahrs_ekf_estimate(accel, gyro);
-#endif
-
-#if AHRS_SELECT == AHRS_SELECT_CF
-	ahrs_complementary_filter_estimate(accel, gyro);
-#endif
-
-	euler_t euler;
-	quat_to_euler(&_mat_(x_posteriori)[0], &euler);
-	ahrs->attitude.roll = rad_to_deg(euler.roll);
-	ahrs->attitude.pitch = rad_to_deg(euler.pitch);
-	ahrs->attitude.yaw = rad_to_deg(euler.yaw);
-
-	ahrs->q[0] = _mat_(x_posteriori)[0];
-	ahrs->q[1] = _mat_(x_posteriori)[1];
-	ahrs->q[2] = _mat_(x_posteriori)[2];
-	ahrs->q[3] = _mat_(x_posteriori)[3];
+	q[0] = _mat_(filter->x_posteriori)[0];
+	q[1] = _mat_(filter->x_posteriori)[1];
+	q[2] = _mat_(filter->x_posteriori)[2];
+	q[3] = _mat_(filter->x_posteriori)[3];
 }
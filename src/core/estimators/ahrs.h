@@ -1,13 +1,12 @@
 #ifndef __AHRS__
 #define __AHRS__
 
+#include "arm_math.h"
 #include "vector.h"
+#include "ud_filter.h"
 
-#define AHRS_SELECT_EKF 0
-#define AHRS_SELECT_CF 1
-
-#define deg_to_rad(angle) (angle * 0.01745329252)
-#define rad_to_deg(radian) (radian * 57.2957795056)
+#define deg_to_rad(angle) (angle * 0.01745329252f)
+#define rad_to_deg(radian) (radian * 57.2957795056f)
 
 typedef struct {
 	float roll;
@@ -18,18 +17,36 @@ typedef struct {
 typedef struct {
 	euler_t attitude;
 	float q[4];
+	float gyro_bias[3]; //residual gyro bias estimated in flight [rad/s]
 } ahrs_t;
 
+/* state of one complementary filter or ekf instance */
+typedef struct {
+	arm_matrix_instance_f32 x_priori;
+	arm_matrix_instance_f32 x_posteriori;
+	arm_matrix_instance_f32 P;
+	float x_priori_arr[4];
+	float x_posteriori_arr[4];
+	float P_arr[4 * 4];
+	ud_cov_t ud;        //P = U * D * U' of the ud factorized ekf
+	float gyro_bias[3]; //residual gyro bias state [rad/s]
+} ahrs_filter_t;
+
 void imu_read(vector3d_f_t *accel, vector3d_f_t *gyro);
 
-void ahrs_init(vector3d_f_t init_accel);
-void ahrs_estimate(ahrs_t *ahrs, vector3d_f_t accel, vector3d_f_t gyro);
+void ahrs_filter_init(ahrs_filter_t *filter, vector3d_f_t init_accel);
+void ahrs_complementary_filter_estimate(ahrs_filter_t *filter, vector3d_f_t accel, vector3d_f_t gyro, float dt);
+void ahrs_ekf_estimate(ahrs_filter_t *filter, vector3d_f_t accel, vector3d_f_t gyro, float dt);
+void ahrs_ekf_ud_estimate(ahrs_filter_t *filter, vector3d_f_t accel, vector3d_f_t gyro, float dt);
+void ahrs_filter_get_quat(ahrs_filter_t *filter, float *q);
+void ahrs_accel_to_world(float *q, vector3d_f_t *f, float *accel);
 
 void quat_normalize(float *q);
 
 void euler_to_quat(euler_t *euler, float *q);
 void quat_to_euler(float *q, euler_t *euler);
 
+void convert_gravity_to_quat(vector3d_f_t *a, float *q);
 void calc_attitude_use_accel(euler_t *att_estimated, vector3d_f_t *accel);
 
 #endif
@@ -0,0 +1,342 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "ahrs.h"
+#include "ahrs_registry.h"
+#include "madgwick_ahrs.h"
+#include "imu_preint.h"
+#include "hmc5983.h"
+#include "profiler.h"
+#include "ccm.h"
+#include "proj_config.h"
+
+#define AHRS_MADGWICK_BETA 0.4f
+
+#if (SELECT_AHRS < 0) || (SELECT_AHRS >= AHRS_ESTIMATOR_CNT)
+#error "SELECT_AHRS is not a registered estimator"
+#endif
+
+typedef struct {
+	madgwick_t madgwick;
+	uint32_t mag_seq;
+} ahrs_madgwick_state_t;
+
+/* imu data not yet seen by an estimator and its cost, a shadow estimator that
+ * missed its slot integrates the next periods together */
+typedef struct {
+	imu_delta_t pending;
+	profiler_t profiler;
+	float cost;       //worst case update time, decays while skipped [cycles]
+	uint32_t skip_cnt;
+	bool restart;     //fell AHRS_SHADOW_PENDING_MAX behind, re-initialized on its next run
+} ahrs_estimator_status_t;
+
+ahrs_filter_t ahrs_cf_filter CCM_HOT;
+ahrs_filter_t ahrs_ekf_filter CCM_HOT;
+ahrs_filter_t ahrs_ekf_ud_filter CCM_HOT;
+static ahrs_madgwick_state_t ahrs_madgwick CCM_HOT;
+
+static ahrs_estimator_status_t ahrs_status[AHRS_ESTIMATOR_CNT] CCM_HOT;
+static int ahrs_primary;
+static int ahrs_shadow_next;
+static float ahrs_sample_rate;
+
+static void ahrs_filter_init_adapter(void *state, vector3d_f_t init_accel, float sample_rate)
+{
+	ahrs_filter_init((ahrs_filter_t *)state, init_accel);
+}
+
+static void ahrs_cf_update(void *state, vector3d_f_t accel, vector3d_f_t gyro, float dt)
+{
+	ahrs_complementary_filter_estimate((ahrs_filter_t *)state, accel, gyro, dt);
+}
+
+static void ahrs_ekf_update(void *state, vector3d_f_t accel, vector3d_f_t gyro, float dt)
+{
+	ahrs_ekf_estimate((ahrs_filter_t *)state, accel, gyro, dt);
+}
+
+static void ahrs_ekf_ud_update(void *state, vector3d_f_t accel, vector3d_f_t gyro, float dt)
+{
+	ahrs_ekf_ud_estimate((ahrs_filter_t *)state, accel, gyro, dt);
+}
+
+static void ahrs_filter_get_quat_adapter(void *state, float *q)
+{
+	ahrs_filter_get_quat((ahrs_filter_t *)state, q);
+}
+
+static void ahrs_filter_get_gyro_bias(void *state, float *gyro_bias)
+{
+	ahrs_filter_t *filter = (ahrs_filter_t *)state;
+	gyro_bias[0] = filter->gyro_bias[0];
+	gyro_bias[1] = filter->gyro_bias[1];
+	gyro_bias[2] = filter->gyro_bias[2];
+}
+
+static void ahrs_madgwick_init(void *state, vector3d_f_t init_accel, float sample_rate)
+{
+	ahrs_madgwick_state_t *madgwick = (ahrs_madgwick_state_t *)state;
+	madgwick_init(&madgwick->madgwick, sample_rate, AHRS_MADGWICK_BETA);
+	madgwick->mag_seq = 0;
+
+	/* the same initial attitude as the ahrs.c filters, see ahrs_madgwick_update() */
+	float q[4];
+	vector3d_normalize(&init_accel);
+	convert_gravity_to_quat(&init_accel, q);
+	madgwick->madgwick.q0 = q[0];
+	madgwick->madgwick.q1 = q[1];
+	madgwick->madgwick.q2 = q[2];
+	madgwick->madgwick.q3 = q[3];
+}
+
+/* the magnetometer is slower than the attitude loop, the marg update only
+ * runs with a new sample and the imu update fills the periods between.
+ * madgwick's objective predicts gravity as R(q)' * e_z while ahrs.c measures
+ * it as R(q) * e_z (see convert_gravity_to_quat()), the gyro integration is
+ * the same. mirroring x and y of the observed vectors maps one onto the
+ * other for the tilt, its quaternion is then in the convention of ahrs.c */
+static void ahrs_madgwick_update(void *state, vector3d_f_t accel, vector3d_f_t gyro, float dt)
+{
+	ahrs_madgwick_state_t *madgwick = (ahrs_madgwick_state_t *)state;
+	madgwick->madgwick.sampleRate = dt;
+
+#if (SELECT_HEADING == HEADING_USE_MAGNETOMETER)
+	hmc5983_sample_t mag;
+	uint32_t seq = hmc5983_read(&mag);
+
+	if(seq != madgwick->mag_seq) {
+		madgwick->mag_seq = seq;
+		Madgwick_MARG_AHRS(&madgwick->madgwick, -accel.x, -accel.y, accel.z,
+		                   deg_to_rad(gyro.x), deg_to_rad(gyro.y), deg_to_rad(gyro.z),
+		                   -mag.mag.x, -mag.mag.y, mag.mag.z);
+		return;
+	}
+#endif
+
+	madgwick_imu_ahrs(&madgwick->madgwick, -accel.x, -accel.y, accel.z,
+	                  deg_to_rad(gyro.x), deg_to_rad(gyro.y), deg_to_rad(gyro.z));
+}
+
+static void ahrs_madgwick_get_quat(void *state, float *q)
+{
+	ahrs_madgwick_state_t *madgwick = (ahrs_madgwick_state_t *)state;
+	q[0] = madgwick->madgwick.q0;
+	q[1] = madgwick->madgwick.q1;
+	q[2] = madgwick->madgwick.q2;
+	q[3] = madgwick->madgwick.q3;
+}
+
+/* indexed by the SELECT_AHRS options of proj_config.h */
+static const ahrs_estimator_t ahrs_estimators[AHRS_ESTIMATOR_CNT] = {
+	[AHRS_COMPLEMENTARY_FILTER] = {
+		.name = "cf",
+		.init = ahrs_filter_init_adapter,
+		.update = ahrs_cf_update,
+		.get_quat = ahrs_filter_get_quat_adapter,
+		.get_gyro_bias = ahrs_filter_get_gyro_bias,
+		.state = &ahrs_cf_filter
+	},
+	[AHRS_EKF] = {
+		.name = "ekf",
+		.init = ahrs_filter_init_adapter,
+		.update = ahrs_ekf_update,
+		.get_quat = ahrs_filter_get_quat_adapter,
+		.get_gyro_bias = ahrs_filter_get_gyro_bias,
+		.state = &ahrs_ekf_filter
+	},
+	[AHRS_MADGWICK_FILTER] = {
+		.name = "madgwick",
+		.init = ahrs_madgwick_init,
+		.update = ahrs_madgwick_update,
+		.get_quat = ahrs_madgwick_get_quat,
+		.get_gyro_bias = NULL,
+		.state = &ahrs_madgwick
+	},
+	[AHRS_EKF_UD] = {
+		.name = "ekf_ud",
+		.init = ahrs_filter_init_adapter,
+		.update = ahrs_ekf_ud_update,
+		.get_quat = ahrs_filter_get_quat_adapter,
+		.get_gyro_bias = ahrs_filter_get_gyro_bias,
+		.state = &ahrs_ekf_ud_filter
+	}
+};
+
+void ahrs_registry_init(vector3d_f_t init_accel, float sample_rate)
+{
+	ahrs_sample_rate = sample_rate;
+
+	int i;
+	for(i = 0; i < AHRS_ESTIMATOR_CNT; i++) {
+		ahrs_estimators[i].init(ahrs_estimators[i].state, init_accel, sample_rate);
+
+		ahrs_status[i].pending.delta_angle = (vector3d_f_t){0};
+		ahrs_status[i].pending.delta_velocity = (vector3d_f_t){0};
+		ahrs_status[i].pending.accel_lpf = init_accel;
+		ahrs_status[i].pending.dt = 0.0f;
+		ahrs_status[i].cost = 0.0f;
+		ahrs_status[i].skip_cnt = 0;
+		ahrs_status[i].restart = false;
+		profiler_reset(&ahrs_status[i].profiler);
+	}
+
+	ahrs_primary = SELECT_AHRS;
+	ahrs_shadow_next = 0;
+}
+
+static void ahrs_pending_add(imu_delta_t *pending, imu_delta_t *imu_delta)
+{
+	pending->delta_angle.x += imu_delta->delta_angle.x;
+	pending->delta_angle.y += imu_delta->delta_angle.y;
+	pending->delta_angle.z += imu_delta->delta_angle.z;
+	pending->delta_velocity.x += imu_delta->delta_velocity.x;
+	pending->delta_velocity.y += imu_delta->delta_velocity.y;
+	pending->delta_velocity.z += imu_delta->delta_velocity.z;
+	pending->accel_lpf = imu_delta->accel_lpf;
+	pending->dt += imu_delta->dt;
+}
+
+/* the estimators integrate the coning compensated mean rate [deg/s] of
+ * everything since their last update, which replaces the low pass filtered
+ * gyro: integrating the mean rate of the period is exact, the 0.03 gyro lpf
+ * at 8khz only added ~4ms of lag. the accel correction keeps the low pass
+ * filtered specific force [m/s^2] the filter gains were tuned with */
+static void ahrs_estimator_run(int id)
+{
+	ahrs_estimator_status_t *status = &ahrs_status[id];
+	imu_delta_t *pending = &status->pending;
+
+	if(status->restart == true) {
+		ahrs_estimators[id].init(ahrs_estimators[id].state, pending->accel_lpf, ahrs_sample_rate);
+		status->restart = false;
+	}
+
+	float dt_inv = 1.0f / pending->dt;
+	vector3d_f_t gyro_mean = {
+		.x = rad_to_deg(pending->delta_angle.x) * dt_inv,
+		.y = rad_to_deg(pending->delta_angle.y) * dt_inv,
+		.z = rad_to_deg(pending->delta_angle.z) * dt_inv
+	};
+
+	profiler_start(&status->profiler);
+	ahrs_estimators[id].update(ahrs_estimators[id].state, pending->accel_lpf, gyro_mean, pending->dt);
+	profiler_stop(&status->profiler);
+
+	if((float)status->profiler.last > status->cost) {
+		status->cost = (float)status->profiler.last;
+	}
+
+	pending->delta_angle = (vector3d_f_t){0};
+	pending->delta_velocity = (vector3d_f_t){0};
+	pending->dt = 0.0f;
+}
+
+/* hand the period to every estimator and run the primary right away */
+void ahrs_registry_update(imu_delta_t *imu_delta, ahrs_t *ahrs)
+{
+	int i;
+	for(i = 0; i < AHRS_ESTIMATOR_CNT; i++) {
+		imu_delta_t *pending = &ahrs_status[i].pending;
+		ahrs_pending_add(pending, imu_delta);
+
+		/* a starved shadow restarts from this period instead of integrating
+		 * an ever longer one, the primary runs every period */
+		if((i != ahrs_primary) && (pending->dt > AHRS_SHADOW_PENDING_MAX)) {
+			*pending = *imu_delta;
+			ahrs_status[i].restart = true;
+		}
+	}
+
+	const ahrs_estimator_t *primary = &ahrs_estimators[ahrs_primary];
+	ahrs_estimator_run(ahrs_primary);
+
+	primary->get_quat(primary->state, ahrs->q);
+
+	euler_t euler;
+	quat_to_euler(ahrs->q, &euler);
+	ahrs->attitude.roll = rad_to_deg(euler.roll);
+	ahrs->attitude.pitch = rad_to_deg(euler.pitch);
+	ahrs->attitude.yaw = rad_to_deg(euler.yaw);
+
+	if(primary->get_gyro_bias != NULL) {
+		primary->get_gyro_bias(primary->state, ahrs->gyro_bias);
+	} else {
+		ahrs->gyro_bias[0] = 0.0f;
+		ahrs->gyro_bias[1] = 0.0f;
+		ahrs->gyro_bias[2] = 0.0f;
+	}
+}
+
+/* runs the shadow estimators with the time left in the period, an estimator
+ * only starts if its worst case still ends AHRS_SHADOW_MARGIN_US before the
+ * deadline. the worst case decays while the estimator is skipped, so a single
+ * outlier does not keep it out forever. the first candidate rotates every
+ * period so a slow estimator can not starve the others */
+void ahrs_registry_run_shadows(uint32_t release_time, uint32_t deadline)
+{
+	const uint32_t margin = (uint32_t)(AHRS_SHADOW_MARGIN_US * (PROFILER_CPU_FREQ / 1000000));
+
+	int i;
+	for(i = 0; i < AHRS_ESTIMATOR_CNT; i++) {
+		int id = (ahrs_shadow_next + i) % AHRS_ESTIMATOR_CNT;
+
+		if((id == ahrs_primary) || (ahrs_status[id].pending.dt == 0.0f)) {
+			continue;
+		}
+
+		/* unsigned subtraction handles the counter overflow */
+		uint32_t elapsed = profiler_get_cycles() - release_time;
+		if((elapsed + (uint32_t)ahrs_status[id].cost + margin) > deadline) {
+			ahrs_status[id].cost *= AHRS_SHADOW_COST_DECAY;
+			ahrs_status[id].skip_cnt++;
+			continue;
+		}
+
+		ahrs_estimator_run(id);
+	}
+
+	ahrs_shadow_next = (ahrs_shadow_next + 1) % AHRS_ESTIMATOR_CNT;
+}
+
+/* the estimators are not interchangeable mid flight, switching is only
+ * accepted while disarmed. the new primary was running as a shadow already,
+ * one that missed its last period may have been starved and is
+ * re-initialized from the accelerometer before it takes over */
+bool ahrs_registry_set_primary(int id, bool armed)
+{
+	if((armed == true) || (id < 0) || (id >= AHRS_ESTIMATOR_CNT)) {
+		return false;
+	}
+
+	if(ahrs_status[id].pending.dt > 0.0f) {
+		ahrs_status[id].restart = true;
+	}
+
+	ahrs_primary = id;
+	return true;
+}
+
+int ahrs_registry_get_primary(void)
+{
+	return ahrs_primary;
+}
+
+const ahrs_estimator_t *ahrs_registry_get_estimator(int id)
+{
+	return &ahrs_estimators[id];
+}
+
+void ahrs_registry_get_quat(int id, float *q)
+{
+	ahrs_estimators[id].get_quat(ahrs_estimators[id].state, q);
+}
+
+profiler_t *ahrs_registry_get_profiler(int id)
+{
+	return &ahrs_status[id].profiler;
+}
+
+uint32_t ahrs_registry_get_skip_cnt(int id)
+{
+	return ahrs_status[id].skip_cnt;
+}
@@ -0,0 +1,40 @@
+#ifndef __AHRS_REGISTRY_H__
+#define __AHRS_REGISTRY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "vector.h"
+#include "ahrs.h"
+#include "imu_preint.h"
+#include "profiler.h"
+
+#define AHRS_ESTIMATOR_CNT 4 //indexed by the SELECT_AHRS options of proj_config.h
+
+#define AHRS_SHADOW_MARGIN_US 200.0f //kept free before the attitude loop deadline [us]
+#define AHRS_SHADOW_COST_DECAY 0.99f //per skipped period, one slow update can not stop a shadow for good
+#define AHRS_SHADOW_PENDING_MAX 0.05f //imu data a shadow may fall behind before it is re-initialized [s]
+
+/* attitude estimator interface, the state is owned by the registry.
+ * accel [m/s^2], gyro [deg/s], dt [s] */
+typedef struct {
+	const char *name;
+	void (*init)(void *state, vector3d_f_t init_accel, float sample_rate);
+	void (*update)(void *state, vector3d_f_t accel, vector3d_f_t gyro, float dt);
+	void (*get_quat)(void *state, float *q);
+	void (*get_gyro_bias)(void *state, float *gyro_bias); //NULL if not estimated
+	void *state;
+} ahrs_estimator_t;
+
+void ahrs_registry_init(vector3d_f_t init_accel, float sample_rate);
+void ahrs_registry_update(imu_delta_t *imu_delta, ahrs_t *ahrs);
+void ahrs_registry_run_shadows(uint32_t release_time, uint32_t deadline);
+
+bool ahrs_registry_set_primary(int id, bool armed);
+int ahrs_registry_get_primary(void);
+
+const ahrs_estimator_t *ahrs_registry_get_estimator(int id);
+void ahrs_registry_get_quat(int id, float *q);
+profiler_t *ahrs_registry_get_profiler(int id);
+uint32_t ahrs_registry_get_skip_cnt(int id);
+
+#endif
@@ -0,0 +1,221 @@
+#include <math.h>
+#include "alt_est.h"
+#include "bound.h"
+#include "slot.h"
+
+/* third order complementary filter of the vertical channel: the earth frame
+ * vertical acceleration is integrated at the control rate, the barometer
+ * corrects the altitude, velocity and accelerometer bias with the gains of
+ * a critically damped loop */
+
+#define ALT_EST_TIME_CONSTANT 1.5f //[s]
+#define ALT_EST_K1 (3.0f / ALT_EST_TIME_CONSTANT)
+#define ALT_EST_K2 (3.0f / (ALT_EST_TIME_CONSTANT * ALT_EST_TIME_CONSTANT))
+#define ALT_EST_K3 (1.0f / (ALT_EST_TIME_CONSTANT * ALT_EST_TIME_CONSTANT * ALT_EST_TIME_CONSTANT))
+
+#define ALT_EST_BARO_INIT_CNT 20      //samples averaged as the takeoff pressure
+#define ALT_EST_BARO_DT_MAX 0.1f      //longest correction step [s]
+#define ALT_EST_BARO_TIMEOUT_MS 500.0f
+#define ALT_EST_BIAS_MAX 100.0f       //[cm/s^2]
+
+/* the propeller downwash raises the static pressure near the ground, the
+ * barometer reads too low then, so low readings within the deadband are
+ * ignored below the ground effect height */
+#define ALT_EST_GROUND_EFFECT_HEIGHT 50.0f   //[cm]
+#define ALT_EST_GROUND_EFFECT_DEADBAND 40.0f //[cm]
+
+typedef struct {
+	float time; //[ms]
+	float alt;  //[cm]
+} alt_est_history_t;
+
+static alt_est_history_t alt_est_history[ALT_EST_HISTORY_SIZE];
+static int alt_est_history_newest;
+static int alt_est_history_cnt;
+
+static float alt, vel, accel_bias;
+static bool ground_effect;
+static bool alt_est_started; //takeoff pressure and initial bias are set
+static bool alt_est_valid;   //started and the barometer is not timed out
+
+static float baro_pressure_ref; //takeoff pressure [Pa]
+static float baro_pressure_sum;
+static int baro_init_cnt;
+static float baro_time_last; //[ms]
+
+static float accel_sum; //vertical acceleration while the takeoff pressure is averaged
+static int accel_cnt;
+
+static volatile int alt_source = ALT_SOURCE_AUTO;
+static volatile bool alt_est_armed = false;
+
+SLOT_ALLOC(alt_est_slot, alt_est_state_t);
+
+void alt_est_init(void)
+{
+	alt = vel = accel_bias = 0.0f;
+	ground_effect = true;
+	alt_est_started = false;
+	alt_est_valid = false;
+
+	alt_est_history_newest = 0;
+	alt_est_history_cnt = 0;
+
+	baro_pressure_sum = 0.0f;
+	baro_init_cnt = 0;
+	accel_sum = 0.0f;
+	accel_cnt = 0;
+
+	alt_est_state_t state = {.valid = false, .source = ALT_SOURCE_BARO};
+	slot_publish(&alt_est_slot, &state);
+}
+
+static void alt_est_publish(void)
+{
+	alt_est_state_t state = {
+		.alt = alt,
+		.vel = vel,
+		.accel_bias = accel_bias,
+		.ground_effect = ground_effect,
+		.valid = alt_est_valid,
+		.source = ALT_SOURCE_BARO
+	};
+
+	slot_publish(&alt_est_slot, &state);
+}
+
+/* accel_up: earth frame vertical acceleration (see ahrs_accel_to_world()) [cm/s^2] */
+void alt_est_predict(float accel_up, float dt, float time_ms)
+{
+	if(alt_est_started == true && (time_ms - baro_time_last) > ALT_EST_BARO_TIMEOUT_MS) {
+		if(alt_est_armed == false) {
+			/* on the ground, restart with a new takeoff pressure */
+			alt_est_init();
+		} else {
+			/* in flight the takeoff reference is kept, the estimate coasts
+			 * on the accelerometer until the barometer is back */
+			alt_est_valid = false;
+		}
+	}
+
+	if(alt_est_started == false) {
+		/* on the ground, the mean is the initial bias */
+		accel_sum += accel_up;
+		accel_cnt++;
+		return;
+	}
+
+	vel += (accel_up - accel_bias) * dt;
+	alt += vel * dt;
+
+	alt_est_history_newest = (alt_est_history_newest + 1) % ALT_EST_HISTORY_SIZE;
+	if(alt_est_history_cnt < ALT_EST_HISTORY_SIZE) {
+		alt_est_history_cnt++;
+	}
+	alt_est_history[alt_est_history_newest].time = time_ms;
+	alt_est_history[alt_est_history_newest].alt = alt;
+
+	alt_est_publish();
+}
+
+/* pressure: [Pa], time_ms: time of the sample */
+void alt_est_fuse_baro(float pressure, float time_ms)
+{
+	if(alt_est_started == false) {
+		/* the takeoff point is the altitude reference */
+		baro_pressure_sum += pressure;
+		if(++baro_init_cnt < ALT_EST_BARO_INIT_CNT) {
+			return;
+		}
+
+		baro_pressure_ref = baro_pressure_sum / (float)ALT_EST_BARO_INIT_CNT;
+		baro_time_last = time_ms;
+
+		alt = vel = 0.0f;
+		accel_bias = (accel_cnt > 0) ? accel_sum / (float)accel_cnt : 0.0f;
+		bound_float(&accel_bias, ALT_EST_BIAS_MAX, -ALT_EST_BIAS_MAX);
+
+		alt_est_history_newest = 0;
+		alt_est_history_cnt = 1;
+		alt_est_history[0].time = time_ms;
+		alt_est_history[0].alt = 0.0f;
+
+		alt_est_started = true;
+		alt_est_valid = true;
+		alt_est_publish();
+		return;
+	}
+
+	/* back from a timeout, the correction step is bounded by ALT_EST_BARO_DT_MAX */
+	alt_est_valid = true;
+
+	/* international standard atmosphere [cm] */
+	float baro_alt = 4433000.0f * (1.0f - powf(pressure / baro_pressure_ref, 0.190263f));
+
+	/* compare with the estimate of the sample time */
+	int age;
+	int index = alt_est_history_newest;
+	for(age = 0; age < alt_est_history_cnt - 1; age++) {
+		if(alt_est_history[index].time <= time_ms) {
+			break;
+		}
+		index = (index == 0) ? ALT_EST_HISTORY_SIZE - 1 : index - 1;
+	}
+
+	float error = baro_alt - alt_est_history[index].alt;
+
+	ground_effect = alt < ALT_EST_GROUND_EFFECT_HEIGHT;
+	if(ground_effect == true && error < 0.0f) {
+		error += ALT_EST_GROUND_EFFECT_DEADBAND;
+		if(error > 0.0f) error = 0.0f;
+	}
+
+	float dt = (time_ms - baro_time_last) * 0.001f;
+	bound_float(&dt, ALT_EST_BARO_DT_MAX, 0.0f);
+	baro_time_last = time_ms;
+
+	float alt_correction = ALT_EST_K1 * error * dt;
+	alt += alt_correction;
+	vel += ALT_EST_K2 * error * dt;
+	accel_bias -= ALT_EST_K3 * error * dt;
+	bound_float(&accel_bias, ALT_EST_BIAS_MAX, -ALT_EST_BIAS_MAX);
+
+	/* the stored estimates get the same correction, so the next sample
+	 * is not compared against the uncorrected past */
+	int i;
+	for(i = 0; i < alt_est_history_cnt; i++) {
+		alt_est_history[i].alt += alt_correction;
+	}
+
+	alt_est_publish();
+}
+
+void alt_est_read(alt_est_state_t *state)
+{
+	slot_read(&alt_est_slot, state);
+}
+
+void alt_est_set_source(int source)
+{
+	alt_source = source;
+}
+
+/* called by the attitude task, the takeoff reference is only renewed disarmed */
+void alt_est_set_armed(bool armed)
+{
+	alt_est_armed = armed;
+}
+
+/* replaces the barometric estimate by the optitrack one if selected */
+void alt_est_select_source(pos_kf_state_t *pos, alt_est_state_t *alt_state)
+{
+	if(alt_source == ALT_SOURCE_OPTITRACK ||
+	   (alt_source == ALT_SOURCE_AUTO && pos->valid == true)) {
+		alt_state->alt = pos->pos[2];
+		alt_state->vel = pos->vel[2];
+		alt_state->accel_bias = pos->accel_bias[2];
+		alt_state->ground_effect = false;
+		alt_state->valid = pos->valid;
+		alt_state->source = ALT_SOURCE_OPTITRACK;
+	}
+}
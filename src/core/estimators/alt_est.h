@@ -0,0 +1,33 @@
+#ifndef __ALT_EST_H__
+#define __ALT_EST_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pos_kf.h"
+
+#define ALT_EST_HISTORY_SIZE 32 //prediction steps kept for the barometer delay (80ms at 400Hz)
+
+/* altitude source of the altitude controller, can be changed in flight */
+#define ALT_SOURCE_AUTO 0      //optitrack while available, barometer otherwise
+#define ALT_SOURCE_OPTITRACK 1
+#define ALT_SOURCE_BARO 2
+
+typedef struct {
+	float alt;        //above the takeoff point [cm]
+	float vel;        //[cm/s]
+	float accel_bias; //vertical accelerometer bias [cm/s^2]
+	bool ground_effect;
+	bool valid;
+	int source;       //ALT_SOURCE_OPTITRACK or ALT_SOURCE_BARO
+} alt_est_state_t;
+
+void alt_est_init(void);
+void alt_est_predict(float accel_up, float dt, float time_ms);
+void alt_est_fuse_baro(float pressure, float time_ms);
+void alt_est_read(alt_est_state_t *state);
+
+void alt_est_set_source(int source);
+void alt_est_set_armed(bool armed);
+void alt_est_select_source(pos_kf_state_t *pos, alt_est_state_t *alt);
+
+#endif
@@ -0,0 +1,34 @@
+#include "arm_math.h"
+#include "fastmath.h"
+#include "biquad.h"
+
+/* check: http://www.musicdsp.org/files/Audio-EQ-Cookbook.txt */
+void biquad_notch_coeff(biquad_coeff_t *coeff, float center_freq, float sample_rate, float q)
+{
+	float omega = 2.0f * PI * center_freq / sample_rate;
+	float sin_omega, cos_omega;
+	fast_sincosf(omega, &sin_omega, &cos_omega);
+	float alpha = sin_omega / (2.0f * q);
+	float a0_inv = 1.0f / (1.0f + alpha);
+
+	coeff->b0 = a0_inv;
+	coeff->b1 = -2.0f * cos_omega * a0_inv;
+	coeff->b2 = a0_inv;
+	coeff->a1 = coeff->b1;
+	coeff->a2 = (1.0f - alpha) * a0_inv;
+}
+
+void biquad_bypass_coeff(biquad_coeff_t *coeff)
+{
+	coeff->b0 = 1.0f;
+	coeff->b1 = 0.0f;
+	coeff->b2 = 0.0f;
+	coeff->a1 = 0.0f;
+	coeff->a2 = 0.0f;
+}
+
+void biquad_reset(biquad_state_t *state)
+{
+	state->z1 = 0.0f;
+	state->z2 = 0.0f;
+}
@@ -0,0 +1,27 @@
+#ifndef __BIQUAD_H__
+#define __BIQUAD_H__
+
+/* coefficients are normalized with a0 = 1 */
+typedef struct {
+	float b0, b1, b2;
+	float a1, a2;
+} biquad_coeff_t;
+
+/* transposed direct form 2 delay elements */
+typedef struct {
+	float z1, z2;
+} biquad_state_t;
+
+void biquad_notch_coeff(biquad_coeff_t *coeff, float center_freq, float sample_rate, float q);
+void biquad_bypass_coeff(biquad_coeff_t *coeff);
+void biquad_reset(biquad_state_t *state);
+
+static inline float biquad_apply(biquad_coeff_t *coeff, biquad_state_t *state, float in)
+{
+	float out = coeff->b0 * in + state->z1;
+	state->z1 = coeff->b1 * in - coeff->a1 * out + state->z2;
+	state->z2 = coeff->b2 * in - coeff->a2 * out;
+	return out;
+}
+
+#endif
@@ -0,0 +1,59 @@
+#include "vector.h"
+#include "biquad.h"
+#include "dyn_notch.h"
+#include "ccm.h"
+
+dyn_notch_t dyn_notch CCM_HOT;
+
+void dyn_notch_init(float sample_rate)
+{
+	dyn_notch.sample_rate = sample_rate;
+	dyn_notch.retune_axis = 0;
+	dyn_notch.retune_notch = 0;
+
+	int axis, n;
+	for(axis = 0; axis < 3; axis++) {
+		for(n = 0; n < DYN_NOTCH_CNT; n++) {
+			dyn_notch.freq[axis][n] = 0.0f;
+			biquad_bypass_coeff(&dyn_notch.coeff[axis][n]);
+			biquad_reset(&dyn_notch.state[axis][n]);
+		}
+	}
+}
+
+/* called by the spectrum analysis task */
+void dyn_notch_set_freq(int axis, int notch, float freq)
+{
+	dyn_notch.freq[axis][notch] = freq;
+}
+
+/* run by the imu decoding. like the rpm filter, only one notch is retuned
+ * per sample and the coefficients are never touched while the bank runs */
+void dyn_notch_apply(vector3d_f_t *gyro)
+{
+	int axis = dyn_notch.retune_axis;
+	int n = dyn_notch.retune_notch;
+	float freq = dyn_notch.freq[axis][n];
+
+	if(freq == 0.0f) {
+		biquad_bypass_coeff(&dyn_notch.coeff[axis][n]);
+	} else {
+		biquad_notch_coeff(&dyn_notch.coeff[axis][n], freq, dyn_notch.sample_rate, DYN_NOTCH_Q);
+	}
+
+	if(++dyn_notch.retune_notch == DYN_NOTCH_CNT) {
+		dyn_notch.retune_notch = 0;
+		if(++dyn_notch.retune_axis == 3) {
+			dyn_notch.retune_axis = 0;
+		}
+	}
+
+	float *in[3] = {&gyro->x, &gyro->y, &gyro->z};
+	for(axis = 0; axis < 3; axis++) {
+		float x = *in[axis];
+		for(n = 0; n < DYN_NOTCH_CNT; n++) {
+			x = biquad_apply(&dyn_notch.coeff[axis][n], &dyn_notch.state[axis][n], x);
+		}
+		*in[axis] = x;
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef __DYN_NOTCH_H__
+#define __DYN_NOTCH_H__
+
+#include "vector.h"
+#include "biquad.h"
+#include "gyro_fft.h"
+
+#define DYN_NOTCH_CNT GYRO_FFT_PEAK_CNT //notches per axis
+#define DYN_NOTCH_Q 3.0f
+
+/* notch filters on the gyro placed at the noise peaks found by the
+ * spectrum analyzer, every axis has its own center frequencies */
+typedef struct {
+	biquad_coeff_t coeff[3][DYN_NOTCH_CNT];
+	biquad_state_t state[3][DYN_NOTCH_CNT];
+	volatile float freq[3][DYN_NOTCH_CNT]; //0 bypasses the notch [Hz]
+	float sample_rate;
+	int retune_axis;
+	int retune_notch;
+} dyn_notch_t;
+
+void dyn_notch_init(float sample_rate);
+void dyn_notch_set_freq(int axis, int notch, float freq);
+void dyn_notch_apply(vector3d_f_t *gyro);
+
+#endif
@@ -0,0 +1,222 @@
+#include <stdbool.h>
+#include <math.h>
+#include "arm_math.h"
+#include "vector.h"
+#include "gyro_fft.h"
+#include "profiler.h"
+
+#if (GYRO_FFT_LEN & (GYRO_FFT_LEN - 1)) != 0
+#error "GYRO_FFT_LEN has to be a power of two"
+#endif
+
+gyro_fft_t gyro_fft;
+
+profiler_t gyro_fft_profiler; //execution time of one axis analysis
+
+void gyro_fft_init(float imu_sample_rate)
+{
+	gyro_fft.head = 0;
+	gyro_fft.decim_cnt = 0;
+	gyro_fft.sample_rate = imu_sample_rate / (float)GYRO_FFT_DECIMATION;
+	gyro_fft.bin_freq = gyro_fft.sample_rate / (float)GYRO_FFT_LEN;
+
+	arm_rfft_fast_init_f32(&gyro_fft.rfft, GYRO_FFT_LEN);
+
+	int i, axis;
+	for(i = 0; i < GYRO_FFT_LEN; i++) {
+		gyro_fft.window[i] = 0.5f - 0.5f * cosf(2.0f * PI * (float)i / (float)GYRO_FFT_LEN);
+	}
+
+	for(axis = 0; axis < 3; axis++) {
+		gyro_fft.decim_sum[axis] = 0.0f;
+		for(i = 0; i < GYRO_FFT_LEN; i++) {
+			gyro_fft.buf[axis][i] = 0.0f;
+		}
+		for(i = 0; i < GYRO_FFT_BIN_CNT; i++) {
+			gyro_fft.spectrum[axis][i] = 0.0f;
+		}
+		for(i = 0; i < GYRO_FFT_PEAK_CNT; i++) {
+			gyro_fft.peak_freq[axis][i] = 0.0f;
+			gyro_fft.peak_miss[axis][i] = 0;
+		}
+	}
+}
+
+/* called by the imu decoding with every sample, the average over the
+ * decimation is the anti-aliasing filter */
+void gyro_fft_push(vector3d_f_t *gyro)
+{
+	gyro_fft.decim_sum[0] += gyro->x;
+	gyro_fft.decim_sum[1] += gyro->y;
+	gyro_fft.decim_sum[2] += gyro->z;
+
+	if(++gyro_fft.decim_cnt < GYRO_FFT_DECIMATION) {
+		return;
+	}
+
+	const float scale = 1.0f / (float)GYRO_FFT_DECIMATION;
+
+	int head = gyro_fft.head;
+	int axis;
+	for(axis = 0; axis < 3; axis++) {
+		gyro_fft.buf[axis][head] = gyro_fft.decim_sum[axis] * scale;
+		gyro_fft.decim_sum[axis] = 0.0f;
+	}
+	gyro_fft.decim_cnt = 0;
+
+	gyro_fft.head = (head + 1) & (GYRO_FFT_LEN - 1);
+}
+
+/* median of the search band power. the bins of white noise are exponentially
+ * distributed, their median is ln(2) of the mean and the tones in the band
+ * barely move it, unlike the mean */
+static float gyro_fft_noise_floor(const float *power, int min_bin, int max_bin)
+{
+	float sorted[GYRO_FFT_BIN_CNT];
+	int cnt = max_bin - min_bin + 1;
+	int i, j;
+
+	/* insertion sort, the bins of a noisy spectrum are in random order */
+	for(i = 0; i < cnt; i++) {
+		float p = power[min_bin + i];
+		for(j = i; j > 0 && sorted[j - 1] > p; j--) {
+			sorted[j] = sorted[j - 1];
+		}
+		sorted[j] = p;
+	}
+
+	return sorted[cnt / 2] * (1.0f / 0.693147f);
+}
+
+/* the peak of a hann windowed sinusoid is about gaussian, a parabola through
+ * the logarithm of the three bins around it gives the fractional bin */
+static float gyro_fft_interpolate(float *power, int bin)
+{
+	float l = logf(power[bin - 1] + 1e-12f);
+	float c = logf(power[bin] + 1e-12f);
+	float r = logf(power[bin + 1] + 1e-12f);
+
+	float denominator = l - 2.0f * c + r;
+	float delta = (denominator < 0.0f) ? 0.5f * (l - r) / denominator : 0.0f;
+
+	return ((float)bin + delta) * gyro_fft.bin_freq;
+}
+
+/* every tracked peak follows the closest new peak, the remaining new peaks
+ * take the free slots. a peak is dropped after missing several analyses */
+static void gyro_fft_track(int axis, float *found, int found_cnt)
+{
+	float *tracked = gyro_fft.peak_freq[axis];
+	int *miss = gyro_fft.peak_miss[axis];
+	bool used[GYRO_FFT_PEAK_CNT] = {false};
+
+	int i, j;
+	for(i = 0; i < GYRO_FFT_PEAK_CNT; i++) {
+		if(tracked[i] == 0.0f) {
+			continue;
+		}
+
+		int closest = -1;
+		for(j = 0; j < found_cnt; j++) {
+			if(used[j] == false && (closest < 0 ||
+			    fabsf(found[j] - tracked[i]) < fabsf(found[closest] - tracked[i]))) {
+				closest = j;
+			}
+		}
+
+		if(closest >= 0) {
+			used[closest] = true;
+			tracked[i] += GYRO_FFT_FREQ_SMOOTH * (found[closest] - tracked[i]);
+			miss[i] = 0;
+		} else if(++miss[i] > GYRO_FFT_PEAK_HOLD) {
+			tracked[i] = 0.0f;
+		}
+	}
+
+	for(j = 0; j < found_cnt; j++) {
+		if(used[j] == true) {
+			continue;
+		}
+		for(i = 0; i < GYRO_FFT_PEAK_CNT; i++) {
+			if(tracked[i] == 0.0f) {
+				tracked[i] = found[j];
+				miss[i] = 0;
+				break;
+			}
+		}
+	}
+}
+
+/* called by the background task, transforms the window of one axis and
+ * updates its tracked peaks */
+void gyro_fft_analyze(int axis)
+{
+	profiler_start(&gyro_fft_profiler);
+
+	/* oldest to newest. a sample the imu decoding writes during the copy
+	 * lands at the start of the window where the hann window is ~0 */
+	int head = gyro_fft.head;
+	int i;
+	for(i = 0; i < GYRO_FFT_LEN; i++) {
+		gyro_fft.work[i] = gyro_fft.buf[axis][(head + i) & (GYRO_FFT_LEN - 1)] * gyro_fft.window[i];
+	}
+
+	arm_rfft_fast_f32(&gyro_fft.rfft, gyro_fft.work, gyro_fft.out, 0);
+
+	/* out[0] and out[1] are the real dc and nyquist bins */
+	float *power = gyro_fft.spectrum[axis];
+	arm_cmplx_mag_squared_f32(gyro_fft.out, power, GYRO_FFT_BIN_CNT);
+	power[0] = gyro_fft.out[0] * gyro_fft.out[0];
+
+	int min_bin = (int)(GYRO_FFT_MIN_FREQ / gyro_fft.bin_freq) + 1;
+	int max_bin = (int)(GYRO_FFT_MAX_FREQ / gyro_fft.bin_freq);
+	if(max_bin > GYRO_FFT_BIN_CNT - 2) {
+		max_bin = GYRO_FFT_BIN_CNT - 2;
+	}
+
+	float threshold = GYRO_FFT_PEAK_SNR * gyro_fft_noise_floor(power, min_bin, max_bin);
+
+	/* strongest local maxima above the noise floor, descending */
+	int peak_bin[GYRO_FFT_PEAK_CNT];
+	int peak_cnt = 0;
+	for(i = min_bin; i <= max_bin; i++) {
+		if(power[i] <= threshold || power[i] <= power[i - 1] || power[i] < power[i + 1]) {
+			continue;
+		}
+
+		int j = (peak_cnt < GYRO_FFT_PEAK_CNT) ? peak_cnt++ : GYRO_FFT_PEAK_CNT;
+		while(j > 0 && power[peak_bin[j - 1]] < power[i]) {
+			if(j < GYRO_FFT_PEAK_CNT) {
+				peak_bin[j] = peak_bin[j - 1];
+			}
+			j--;
+		}
+		if(j < GYRO_FFT_PEAK_CNT) {
+			peak_bin[j] = i;
+		}
+	}
+
+	float found[GYRO_FFT_PEAK_CNT];
+	for(i = 0; i < peak_cnt; i++) {
+		found[i] = gyro_fft_interpolate(power, peak_bin[i]);
+	}
+	gyro_fft_track(axis, found, peak_cnt);
+
+	profiler_stop(&gyro_fft_profiler);
+}
+
+float gyro_fft_get_peak_freq(int axis, int peak)
+{
+	return gyro_fft.peak_freq[axis][peak];
+}
+
+float gyro_fft_get_bin_freq(void)
+{
+	return gyro_fft.bin_freq;
+}
+
+/* power of the latest analysis, GYRO_FFT_BIN_CNT bins */
+float *gyro_fft_get_spectrum(int axis)
+{
+	return gyro_fft.spectrum[axis];
+}
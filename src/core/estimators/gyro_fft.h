@@ -0,0 +1,45 @@
+#ifndef __GYRO_FFT_H__
+#define __GYRO_FFT_H__
+
+#include "arm_math.h"
+#include "vector.h"
+
+#define GYRO_FFT_DECIMATION 4  //averaged imu samples per analyzed sample (8kHz to 2kHz)
+#define GYRO_FFT_LEN 256       //7.8Hz bins, 128ms window at 2kHz
+#define GYRO_FFT_BIN_CNT (GYRO_FFT_LEN / 2)
+#define GYRO_FFT_PEAK_CNT 2    //tracked peaks per axis
+#define GYRO_FFT_MIN_FREQ 80.0f  //[Hz], above the control bandwidth
+#define GYRO_FFT_MAX_FREQ 600.0f //[Hz]
+#define GYRO_FFT_PEAK_SNR 12.0f  //minimum peak to noise floor power ratio, ~66 * exp(-12) false peaks per analysis on white noise
+#define GYRO_FFT_FREQ_SMOOTH 0.3f //low pass weight of a new peak frequency
+#define GYRO_FFT_PEAK_HOLD 3      //analyses without the peak before it is dropped
+
+/* sliding window spectrum analyzer of the gyro. the imu decoding pushes
+ * every sample, the analysis runs in a background task and transforms one
+ * axis per call */
+typedef struct {
+	float buf[3][GYRO_FFT_LEN]; //circular window of the decimated samples
+	volatile int head;          //next write position
+	float decim_sum[3];
+	int decim_cnt;
+	float sample_rate;          //after the decimation [Hz]
+	float bin_freq;             //[Hz]
+
+	arm_rfft_fast_instance_f32 rfft;
+	float window[GYRO_FFT_LEN]; //hann
+	float work[GYRO_FFT_LEN];
+	float out[GYRO_FFT_LEN];
+
+	float spectrum[3][GYRO_FFT_BIN_CNT]; //power of the latest analysis
+	float peak_freq[3][GYRO_FFT_PEAK_CNT]; //ascending, 0 if not tracked [Hz]
+	int peak_miss[3][GYRO_FFT_PEAK_CNT];
+} gyro_fft_t;
+
+void gyro_fft_init(float imu_sample_rate);
+void gyro_fft_push(vector3d_f_t *gyro);
+void gyro_fft_analyze(int axis);
+float gyro_fft_get_peak_freq(int axis, int peak);
+float gyro_fft_get_bin_freq(void);
+float *gyro_fft_get_spectrum(int axis);
+
+#endif
@@ -0,0 +1,115 @@
+#include <stdbool.h>
+#include <string.h>
+#include "vector.h"
+#include "imu_preint.h"
+
+/* check: savage, "strapdown inertial navigation integration algorithm
+ * design part 1 and 2", j. guidance control and dynamics, 1998 */
+
+static inline void cross_add(vector3d_f_t *result, vector3d_f_t *a, vector3d_f_t *b, float scale)
+{
+	result->x += scale * (a->y * b->z - a->z * b->y);
+	result->y += scale * (a->z * b->x - a->x * b->z);
+	result->z += scale * (a->x * b->y - a->y * b->x);
+}
+
+static void imu_preint_reset(imu_preint_t *preint)
+{
+	memset(&preint->alpha, 0, sizeof(vector3d_f_t));
+	memset(&preint->beta, 0, sizeof(vector3d_f_t));
+	memset(&preint->nu, 0, sizeof(vector3d_f_t));
+	memset(&preint->sculling, 0, sizeof(vector3d_f_t));
+	preint->dt = 0.0f;
+}
+
+void imu_preint_init(imu_preint_t *preint)
+{
+	imu_preint_reset(preint);
+	memset(&preint->delta_angle_last, 0, sizeof(vector3d_f_t));
+	memset(&preint->delta_velocity_last, 0, sizeof(vector3d_f_t));
+	preint->initialized = false;
+}
+
+/* called with every imu sample */
+void imu_preint_add(imu_preint_t *preint, vector3d_f_t *gyro, vector3d_f_t *accel, float dt)
+{
+	if(preint->initialized == false) {
+		preint->gyro_last = *gyro;
+		preint->accel_last = *accel;
+		preint->initialized = true;
+	}
+
+	/* trapezoidal increments of this sample */
+	float half_dt = 0.5f * dt;
+	vector3d_f_t d_angle = {
+		.x = (preint->gyro_last.x + gyro->x) * half_dt,
+		.y = (preint->gyro_last.y + gyro->y) * half_dt,
+		.z = (preint->gyro_last.z + gyro->z) * half_dt
+	};
+	vector3d_f_t d_vel = {
+		.x = (preint->accel_last.x + accel->x) * half_dt,
+		.y = (preint->accel_last.y + accel->y) * half_dt,
+		.z = (preint->accel_last.z + accel->z) * half_dt
+	};
+
+	/* coning: beta += 1/2 * (alpha + 1/6 * d_angle_last) x d_angle */
+	vector3d_f_t alpha_coning = {
+		.x = preint->alpha.x + preint->delta_angle_last.x * (1.0f / 6.0f),
+		.y = preint->alpha.y + preint->delta_angle_last.y * (1.0f / 6.0f),
+		.z = preint->alpha.z + preint->delta_angle_last.z * (1.0f / 6.0f)
+	};
+	cross_add(&preint->beta, &alpha_coning, &d_angle, 0.5f);
+
+	/* sculling: 1/2 * ((alpha + 1/6 * d_angle_last) x d_vel + (nu + 1/6 * d_vel_last) x d_angle) */
+	vector3d_f_t nu_sculling = {
+		.x = preint->nu.x + preint->delta_velocity_last.x * (1.0f / 6.0f),
+		.y = preint->nu.y + preint->delta_velocity_last.y * (1.0f / 6.0f),
+		.z = preint->nu.z + preint->delta_velocity_last.z * (1.0f / 6.0f)
+	};
+	cross_add(&preint->sculling, &alpha_coning, &d_vel, 0.5f);
+	cross_add(&preint->sculling, &nu_sculling, &d_angle, 0.5f);
+
+	preint->alpha.x += d_angle.x;
+	preint->alpha.y += d_angle.y;
+	preint->alpha.z += d_angle.z;
+	preint->nu.x += d_vel.x;
+	preint->nu.y += d_vel.y;
+	preint->nu.z += d_vel.z;
+	preint->dt += dt;
+
+	preint->gyro_last = *gyro;
+	preint->accel_last = *accel;
+	preint->delta_angle_last = d_angle;
+	preint->delta_velocity_last = d_vel;
+}
+
+/* hand the integrated period over to the estimator and start the next one,
+ * returns false if no sample was integrated since the last call */
+bool imu_preint_take(imu_preint_t *preint, imu_delta_t *delta)
+{
+	if(preint->dt <= 0.0f) {
+		return false;
+	}
+
+	delta->delta_angle.x = preint->alpha.x + preint->beta.x;
+	delta->delta_angle.y = preint->alpha.y + preint->beta.y;
+	delta->delta_angle.z = preint->alpha.z + preint->beta.z;
+
+	/* rotation compensation 1/2 * alpha x nu + 1/6 * alpha x (alpha x nu), plus
+	 * sculling. the third order term is the same size as the sculling residual
+	 * at the coning rates of a multirotor */
+	delta->delta_velocity.x = preint->nu.x + preint->sculling.x;
+	delta->delta_velocity.y = preint->nu.y + preint->sculling.y;
+	delta->delta_velocity.z = preint->nu.z + preint->sculling.z;
+
+	vector3d_f_t alpha_nu = {0.0f, 0.0f, 0.0f};
+	cross_add(&alpha_nu, &preint->alpha, &preint->nu, 1.0f);
+	cross_add(&delta->delta_velocity, &preint->alpha, &alpha_nu, 1.0f / 6.0f);
+	cross_add(&delta->delta_velocity, &preint->alpha, &preint->nu, 0.5f);
+
+	delta->dt = preint->dt;
+
+	imu_preint_reset(preint);
+
+	return true;
+}
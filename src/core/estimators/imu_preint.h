@@ -0,0 +1,35 @@
+#ifndef __IMU_PREINT_H__
+#define __IMU_PREINT_H__
+
+#include <stdbool.h>
+#include "vector.h"
+
+/* imu samples integrated over one estimator period */
+typedef struct {
+	vector3d_f_t delta_angle;    //body frame rotation [rad]
+	vector3d_f_t delta_velocity; //body frame (start of the period) specific force integral [m/s]
+	vector3d_f_t accel_lpf;      //low pass filtered specific force at the end of the period [m/s^2]
+	float dt;                    //[s]
+} imu_delta_t;
+
+/* trapezoidal integration at the imu rate with coning (delta angle) and
+ * rotation + sculling (delta velocity) compensation */
+typedef struct {
+	vector3d_f_t alpha;     //delta angle sum [rad]
+	vector3d_f_t beta;      //coning correction [rad]
+	vector3d_f_t nu;        //delta velocity sum [m/s]
+	vector3d_f_t sculling;  //sculling correction [m/s]
+	float dt;               //[s]
+
+	vector3d_f_t gyro_last;           //[rad/s]
+	vector3d_f_t accel_last;          //[m/s^2]
+	vector3d_f_t delta_angle_last;    //delta angle of the last sample [rad]
+	vector3d_f_t delta_velocity_last; //delta velocity of the last sample [m/s]
+	bool initialized;
+} imu_preint_t;
+
+void imu_preint_init(imu_preint_t *preint);
+void imu_preint_add(imu_preint_t *preint, vector3d_f_t *gyro, vector3d_f_t *accel, float dt);
+bool imu_preint_take(imu_preint_t *preint, imu_delta_t *delta);
+
+#endif
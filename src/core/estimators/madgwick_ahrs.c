@@ -1,11 +1,11 @@
 #include "madgwick_ahrs.h"
 #include "arm_math.h"
+#include "fastmath.h"
+#include "profiler.h"
 //#include "geometry_ctl.h"
 
-inline void LPF_float(float *raw, float *filtered, float alpha)
-{
-	*filtered = (1.0f - alpha) * (*filtered) + alpha *((*raw));
-}
+profiler_t madgwick_imu_profiler;  //execution time of the imu update
+profiler_t madgwick_marg_profiler; //execution time of the marg update (new magnetometer sample)
 
 void madgwick_init(madgwick_t* madgwick, float sample_rate, float beta)
 {
@@ -19,182 +19,179 @@ void madgwick_init(madgwick_t* madgwick, float sample_rate, float beta)
 
 void MadgwickcalculateAngles(madgwick_t* Madgwick)
 {
-	Madgwick->Roll_rad = (float) atan2(Madgwick->q0 * Madgwick->q1 + Madgwick->q2 * Madgwick->q3, 0.5f - Madgwick->q1 * Madgwick->q1 - Madgwick->q2 * Madgwick->q2);
-	Madgwick->Pitch_rad = (float) asin(-2.0f * (Madgwick->q1 * Madgwick->q3 - Madgwick->q0 * Madgwick->q2));
+	Madgwick->Roll_rad = fast_atan2f(Madgwick->q0 * Madgwick->q1 + Madgwick->q2 * Madgwick->q3, 0.5f - Madgwick->q1 * Madgwick->q1 - Madgwick->q2 * Madgwick->q2);
+	Madgwick->Pitch_rad = fast_asinf(-2.0f * (Madgwick->q1 * Madgwick->q3 - Madgwick->q0 * Madgwick->q2));
+	Madgwick->Yaw_rad = fast_atan2f(Madgwick->q1 * Madgwick->q2 + Madgwick->q0 * Madgwick->q3, 0.5f - Madgwick->q2 * Madgwick->q2 - Madgwick->q3 * Madgwick->q3);
 
 	Madgwick->Roll = Madgwick->Roll_rad*Madgwick_RAD2DEG(1);
 	Madgwick->Pitch = Madgwick->Pitch_rad*Madgwick_RAD2DEG(1);
+	Madgwick->Yaw = Madgwick->Yaw_rad*Madgwick_RAD2DEG(1);
+}
+
+/* q = q + (q_dot - beta * g / |g|) * dt, then renormalize */
+static void madgwick_feedback(madgwick_t* Madgwick, float *q_dot, float g0, float g1, float g2, float g3)
+{
+	float g_sq = g0*g0 + g1*g1 + g2*g2 + g3*g3;
+	if(g_sq > 0.0f) {
+		float beta_norm = Madgwick->beta * fast_invsqrtf(g_sq);
+		q_dot[0] -= beta_norm*g0;
+		q_dot[1] -= beta_norm*g1;
+		q_dot[2] -= beta_norm*g2;
+		q_dot[3] -= beta_norm*g3;
+	}
+
+	float q0 = Madgwick->q0 + q_dot[0]*Madgwick->sampleRate;
+	float q1 = Madgwick->q1 + q_dot[1]*Madgwick->sampleRate;
+	float q2 = Madgwick->q2 + q_dot[2]*Madgwick->sampleRate;
+	float q3 = Madgwick->q3 + q_dot[3]*Madgwick->sampleRate;
+
+	float q_norm = fast_invsqrtf(q0*q0 + q1*q1 + q2*q2 + q3*q3);
+	Madgwick->q0 = q0 * q_norm;
+	Madgwick->q1 = q1 * q_norm;
+	Madgwick->q2 = q2 * q_norm;
+	Madgwick->q3 = q3 * q_norm;
 }
 
 //Acceleometer unit : g
 //Gyroscope unit : rad/s
 void madgwick_imu_ahrs(madgwick_t* Madgwick, float ax, float ay, float az, float gx, float gy, float gz)
 {
-	float q0_dot = 0.5f*(-Madgwick->q1*gx - Madgwick->q2*gy - Madgwick->q3*gz);
-	float q1_dot = 0.5f*(Madgwick->q0*gx + Madgwick->q2*gz - Madgwick->q3*gy);
-	float q2_dot = 0.5f*(Madgwick->q0*gy - Madgwick->q1*gz + Madgwick->q3*gx);
-	float q3_dot = 0.5f*(Madgwick->q0*gz + Madgwick->q1*gy - Madgwick->q2*gx);
+	profiler_start(&madgwick_imu_profiler);
+
+	float q0 = Madgwick->q0;
+	float q1 = Madgwick->q1;
+	float q2 = Madgwick->q2;
+	float q3 = Madgwick->q3;
 
-	float accel_norm = 1 / (sqrt(ax*ax + ay*ay + az*az));
+	float q_dot[4];
+	q_dot[0] = 0.5f*(-q1*gx - q2*gy - q3*gz);
+	q_dot[1] = 0.5f*(q0*gx + q2*gz - q3*gy);
+	q_dot[2] = 0.5f*(q0*gy - q1*gz + q3*gx);
+	q_dot[3] = 0.5f*(q0*gz + q1*gy - q2*gx);
+
+	float accel_norm = fast_invsqrtf(ax*ax + ay*ay + az*az);
 	ax *= accel_norm;
 	ay *= accel_norm;
 	az *= accel_norm;
 
-	float _2q0 = 2.0f*Madgwick->q0;
-	float _2q1 = 2.0f*Madgwick->q1;
-	float _2q2 = 2.0f*Madgwick->q2;
-	float _2q3 = 2.0f*Madgwick->q3;
-	float _4q0 = 4.0f*Madgwick->q0;
-	float _4q1 = 4.0f*Madgwick->q1;
-	float _4q2 = 4.0f*Madgwick->q2;
-	float _4q3 = 4.0f*Madgwick->q3;
-	float q0q0 = Madgwick->q0*Madgwick->q0;
-	float q1q1 = Madgwick->q1*Madgwick->q1;
-	float q2q2 = Madgwick->q2*Madgwick->q2;
-	float q3q3 = Madgwick->q3*Madgwick->q3;
-	float q1q1_q2q2 = q1q1 + q2q2;
-
-	//Gradient decent algorithm corrective step
-	float g0 = _4q0*q1q1_q2q2 + _2q2*ax - _2q1*ay;
-	float g1 = _4q1*q1q1_q2q2 - _2q3*ax - _2q0*ay + _4q1*az;
-	float g2 = _4q2*q1q1_q2q2 + _2q0*ax - _2q3*ay + _4q2*az;
-	float g3 = _4q3*q1q1_q2q2 - _2q1*ax - _2q2*ay;
-
-	/* normalise step magnitude */
-	float g_norm = 1 / (sqrt(g0*g0 + g1*g1 + g2*g2 + g3*g3));
-	g0 *= g_norm;
-	g1 *= g_norm;
-	g2 *= g_norm;
-	g3 *= g_norm;
-
-	q0_dot -= Madgwick->beta*g0;
-	q1_dot -= Madgwick->beta*g1;
-	q2_dot -= Madgwick->beta*g2;
-	q3_dot -= Madgwick->beta*g3;
-
-	Madgwick->q0 += q0_dot*Madgwick->sampleRate;
-	Madgwick->q1 += q1_dot*Madgwick->sampleRate;
-	Madgwick->q2 += q2_dot*Madgwick->sampleRate;
-	Madgwick->q3 += q3_dot*Madgwick->sampleRate;
-
-	float q_norm = 1 / (sqrt(q0q0 + q1q1 + q2q2 + q3q3));
-	Madgwick->q0 *= q_norm;
-	Madgwick->q1 *= q_norm;
-	Madgwick->q2 *= q_norm;
-	Madgwick->q3 *= q_norm;
+	/* objective function: gravity predicted in the body frame minus the measurement */
+	float f0 = 2.0f*(q1*q3 - q0*q2) - ax;
+	float f1 = 2.0f*(q0*q1 + q2*q3) - ay;
+	float f2 = 1.0f - 2.0f*(q1*q1 + q2*q2) - az;
+
+	//Gradient decent algorithm corrective step, J' * f / 2
+	float g0 = q1*f1 - q2*f0;
+	float g1 = q3*f0 + q0*f1 - 2.0f*q1*f2;
+	float g2 = q3*f1 - q0*f0 - 2.0f*q2*f2;
+	float g3 = q1*f0 + q2*f1;
+
+	madgwick_feedback(Madgwick, q_dot, g0, g1, g2, g3);
 
 	MadgwickcalculateAngles(Madgwick);
+
+	profiler_stop(&madgwick_imu_profiler);
+}
+
+/* check: madgwick, "an efficient orientation filter for inertial and inertial/magnetic
+ * sensor arrays", 2010, equation (25) ~ (34). the objective function and the jacobian
+ * share the rotation matrix elements, the common factor 2 of the gradient is dropped
+ * since only its direction is used. a and m are normalized, the reference field b
+ * is computed from q and held constant in the jacobian */
+void madgwick_marg_gradient(const float *q, float ax, float ay, float az, float mx, float my, float mz, float *g)
+{
+	float q0 = q[0];
+	float q1 = q[1];
+	float q2 = q[2];
+	float q3 = q[3];
+
+	/* body to earth rotation matrix of the unit quaternion */
+	float q0q0 = q0*q0;
+	float q1q1 = q1*q1;
+	float q2q2 = q2*q2;
+	float q3q3 = q3*q3;
+	float q0q1 = q0*q1;
+	float q0q2 = q0*q2;
+	float q0q3 = q0*q3;
+	float q1q2 = q1*q2;
+	float q1q3 = q1*q3;
+	float q2q3 = q2*q3;
+	float r00 = q0q0 + q1q1 - q2q2 - q3q3;
+	float r01 = 2.0f*(q1q2 - q0q3);
+	float r02 = 2.0f*(q0q2 + q1q3);
+	float r10 = 2.0f*(q1q2 + q0q3);
+	float r11 = q0q0 - q1q1 + q2q2 - q3q3;
+	float r12 = 2.0f*(q2q3 - q0q1);
+	float r20 = 2.0f*(q1q3 - q0q2);
+	float r21 = 2.0f*(q0q1 + q2q3);
+	float r22 = q0q0 - q1q1 - q2q2 + q3q3;
+
+	/* Reference direction of Earth's magnetic field, b = [bx, 0, bz] */
+	float hx = r00*mx + r01*my + r02*mz;
+	float hy = r10*mx + r11*my + r12*mz;
+	float hxy_sq = hx*hx + hy*hy;
+	float bx = hxy_sq * fast_invsqrtf(hxy_sq);
+	float bz = r20*mx + r21*my + r22*mz;
+
+	/* objective function: gravity and reference field rotated into the body
+	 * frame (R' * e_z and R' * b) minus the measurements */
+	float f0 = r20 - ax;
+	float f1 = r21 - ay;
+	float f2 = r22 - az;
+	float f3 = bx*r00 + bz*r20 - mx;
+	float f4 = bx*r01 + bz*r21 - my;
+	float f5 = bx*r02 + bz*r22 - mz;
+
+	/* Gradient decent algorithm corrective step, J' * f / 2 */
+	float bx_f3 = bx*f3;
+	float bx_f4 = bx*f4;
+	float bx_f5 = bx*f5;
+	float s0 = f0 + bz*f3;
+	float s1 = f1 + bz*f4;
+	float s2 = f2 + bz*f5;
+	float s0_minus = bx_f5 - s0;
+	float s0_plus = bx_f5 + s0;
+
+	g[0] = q2*s0_minus + q1*s1 - q3*bx_f4;
+	g[1] = q3*s0_plus + q0*s1 + q2*bx_f4 - 2.0f*q1*s2;
+	g[2] = q0*s0_minus + q3*s1 + q1*bx_f4 - 2.0f*q2*(s2 + bx_f3);
+	g[3] = q1*s0_plus + q2*s1 - q0*bx_f4 - 2.0f*q3*bx_f3;
 }
 
 void Madgwick_MARG_AHRS(madgwick_t* Madgwick, float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz)
 {
-	if ((mx != 0.0f) || (my != 0.0f) || (mz != 0.0f)) {
-		float q0_dot = 0.5f*(-Madgwick->q1*gx - Madgwick->q2*gy - Madgwick->q3*gz);
-		float q1_dot = 0.5f*(Madgwick->q0*gx + Madgwick->q2*gz - Madgwick->q3*gy);
-		float q2_dot = 0.5f*(Madgwick->q0*gy - Madgwick->q1*gz + Madgwick->q3*gx);
-		float q3_dot = 0.5f*(Madgwick->q0*gz + Madgwick->q1*gy - Madgwick->q2*gx);
-
-		float accel_norm = 1 / (sqrt(ax*ax + ay*ay + az*az));
-		ax *= accel_norm;
-		ay *= accel_norm;
-		az *= accel_norm;
-
-		float mag_norm = 1 / (sqrt(mx*mx + my*my + mz*mz));
-		mx *= mag_norm;
-		my *= mag_norm;
-		mz *= mag_norm;
-
-		float _2q0mx = 2.0f * Madgwick->q0 * mx;
-		float _2q0my = 2.0f * Madgwick->q0 * my;
-		float _2q0mz = 2.0f * Madgwick->q0 * mz;
-		float _2q1mx = 2.0f * Madgwick->q1 * mx;
-		float _2q0 = 2.0f*Madgwick->q0;
-		float _2q1 = 2.0f*Madgwick->q1;
-		float _2q2 = 2.0f*Madgwick->q2;
-		float _2q3 = 2.0f*Madgwick->q3;
-		float _4q0 = 4.0f*Madgwick->q0;
-		float _4q1 = 4.0f*Madgwick->q1;
-		float _4q2 = 4.0f*Madgwick->q2;
-		float _4q3 = 4.0f*Madgwick->q3;
-		//float _2q0q2 = 2.0f * Madgwick->q0 * Madgwick->q2;
-		//float _2q2q3 = 2.0f * Madgwick->q2 * Madgwick->q3;
-		float q0q0 = Madgwick->q0 * Madgwick->q0;
-		float q0q1 = Madgwick->q0 * Madgwick->q1;
-		float q0q2 = Madgwick->q0 * Madgwick->q2;
-		float q0q3 = Madgwick->q0 * Madgwick->q3;
-		float q1q1 = Madgwick->q1 * Madgwick->q1;
-		float q1q2 = Madgwick->q1 * Madgwick->q2;
-		float q1q3 = Madgwick->q1 * Madgwick->q3;
-		float q2q2 = Madgwick->q2 * Madgwick->q2;
-		float q2q3 = Madgwick->q2 * Madgwick->q3;
-		float q3q3 = Madgwick->q3 * Madgwick->q3;
-		float q1q1_q2q2 = q1q1 + q2q2;
-
-		/* Reference direction of Earth's magnetic field */
-		float hx = mx * q0q0 - _2q0my * Madgwick->q3 + _2q0mz * Madgwick->q2 + mx * q1q1 + _2q1 * my * Madgwick->q2 + _2q1 * mz * Madgwick->q3 - mx * q2q2 - mx * q3q3;
-		float hy = _2q0mx * Madgwick->q3 + my * q0q0 - _2q0mz * Madgwick->q1 + _2q1mx * Madgwick->q2 - my * q1q1 + my * q2q2 + _2q2 * mz * Madgwick->q3 - my * q3q3;
-		float _2bx = (float) sqrt(hx * hx + hy * hy);
-		float _2bz = -_2q0mx * Madgwick->q2 + _2q0my * Madgwick->q1 + mz * q0q0 + _2q1mx * Madgwick->q3 - mz * q1q1 + _2q2 * my * Madgwick->q3 - mz * q2q2 + mz * q3q3;
-		float _4bx = 2.0f * _2bx;
-		float _4bz = 2.0f * _2bz;
-
-		/* Gradient decent algorithm corrective step */
-		float g0 = _4q0*q1q1_q2q2 + _2q2*ax - _2q1*ay - _2bz * Madgwick->q2 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * Madgwick->q3 + _2bz * Madgwick->q1) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * Madgwick->q2 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-		float g1 = _4q1*q1q1_q2q2 - _2q3*ax - _2q0*ay + _4q1*az + _2bz * Madgwick->q3 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * Madgwick->q2 + _2bz * Madgwick->q0) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * Madgwick->q3 - _4bz * Madgwick->q1) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-		float g2 = _4q2*q1q1_q2q2 + _2q0*ax - _2q3*ay + _4q2*az + (-_4bx * Madgwick->q2 - _2bz * Madgwick->q0) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * Madgwick->q1 + _2bz * Madgwick->q3) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * Madgwick->q0 - _4bz * Madgwick->q2) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-		float g3 = _4q3*q1q1_q2q2 - _2q1*ax - _2q2*ay + (-_4bx * Madgwick->q3 + _2bz * Madgwick->q1) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * Madgwick->q0 + _2bz * Madgwick->q2) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * Madgwick->q1 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-
-		/* normalise step magnitude */
-		float g_norm = 1 / (sqrt(g0*g0 + g1*g1 + g2*g2 + g3*g3));
-		g0 *= g_norm;
-		g1 *= g_norm;
-		g2 *= g_norm;
-		g3 *= g_norm;
-
-		q0_dot -= Madgwick->beta*g0;
-		q1_dot -= Madgwick->beta*g1;
-		q2_dot -= Madgwick->beta*g2;
-		q3_dot -= Madgwick->beta*g3;
-
-		/* Apply feedback step */
-		Madgwick->q0 += q0_dot*Madgwick->sampleRate;
-		Madgwick->q1 += q1_dot*Madgwick->sampleRate;
-		Madgwick->q2 += q2_dot*Madgwick->sampleRate;
-		Madgwick->q3 += q3_dot*Madgwick->sampleRate;
-
-		float q_norm = 1 / (sqrt(q0q0 + q1q1 + q2q2 + q3q3));
-		Madgwick->q0 *= q_norm;
-		Madgwick->q1 *= q_norm;
-		Madgwick->q2 *= q_norm;
-		Madgwick->q3 *= q_norm;
-	} else {
+	if((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
 		/* Update IMU algorithm */
 		madgwick_imu_ahrs(Madgwick, ax, ay, az, gx, gy, gz);
+		return;
 	}
-	/* Calculate new angles */
-	MadgwickcalculateAngles(Madgwick);
-}
 
-void heading_Madgwick(madgwick_t* MadgwickIMU, MPU9250_t *MPU9250)
-{
-	float MagX_rotated=0.0f,MagY_rotated=0.0f;//,MagZ_rotated=0.0f;
+	profiler_start(&madgwick_marg_profiler);
+
+	float q[4] = {Madgwick->q0, Madgwick->q1, Madgwick->q2, Madgwick->q3};
 
-	float C_roll = arm_cos_f32(-MadgwickIMU->Roll_rad);
-	float S_roll = arm_sin_f32(-MadgwickIMU->Roll_rad);
+	float q_dot[4];
+	q_dot[0] = 0.5f*(-q[1]*gx - q[2]*gy - q[3]*gz);
+	q_dot[1] = 0.5f*(q[0]*gx + q[2]*gz - q[3]*gy);
+	q_dot[2] = 0.5f*(q[0]*gy - q[1]*gz + q[3]*gx);
+	q_dot[3] = 0.5f*(q[0]*gz + q[1]*gy - q[2]*gx);
 
-	float C_pitch = arm_cos_f32(-MadgwickIMU->Pitch_rad);
-	float S_pitch = arm_sin_f32(-MadgwickIMU->Pitch_rad);
+	float accel_norm = fast_invsqrtf(ax*ax + ay*ay + az*az);
+	ax *= accel_norm;
+	ay *= accel_norm;
+	az *= accel_norm;
 
-	MagX_rotated = MPU9250->Mx*(C_pitch)+MPU9250->My*(S_roll)*(S_pitch)-MPU9250->Mz*(C_roll)*(S_pitch);
-	MagY_rotated = MPU9250->My*(C_roll)+MPU9250->Mz*(S_roll);
+	float mag_norm = fast_invsqrtf(mx*mx + my*my + mz*mz);
+	mx *= mag_norm;
+	my *= mag_norm;
+	mz *= mag_norm;
 
-	MadgwickIMU->Yaw_rad = atan2f(MagY_rotated,MagX_rotated);
-	LPF_float(&MadgwickIMU->Yaw_rad, &MadgwickIMU->Yaw_rad_filtered, 0.018);
+	float g[4];
+	madgwick_marg_gradient(q, ax, ay, az, mx, my, mz, g);
 
-	MadgwickIMU->Yaw_filtered = MadgwickIMU->Yaw_rad_filtered*57.32484076433121f;
-	MadgwickIMU->Yaw = MadgwickIMU->Yaw_filtered;
+	madgwick_feedback(Madgwick, q_dot, g[0], g[1], g[2], g[3]);
 
-	//MadgwickIMU->Yaw_filtered = lowpass_float(&MadgwickIMU->Yaw_filtered, &MadgwickIMU->Yaw, 0.015);
-	//printf("%f\n", MadgwickIMU->Yaw_filtered);
-}
+	/* Calculate new angles */
+	MadgwickcalculateAngles(Madgwick);
 
+	profiler_stop(&madgwick_marg_profiler);
+}
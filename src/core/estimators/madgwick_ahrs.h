@@ -7,28 +7,6 @@
 #define Madgwick_RAD2DEG(x) ((x) * 57.2957795f)
 #define Madgwick_DEG2RAD(x) ((x) * 0.0174532925f)
 
-typedef struct {
-	float Ax, Ay, Az;
-	float Gx, Gy, Gz;
-	float Mx, My, Mz;
-	int16_t Ax_Raw, Ay_Raw, Az_Raw;
-	int16_t Gx_Raw, Gy_Raw, Gz_Raw;
-	int16_t Mx_Raw, My_Raw, Mz_Raw;
-
-	float AMult, GMult, MMult;
-	float magCalibrationX, magCalibrationY, magCalibrationZ;
-	float mx, my, mz;
-	float magbias[3];
-	float accele_local[3];
-	float gyro_local[3];
-	float filtered_mx, filtered_my, filtered_mz;
-	float magscale[3];
-	float mag_avg_rad;
-
-	uint8_t I2C_Addr;
-	uint8_t I2C_Addr_Mag;
-} MPU9250_t;
-
 typedef struct _madgwick_t {
 	float Roll, Roll_rad;
 	float Pitch, Pitch_rad;
@@ -48,8 +26,10 @@ void MadgwickcalculateAngles(madgwick_t* Madgwick);
 //Acceleometer unit : g
 //Gyroscope unit : rad/s
 void madgwick_imu_ahrs(madgwick_t* Madgwick, float ax, float ay, float az, float gx, float gy, float gz);
+//a and m normalized, g = J' * f / 2 of the marg objective function
+void madgwick_marg_gradient(const float *q, float ax, float ay, float az, float mx, float my, float mz, float *g);
+//Magnetometer unit : arbitrary, same axes as the accelerometer
 void Madgwick_MARG_AHRS(madgwick_t* Madgwick, float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz);
-void heading_Madgwick(madgwick_t* MadgwickIMU, MPU9250_t *MPU9250);
 
 #endif
 
@@ -1,13 +1,62 @@
-#include "arm_math.h"
+#include <math.h>
 #include "navigation.h"
 
-#define EARTH_RADIUS 6371 //[km]
+/* wgs-84 ellipsoid */
+#define WGS84_A 6378137.0f          //semi-major axis [m]
+#define WGS84_E2 6.69437999014e-3f  //first eccentricity squared
 
-void latitude_longitude_to_cartesian(float latitude, float longitude, float *x, float *y)
+#define DEG_E7_TO_RAD 1.745329252e-9f //1e-7 deg to rad
+
+void nav_set_home(nav_home_t *home, int32_t latitude, int32_t longitude, float altitude)
 {
-	/* haversine formula, the error is ~0.5% (by assuming earth is spherical symmetry),
-	 * can be improved by using vincenty formula if necessary */
-	*x = EARTH_RADIUS * arm_cos_f32(latitude) * arm_cos_f32(longitude);
-	*y = EARTH_RADIUS * arm_cos_f32(latitude) * arm_sin_f32(longitude);
-	//*z = EARTH_RADIUS * arm_sin_f32(latitude);
+	float lat = (float)latitude * DEG_E7_TO_RAD;
+	float sin_lat = sinf(lat);
+	float cos_lat = cosf(lat);
+
+	/* radii of curvature at the reference latitude */
+	float w2 = 1.0f - WGS84_E2 * sin_lat * sin_lat;
+	float w = sqrtf(w2);
+	float r_n = WGS84_A / w;                            //prime vertical
+	float r_m = WGS84_A * (1.0f - WGS84_E2) / (w2 * w); //meridian
+
+	home->latitude = latitude;
+	home->longitude = longitude;
+	home->altitude = altitude;
+
+	home->north_per_lat = (r_m + altitude) * DEG_E7_TO_RAD;
+	home->east_per_lon = (r_n + altitude) * cos_lat * DEG_E7_TO_RAD;
+	home->east_lat_gain = -(sin_lat / cos_lat) * DEG_E7_TO_RAD;
+	home->north_east2_gain = (sin_lat / cos_lat) / (2.0f * r_n);
+	home->inv_2r = 0.5f / sqrtf(r_m * r_n);
+
+	home->valid = true;
+}
+
+/*
+ * the position difference is taken in integer before converting to float,
+ * so the float only holds the small offset from home and keeps centimeter
+ * resolution, which is lost if the absolute coordinates are used.
+ */
+void nav_geodetic_to_ned(nav_home_t *home, int32_t latitude, int32_t longitude, float altitude,
+                         float *ned)
+{
+	int64_t d_lon_e7 = (int64_t)longitude - home->longitude;
+	if(d_lon_e7 > 1800000000) {
+		d_lon_e7 -= 3600000000; //crossing the antimeridian
+	} else if(d_lon_e7 < -1800000000) {
+		d_lon_e7 += 3600000000;
+	}
+
+	float d_lat = (float)(latitude - home->latitude);
+	float d_lon = (float)d_lon_e7;
+
+	/* cos(latitude) is linearized around the reference latitude */
+	float east = d_lon * home->east_per_lon * (1.0f + home->east_lat_gain * d_lat);
+	/* parallels curve toward the pole on the tangent plane */
+	float north = d_lat * home->north_per_lat + east * east * home->north_east2_gain;
+
+	ned[0] = north;
+	ned[1] = east;
+	/* the ellipsoid falls below the tangent plane with the distance */
+	ned[2] = (home->altitude - altitude) + (north * north + east * east) * home->inv_2r;
 }
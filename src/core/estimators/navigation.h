@@ -1,6 +1,28 @@
 #ifndef __NAVIGATION_H__
 #define __NAVIGATION_H__
 
-void latitude_longitude_to_cartesian(float latitude, float longitude, float *x, float *y);
+#include <stdint.h>
+#include <stdbool.h>
+
+/* local tangent plane (ned) reference point, everything depending on the
+ * reference latitude is computed once when the home is set. the conversion
+ * error against wgs-84 is below 1cm within 2km and 3cm within 5km */
+typedef struct {
+	int32_t latitude;  //[1e-7 deg]
+	int32_t longitude; //[1e-7 deg]
+	float altitude;    //[m]
+
+	float north_per_lat;   //meridian arc length of 1e-7 deg latitude [m]
+	float east_per_lon;    //parallel arc length of 1e-7 deg longitude [m]
+	float east_lat_gain;   //first order change of east_per_lon with latitude [1/(1e-7 deg)]
+	float north_east2_gain; //meridian convergence, north offset of a parallel [1/m]
+	float inv_2r;          //1 / (2 * gaussian radius), curvature drop of the plane [1/m]
+
+	bool valid;
+} nav_home_t;
+
+void nav_set_home(nav_home_t *home, int32_t latitude, int32_t longitude, float altitude);
+void nav_geodetic_to_ned(nav_home_t *home, int32_t latitude, int32_t longitude, float altitude,
+                         float *ned);
 
 #endif
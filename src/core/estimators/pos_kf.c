@@ -0,0 +1,243 @@
+#include <string.h>
+#include "pos_kf.h"
+#include "slot.h"
+#include "ccm.h"
+
+/* translational kalman filter, every axis is estimated separately:
+ * x = [position; velocity; accelerometer bias], the world frame acceleration
+ * is the input of the prediction and the position is measured */
+
+#define POS_KF_ACCEL_NOISE 50.0f     //acceleration of a prediction step (vibration included) [cm/s^2]
+#define POS_KF_BIAS_WALK 5.0f        //accelerometer bias random walk [cm/s^2/sqrt(s)]
+#define POS_KF_VEL_INIT 100.0f       //initial velocity uncertainty [cm/s]
+#define POS_KF_BIAS_INIT 50.0f       //initial accelerometer bias uncertainty [cm/s^2]
+#define POS_KF_GATE 25.0f            //normalized innovation squared, 5 sigma
+#define POS_KF_REJECT_RESET_CNT 10   //consecutive rejected measurements until reinitialized
+#define POS_KF_TIMEOUT_MS 300.0f     //no position measurement [ms]
+
+static pos_kf_history_t pos_kf_history[POS_KF_HISTORY_SIZE] CCM_HOT;
+static int pos_kf_history_newest;
+static int pos_kf_history_cnt;
+
+static bool pos_kf_valid;
+static int pos_kf_reject_cnt;
+static float pos_kf_fuse_time; //[ms]
+
+SLOT_ALLOC(pos_kf_slot, pos_kf_state_t);
+
+void pos_kf_init(void)
+{
+	pos_kf_history_newest = 0;
+	pos_kf_history_cnt = 0;
+	pos_kf_valid = false;
+	pos_kf_reject_cnt = 0;
+
+	pos_kf_state_t state = {.valid = false};
+	slot_publish(&pos_kf_slot, &state);
+}
+
+/* x = F * x + G * a, P = F * P * F' + Q
+ * F = [1 dt -dt^2/2; 0 1 -dt; 0 0 1], G = [dt^2/2; dt; 0] */
+static void pos_kf_axis_predict(pos_kf_axis_t *axis, float accel, float dt)
+{
+	float *x = axis->x;
+	float (*P)[3] = axis->P;
+
+	float half_dt2 = 0.5f * dt * dt;
+	float a = accel - x[2];
+	x[0] += x[1] * dt + a * half_dt2;
+	x[1] += a * dt;
+
+	/* FP = F * P */
+	float FP[3][3];
+	int j;
+	for(j = 0; j < 3; j++) {
+		FP[0][j] = P[0][j] + dt * P[1][j] - half_dt2 * P[2][j];
+		FP[1][j] = P[1][j] - dt * P[2][j];
+		FP[2][j] = P[2][j];
+	}
+
+	/* P = FP * F' */
+	float P00 = FP[0][0] + dt * FP[0][1] - half_dt2 * FP[0][2];
+	float P01 = FP[0][1] - dt * FP[0][2];
+	float P02 = FP[0][2];
+	float P11 = FP[1][1] - dt * FP[1][2];
+	float P12 = FP[1][2];
+	float P22 = FP[2][2];
+
+	/* Q = G * G' * sigma_a^2 + diag(0, 0, sigma_b^2 * dt) */
+	float q_a = POS_KF_ACCEL_NOISE * POS_KF_ACCEL_NOISE;
+	P00 += half_dt2 * half_dt2 * q_a;
+	P01 += half_dt2 * dt * q_a;
+	P11 += dt * dt * q_a;
+	P22 += POS_KF_BIAS_WALK * POS_KF_BIAS_WALK * dt;
+
+	P[0][0] = P00;
+	P[0][1] = P[1][0] = P01;
+	P[0][2] = P[2][0] = P02;
+	P[1][1] = P11;
+	P[1][2] = P[2][1] = P12;
+	P[2][2] = P22;
+}
+
+/* H = [1 0 0], returns false if the innovation is rejected by the gate */
+static bool pos_kf_axis_update(pos_kf_axis_t *axis, float pos, float noise)
+{
+	float *x = axis->x;
+	float (*P)[3] = axis->P;
+
+	float y = pos - x[0];
+	float S = P[0][0] + noise * noise;
+	if(y * y > POS_KF_GATE * S) {
+		return false;
+	}
+
+	float S_inv = 1.0f / S;
+	float K[3] = {P[0][0] * S_inv, P[1][0] * S_inv, P[2][0] * S_inv};
+
+	x[0] += K[0] * y;
+	x[1] += K[1] * y;
+	x[2] += K[2] * y;
+
+	/* P = (I - K * H) * P */
+	float P0[3] = {P[0][0], P[0][1], P[0][2]};
+	int i, j;
+	for(i = 0; i < 3; i++) {
+		for(j = 0; j < 3; j++) {
+			P[i][j] -= K[i] * P0[j];
+		}
+	}
+
+	return true;
+}
+
+static void pos_kf_axis_reset(pos_kf_axis_t *axis, float pos, float noise)
+{
+	memset(axis, 0, sizeof(pos_kf_axis_t));
+	axis->x[0] = pos;
+	axis->P[0][0] = noise * noise;
+	axis->P[1][1] = POS_KF_VEL_INIT * POS_KF_VEL_INIT;
+	axis->P[2][2] = POS_KF_BIAS_INIT * POS_KF_BIAS_INIT;
+}
+
+static int pos_kf_history_index(int age)
+{
+	int index = pos_kf_history_newest - age;
+	return index < 0 ? index + POS_KF_HISTORY_SIZE : index;
+}
+
+static void pos_kf_publish(void)
+{
+	pos_kf_state_t state = {.valid = pos_kf_valid};
+
+	if(pos_kf_valid == true) {
+		pos_kf_history_t *newest = &pos_kf_history[pos_kf_history_newest];
+		int i;
+		for(i = 0; i < 3; i++) {
+			state.pos[i] = newest->axis[i].x[0];
+			state.vel[i] = newest->axis[i].x[1];
+			state.accel_bias[i] = newest->axis[i].x[2];
+		}
+	}
+
+	slot_publish(&pos_kf_slot, &state);
+}
+
+/* accel: north-east-up acceleration of the step (see ahrs_accel_to_world()) [cm/s^2] */
+void pos_kf_predict(float *accel, float dt, float time_ms)
+{
+	if(pos_kf_valid == true && (time_ms - pos_kf_fuse_time) > POS_KF_TIMEOUT_MS) {
+		pos_kf_valid = false;
+	}
+
+	if(pos_kf_valid == false) {
+		pos_kf_publish();
+		return;
+	}
+
+	pos_kf_history_t *last = &pos_kf_history[pos_kf_history_newest];
+
+	pos_kf_history_newest = (pos_kf_history_newest + 1) % POS_KF_HISTORY_SIZE;
+	if(pos_kf_history_cnt < POS_KF_HISTORY_SIZE) {
+		pos_kf_history_cnt++;
+	}
+
+	pos_kf_history_t *newest = &pos_kf_history[pos_kf_history_newest];
+	newest->time = time_ms;
+	newest->dt = dt;
+
+	int i;
+	for(i = 0; i < 3; i++) {
+		newest->accel[i] = accel[i];
+		newest->axis[i] = last->axis[i];
+		pos_kf_axis_predict(&newest->axis[i], newest->accel[i], dt);
+	}
+
+	pos_kf_publish();
+}
+
+/* pos: north-east-up position [cm], noise: standard deviation of every axis [cm],
+ * time_ms: time of the measurement, not of the reception */
+void pos_kf_fuse_position(float *pos, float *noise, float time_ms)
+{
+	int i;
+
+	if(pos_kf_valid == false || pos_kf_reject_cnt >= POS_KF_REJECT_RESET_CNT) {
+		/* (re)initialize at the newest step, the history is discarded */
+		pos_kf_history_t *newest = &pos_kf_history[pos_kf_history_newest];
+		newest->time = time_ms;
+		newest->dt = 0.0f;
+		for(i = 0; i < 3; i++) {
+			newest->accel[i] = 0.0f;
+			pos_kf_axis_reset(&newest->axis[i], pos[i], noise[i]);
+		}
+		pos_kf_history_cnt = 1;
+
+		pos_kf_valid = true;
+		pos_kf_reject_cnt = 0;
+		pos_kf_fuse_time = time_ms;
+		return;
+	}
+
+	/* latest step not newer than the measurement, the oldest one if the
+	 * measurement is delayed longer than the history */
+	int age;
+	for(age = 0; age < pos_kf_history_cnt - 1; age++) {
+		if(pos_kf_history[pos_kf_history_index(age)].time <= time_ms) {
+			break;
+		}
+	}
+
+	pos_kf_history_t *entry = &pos_kf_history[pos_kf_history_index(age)];
+	bool accepted = true;
+	for(i = 0; i < 3; i++) {
+		/* the axes are independent, a rejected axis keeps its prediction */
+		if(pos_kf_axis_update(&entry->axis[i], pos[i], noise[i]) == false) {
+			accepted = false;
+		}
+	}
+
+	if(accepted == false) {
+		pos_kf_reject_cnt++;
+	} else {
+		pos_kf_reject_cnt = 0;
+		pos_kf_fuse_time = time_ms;
+	}
+
+	/* replay the stored accelerations up to now */
+	for(; age > 0; age--) {
+		pos_kf_history_t *prev = &pos_kf_history[pos_kf_history_index(age)];
+		pos_kf_history_t *next = &pos_kf_history[pos_kf_history_index(age - 1)];
+		for(i = 0; i < 3; i++) {
+			next->axis[i] = prev->axis[i];
+			pos_kf_axis_predict(&next->axis[i], next->accel[i], next->dt);
+		}
+	}
+
+	pos_kf_publish();
+}
+
+void pos_kf_read(pos_kf_state_t *state)
+{
+	slot_read(&pos_kf_slot, state);
+}
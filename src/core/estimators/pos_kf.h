@@ -0,0 +1,37 @@
+#ifndef __POS_KF_H__
+#define __POS_KF_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define POS_KF_HISTORY_SIZE 64 //prediction steps kept for the delayed fusion (160ms at 400Hz)
+
+/* local frame of the position source: north, east and up [cm] */
+typedef struct {
+	float pos[3];        //[cm]
+	float vel[3];        //[cm/s]
+	float accel_bias[3]; //world frame accelerometer bias [cm/s^2]
+	bool valid;          //false before the first fix and after a measurement timeout
+} pos_kf_state_t;
+
+/* one axis: position, velocity and accelerometer bias */
+typedef struct {
+	float x[3];
+	float P[3][3];
+} pos_kf_axis_t;
+
+/* state after every prediction, the delayed measurements are fused into the
+ * entry of their timestamp and the newer entries are predicted again */
+typedef struct {
+	float time;            //end of the prediction step [ms]
+	float dt;              //[s]
+	float accel[3];        //world frame acceleration [cm/s^2]
+	pos_kf_axis_t axis[3];
+} pos_kf_history_t;
+
+void pos_kf_init(void);
+void pos_kf_predict(float *accel, float dt, float time_ms);
+void pos_kf_fuse_position(float *pos, float *noise, float time_ms);
+void pos_kf_read(pos_kf_state_t *state);
+
+#endif
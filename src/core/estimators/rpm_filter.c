@@ -0,0 +1,86 @@
+#include "vector.h"
+#include "biquad.h"
+#include "rpm_filter.h"
+#include "profiler.h"
+#include "ccm.h"
+
+rpm_filter_t rpm_filter CCM_HOT;
+
+profiler_t rpm_filter_profiler; //execution time of the filter bank per imu sample
+
+void rpm_filter_init(float sample_rate)
+{
+	rpm_filter.sample_rate = sample_rate;
+	rpm_filter.max_freq = 0.45f * sample_rate; //stay below nyquist frequency
+	rpm_filter.retune_motor = 0;
+	rpm_filter.retune_harmonic = 0;
+
+	int m, h, axis;
+	for(m = 0; m < RPM_FILTER_MOTOR_CNT; m++) {
+		rpm_filter.motor_freq[m] = 0.0f;
+		for(h = 0; h < RPM_FILTER_HARMONIC_CNT; h++) {
+			biquad_bypass_coeff(&rpm_filter.coeff[m][h]);
+			for(axis = 0; axis < 3; axis++) {
+				biquad_reset(&rpm_filter.state[m][h][axis]);
+			}
+		}
+	}
+}
+
+/* called by the flight control task with the rpm telemetry of the esc */
+void rpm_filter_set_motor_freq(int motor, float freq)
+{
+	rpm_filter.motor_freq[motor] = freq;
+}
+
+static void rpm_filter_retune(int motor, int harmonic)
+{
+	float freq = rpm_filter.motor_freq[motor] * (float)(harmonic + 1);
+
+	/* bypass if the motor is stopped, telemetry is lost or the harmonic
+	 * is not sampleable */
+	if(freq < RPM_FILTER_MIN_FREQ || freq > rpm_filter.max_freq) {
+		biquad_bypass_coeff(&rpm_filter.coeff[motor][harmonic]);
+	} else {
+		biquad_notch_coeff(&rpm_filter.coeff[motor][harmonic], freq,
+		                   rpm_filter.sample_rate, RPM_FILTER_Q);
+	}
+}
+
+/* run by mpu6500_decode() in the deferred work task on every imu sample.
+ * only one motor harmonic is retuned per sample, this spreads the
+ * trigonometric cost over several samples and the coefficients are never
+ * touched while the bank is running */
+void rpm_filter_apply(vector3d_f_t *gyro)
+{
+	profiler_start(&rpm_filter_profiler);
+
+	rpm_filter_retune(rpm_filter.retune_motor, rpm_filter.retune_harmonic);
+
+	rpm_filter.retune_harmonic++;
+	if(rpm_filter.retune_harmonic == RPM_FILTER_HARMONIC_CNT) {
+		rpm_filter.retune_harmonic = 0;
+		rpm_filter.retune_motor++;
+		if(rpm_filter.retune_motor == RPM_FILTER_MOTOR_CNT) {
+			rpm_filter.retune_motor = 0;
+		}
+	}
+
+	float x = gyro->x, y = gyro->y, z = gyro->z;
+
+	int m, h;
+	for(m = 0; m < RPM_FILTER_MOTOR_CNT; m++) {
+		for(h = 0; h < RPM_FILTER_HARMONIC_CNT; h++) {
+			biquad_coeff_t *coeff = &rpm_filter.coeff[m][h];
+			x = biquad_apply(coeff, &rpm_filter.state[m][h][0], x);
+			y = biquad_apply(coeff, &rpm_filter.state[m][h][1], y);
+			z = biquad_apply(coeff, &rpm_filter.state[m][h][2], z);
+		}
+	}
+
+	gyro->x = x;
+	gyro->y = y;
+	gyro->z = z;
+
+	profiler_stop(&rpm_filter_profiler);
+}
@@ -0,0 +1,28 @@
+#ifndef __RPM_FILTER_H__
+#define __RPM_FILTER_H__
+
+#include "vector.h"
+#include "biquad.h"
+
+#define RPM_FILTER_MOTOR_CNT 4
+#define RPM_FILTER_HARMONIC_CNT 3 //fundamental, 2nd and 3rd harmonics
+#define RPM_FILTER_Q 5.0f
+#define RPM_FILTER_MIN_FREQ 80.0f //[Hz]
+
+/* notch filter bank centered on the motor rotation frequencies, every gyro
+ * axis is filtered by (motor count * harmonic count) biquads per sample */
+typedef struct {
+	biquad_coeff_t coeff[RPM_FILTER_MOTOR_CNT][RPM_FILTER_HARMONIC_CNT];
+	biquad_state_t state[RPM_FILTER_MOTOR_CNT][RPM_FILTER_HARMONIC_CNT][3];
+	volatile float motor_freq[RPM_FILTER_MOTOR_CNT]; //fundamental frequency [Hz]
+	float sample_rate;
+	float max_freq;
+	int retune_motor;
+	int retune_harmonic;
+} rpm_filter_t;
+
+void rpm_filter_init(float sample_rate);
+void rpm_filter_set_motor_freq(int motor, float freq);
+void rpm_filter_apply(vector3d_f_t *gyro);
+
+#endif
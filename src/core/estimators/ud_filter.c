@@ -0,0 +1,131 @@
+#include <string.h>
+#include "ud_filter.h"
+
+/* check: bierman, "factorization methods for discrete sequential estimation",
+ * and grewal and andrews, "kalman filtering: theory and practice", chapter 6 */
+
+void ud_init(ud_cov_t *ud, int n, const float *p_diag)
+{
+	memset(ud, 0, sizeof(ud_cov_t));
+	ud->n = n;
+
+	int i;
+	for(i = 0; i < n; i++) {
+		ud->U[i][i] = 1.0f;
+		ud->D[i] = p_diag[i];
+	}
+}
+
+/* thornton time update: P = phi * U * D * U' * phi' + diag(q)
+ * the rows of W = [phi * U, I] are orthogonalized with the weights diag(D, q)
+ * by the modified weighted gram-schmidt process, from the last row upward */
+void ud_predict(ud_cov_t *ud, float phi[UD_MAX_STATES][UD_MAX_STATES], const float *q_diag)
+{
+	int n = ud->n;
+	float W[UD_MAX_STATES][2 * UD_MAX_STATES];
+	float weight[2 * UD_MAX_STATES];
+	float weighted[2 * UD_MAX_STATES];
+	int i, j, k;
+
+	/* W = [phi * U, I], U is unit upper triangular */
+	for(i = 0; i < n; i++) {
+		for(j = 0; j < n; j++) {
+			float sum = phi[i][j];
+			for(k = 0; k < j; k++) {
+				sum += phi[i][k] * ud->U[k][j];
+			}
+			W[i][j] = sum;
+			W[i][n + j] = (i == j) ? 1.0f : 0.0f;
+		}
+		weight[i] = ud->D[i];
+		weight[n + i] = q_diag[i];
+	}
+
+	for(k = n - 1; k >= 0; k--) {
+		float sigma = 0.0f;
+		for(j = 0; j < 2 * n; j++) {
+			weighted[j] = W[k][j] * weight[j];
+			sigma += W[k][j] * weighted[j];
+		}
+		ud->D[k] = sigma;
+
+		float sigma_inv = 1.0f / sigma;
+		for(i = 0; i < k; i++) {
+			float sum = 0.0f;
+			for(j = 0; j < 2 * n; j++) {
+				sum += W[i][j] * weighted[j];
+			}
+
+			float u = sum * sigma_inv;
+			ud->U[i][k] = u;
+
+			for(j = 0; j < 2 * n; j++) {
+				W[i][j] -= u * W[k][j];
+			}
+		}
+
+		ud->U[k][k] = 1.0f;
+		for(i = k + 1; i < n; i++) {
+			ud->U[i][k] = 0.0f;
+		}
+	}
+}
+
+/* bierman measurement update of one scalar measurement z = h * x + v, v ~ N(0, r),
+ * correlated measurements have to be decorrelated first.
+ * returns the innovation variance h * P * h' + r */
+float ud_update(ud_cov_t *ud, float *x, const float *h, float r, float innovation)
+{
+	int n = ud->n;
+	float f[UD_MAX_STATES]; //U' * h'
+	float g[UD_MAX_STATES]; //D * f, becomes the unnormalized gain
+	int i, j;
+
+	for(j = 0; j < n; j++) {
+		float sum = h[j];
+		for(i = 0; i < j; i++) {
+			sum += ud->U[i][j] * h[i];
+		}
+		f[j] = sum;
+		g[j] = ud->D[j] * sum;
+	}
+
+	float alpha = r;
+	for(j = 0; j < n; j++) {
+		float alpha_last = alpha;
+		alpha += f[j] * g[j];
+		float lambda = -f[j] / alpha_last;
+		ud->D[j] *= alpha_last / alpha;
+
+		for(i = 0; i < j; i++) {
+			float u = ud->U[i][j];
+			ud->U[i][j] = u + g[i] * lambda;
+			g[i] += g[j] * u;
+		}
+	}
+
+	float gain_scale = innovation / alpha;
+	for(i = 0; i < n; i++) {
+		x[i] += g[i] * gain_scale;
+	}
+
+	return alpha;
+}
+
+/* P = U * D * U', the flight code only carries the factors, tools/ud_filter_check
+ * compares the product against a double precision covariance */
+void ud_to_covariance(ud_cov_t *ud, float P[UD_MAX_STATES][UD_MAX_STATES])
+{
+	int n = ud->n;
+	int i, j, k;
+
+	for(i = 0; i < n; i++) {
+		for(j = i; j < n; j++) {
+			float sum = 0.0f;
+			for(k = j; k < n; k++) {
+				sum += ud->U[i][k] * ud->D[k] * ud->U[j][k];
+			}
+			P[i][j] = P[j][i] = sum;
+		}
+	}
+}
@@ -0,0 +1,21 @@
+#ifndef __UD_FILTER_H__
+#define __UD_FILTER_H__
+
+#define UD_MAX_STATES 4
+
+/* factorized covariance P = U * D * U', U is unit upper triangular and D
+ * is diagonal. the factors stay symmetric and positive definite by
+ * construction, single precision is sufficient where P = F * P * F' + Q
+ * slowly loses both */
+typedef struct {
+	int n;
+	float U[UD_MAX_STATES][UD_MAX_STATES];
+	float D[UD_MAX_STATES];
+} ud_cov_t;
+
+void ud_init(ud_cov_t *ud, int n, const float *p_diag);
+void ud_predict(ud_cov_t *ud, float phi[UD_MAX_STATES][UD_MAX_STATES], const float *q_diag);
+float ud_update(ud_cov_t *ud, float *x, const float *h, float r, float innovation);
+void ud_to_covariance(ud_cov_t *ud, float P[UD_MAX_STATES][UD_MAX_STATES]);
+
+#endif
@@ -5,24 +5,45 @@
 #if defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__)
 #include <stdint.h>
 extern uint32_t SystemCoreClock;
+extern volatile uint32_t sys_stats_switch_cnt[];
 #endif
 
 #define configUSE_PREEMPTION                     1
-#define configSUPPORT_STATIC_ALLOCATION          0
+#define configSUPPORT_STATIC_ALLOCATION          1
 #define configSUPPORT_DYNAMIC_ALLOCATION         1
-#define configUSE_IDLE_HOOK                      0
+#define configUSE_IDLE_HOOK                      1
 #define configUSE_TICK_HOOK                      0
 #define configCPU_CLOCK_HZ                       (180000000)
 #define configTICK_RATE_HZ                       ((TickType_t)4000)
 #define configMAX_PRIORITIES                     (10)
 #define configMINIMAL_STACK_SIZE                 ((uint16_t)130)
-#define configTOTAL_HEAP_SIZE                    ((size_t)50 * 1024)
+#define configTOTAL_HEAP_SIZE                    ((size_t)8 * 1024) //flight control tasks are allocated statically
 #define configMAX_TASK_NAME_LEN                  (20)
 #define configUSE_16_BIT_TICKS                   0
 #define configUSE_MUTEXES                        1
 #define configQUEUE_REGISTRY_SIZE                8
 #define configUSE_PORT_OPTIMISED_TASK_SELECTION  1
 
+/* run time statistics (see sys_stats.c), counted in cpu cycles with the dwt
+   cycle counter which is already started by profiler_init() */
+#define configUSE_TRACE_FACILITY                 1
+#define configGENERATE_RUN_TIME_STATS            1
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE()         (*(volatile uint32_t *)0xE0001004) //DWT->CYCCNT
+
+/* context switch count of every task, indexed by the tcb number. tcb numbers
+   start at 1 and are not reused after vTaskDelete(), so the table needs a slot
+   for every task created since boot (checked in main.c), tasks beyond it are
+   not counted */
+#define SYS_TASK_CNT 9 //8 created at boot and a spare one
+#define SYS_STATS_TASK_MAX (SYS_TASK_CNT + 1)
+#define traceTASK_SWITCHED_IN() \
+	do { \
+		if(pxCurrentTCB->uxTCBNumber < SYS_STATS_TASK_MAX) { \
+			sys_stats_switch_cnt[pxCurrentTCB->uxTCBNumber]++; \
+		} \
+	} while(0)
+
 /* Co-routine definitions. */
 #define configUSE_CO_ROUTINES                    0
 #define configMAX_CO_ROUTINE_PRIORITIES          (2)
@@ -37,6 +58,7 @@ extern uint32_t SystemCoreClock;
 #define INCLUDE_vTaskDelayUntil             0
 #define INCLUDE_vTaskDelay                  1
 #define INCLUDE_xTaskGetSchedulerState      1
+#define INCLUDE_uxTaskGetStackHighWaterMark 1
 
 /* Cortex-M specific definitions. */
 #ifdef __NVIC_PRIO_BITS
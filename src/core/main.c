@@ -11,44 +11,92 @@
 #include "spi.h"
 #include "timer.h"
 #include "pwm.h"
+#include "dshot.h"
 #include "exti.h"
 #include "mpu6500.h"
 #include "sbus_receiver.h"
 #include "optitrack.h"
+#include "ublox.h"
 #include "sys_time.h"
 #include "motor.h"
 #include "debug_link.h"
 #include "multirotor_pid_ctrl.h"
 #include "fc_task.h"
+#include "profiler.h"
+#include "sys_stats.h"
+#include "deferred_work.h"
 #include "proj_config.h"
 
-extern SemaphoreHandle_t flight_ctl_semphr;
+/* flight control, deferred work, debug link and idle tasks, their tcb numbers
+ * index the sys_stats table */
+#if (FLIGHT_CTL_TASK_CNT + 3) > SYS_TASK_CNT
+#error "more tasks than sys_stats slots, raise SYS_TASK_CNT in freertos_config.h"
+#endif
+
+/* idle task memory for the static allocation support of freertos */
+static StaticTask_t idle_task_tcb;
+static StackType_t idle_task_stack[configMINIMAL_STACK_SIZE];
+
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer,
+                                   uint32_t *pulIdleTaskStackSize)
+{
+	*ppxIdleTaskTCBBuffer = &idle_task_tcb;
+	*ppxIdleTaskStackBuffer = idle_task_stack;
+	*pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
+}
+
+/* background jobs which may block, e.g. flash programming */
+void vApplicationIdleHook(void)
+{
+	mpu6500_gyro_bias_store();
+}
 
 int main(void)
 {
 	NVIC_PriorityGroupConfig(NVIC_PriorityGroup_4);
 
+	profiler_init(); //dwt cycle counter, the delays and boot timing depend on it
+
 	/* freertos initialization */
-	flight_ctl_semphr = xSemaphoreCreateBinary();
+	flight_ctl_rate_group_init();
+	deferred_work_init();
+
+	/* sensor decoding, runs in the deferred work task */
+	deferred_work_register(DEFERRED_WORK_IMU, mpu6500_process);
+	deferred_work_register(DEFERRED_WORK_SBUS, sbus_process);
+#if (SELECT_LOCALIZATION == LOCALIZATION_USE_GPS)
+	deferred_work_register(DEFERRED_WORK_GPS, ublox_rx_handler);
+#else
+	deferred_work_register(DEFERRED_WORK_OPTITRACK, optitrack_process);
+#endif
 
 	optitrack_init(UAV_ID); //setup tracker id for this MAV
 
 	/* driver initialization */
+	sys_stats_init();
 	led_init();
 	uart1_init(115200);
 	uart3_init(115200); //telem
 	uart4_init(100000); //s-bus
 	uart6_init(115200);
-	uart7_init(115200); //gps or optitrack
+#if (SELECT_LOCALIZATION == LOCALIZATION_USE_GPS)
+	ublox_init(); //gps
+#else
+	uart7_init(115200); //optitrack
+#endif
 	timer12_init(); //system timer and flight controller timer
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_DSHOT600)
+	dshot_init(); //motor
+#else
 	pwm_timer1_init(); //motor
 	pwm_timer4_init(); //motor
+#endif
+	motor_init(); //start arming the esc
 	exti10_init(); //imu ext interrupt
 	spi1_init(); //imu
+	spi3_init(); //barometer
 
-	blocked_delay_ms(1000);
-
-	xTaskCreate(task_flight_ctl, "flight control", 4096, NULL, tskIDLE_PRIORITY + 3, NULL);
+	flight_ctl_task_create();
 	xTaskCreate(task_debug_link, "debug link", 512, NULL, tskIDLE_PRIORITY + 1, NULL);
 
 	/* start freertos scheduler */
@@ -20,7 +20,7 @@ void send_mavlink_heartbeat(void)
 
 void send_mavlink_system_status(void)
 {
-	float battery_voltage = 12.5 * 1000;
+	float battery_voltage = 12.5f * 1000;
 	float battery_remain_percentage = 100;
 	mavlink_message_t msg;
 
@@ -35,7 +35,7 @@ void send_mavlink_attitude(void)
 	uint32_t curr_time_ms = 0;
 
 	mavlink_message_t msg;
-	mavlink_msg_attitude_pack(1, 200, &msg, curr_time_ms, roll, pitch, yaw, 0.0, 0.0, 0.0);
+	mavlink_msg_attitude_pack(1, 200, &msg, curr_time_ms, roll, pitch, yaw, 0.0f, 0.0f, 0.0f);
 	send_mavlink_msg_to_uart(&msg);
 }
 
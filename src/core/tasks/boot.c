@@ -0,0 +1,41 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "delay.h"
+#include "profiler.h"
+#include "boot.h"
+
+/* completion time of every boot phase since profiler_init() at the
+ * beginning of main() [ms], 0 if not reached */
+float boot_time_ms[BOOT_PHASE_CNT];
+
+void boot_phase_done(int phase)
+{
+	boot_time_ms[phase] = profiler_cycles_to_us((float)profiler_get_cycles()) * 0.001f;
+}
+
+/* step the device state machines concurrently until all of them are ready,
+ * the waiting time of one device is used by the others instead of being
+ * spent in busy loops. ready devices are served by their idle hook */
+void boot_run_devices(boot_device_t *devices, int device_cnt)
+{
+	uint32_t ready_mask = 0;
+	uint32_t all_ready = (1 << device_cnt) - 1;
+
+	while(ready_mask != all_ready) {
+		int i;
+		for(i = 0; i < device_cnt; i++) {
+			if((ready_mask & (1 << i)) != 0) {
+				if(devices[i].idle != NULL) {
+					devices[i].idle();
+				}
+			} else if(devices[i].step() == true) {
+				ready_mask |= 1 << i;
+				boot_phase_done(devices[i].phase);
+			}
+		}
+
+		freertos_task_delay(BOOT_STEP_PERIOD_MS);
+	}
+}
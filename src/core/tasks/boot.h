@@ -0,0 +1,36 @@
+#ifndef __BOOT_H__
+#define __BOOT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BOOT_STEP_PERIOD_MS 1
+
+/* boot phases with logged completion time */
+#define BOOT_PHASE_SCHEDULER 0 //freertos started
+#define BOOT_PHASE_IMU 1       //imu configured and gyro calibrated
+#define BOOT_PHASE_ESC 2       //esc armed with the minimum pulse
+#define BOOT_PHASE_GPS 3       //gps receiver configured
+#define BOOT_PHASE_BARO 4      //barometer calibration data read
+#define BOOT_PHASE_MAG 5       //magnetometer configured
+#define BOOT_PHASE_ARMABLE 6   //estimators and controllers initialized
+#define BOOT_PHASE_CNT 7
+
+/* returns true once the device is ready */
+typedef bool (*boot_step_t)(void);
+
+/* keeps a ready device alive while the others are still booting */
+typedef void (*boot_idle_t)(void);
+
+typedef struct {
+	boot_step_t step;
+	boot_idle_t idle; //optional
+	int phase;
+} boot_device_t;
+
+extern float boot_time_ms[BOOT_PHASE_CNT];
+
+void boot_phase_done(int phase);
+void boot_run_devices(boot_device_t *devices, int device_cnt);
+
+#endif
@@ -0,0 +1,50 @@
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "ccm.h"
+#include "deferred_work.h"
+
+/* interrupts only capture raw data with a timestamp into the ring of their
+ * source and signal the worker, decoding and float math run in the worker */
+
+static deferred_work_handler_t deferred_work_handlers[DEFERRED_WORK_SRC_CNT];
+
+static TaskHandle_t deferred_work_task_handle;
+static StackType_t deferred_work_stack[DEFERRED_WORK_STACK_SIZE] CCM_HOT;
+static StaticTask_t deferred_work_tcb CCM_HOT;
+
+static void task_deferred_work(void *param)
+{
+	uint32_t pending;
+
+	while(1) {
+		xTaskNotifyWait(0, UINT32_MAX, &pending, portMAX_DELAY);
+
+		int i;
+		for(i = 0; i < DEFERRED_WORK_SRC_CNT; i++) {
+			if((pending & (1 << i)) && deferred_work_handlers[i] != NULL) {
+				deferred_work_handlers[i]();
+			}
+		}
+	}
+}
+
+/* has to be called before any source interrupt is enabled */
+void deferred_work_init(void)
+{
+	deferred_work_task_handle = xTaskCreateStatic(task_deferred_work, "deferred work",
+	                            DEFERRED_WORK_STACK_SIZE, NULL, DEFERRED_WORK_PRIORITY,
+	                            deferred_work_stack, &deferred_work_tcb);
+}
+
+void deferred_work_register(int src, deferred_work_handler_t handler)
+{
+	deferred_work_handlers[src] = handler;
+}
+
+void deferred_work_signal_from_isr(int src)
+{
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+	xTaskNotifyFromISR(deferred_work_task_handle, 1 << src, eSetBits, &xHigherPriorityTaskWoken);
+	portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+}
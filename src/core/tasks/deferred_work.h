@@ -0,0 +1,23 @@
+#ifndef __DEFERRED_WORK_H__
+#define __DEFERRED_WORK_H__
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define DEFERRED_WORK_PRIORITY (tskIDLE_PRIORITY + 6) //above every flight control rate group
+#define DEFERRED_WORK_STACK_SIZE 1024 //[words]
+
+/* work sources, one notification bit each */
+#define DEFERRED_WORK_IMU 0
+#define DEFERRED_WORK_SBUS 1
+#define DEFERRED_WORK_OPTITRACK 2
+#define DEFERRED_WORK_GPS 3
+#define DEFERRED_WORK_SRC_CNT 4
+
+typedef void (*deferred_work_handler_t)(void);
+
+void deferred_work_init(void);
+void deferred_work_register(int src, deferred_work_handler_t handler);
+void deferred_work_signal_from_isr(int src);
+
+#endif
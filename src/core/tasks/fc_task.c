@@ -15,37 +15,104 @@
 #include "lpf.h"
 #include "imu.h"
 #include "ahrs.h"
-#include "madgwick_ahrs.h"
+#include "ahrs_registry.h"
 #include "multirotor_pid_ctrl.h"
 #include "multirotor_geometry_ctrl.h"
 #include "motor_thrust.h"
+#include "dshot.h"
+#include "rpm_filter.h"
+#include "gyro_fft.h"
+#include "dyn_notch.h"
+#include "pos_kf.h"
+#include "alt_est.h"
+#include "ms5611.h"
+#include "hmc5983.h"
 #include "fc_task.h"
 #include "sys_time.h"
+#include "profiler.h"
+#include "slot.h"
+#include "rate_group.h"
+#include "ccm.h"
+#include "boot.h"
+#include "math_bench.h"
+#include "ublox.h"
+#include "navigation.h"
 #include "proj_config.h"
 
-#define FLIGHT_CTL_PRESCALER_RELOAD 10
+#if (SELECT_HEADING == HEADING_USE_MAGNETOMETER) && (SELECT_AHRS != AHRS_MADGWICK_FILTER)
+#error "the magnetometer heading is only fused by the madgwick filter, select it as the boot primary"
+#endif
 
 extern optitrack_t optitrack;
 
-SemaphoreHandle_t flight_ctl_semphr;
-
-imu_t imu;
-ahrs_t ahrs;
+imu_t imu CCM_HOT;
+ahrs_t ahrs CCM_HOT;
 radio_t rc;
 
+rate_group_t rate_ctl_group CCM_HOT;
+rate_group_t attitude_ctl_group CCM_HOT;
+rate_group_t position_ctl_group CCM_HOT;
+
+#if (SELECT_LOCALIZATION == LOCALIZATION_USE_GPS)
+static nav_home_t gps_home;
+#endif
+
+/* flight control tasks are statically allocated, stacks hold no dma buffers */
+static StackType_t flight_ctl_stack[FLIGHT_CTL_STACK_SIZE] CCM_HOT;
+static StackType_t rate_ctl_stack[RATE_CTL_STACK_SIZE] CCM_HOT;
+static StackType_t attitude_ctl_stack[ATTITUDE_CTL_STACK_SIZE] CCM_HOT;
+static StackType_t position_ctl_stack[POSITION_CTL_STACK_SIZE] CCM_HOT;
+static StaticTask_t flight_ctl_tcb CCM_HOT;
+static StaticTask_t rate_ctl_tcb CCM_HOT;
+static StaticTask_t attitude_ctl_tcb CCM_HOT;
+static StaticTask_t position_ctl_tcb CCM_HOT;
+#if (SELECT_GYRO_DYN_NOTCH == GYRO_DYN_NOTCH_ENABLED)
+static StackType_t gyro_fft_stack[GYRO_FFT_STACK_SIZE];
+static StaticTask_t gyro_fft_tcb;
+#endif
+
+/* attitude estimate handed to the position loop */
+SLOT_ALLOC(ahrs_slot, ahrs_t);
+
+profiler_t sample_to_pulse_profiler;
+
+void flight_ctl_rate_group_init(void)
+{
+	rate_group_init(&rate_ctl_group, RATE_CTL_RATE, RATE_CTL_RATE, RATE_CTL_DEADLINE);
+	rate_group_init(&attitude_ctl_group, RATE_CTL_RATE, ATTITUDE_CTL_RATE, ATTITUDE_CTL_DEADLINE);
+	rate_group_init(&position_ctl_group, RATE_CTL_RATE, POSITION_CTL_RATE, POSITION_CTL_DEADLINE);
+}
+
+/* flight control trigger from the system timer interrupt */
 void flight_ctl_semaphore_handler(void)
 {
-	static BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-	xSemaphoreGiveFromISR(flight_ctl_semphr, &xHigherPriorityTaskWoken);
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+	uint32_t sample_time = imu.sample_time;
+
+	rate_group_trigger_from_isr(&rate_ctl_group, sample_time, &xHigherPriorityTaskWoken);
+	rate_group_trigger_from_isr(&attitude_ctl_group, sample_time, &xHigherPriorityTaskWoken);
+	rate_group_trigger_from_isr(&position_ctl_group, sample_time, &xHigherPriorityTaskWoken);
+
 	portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
 }
 
+/* flight control trigger from the imu sample decoding (deferred work task) */
+void flight_ctl_trigger_handler(void)
+{
+	uint32_t sample_time = imu.sample_time;
+
+	rate_group_trigger(&rate_ctl_group, sample_time);
+	rate_group_trigger(&attitude_ctl_group, sample_time);
+	rate_group_trigger(&position_ctl_group, sample_time);
+}
+
 void rc_safety_protection(void)
 {
 	radio_t rc;
 
 	float time_last = 0.0f;
 	float time_current = 0.0f;
+	float motor_time_last = 0.0f;
 
 	led_off(LED_R);
 	led_off(LED_G);
@@ -57,6 +124,11 @@ void rc_safety_protection(void)
 			led_toggle(LED_R);
 			time_last = time_current;
 		}
+		/* oneshot esc only receives pulses on demand, keep them fed */
+		if(time_current - motor_time_last > 2.5f) {
+			motor_halt();
+			motor_time_last = time_current;
+		}
 		read_rc_info(&rc);
 	} while(rc_safety_check(&rc) == 1);
 }
@@ -75,59 +147,305 @@ void rc_yaw_setpoint_handler(float *desired_yaw, float rc_yaw_cmd, float dt)
 	}
 }
 
-void task_flight_ctl(void *param)
+/* imu sampling to motor pulse latency. the sample time is copied when the loop
+ * consumes the sample, the imu keeps overwriting it during the control. a pulse
+ * before the sample was the one of the previous period and is not accounted */
+static void sample_to_pulse_update(uint32_t sample_time)
 {
-	mpu6500_init(&imu);
-	motor_init();
+	int32_t latency = (int32_t)(motor_output_get_pulse_time() - sample_time);
+	if(latency >= 0) {
+		profiler_update(&sample_to_pulse_profiler, (uint32_t)latency);
+	}
+}
 
-	ahrs_init(imu.accel_raw);
-	madgwick_t madgwick_ahrs_info;
-	madgwick_init(&madgwick_ahrs_info, 400, 0.4);
+#define AHRS_SWITCH_HOLD_TIME 1.0f //[s]
 
-	multirotor_pid_controller_init();
-	geometry_ctrl_init();
+/* there is no command uplink, the primary estimator is cycled with a stick
+ * command instead: disarmed, throttle low and yaw held right for one second.
+ * the command is latched until the yaw stick is released */
+static void rc_ahrs_switch_handler(radio_t *rc, float dt)
+{
+	static float hold_time = 0.0f;
+	static bool latched = false;
 
-	led_off(LED_R);
-	led_off(LED_G);
-	led_on(LED_B);
+	if((rc->safety == false) || (rc->throttle > 10.0f) || (rc->yaw < 30.0f)) {
+		hold_time = 0.0f;
+		latched = false;
+		return;
+	}
 
-	rc_safety_protection();
+	hold_time += dt;
+	if((latched == false) && (hold_time > AHRS_SWITCH_HOLD_TIME)) {
+		int next = (ahrs_registry_get_primary() + 1) % AHRS_ESTIMATOR_CNT;
+		ahrs_registry_set_primary(next, rc->safety == false);
+		latched = true;
+	}
+}
+
+/* inner rate loop, released on every n-th imu sample */
+void task_rate_ctl(void *param)
+{
+	while(1) {
+		rate_group_wait(&rate_ctl_group);
+#if (SELECT_CONTROLLER == QUADROTOR_USE_PID)
+		uint32_t sample_time = imu.sample_time;
+		multirotor_pid_rate_control(&imu);
+		sample_to_pulse_update(sample_time);
+#endif
+
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_DSHOT600)
+		/* retune the gyro notch filters with the esc rpm telemetry */
+		int i;
+		for(i = 0; i < RPM_FILTER_MOTOR_CNT; i++) {
+			rpm_filter_set_motor_freq(i, dshot_get_motor_freq(i));
+		}
+#endif
+
+		rate_group_complete(&rate_ctl_group);
+	}
+}
+
+#if (SELECT_LOCALIZATION == LOCALIZATION_USE_GPS)
+/* the first good 3d fix becomes the origin of the local frame, the fix is
+ * fused at its measurement epoch */
+static void gps_position_fuse(gps_fix_t *fix)
+{
+	if(fix->fix_type != GPS_FIX_3D || fix->fix_ok == false) {
+		return;
+	}
+
+	if(gps_home.valid == false) {
+		nav_set_home(&gps_home, fix->latitude, fix->longitude, fix->height_msl);
+	}
+
+	float ned[3];
+	nav_geodetic_to_ned(&gps_home, fix->latitude, fix->longitude, fix->height_msl, ned);
+
+	float pos[3] = {ned[0] * 100.0f, ned[1] * 100.0f, -ned[2] * 100.0f};
+	float noise[3] = {fix->h_acc * 100.0f, fix->h_acc * 100.0f, fix->v_acc * 100.0f};
+	pos_kf_fuse_position(pos, noise, fix->timestamp_ms - UBLOX_LATENCY_MS);
+}
+#endif
+
+/* attitude estimation with every imu sample since the last period, coning and
+ * sculling compensated, the filters see the mean rate and specific force of the period */
+static void attitude_estimate(void)
+{
+	imu_delta_t imu_delta;
+	if(mpu6500_preint_take(&imu_delta) == false) {
+		return;
+	}
+
+	/* the primary estimator runs now, the shadows after the attitude control */
+	ahrs_registry_update(&imu_delta, &ahrs);
+
+	float dt_inv = 1.0f / imu_delta.dt;
+	vector3d_f_t accel_mean = {
+		.x = imu_delta.delta_velocity.x * dt_inv,
+		.y = imu_delta.delta_velocity.y * dt_inv,
+		.z = imu_delta.delta_velocity.z * dt_inv
+	};
+
+	/* translational estimation with the same imu samples */
+	float accel_world[3];
+	ahrs_accel_to_world(ahrs.q, &accel_mean, accel_world);
+	pos_kf_predict(accel_world, imu_delta.dt, get_sys_time_ms());
+	alt_est_predict(accel_world[2], imu_delta.dt, get_sys_time_ms());
+
+	static uint32_t baro_seq = 0;
+	ms5611_sample_t baro;
+	uint32_t seq = ms5611_read(&baro);
+	if(seq != baro_seq) {
+		baro_seq = seq;
+		alt_est_fuse_baro(baro.pressure, baro.time_ms);
+	}
+
+#if (SELECT_LOCALIZATION == LOCALIZATION_USE_OPTITRACK)
+	/* the pose is fused at its capture time */
+	static uint32_t optitrack_seq = 0;
+	optitrack_pose_t pose;
+	seq = optitrack_pose_read(&pose);
+	if(seq != optitrack_seq) {
+		optitrack_seq = seq;
+		float noise[3] = {OPTITRACK_POS_NOISE, OPTITRACK_POS_NOISE, OPTITRACK_POS_NOISE};
+		pos_kf_fuse_position(pose.pos, noise, pose.time_ms);
+	}
+#elif (SELECT_LOCALIZATION == LOCALIZATION_USE_GPS)
+	static uint32_t gps_cnt = 0;
+	gps_fix_t fix;
+	uint32_t cnt = ublox_get_fix(&fix);
+	if(cnt != gps_cnt) {
+		gps_cnt = cnt;
+		gps_position_fuse(&fix);
+	}
+#endif
+}
 
+/* attitude estimation and attitude loop */
+void task_attitude_ctl(void *param)
+{
 	float desired_yaw = 0.0f;
 
 	while(1) {
-		while(xSemaphoreTake(flight_ctl_semphr, 9) == pdFALSE);
+		float dt = rate_group_wait(&attitude_ctl_group);
+#if (SELECT_CONTROLLER == QUADROTOR_USE_GEOMETRY)
+		uint32_t sample_time = imu.sample_time;
+#endif
 
 		//gpio_toggle(MOTOR7_FREQ_TEST);
 
 		read_rc_info(&rc);
-		rc_yaw_setpoint_handler(&desired_yaw, -rc.yaw, 0.0025);
-
-#if (SELECT_AHRS == AHRS_COMPLEMENTARY_FILTER)
-		ahrs_estimate(&ahrs, imu.accel_lpf, imu.gyro_lpf);
-#elif (SELECT_AHRS ==  AHRS_MADGWICK_FILTER)
-		madgwick_imu_ahrs(&madgwick_ahrs_info,
-		                  imu.accel_lpf.x,
-		                  imu.accel_lpf.y,
-		                  imu.accel_lpf.z,
-		                  deg_to_rad(imu.gyro_lpf.x),
-		                  deg_to_rad(imu.gyro_lpf.y),
-		                  deg_to_rad(imu.gyro_lpf.z));
-
-		ahrs.attitude.roll = madgwick_ahrs_info.Roll;
-		ahrs.attitude.pitch = madgwick_ahrs_info.Pitch;
-		ahrs.q[0] = madgwick_ahrs_info.q0;
-		ahrs.q[1] = madgwick_ahrs_info.q1;
-		ahrs.q[2] = madgwick_ahrs_info.q2;
-		ahrs.q[3] = madgwick_ahrs_info.q3;
-#endif
+		mpu6500_set_armed(rc.safety == false);
+		alt_est_set_armed(rc.safety == false);
+		rc_yaw_setpoint_handler(&desired_yaw, -rc.yaw, dt);
+		rc_ahrs_switch_handler(&rc, dt);
+
+		attitude_estimate();
+		slot_publish(&ahrs_slot, &ahrs);
 
 #if (SELECT_CONTROLLER == QUADROTOR_USE_PID)
-		multirotor_pid_control(&imu, &ahrs, &rc, desired_yaw);
+		multirotor_pid_attitude_control(&ahrs, &rc, desired_yaw, dt);
 #elif (SELECT_CONTROLLER == QUADROTOR_USE_GEOMETRY)
-		multirotor_geometry_control(&imu, &ahrs, &rc, desired_yaw);
+		/* the geometry controller closes the attitude and rate loop together */
+		multirotor_geometry_control(&imu, &ahrs, &rc, desired_yaw, dt);
+		sample_to_pulse_update(sample_time);
+#endif
+
+		/* shadow estimators with the rest of the period */
+		ahrs_registry_run_shadows(attitude_ctl_group.release_time_last, attitude_ctl_group.deadline);
+
+		rate_group_complete(&attitude_ctl_group);
+	}
+}
+
+/* position and altitude loop */
+void task_position_ctl(void *param)
+{
+	radio_t rc;
+	ahrs_t ahrs;
+	pos_kf_state_t pos_kf_state;
+	alt_est_state_t alt_est_state;
+
+	while(1) {
+		rate_group_wait(&position_ctl_group);
+
+		/* the barometer conversion is slower than the attitude loop */
+		ms5611_update();
+#if (SELECT_HEADING == HEADING_USE_MAGNETOMETER)
+		hmc5983_update();
+#endif
+
+		read_rc_info(&rc);
+		slot_read(&ahrs_slot, &ahrs);
+		pos_kf_read(&pos_kf_state);
+
+		/* altitude source switch: auto, optitrack, barometer */
+		const int alt_sources[] = {ALT_SOURCE_AUTO, ALT_SOURCE_OPTITRACK, ALT_SOURCE_BARO};
+		alt_est_set_source(alt_sources[rc.aux1]);
+		alt_est_read(&alt_est_state);
+		alt_est_select_source(&pos_kf_state, &alt_est_state);
+
+#if (SELECT_CONTROLLER == QUADROTOR_USE_PID)
+		multirotor_pid_position_control(&rc, &pos_kf_state, &alt_est_state, ahrs.attitude.yaw,
+		                                position_ctl_group.dt);
 #endif
 
-		taskYIELD();
+		rate_group_complete(&position_ctl_group);
+	}
+}
+
+#if (SELECT_GYRO_DYN_NOTCH == GYRO_DYN_NOTCH_ENABLED)
+extern profiler_t gyro_fft_profiler;
+
+/* gyro spectrum analysis and notch placement. every control loop preempts
+ * this task, and the period grows if an analysis would exceed the cpu budget */
+void task_gyro_fft(void *param)
+{
+	int axis = 0;
+	uint32_t period_ms = GYRO_FFT_PERIOD_MS;
+
+	while(1) {
+		freertos_task_delay(period_ms);
+
+		gyro_fft_analyze(axis);
+
+		int i;
+		for(i = 0; i < GYRO_FFT_PEAK_CNT; i++) {
+			dyn_notch_set_freq(axis, i, gyro_fft_get_peak_freq(axis, i));
+		}
+
+		axis = (axis + 1) % 3;
+
+		float exec_ms = profiler_cycles_to_us((float)gyro_fft_profiler.last) * 0.001f;
+		uint32_t min_period_ms = (uint32_t)(exec_ms / GYRO_FFT_CPU_BUDGET) + 1;
+		period_ms = (min_period_ms > GYRO_FFT_PERIOD_MS) ? min_period_ms : GYRO_FFT_PERIOD_MS;
 	}
 }
+#endif
+
+/* initialize the sensors and controllers, then hand over to the rate groups */
+void task_flight_ctl(void *param)
+{
+	boot_phase_done(BOOT_PHASE_SCHEDULER);
+
+	rpm_filter_init(MPU6500_SAMPLE_RATE);
+	gyro_fft_init(MPU6500_SAMPLE_RATE);
+	dyn_notch_init(MPU6500_SAMPLE_RATE);
+	mpu6500_init(&imu);
+	ms5611_init();
+	hmc5983_init();
+
+	/* the esc arming and gps configuration were started by main() */
+	boot_device_t boot_devices[] = {
+		{.step = mpu6500_init_step, .phase = BOOT_PHASE_IMU},
+		/* oneshot and dshot escs disarm without pulses, keep the minimum
+		 * pulse going until the last device is ready */
+		{.step = motor_init_step, .idle = motor_halt, .phase = BOOT_PHASE_ESC},
+		{.step = ms5611_init_step, .phase = BOOT_PHASE_BARO},
+#if (SELECT_HEADING == HEADING_USE_MAGNETOMETER)
+		{.step = hmc5983_init_step, .phase = BOOT_PHASE_MAG},
+#endif
+#if (SELECT_LOCALIZATION == LOCALIZATION_USE_GPS)
+		{.step = ublox_init_step, .phase = BOOT_PHASE_GPS},
+#endif
+	};
+	boot_run_devices(boot_devices, sizeof(boot_devices) / sizeof(boot_device_t));
+
+	ahrs_registry_init(imu.accel_raw, ATTITUDE_CTL_RATE);
+	pos_kf_init();
+	alt_est_init();
+
+	multirotor_pid_controller_init();
+	geometry_ctrl_init();
+
+	led_off(LED_R);
+	led_off(LED_G);
+	led_on(LED_B);
+
+	boot_phase_done(BOOT_PHASE_ARMABLE);
+
+#if (SELECT_MATH_BENCH == MATH_BENCH_ENABLED)
+	math_bench_run();
+#endif
+
+	rc_safety_protection();
+
+	xTaskCreateStatic(task_rate_ctl, "rate control", RATE_CTL_STACK_SIZE, NULL,
+	                  RATE_CTL_PRIORITY, rate_ctl_stack, &rate_ctl_tcb);
+	xTaskCreateStatic(task_attitude_ctl, "attitude control", ATTITUDE_CTL_STACK_SIZE, NULL,
+	                  ATTITUDE_CTL_PRIORITY, attitude_ctl_stack, &attitude_ctl_tcb);
+	xTaskCreateStatic(task_position_ctl, "position control", POSITION_CTL_STACK_SIZE, NULL,
+	                  POSITION_CTL_PRIORITY, position_ctl_stack, &position_ctl_tcb);
+#if (SELECT_GYRO_DYN_NOTCH == GYRO_DYN_NOTCH_ENABLED)
+	xTaskCreateStatic(task_gyro_fft, "gyro fft", GYRO_FFT_STACK_SIZE, NULL,
+	                  GYRO_FFT_PRIORITY, gyro_fft_stack, &gyro_fft_tcb);
+#endif
+
+	vTaskDelete(NULL);
+}
+
+void flight_ctl_task_create(void)
+{
+	xTaskCreateStatic(task_flight_ctl, "flight control", FLIGHT_CTL_STACK_SIZE, NULL,
+	                  RATE_CTL_PRIORITY, flight_ctl_stack, &flight_ctl_tcb);
+}
@@ -1,7 +1,51 @@
 #ifndef __FC_TASK_H__
 #define __FC_TASK_H__
 
-void task_flight_ctl(void *param);
+#include "FreeRTOS.h"
+#include "task.h"
+#include "proj_config.h"
+
+/* rate groups, the flight control trigger releases the inner rate loop and
+ * the slower groups are divided down from it */
+#define RATE_CTL_RATE 2000    //[Hz]
+#define ATTITUDE_CTL_RATE 400 //[Hz]
+#define POSITION_CTL_RATE 50  //[Hz]
+
+/* deadlines measured from the imu sample which released the group */
+#define RATE_CTL_DEADLINE 500.0f       //[us]
+#define ATTITUDE_CTL_DEADLINE 2500.0f  //[us]
+#define POSITION_CTL_DEADLINE 20000.0f //[us]
+
+#define RATE_CTL_PRIORITY (tskIDLE_PRIORITY + 5)
+#define ATTITUDE_CTL_PRIORITY (tskIDLE_PRIORITY + 4)
+#define POSITION_CTL_PRIORITY (tskIDLE_PRIORITY + 3)
+#define GYRO_FFT_PRIORITY (tskIDLE_PRIORITY + 2) //background, only uses the slack of the control loops
+
+#define FLIGHT_CTL_STACK_SIZE 1024 //[words]
+#define RATE_CTL_STACK_SIZE 1024
+#define ATTITUDE_CTL_STACK_SIZE 2048
+#define POSITION_CTL_STACK_SIZE 1024
+#define GYRO_FFT_STACK_SIZE 512
+
+/* tasks created by flight_ctl_task_create(), including the flight control
+ * task which deletes itself after the boot */
+#if (SELECT_GYRO_DYN_NOTCH == GYRO_DYN_NOTCH_ENABLED)
+#define FLIGHT_CTL_TASK_CNT 5
+#else
+#define FLIGHT_CTL_TASK_CNT 4
+#endif
+
+/* gyro spectrum analysis, one axis per period */
+#define GYRO_FFT_PERIOD_MS 10
+#define GYRO_FFT_CPU_BUDGET 0.01f //longest share of the cpu time, the period is stretched beyond it
+
+#if ((RATE_CTL_RATE % ATTITUDE_CTL_RATE) != 0) || ((RATE_CTL_RATE % POSITION_CTL_RATE) != 0)
+#error "rate group rates must divide the inner rate loop rate"
+#endif
+
+void flight_ctl_task_create(void);
+void flight_ctl_rate_group_init(void);
 void flight_ctl_semaphore_handler(void);
+void flight_ctl_trigger_handler(void);
 
 #endif
@@ -0,0 +1,175 @@
+#include <stdint.h>
+#include <math.h>
+#include "arm_math.h"
+#include "fastmath.h"
+#include "profiler.h"
+#include "ahrs.h"
+#include "math_bench.h"
+
+/* cycles of the single precision functions against the double precision ones
+ * they replaced, the "double" entries are the code before the float-only
+ * build. every call is measured alone with the dwt counter, the minimum is
+ * free of interrupts and the cost of an empty call is subtracted from it */
+
+/* inputs change with every call so nothing is hoisted out of the loop */
+static volatile float bench_in[8] = {0.12f, -0.71f, 0.93f, -0.05f, 0.44f, -0.38f, 0.67f, -0.99f};
+static volatile float bench_out;
+static int bench_idx;
+
+static float bench_input(void)
+{
+	bench_idx = (bench_idx + 1) & 7;
+	return bench_in[bench_idx];
+}
+
+static void bench_empty(void)
+{
+}
+
+static void bench_sqrt(void)
+{
+	bench_out = (float)sqrt((double)fabsf(bench_input()));
+}
+
+static void bench_sqrtf(void)
+{
+	bench_out = sqrtf(fabsf(bench_input()));
+}
+
+static void bench_atan2(void)
+{
+	bench_out = (float)atan2((double)bench_input(), (double)bench_input());
+}
+
+static void bench_atan2f(void)
+{
+	bench_out = atan2f(bench_input(), bench_input());
+}
+
+static void bench_fast_atan2f(void)
+{
+	bench_out = fast_atan2f(bench_input(), bench_input());
+}
+
+static void bench_asin(void)
+{
+	bench_out = (float)asin((double)bench_input());
+}
+
+static void bench_asinf(void)
+{
+	bench_out = asinf(bench_input());
+}
+
+static void bench_fast_asinf(void)
+{
+	bench_out = fast_asinf(bench_input());
+}
+
+static void bench_deg_to_rad_double(void)
+{
+	bench_out = (float)((double)bench_input() * (double)0.01745329252);
+}
+
+static void bench_deg_to_rad(void)
+{
+	bench_out = deg_to_rad(bench_input());
+}
+
+/* unit quaternion input, the same setup cost is in both versions */
+static void bench_quat(float *q)
+{
+	q[0] = bench_input();
+	q[1] = bench_input();
+	q[2] = bench_input();
+	q[3] = bench_input();
+	quat_normalize(q);
+}
+
+/* quat_to_euler() as it was before the float-only build */
+static void bench_quat_to_euler_double(void)
+{
+	float q[4];
+	euler_t euler;
+	bench_quat(q);
+	euler.roll = (float)atan2((double)2.0f * (double)(q[0] * q[1] + q[2] * q[3]),
+	                          (double)1.0f - (double)2.0f * (double)(q[1] * q[1] + q[2] * q[2]));
+	euler.pitch = (float)asin((double)2.0f * (double)(q[0] * q[2] - q[3] * q[1]));
+	euler.yaw = (float)atan2((double)2.0f * (double)(q[0] * q[3] + q[1] * q[2]),
+	                         (double)1.0f - (double)2.0f * (double)(q[2] * q[2] + q[3] * q[3]));
+	bench_out = euler.roll + euler.pitch + euler.yaw;
+}
+
+static void bench_quat_to_euler(void)
+{
+	float q[4];
+	euler_t euler;
+	bench_quat(q);
+	quat_to_euler(q, &euler);
+	bench_out = euler.roll + euler.pitch + euler.yaw;
+}
+
+/* calc_attitude_use_accel() as it was before the float-only build */
+static void bench_attitude_use_accel_double(void)
+{
+	vector3d_f_t accel = {.x = bench_input(), .y = bench_input(), .z = bench_input()};
+	euler_t att;
+	att.roll = (float)asin((double)accel.x);
+	att.pitch = (float)atan2((double)-accel.y, (double)accel.z);
+	bench_out = att.roll + att.pitch;
+}
+
+static void bench_attitude_use_accel(void)
+{
+	vector3d_f_t accel = {.x = bench_input(), .y = bench_input(), .z = bench_input()};
+	euler_t att;
+	calc_attitude_use_accel(&att, &accel);
+	bench_out = att.roll + att.pitch;
+}
+
+math_bench_t math_bench[] = {
+	{.name = "empty call", .func = bench_empty},
+	{.name = "sqrt (double)", .func = bench_sqrt},
+	{.name = "sqrtf", .func = bench_sqrtf},
+	{.name = "atan2 (double)", .func = bench_atan2},
+	{.name = "atan2f", .func = bench_atan2f},
+	{.name = "fast_atan2f", .func = bench_fast_atan2f},
+	{.name = "asin (double)", .func = bench_asin},
+	{.name = "asinf", .func = bench_asinf},
+	{.name = "fast_asinf", .func = bench_fast_asinf},
+	{.name = "deg_to_rad (double)", .func = bench_deg_to_rad_double},
+	{.name = "deg_to_rad", .func = bench_deg_to_rad},
+	{.name = "quat_to_euler (double)", .func = bench_quat_to_euler_double},
+	{.name = "quat_to_euler", .func = bench_quat_to_euler},
+	{.name = "calc_attitude_use_accel (double)", .func = bench_attitude_use_accel_double},
+	{.name = "calc_attitude_use_accel", .func = bench_attitude_use_accel}
+};
+
+const int math_bench_cnt = sizeof(math_bench) / sizeof(math_bench_t);
+
+/* runs once before the rate groups are started, only interrupts preempt it */
+void math_bench_run(void)
+{
+	int i, n;
+	for(i = 0; i < math_bench_cnt; i++) {
+		math_bench_t *bench = &math_bench[i];
+		profiler_reset(&bench->prof);
+		bench->min = UINT32_MAX;
+
+		for(n = 0; n < MATH_BENCH_REPEAT; n++) {
+			profiler_start(&bench->prof);
+			bench->func();
+			profiler_stop(&bench->prof);
+
+			if(bench->prof.last < bench->min) {
+				bench->min = bench->prof.last;
+			}
+		}
+	}
+
+	/* leave only the function itself */
+	uint32_t overhead = math_bench[0].min;
+	for(i = 0; i < math_bench_cnt; i++) {
+		math_bench[i].min -= overhead;
+	}
+}
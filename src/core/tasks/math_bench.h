@@ -0,0 +1,21 @@
+#ifndef __MATH_BENCH_H__
+#define __MATH_BENCH_H__
+
+#include <stdint.h>
+#include "profiler.h"
+
+#define MATH_BENCH_REPEAT 1000 //measured calls of every function
+
+typedef struct {
+	const char *name;
+	void (*func)(void);
+	uint32_t min;     //fastest call, free of interrupts [cycles]
+	profiler_t prof;  //every call [cycles]
+} math_bench_t;
+
+extern math_bench_t math_bench[];
+extern const int math_bench_cnt;
+
+void math_bench_run(void);
+
+#endif
@@ -0,0 +1,136 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "bound.h"
+#include "profiler.h"
+#include "rate_group.h"
+
+void rate_group_init(rate_group_t *group, int trigger_rate, int rate, float deadline_us)
+{
+	group->semphr = xSemaphoreCreateBinaryStatic(&group->semphr_buf);
+	group->divider = trigger_rate / rate;
+	group->cnt = 1; //release on the first trigger
+	group->period = 1.0f / (float)rate;
+	group->period_cycles = PROFILER_CPU_FREQ / rate;
+	group->deadline = (uint32_t)(deadline_us * ((float)PROFILER_CPU_FREQ / 1000000.0f));
+	group->dt = group->period;
+	group->running = false;
+	group->cycle_cnt = 0;
+	group->deadline_miss = 0;
+	group->overrun = 0;
+	group->skipped = 0;
+	profiler_reset(&group->wake_profiler);
+	profiler_reset(&group->response_profiler);
+	memset(group->jitter_hist, 0, sizeof(group->jitter_hist));
+	memset(group->exec_hist, 0, sizeof(group->exec_hist));
+}
+
+static void rate_group_hist_add(uint32_t *hist, uint32_t cycles)
+{
+	uint32_t us = cycles / (PROFILER_CPU_FREQ / 1000000);
+
+	/* bin = number of significant bits, a single clz instruction */
+	int bin = (us == 0) ? 0 : 32 - __builtin_clz(us);
+	if(bin >= RATE_GROUP_HIST_BINS) {
+		bin = RATE_GROUP_HIST_BINS - 1;
+	}
+
+	hist[bin]++;
+}
+
+/* counts the trigger ticks down, returns true if the group is due */
+static bool rate_group_tick(rate_group_t *group)
+{
+	if(--group->cnt != 0) {
+		return false;
+	}
+
+	group->cnt = group->divider;
+
+	/* no accounting before the task has completed its first cycle,
+	 * releases pile up while the flight controller initializes */
+	if(group->running == true && group->cycle_cnt > 0) {
+		group->overrun++;
+	}
+
+	return true;
+}
+
+static void rate_group_released(rate_group_t *group, BaseType_t given, uint32_t sample_time)
+{
+	/* the binary semaphore is still given if the task did not even take
+	 * the previous release, this release is lost */
+	if(given != pdTRUE) {
+		if(group->cycle_cnt > 0) {
+			group->skipped++;
+		}
+		return;
+	}
+
+	group->release_time = sample_time;
+}
+
+/* called by the flight control trigger, every group divides it down to its own rate
+ * so all groups are released phase aligned on the same imu sample */
+void rate_group_trigger_from_isr(rate_group_t *group, uint32_t sample_time,
+                                 BaseType_t *higher_priority_task_woken)
+{
+	if(rate_group_tick(group) == true) {
+		rate_group_released(group, xSemaphoreGiveFromISR(group->semphr, higher_priority_task_woken),
+		                    sample_time);
+	}
+}
+
+/* task context version, the caller must have a higher priority than the group */
+void rate_group_trigger(rate_group_t *group, uint32_t sample_time)
+{
+	if(rate_group_tick(group) == true) {
+		rate_group_released(group, xSemaphoreGive(group->semphr), sample_time);
+	}
+}
+
+/* block until the next release, returns the measured period */
+float rate_group_wait(rate_group_t *group)
+{
+	while(xSemaphoreTake(group->semphr, portMAX_DELAY) == pdFALSE);
+
+	group->start_time = profiler_get_cycles();
+	group->running = true;
+
+	uint32_t release_time = group->release_time;
+	profiler_update(&group->wake_profiler, group->start_time - release_time);
+
+	if(group->cycle_cnt > 0) {
+		/* wake up jitter */
+		uint32_t period = group->start_time - group->start_time_last;
+		rate_group_hist_add(group->jitter_hist, period > group->period_cycles ?
+		                    period - group->period_cycles : group->period_cycles - period);
+
+		/* bounded in case of a stalled or missing imu sample */
+		group->dt = (float)(release_time - group->release_time_last) * (1.0f / PROFILER_CPU_FREQ);
+		bound_float(&group->dt, 4.0f * group->period, 0.0f);
+	}
+	group->release_time_last = release_time;
+	group->start_time_last = group->start_time;
+
+	return group->dt;
+}
+
+void rate_group_complete(rate_group_t *group)
+{
+	uint32_t complete_time = profiler_get_cycles();
+	group->running = false;
+
+	uint32_t response_time = complete_time - group->release_time_last;
+	profiler_update(&group->response_profiler, response_time);
+	rate_group_hist_add(group->exec_hist, complete_time - group->start_time);
+
+	/* the first release may be stale since it was given before the task started */
+	if(response_time > group->deadline && group->cycle_cnt > 0) {
+		group->deadline_miss++;
+	}
+
+	group->cycle_cnt++;
+}
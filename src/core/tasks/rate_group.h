@@ -0,0 +1,47 @@
+#ifndef __RATE_GROUP_H__
+#define __RATE_GROUP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "profiler.h"
+
+/* log2 histogram bins, bin 0 counts < 1us and bin n counts [2^(n-1), 2^n) us */
+#define RATE_GROUP_HIST_BINS 16
+
+typedef struct {
+	SemaphoreHandle_t semphr;
+	StaticSemaphore_t semphr_buf;
+	int divider;                    //trigger ticks per release
+	int cnt;
+	float period;                   //nominal period [s]
+	uint32_t deadline;              //allowed imu sample to completion time [cycles]
+	volatile uint32_t release_time; //imu sample timestamp of the latest release [cycles]
+	uint32_t release_time_last;
+	float dt;                       //measured period of the current cycle [s]
+	uint32_t period_cycles;         //nominal period [cycles]
+	volatile bool running;          //released and not completed yet
+	uint32_t start_time;            //task wake up of the current cycle [cycles]
+	uint32_t start_time_last;
+	uint32_t cycle_cnt;
+
+	/* timing faults */
+	uint32_t deadline_miss;         //completed later than the deadline
+	volatile uint32_t overrun;      //released again before the current cycle completed
+	volatile uint32_t skipped;      //release lost since the previous one was not taken yet
+
+	profiler_t wake_profiler;       //imu sample to task wake up time
+	profiler_t response_profiler;   //imu sample to completion time
+	uint32_t jitter_hist[RATE_GROUP_HIST_BINS]; //|wake up period - nominal period|
+	uint32_t exec_hist[RATE_GROUP_HIST_BINS];   //wake up to completion time
+} rate_group_t;
+
+void rate_group_init(rate_group_t *group, int trigger_rate, int rate, float deadline_us);
+void rate_group_trigger_from_isr(rate_group_t *group, uint32_t sample_time,
+                                 BaseType_t *higher_priority_task_woken);
+void rate_group_trigger(rate_group_t *group, uint32_t sample_time);
+float rate_group_wait(rate_group_t *group);
+void rate_group_complete(rate_group_t *group);
+
+#endif
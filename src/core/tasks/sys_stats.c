@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "profiler.h"
+#include "sys_stats.h"
+
+volatile uint32_t sys_stats_switch_cnt[SYS_STATS_TASK_MAX];
+
+isr_stats_t isr_stats[SYS_STATS_ISR_CNT];
+sys_stats_t sys_stats;
+
+/* counters of the last update */
+static uint32_t update_time_last;
+static uint32_t run_time_last[SYS_STATS_TASK_MAX];
+static uint32_t switch_cnt_last[SYS_STATS_TASK_MAX];
+static uint32_t isr_busy_last[SYS_STATS_ISR_CNT];
+static uint32_t isr_cnt_last[SYS_STATS_ISR_CNT];
+
+void sys_stats_init(void)
+{
+	/* measure the cost of the interrupt accounting hooks on a spare slot,
+	 * the minimum excludes runs which got interrupted */
+	isr_stats_t isr_stats_save = isr_stats[0];
+	uint32_t overhead = UINT32_MAX;
+
+	int i;
+	for(i = 0; i < 16; i++) {
+		uint32_t start = profiler_get_cycles();
+		sys_stats_isr_enter(0);
+		sys_stats_isr_exit(0);
+		uint32_t cycles = profiler_get_cycles() - start;
+		if(cycles < overhead) {
+			overhead = cycles;
+		}
+	}
+
+	isr_stats[0] = isr_stats_save;
+	sys_stats.isr_hook_overhead = overhead;
+
+	update_time_last = profiler_get_cycles();
+}
+
+/* recalculate the statistics once a window has elapsed, called periodically
+ * by the debug link */
+void sys_stats_update(void)
+{
+	uint32_t now = profiler_get_cycles();
+	uint32_t window = now - update_time_last;
+
+	if(window < (uint32_t)(SYS_STATS_WINDOW * PROFILER_CPU_FREQ)) {
+		return;
+	}
+
+	profiler_start(&sys_stats.update_profiler);
+
+	update_time_last = now;
+
+	float to_percent = 100.0f / (float)window;
+	float to_rate = (float)PROFILER_CPU_FREQ / (float)window;
+
+	/* tasks, counters are 32 bits so every difference stays valid as long as the
+	 * window is shorter than the cycle counter overflow period (~23s) */
+	TaskStatus_t status[SYS_STATS_TASK_MAX];
+	uint32_t total_run_time;
+	int task_cnt = uxTaskGetSystemState(status, SYS_STATS_TASK_MAX, &total_run_time);
+
+	uint32_t switch_cnt_total = 0;
+
+	int i, n = 0;
+	for(i = 0; i < task_cnt; i++) {
+		/* a task created beyond the table has no counters, never share a slot */
+		UBaseType_t slot = status[i].xTaskNumber;
+		if(slot >= SYS_STATS_TASK_MAX) {
+			continue;
+		}
+
+		uint32_t switch_cnt_now = sys_stats_switch_cnt[slot];
+		uint32_t run_time = status[i].ulRunTimeCounter - run_time_last[slot];
+		uint32_t switch_cnt = switch_cnt_now - switch_cnt_last[slot];
+		run_time_last[slot] = status[i].ulRunTimeCounter;
+		switch_cnt_last[slot] = switch_cnt_now;
+		switch_cnt_total += switch_cnt;
+
+		sys_stats.task[n].task_number = status[i].xTaskNumber;
+		sys_stats.task[n].cpu_load = (float)run_time * to_percent;
+		sys_stats.task[n].switch_rate = (float)switch_cnt * to_rate;
+		sys_stats.task[n].stack_high_water = status[i].usStackHighWaterMark;
+		n++;
+	}
+
+	sys_stats.task_cnt = n;
+	sys_stats.context_switch_rate = (float)switch_cnt_total * to_rate;
+
+	/* interrupts */
+	for(i = 0; i < SYS_STATS_ISR_CNT; i++) {
+		uint32_t busy = isr_stats[i].busy;
+		uint32_t cnt = isr_stats[i].cnt;
+		sys_stats.isr_load[i] = (float)(busy - isr_busy_last[i]) * to_percent;
+		sys_stats.isr_rate[i] = (float)(cnt - isr_cnt_last[i]) * to_rate;
+		isr_busy_last[i] = busy;
+		isr_cnt_last[i] = cnt;
+
+		/* racing with the interrupt only loses one sample of the new window */
+		sys_stats.isr_max[i] = profiler_cycles_to_us((float)isr_stats[i].max);
+		isr_stats[i].max = 0;
+	}
+
+	profiler_stop(&sys_stats.update_profiler);
+}
@@ -0,0 +1,70 @@
+#ifndef __SYS_STATS_H__
+#define __SYS_STATS_H__
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "profiler.h"
+
+#define SYS_STATS_WINDOW 1.0f //[s], statistics are averaged over this window
+
+/* interrupts with accounting hooks */
+#define SYS_STATS_ISR_IMU_EXTI 0
+#define SYS_STATS_ISR_SBUS_UART4 1
+#define SYS_STATS_ISR_GPS_OPTITRACK_UART7 2
+#define SYS_STATS_ISR_TELEM_USART3 3
+#define SYS_STATS_ISR_SYS_TIMER 4
+#define SYS_STATS_ISR_CNT 5
+
+typedef struct {
+	uint32_t start;
+	uint32_t busy; //accumulated cycles, only differences are meaningful
+	uint32_t cnt;
+	uint32_t max;  //worst case duration of the current window [cycles]
+} isr_stats_t;
+
+typedef struct {
+	UBaseType_t task_number;
+	float cpu_load;             //[%], includes the interrupts which preempted the task
+	float switch_rate;          //[1/s]
+	uint16_t stack_high_water;  //minimum free stack ever [words]
+} task_stats_t;
+
+typedef struct {
+	int task_cnt;
+	task_stats_t task[SYS_STATS_TASK_MAX];
+	float isr_load[SYS_STATS_ISR_CNT]; //[%]
+	float isr_rate[SYS_STATS_ISR_CNT]; //[1/s]
+	/* worst case execution time of the window [us]. this is the longest time
+	 * the interrupt blocks the sources of the same or lower priority, the
+	 * entry latency itself is not measured */
+	float isr_max[SYS_STATS_ISR_CNT];
+	float context_switch_rate;         //[1/s]
+
+	/* cost of the accounting itself */
+	uint32_t isr_hook_overhead;  //one enter/exit pair [cycles]
+	profiler_t update_profiler;  //sys_stats_update() execution time
+} sys_stats_t;
+
+extern isr_stats_t isr_stats[SYS_STATS_ISR_CNT];
+extern sys_stats_t sys_stats;
+
+static inline void sys_stats_isr_enter(int isr)
+{
+	isr_stats[isr].start = profiler_get_cycles();
+}
+
+static inline void sys_stats_isr_exit(int isr)
+{
+	uint32_t cycles = profiler_get_cycles() - isr_stats[isr].start;
+	isr_stats[isr].busy += cycles;
+	isr_stats[isr].cnt++;
+	if(cycles > isr_stats[isr].max) {
+		isr_stats[isr].max = cycles;
+	}
+}
+
+void sys_stats_init(void);
+void sys_stats_update(void);
+
+#endif
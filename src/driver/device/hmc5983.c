@@ -2,59 +2,126 @@
 
 #include "spi.h"
 #include "hmc5983.h"
+#include "sys_time.h"
+#include "slot.h"
+#include "flash.h"
+#include "imu_calib.h"
 
 #include "vector.h"
 
 #define HMC5893_MAG_SCALE HMC5983_SCALE_1
 
-void hmc5983_read(uint8_t register_address, uint8_t *data, int data_count)
+/* chip to body frame. the board has no magnetometer (see hmc5983.h), so this
+ * depends on the mounting of the external one: with its x and y marks parallel
+ * to the ones of the mpu6500 it is the same as the mpu6500 gyro rotation */
+#define HMC5983_ROTATION { \
+	{-1,  0,  0}, \
+	{ 0, -1,  0}, \
+	{ 0,  0, +1}}
+
+#define HMC5983_PROBE_RETRY 3
+#define HMC5983_OVERFLOW -4096 //output of a saturated axis
+
+/* boot state machine */
+enum {
+	HMC5983_BOOT_PROBE,
+	HMC5983_BOOT_READY,
+	HMC5983_BOOT_FAILED
+};
+
+static int hmc5983_boot_state;
+static int hmc5983_probe_cnt;
+
+/* no hard or soft iron until tools/mag_calib_fit stored a fitted one */
+static const hmc5983_calib_param_t hmc5983_calib_default = {
+	.hard_iron = {0, 0, 0},
+	.soft_iron = {1, 0, 0, 0, 1, 0, 0, 0, 1}
+};
+
+static const int16_t hmc5983_rotation[3][3] = HMC5983_ROTATION;
+static imu_calib_kernel_t hmc5983_calib; //body = rotation * scale * soft_iron * (raw - hard_iron)
+
+SLOT_ALLOC(hmc5983_slot, hmc5983_sample_t);
+
+static void hmc5983_read_register(uint8_t register_address, uint8_t *data, int data_count)
 {
 	hmc5983_chip_select();
 
 	//Write the register address
-	spi_read_write(SPI1, register_address | 0xC0); //Continuous byte read
+	spi_read_write(SPI3, register_address | 0xC0); //Continuous byte read
 
 	//Read the data
 	int i;
 	for(i = 0; i < data_count; i++)
-		data[i] = spi_read_write(SPI1, 0x00);
+		data[i] = spi_read_write(SPI3, 0x00);
 
 	hmc5983_chip_deselect();
 }
 
-void hmc5983_write(uint8_t register_address, uint8_t data)
+static void hmc5983_write(uint8_t register_address, uint8_t data)
 {
 	hmc5983_chip_select();
 
 	//Write the register address
-	spi_read_write(SPI1, register_address);
+	spi_read_write(SPI3, register_address);
 	//Write the data
-	spi_read_write(SPI1, data);
+	spi_read_write(SPI3, data);
 
 	hmc5983_chip_deselect();
 }
 
-int hmc5983_read_identification()
+static bool hmc5983_read_identification(void)
 {
 	uint8_t data[3] = {0}; //Identification register A B and C
-	hmc5983_read(HMC5983_ID_A, data, 3);
+	hmc5983_read_register(HMC5983_ID_A, data, 3);
 
-	/* If can't correctly read the hmc5983 identification register then return 1 */
-	if(data[0] != 0x48 || data[1] != 0x34 || data[2] != 0x33) return 1;
+	return data[0] == 0x48 && data[1] == 0x34 && data[2] == 0x33;
+}
 
-	return 0;
+void hmc5983_init(void)
+{
+	hmc5983_boot_state = HMC5983_BOOT_PROBE;
+	hmc5983_probe_cnt = 0;
+
+	hmc5983_calib_param_t calib;
+	if(flash_param_load(FLASH_PARAM_MAG_CALIB, &calib, sizeof(calib)) == false) {
+		calib = hmc5983_calib_default;
+	}
+
+	/* the rotation, scale and soft iron are fused into one matrix */
+	int i, j, k;
+	for(i = 0; i < 3; i++) {
+		hmc5983_calib.bias[i] = calib.hard_iron[i];
+		for(j = 0; j < 3; j++) {
+			float sum = 0.0f;
+			for(k = 0; k < 3; k++) {
+				sum += hmc5983_rotation[i][k] * calib.soft_iron[k * 3 + j];
+			}
+			hmc5983_calib.A[i * 3 + j] = sum * HMC5893_MAG_SCALE;
+		}
+	}
 }
 
-int hmc5983_init()
+/* non-blocking initialization, called periodically by the boot sequence.
+ * a missing magnetometer does not hold the boot, it is just never sampled */
+bool hmc5983_init_step(void)
 {
-	/* Check HMC5983 device is alive or not */
-	if(hmc5983_read_identification() == 1) return 1;
+	if(hmc5983_boot_state != HMC5983_BOOT_PROBE) {
+		return true;
+	}
+
+	if(hmc5983_read_identification() == false) {
+		if(++hmc5983_probe_cnt >= HMC5983_PROBE_RETRY) {
+			hmc5983_boot_state = HMC5983_BOOT_FAILED;
+		}
+		return hmc5983_boot_state == HMC5983_BOOT_FAILED;
+	}
 
 	//HMC5983 configuration A :
 	//(1)Enable temperature sensor compensation
 	//(2)samples averaged : 8 per measurement output
-	//(3)Typical data output rate : 220Hz
-	hmc5983_write(HMC5983_CONF_A, 0xFC);
+	//(3)Typical data output rate : 75Hz (polled by the 50Hz position loop)
+	hmc5983_write(HMC5983_CONF_A, 0xF8);
 
 	//MC5983 configuration B : highest resolution
 	hmc5983_write(HMC5983_CONF_B, 0x00);
@@ -62,25 +129,45 @@ int hmc5983_init()
 	//HMC5983 mode : continuous-measurement mode
 	hmc5983_write(HMC5983_MODE, 0x00);
 
-	return 0;
+	hmc5983_boot_state = HMC5983_BOOT_READY;
+	return true;
 }
 
-void hmc5983_read_unscaled_data(vector3d_16_t *mag_unscaled_data)
+/* called periodically, publishes a sample if the device has a new one */
+void hmc5983_update(void)
 {
-	uint8_t buffer[6];
-
-	/* Get the new data */
-	hmc5983_read(0x03, buffer, 6);
-
-	mag_unscaled_data->x = (buffer[0] << 8) | buffer[1];
-	mag_unscaled_data->y = (buffer[4] << 8) | buffer[5];
-	mag_unscaled_data->z = (buffer[2] << 8) | buffer[3];
+	if(hmc5983_boot_state != HMC5983_BOOT_READY) {
+		return;
+	}
+
+	/* status and data registers in one transfer, rdy is bit 0 of the status */
+	uint8_t buffer[7];
+	hmc5983_read_register(HMC5983_OUT_X_MSB, buffer, 7);
+	if((buffer[6] & 0x01) == 0) {
+		return;
+	}
+
+	/* output order is x, z, y */
+	vector3d_16_t mag_unscaled = {
+		.x = (int16_t)((buffer[0] << 8) | buffer[1]),
+		.y = (int16_t)((buffer[4] << 8) | buffer[5]),
+		.z = (int16_t)((buffer[2] << 8) | buffer[3])
+	};
+
+	if(mag_unscaled.x == HMC5983_OVERFLOW || mag_unscaled.y == HMC5983_OVERFLOW ||
+	   mag_unscaled.z == HMC5983_OVERFLOW) {
+		return;
+	}
+
+	hmc5983_sample_t sample;
+	imu_calib_apply(&hmc5983_calib, &mag_unscaled, &sample.mag);
+	sample.raw = mag_unscaled;
+	sample.time_ms = get_sys_time_ms();
+	slot_publish(&hmc5983_slot, &sample);
 }
 
-void hmc5983_mag_convert_to_scale(vector3d_16_t *mag_unscaled_data,
-                                  vector3d_f_t *mag_scaled_data)
+/* returns the publish count, changes with every new sample */
+uint32_t hmc5983_read(hmc5983_sample_t *sample)
 {
-	mag_scaled_data->x = mag_unscaled_data->x * HMC5893_MAG_SCALE;
-	mag_scaled_data->y = mag_unscaled_data->y * HMC5893_MAG_SCALE;
-	mag_scaled_data->z = mag_unscaled_data->z * HMC5893_MAG_SCALE;
+	return slot_read(&hmc5983_slot, sample);
 }
@@ -1,6 +1,10 @@
 #ifndef __HMC5983_H
 #define __HMC5983_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include "stm32f4xx_conf.h"
+#include "spi.h"
 #include "vector.h"
 
 #define HMC5983_CONF_A 0x00
@@ -13,6 +17,7 @@
 #define HMC5983_OUT_Z_LSB 0x06
 #define HMC5983_OUT_Y_MSB 0x07
 #define HMC5983_OUT_Y_LSB 0x08
+#define HMC5983_STATUS 0x09
 
 #define HMC5983_ID_A 0x0A
 #define HMC5983_ID_B 0x0B
@@ -27,13 +32,33 @@
 #define HMC5983_SCALE_7 0.003030303f
 #define HMC5983_SCALE_8 0.004347826f
 
-#define hmc5983_chip_select() GPIO_ResetBits(GPIOA, GPIO_Pin_4)
-#define hmc5983_chip_deselect() GPIO_SetBits(GPIOA, GPIO_Pin_4)
+/* board wiring: the board has no magnetometer of its own (hardware/schematic.png),
+ * spi3 only carries BAR_SS (pa15) of the ms5611 and none of its signals reach a
+ * connector (hardware/pinout.png). an external hmc5983 is wired to the ms5611
+ * bus with its chip select on a pin without a net, pb12 by default */
+#define HMC5983_CS_GPIO GPIOB
+#define HMC5983_CS_PIN GPIO_Pin_12
+#define HMC5983_CS_GPIO_CLK RCC_AHB1Periph_GPIOB
 
-int hmc5983_init();
+#define hmc5983_chip_select() GPIO_ResetBits(HMC5983_CS_GPIO, HMC5983_CS_PIN)
+#define hmc5983_chip_deselect() GPIO_SetBits(HMC5983_CS_GPIO, HMC5983_CS_PIN)
 
-void hmc5983_read_unscaled_data(vector3d_16_t *mag_unscaled_data);
-void hmc5983_mag_convert_to_scale(vector3d_16_t *mag_unscaled_data,
-                                  vector3d_f_t *mag_scaled_data);
+/* flash record of FLASH_PARAM_MAG_CALIB, written by tools/mag_calib_fit.
+ * chip frame: mag = soft_iron * (raw - hard_iron), before the body rotation */
+typedef struct {
+	float hard_iron[3];     //[lsb]
+	float soft_iron[3 * 3]; //row major
+} hmc5983_calib_param_t;
+
+typedef struct {
+	vector3d_f_t mag;  //calibrated, imu body frame [gauss]
+	vector3d_16_t raw; //chip frame, for the calibration log [lsb]
+	float time_ms;
+} hmc5983_sample_t;
+
+void hmc5983_init(void);
+bool hmc5983_init_step(void);
+void hmc5983_update(void);
+uint32_t hmc5983_read(hmc5983_sample_t *sample);
 
 #endif
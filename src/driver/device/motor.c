@@ -2,16 +2,86 @@
 
 #include "delay.h"
 #include "motor.h"
+#include "profiler.h"
+#include "proj_config.h"
+
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_PWM)
+#define PWM_TIM4_TICK_TO_CYCLES 18 //180MHz / 10MHz
+#else
+uint32_t motor_trigger_time;
+#endif
+
+#define MOTOR_ESC_ARM_TIME_MS 1000 //minimum pulse hold time for the esc to arm
+
+static uint32_t motor_init_time;
 
 void set_motor_pwm_pulse(volatile uint32_t *motor, uint16_t pulse)
 {
 	if(pulse < MOTOR_PULSE_MIN) {
-		*motor = MOTOR_PULSE_MIN;
+		pulse = MOTOR_PULSE_MIN;
 	} else if(pulse > MOTOR_PULSE_MAX) {
-		*motor = MOTOR_PULSE_MAX;
+		pulse = MOTOR_PULSE_MAX;
+	}
+
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_PWM)
+	*motor = pulse;
+#elif (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_DSHOT600)
+	/* minimum pulse stops the motor, otherwise linearly mapped into 48~2047 */
+	if(pulse == MOTOR_PULSE_MIN) {
+		*motor = DSHOT_CMD_MOTOR_STOP;
 	} else {
-		*motor = pulse;
+		*motor = (uint32_t)(pulse - MOTOR_PULSE_MIN) *
+		         (DSHOT_THROTTLE_MAX - DSHOT_THROTTLE_MIN) /
+		         (MOTOR_PULSE_MAX - MOTOR_PULSE_MIN) + DSHOT_THROTTLE_MIN;
+	}
+#else
+	/* convert standard pwm pulse to oneshot pulse width */
+	uint32_t oneshot_pulse = (uint32_t)(pulse - MOTOR_PULSE_MIN) *
+	                         (ONESHOT_PULSE_MAX - ONESHOT_PULSE_MIN) /
+	                         (MOTOR_PULSE_MAX - MOTOR_PULSE_MIN) + ONESHOT_PULSE_MIN;
+
+	/* pwm2 mode: output goes high at ccr and falls at the end of period */
+	*motor = ONESHOT_PULSE_MAX + 1 - oneshot_pulse;
+#endif
+}
+
+/* fire the motor pulses with the latest commands, the free running pwm
+ * does not need to be triggered */
+void motor_output_trigger(void)
+{
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_DSHOT600)
+	dshot_write();
+	motor_trigger_time = profiler_get_cycles();
+#elif (SELECT_MOTOR_OUTPUT != MOTOR_OUTPUT_PWM)
+	TIM_Cmd(TIM4, ENABLE);
+	TIM_Cmd(TIM1, ENABLE);
+	motor_trigger_time = profiler_get_cycles();
+#endif
+}
+
+/* returns the dwt timestamp when the esc receives the latest command */
+uint32_t motor_output_get_pulse_time(void)
+{
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_PWM)
+	/* new command is sent with the next period of the free running timer */
+	uint32_t remained_ticks = TIM4->ARR - TIM4->CNT;
+	return profiler_get_cycles() + remained_ticks * PWM_TIM4_TICK_TO_CYCLES;
+#else
+	return motor_trigger_time;
+#endif
+}
+
+/* keep feeding the esc with current pulses for the given time */
+static void motor_output_hold(uint32_t ms)
+{
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_PWM)
+	blocked_delay_ms(ms);
+#else
+	while(ms--) {
+		motor_output_trigger();
+		blocked_delay_ms(1);
 	}
+#endif
 }
 
 void motor_init(void)
@@ -22,7 +92,21 @@ void motor_init(void)
 	set_motor_pwm_pulse(MOTOR4, MOTOR_PULSE_MIN);
 	set_motor_pwm_pulse(MOTOR5, MOTOR_PULSE_MIN);
 	set_motor_pwm_pulse(MOTOR6, MOTOR_PULSE_MIN);
-	blocked_delay_ms(1000);
+	motor_output_trigger();
+
+	motor_init_time = profiler_get_cycles();
+}
+
+/* non-blocking esc arming, called periodically by the boot sequence until
+ * the minimum pulse was held long enough and true is returned */
+bool motor_init_step(void)
+{
+#if (SELECT_MOTOR_OUTPUT != MOTOR_OUTPUT_PWM)
+	/* oneshot and dshot have no free running output, keep sending pulses */
+	motor_output_trigger();
+#endif
+
+	return delay_elapsed_ms(motor_init_time, MOTOR_ESC_ARM_TIME_MS);
 }
 
 void motor_halt(void)
@@ -33,17 +117,19 @@ void motor_halt(void)
 	set_motor_pwm_pulse(MOTOR4, MOTOR_PULSE_MIN);
 	set_motor_pwm_pulse(MOTOR5, MOTOR_PULSE_MIN);
 	set_motor_pwm_pulse(MOTOR6, MOTOR_PULSE_MIN);
+	motor_output_trigger();
 }
 
 void motor_thrust_test(float ch1_motor_percentage)
 {
 	set_motor_pwm_pulse(MOTOR1, MOTOR_PULSE_MIN);
-	blocked_delay_ms(3000);
+	motor_output_hold(3000);
 
 	ch1_motor_percentage /= 100.0f;
 	float motor_range = (float)MOTOR_PULSE_MAX - MOTOR_PULSE_MIN;
 	float motor_bias = (float)MOTOR_PULSE_MIN;
 	set_motor_pwm_pulse(MOTOR1, (uint16_t)(motor_range * ch1_motor_percentage + motor_bias));
+	motor_output_trigger();
 }
 
 void esc_calibrate(void)
@@ -55,7 +141,7 @@ void esc_calibrate(void)
 	set_motor_pwm_pulse(MOTOR5, MOTOR_PULSE_MAX);
 	set_motor_pwm_pulse(MOTOR6, MOTOR_PULSE_MAX);
 
-	blocked_delay_ms(6000);
+	motor_output_hold(6000);
 
 	set_motor_pwm_pulse(MOTOR1, MOTOR_PULSE_MIN);
 	set_motor_pwm_pulse(MOTOR2, MOTOR_PULSE_MIN);
@@ -64,5 +150,7 @@ void esc_calibrate(void)
 	set_motor_pwm_pulse(MOTOR5, MOTOR_PULSE_MIN);
 	set_motor_pwm_pulse(MOTOR6, MOTOR_PULSE_MIN);
 
-	while(1);
+	while(1) {
+		motor_output_hold(1000);
+	}
 }
@@ -1,7 +1,9 @@
 #ifndef __MOTOR_H__
 #define __MOTOR_H__
 
+#include <stdbool.h>
 #include "stm32f4xx.h"
+#include "proj_config.h"
 
 #define DJI_ESC_PULSE_MAX 20750
 #define DJI_ESC_PULSE_MIN 11000
@@ -9,16 +11,51 @@
 #define MOTOR_PULSE_MAX DJI_ESC_PULSE_MAX
 #define MOTOR_PULSE_MIN DJI_ESC_PULSE_MIN
 
+/* oneshot timings, MOTOR_PULSE_MIN~MOTOR_PULSE_MAX is linearly mapped into
+ * ONESHOT_PULSE_MIN~ONESHOT_PULSE_MAX timer ticks */
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_ONESHOT125)
+#define ONESHOT_TIM1_PRESCALER 18 //180MHz / 18 = 10MHz
+#define ONESHOT_TIM4_PRESCALER 9  //90MHz / 9 = 10MHz
+#define ONESHOT_PULSE_MIN 1250    //125us
+#define ONESHOT_PULSE_MAX 2500    //250us
+#elif (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_ONESHOT42)
+#define ONESHOT_TIM1_PRESCALER 6  //180MHz / 6 = 30MHz
+#define ONESHOT_TIM4_PRESCALER 3  //90MHz / 3 = 30MHz
+#define ONESHOT_PULSE_MIN 1260    //42us
+#define ONESHOT_PULSE_MAX 2520    //84us
+#elif (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_MULTISHOT)
+#define ONESHOT_TIM1_PRESCALER 2  //180MHz / 2 = 90MHz
+#define ONESHOT_TIM4_PRESCALER 1  //90MHz / 1 = 90MHz
+#define ONESHOT_PULSE_MIN 450     //5us
+#define ONESHOT_PULSE_MAX 2250    //25us
+#endif
+
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_DSHOT600)
+#include "dshot.h"
+
+/* commands are buffered and sent by dshot_write(), motor 5 and 6 are not
+ * connected since timer4 channel3/4 have no usable dma request */
+#define MOTOR1 &dshot_throttle[0]
+#define MOTOR2 &dshot_throttle[1]
+#define MOTOR3 &dshot_throttle[2]
+#define MOTOR4 &dshot_throttle[3]
+#define MOTOR5 &dshot_throttle[4]
+#define MOTOR6 &dshot_throttle[5]
+#else
 #define MOTOR1 &TIM4->CCR1
 #define MOTOR2 &TIM4->CCR2
 #define MOTOR3 &TIM1->CCR4
 #define MOTOR4 &TIM1->CCR3
 #define MOTOR5 &TIM4->CCR3
 #define MOTOR6 &TIM4->CCR4
+#endif
 
 void set_motor_pwm_pulse(volatile uint32_t *motor, uint16_t pulse);
 void motor_init(void);
+bool motor_init_step(void);
 void motor_halt(void);
+void motor_output_trigger(void);
+uint32_t motor_output_get_pulse_time(void);
 
 void motor_thrust_test(float ch1_motor_percentage);
 void esc_calibrate(void);
@@ -1,26 +1,137 @@
 #include <stdlib.h>
 #include <stdbool.h>
+#include <math.h>
+#include "FreeRTOS.h"
+#include "task.h"
 #include "stm32f4xx_conf.h"
 #include "delay.h"
 #include "uart.h"
 #include "led.h"
 #include "mpu6500.h"
+#include "mpu6500_frame.h"
 #include "vector.h"
 #include "lpf.h"
 #include "imu.h"
+#include "profiler.h"
+#include "rpm_filter.h"
+#include "gyro_fft.h"
+#include "dyn_notch.h"
+#include "imu_preint.h"
+#include "ahrs.h"
+#include "ccm.h"
+#include "fc_task.h"
+#include "ring.h"
+#include "deferred_work.h"
+#include "flash.h"
+#include "imu_calib.h"
+#include "slot.h"
+#include "proj_config.h"
+
+#define IMU_SAMPLES_PER_CTL_LOOP ((int)(MPU6500_SAMPLE_RATE / RATE_CTL_RATE))
 
 #define MPU6500_ACCEL_SCALE MPU6500A_16g
 #define MPU6500_GYRO_SCALE MPU6500G_2000dps
 
-#define GYRO_CALIB_SAMPLE_CNT 10000;
+/* the gyro bias is averaged over every stationary window, also after boot */
+#define GYRO_BIAS_WINDOW_TIME 0.5f //[s]
+#define GYRO_BIAS_WINDOW_SAMPLE_CNT ((int)(MPU6500_SAMPLE_RATE * GYRO_BIAS_WINDOW_TIME))
+#define GYRO_STILL_RANGE 40             //peak to peak gyro of a stationary window (~2.4dps) [lsb]
+#define ACCEL_STILL_STD 60.0f           //accel standard deviation of a stationary window (~0.03g) [lsb]
+#define GYRO_BIAS_REFINE_GAIN 0.1f      //weight of a new stationary window
+#define GYRO_BIAS_TEMP_TOLERANCE 10.0f  //temperature range the stored bias is used for [degC]
+#define GYRO_BIAS_STORE_DIFF 1.0f       //bias change which is persisted [lsb]
+#define GYRO_BIAS_STORE_TEMP_DIFF 3.0f  //temperature change which is persisted [degC]
+
+#define MPU6500_TEMP_SENSITIVITY 333.87f //[lsb/degC]
+#define MPU6500_TEMP_OFFSET 21.0f        //[degC]
+
+#define MPU6500_RESET_TIME_MS 100 //power-on reset start-up time of the datasheet
+
+/* boot state machine */
+enum {
+	MPU6500_BOOT_PROBE,
+	MPU6500_BOOT_RESET,
+	MPU6500_BOOT_CALIB,
+	MPU6500_BOOT_READY
+};
+
+typedef struct {
+	vector3d_f_t bias; //[lsb]
+	float temp;        //[degC]
+} gyro_bias_param_t;
+
+typedef struct {
+	int cnt;
+	float sum[3];
+	float accel_sum[3];
+	int16_t accel_ref[3];    //first accel sample, the deviation sums stay small
+	float accel_dev_sum[3];
+	float accel_dev_sq_sum[3];
+	float temp_sum;
+	int16_t min[3];
+	int16_t max[3];
+} gyro_bias_window_t;
+
+static gyro_bias_param_t gyro_bias;        //in use, owned by the sample decoding
+static gyro_bias_param_t gyro_bias_stored; //content of the flash
+static bool gyro_bias_stored_valid = false;
+static volatile bool gyro_bias_store_pending = false;
+static volatile bool mpu6500_armed = false; //no bias refinement or flash writes in flight
+static gyro_bias_window_t gyro_bias_window;
+
+/* thermal calibration, used unless tools/imu_calib_fit stored a fitted model */
+static const imu_calib_param_t mpu6500_calib_default = {
+	.accel = {
+		/* accel x/y/z 6-face min/max at room temperature. they were measured
+		 * with the old byte composition -((int16_t)hi << 8) | lo, each value
+		 * here is the sample that composed to the recorded one (+450, +200,
+		 * +480 and 2020/-2111, 2079/-2043, 2558/-2048) */
+		.bias = {{+62}, {-200}, {+32}},
+		.sens = {{(1564.0f + 2497.0f) / (4096.0f * MPU6500A_16g)},
+		         {(2017.0f + 2053.0f) / (4096.0f * MPU6500A_16g)},
+		         {(2050.0f + 2048.0f) / (4096.0f * MPU6500A_16g)}},
+		.misalign = {1, 0, 0, 0, 1, 0, 0, 0, 1}
+	},
+	.gyro = {
+		/* the bias is estimated at runtime, the model only adds its drift */
+		.bias = {{0}, {0}, {0}},
+		.sens = {{1.0f / MPU6500G_2000dps}, {1.0f / MPU6500G_2000dps}, {1.0f / MPU6500G_2000dps}},
+		.misalign = {1, 0, 0, 0, 1, 0, 0, 0, 1}
+	}
+};
+
+static imu_calib_lut_t accel_calib_lut;
+static imu_calib_lut_t gyro_calib_lut;
+static imu_calib_kernel_t accel_calib CCM_HOT; //at the current temperature
+static imu_calib_kernel_t gyro_calib CCM_HOT;
+
+static const int16_t mpu6500_gyro_rotation[3][3] = MPU6500_GYRO_ROTATION;
+static const int16_t mpu6500_accel_rotation[3][3] = MPU6500_ACCEL_ROTATION;
+static mpu6500_rotation_t accel_rotation CCM_HOT;
+static mpu6500_rotation_t gyro_rotation CCM_HOT;
 
-vector3d_16_t gyro_bias  = {0.0f, 0.0f, 0.0f};
+profiler_t mpu6500_convert_profiler; //raw frame to calibrated samples, per imu sample
 
-int gyro_sample_cnt = GYRO_CALIB_SAMPLE_CNT;
+/* means of the stationary windows for the thermal calibration log */
+SLOT_ALLOC(mpu6500_still_slot, mpu6500_still_window_t);
 
-volatile bool mpu6500_init_finished = false;
+volatile bool mpu6500_init_finished = false; //gyro bias is available
 imu_t *mpu6500;
 
+/* full rate samples integrated for the attitude estimator, written by the
+ * deferred work and taken by the attitude task */
+static imu_preint_t imu_preint CCM_HOT;
+
+static int mpu6500_boot_state = MPU6500_BOOT_PROBE;
+static uint32_t mpu6500_boot_time;
+
+typedef struct {
+	uint32_t sample_time;
+	uint32_t frame[4]; //14 bytes of big endian halfwords from ACCEL_XOUT_H on, 2 bytes padding
+} mpu6500_raw_t;
+
+RING_ALLOC(mpu6500_ring, mpu6500_raw_t, 8);
+
 uint8_t mpu6500_read_byte(uint8_t address)
 {
 	uint8_t read;
@@ -43,133 +154,351 @@ void mpu6500_write_byte(uint8_t address, uint8_t data)
 
 uint8_t mpu6500_read_who_am_i()
 {
-	uint8_t id = mpu6500_read_byte(MPU6500_WHO_AM_I);
-	blocked_delay_ms(5);
-	return id;
+	return mpu6500_read_byte(MPU6500_WHO_AM_I);
 }
 
 void mpu6500_reset()
 {
 	mpu6500_write_byte(MPU6500_PWR_MGMT_1, 0x80);
-	blocked_delay_ms(200);
 }
 
-void mpu6500_gyro_bias_calc(vector3d_16_t *gyro)
+static float mpu6500_temp_convert_to_scale(float temp_unscaled)
+{
+	return temp_unscaled / MPU6500_TEMP_SENSITIVITY + MPU6500_TEMP_OFFSET;
+}
+
+static void gyro_bias_window_reset(void)
+{
+	gyro_bias_window.cnt = 0;
+	gyro_bias_window.temp_sum = 0.0f;
+
+	int i;
+	for(i = 0; i < 3; i++) {
+		gyro_bias_window.sum[i] = 0.0f;
+		gyro_bias_window.accel_sum[i] = 0.0f;
+		gyro_bias_window.accel_dev_sum[i] = 0.0f;
+		gyro_bias_window.accel_dev_sq_sum[i] = 0.0f;
+		gyro_bias_window.min[i] = INT16_MAX;
+		gyro_bias_window.max[i] = INT16_MIN;
+	}
+}
+
+/* selects the conversion of the current temperature. the gyro bias was
+ * measured at gyro_bias.temp, the model carries it along its thermal drift */
+static void mpu6500_calib_update(float temp)
 {
-	gyro_sample_cnt--;
-	if(gyro_sample_cnt == 0) {
+	imu_calib_lut_lookup(&accel_calib_lut, temp, &accel_calib);
+	imu_calib_lut_lookup(&gyro_calib_lut, temp, &gyro_calib);
+
+	imu_calib_kernel_t gyro_calib_measured;
+	imu_calib_lut_lookup(&gyro_calib_lut, gyro_bias.temp, &gyro_calib_measured);
+
+	gyro_calib.bias[0] += gyro_bias.bias.x - gyro_calib_measured.bias[0];
+	gyro_calib.bias[1] += gyro_bias.bias.y - gyro_calib_measured.bias[1];
+	gyro_calib.bias[2] += gyro_bias.bias.z - gyro_calib_measured.bias[2];
+}
+
+/* the stored bias is only trusted near the temperature it was measured at,
+ * checked with the first sample after boot */
+static void mpu6500_gyro_bias_restore(int16_t temp_unscaled)
+{
+	float temp = mpu6500_temp_convert_to_scale(temp_unscaled);
+	float temp_diff = temp - gyro_bias_stored.temp;
+
+	if(gyro_bias_stored_valid == true && temp_diff < GYRO_BIAS_TEMP_TOLERANCE &&
+	    temp_diff > -GYRO_BIAS_TEMP_TOLERANCE) {
+		gyro_bias = gyro_bias_stored;
+		mpu6500_calib_update(temp);
 		mpu6500_init_finished = true;
 	}
+}
+
+/* average the gyro over windows and refine the bias with every window in
+ * which the vehicle did not move. a slow constant rotation stays inside the
+ * gyro range, the accel variance catches the handling and vibration of it,
+ * and nothing is refined while armed */
+static void mpu6500_gyro_bias_calc(vector3d_16_t *gyro, vector3d_16_t *accel, int16_t temp_unscaled)
+{
+	int16_t axis[3] = {gyro->x, gyro->y, gyro->z};
+	int16_t accel_axis[3] = {accel->x, accel->y, accel->z};
+
+	int i;
+	for(i = 0; i < 3; i++) {
+		if(gyro_bias_window.cnt == 0) {
+			gyro_bias_window.accel_ref[i] = accel_axis[i];
+		}
+		float accel_dev = (float)(accel_axis[i] - gyro_bias_window.accel_ref[i]);
+
+		gyro_bias_window.sum[i] += axis[i];
+		gyro_bias_window.accel_sum[i] += accel_axis[i];
+		gyro_bias_window.accel_dev_sum[i] += accel_dev;
+		gyro_bias_window.accel_dev_sq_sum[i] += accel_dev * accel_dev;
+		if(axis[i] < gyro_bias_window.min[i]) gyro_bias_window.min[i] = axis[i];
+		if(axis[i] > gyro_bias_window.max[i]) gyro_bias_window.max[i] = axis[i];
+	}
+	gyro_bias_window.temp_sum += temp_unscaled;
+
+	if(++gyro_bias_window.cnt < GYRO_BIAS_WINDOW_SAMPLE_CNT) {
+		return;
+	}
+
+	float cnt_inv = 1.0f / (float)GYRO_BIAS_WINDOW_SAMPLE_CNT;
+	mpu6500->temp = mpu6500_temp_convert_to_scale(gyro_bias_window.temp_sum * cnt_inv);
+
+	bool stationary = true;
+	for(i = 0; i < 3; i++) {
+		float accel_dev_mean = gyro_bias_window.accel_dev_sum[i] * cnt_inv;
+		float accel_var = gyro_bias_window.accel_dev_sq_sum[i] * cnt_inv - accel_dev_mean * accel_dev_mean;
+
+		if((gyro_bias_window.max[i] - gyro_bias_window.min[i]) > GYRO_STILL_RANGE ||
+		    accel_var > ACCEL_STILL_STD * ACCEL_STILL_STD) {
+			stationary = false;
+		}
+	}
+
+	if(stationary == true && mpu6500_armed == false) {
+		gyro_bias_param_t window = {
+			.bias = {
+				.x = gyro_bias_window.sum[0] * cnt_inv,
+				.y = gyro_bias_window.sum[1] * cnt_inv,
+				.z = gyro_bias_window.sum[2] * cnt_inv
+			},
+			.temp = mpu6500->temp
+		};
+
+		mpu6500_still_window_t still = {
+			.temp = window.temp,
+			.accel = {
+				.x = gyro_bias_window.accel_sum[0] * cnt_inv,
+				.y = gyro_bias_window.accel_sum[1] * cnt_inv,
+				.z = gyro_bias_window.accel_sum[2] * cnt_inv
+			},
+			.gyro = window.bias
+		};
+		slot_publish(&mpu6500_still_slot, &still);
+
+		if(mpu6500_init_finished == false) {
+			gyro_bias = window;
+			mpu6500_init_finished = true;
+		} else {
+			gyro_bias.bias.x += GYRO_BIAS_REFINE_GAIN * (window.bias.x - gyro_bias.bias.x);
+			gyro_bias.bias.y += GYRO_BIAS_REFINE_GAIN * (window.bias.y - gyro_bias.bias.y);
+			gyro_bias.bias.z += GYRO_BIAS_REFINE_GAIN * (window.bias.z - gyro_bias.bias.z);
+			gyro_bias.temp += GYRO_BIAS_REFINE_GAIN * (window.temp - gyro_bias.temp);
+		}
+
+		/* persist the bias if it moved away from the stored one */
+		if(gyro_bias_stored_valid == false ||
+		    fabsf(gyro_bias.bias.x - gyro_bias_stored.bias.x) > GYRO_BIAS_STORE_DIFF ||
+		    fabsf(gyro_bias.bias.y - gyro_bias_stored.bias.y) > GYRO_BIAS_STORE_DIFF ||
+		    fabsf(gyro_bias.bias.z - gyro_bias_stored.bias.z) > GYRO_BIAS_STORE_DIFF ||
+		    fabsf(gyro_bias.temp - gyro_bias_stored.temp) > GYRO_BIAS_STORE_TEMP_DIFF) {
+			gyro_bias_store_pending = true;
+		}
+	}
+
+	if(mpu6500_init_finished == true) {
+		mpu6500_calib_update(mpu6500->temp);
+	}
 
-	gyro_bias.x += (float)gyro->x / (float)GYRO_CALIB_SAMPLE_CNT;
-	gyro_bias.y += (float)gyro->y / (float)GYRO_CALIB_SAMPLE_CNT;
-	gyro_bias.z += (float)gyro->z / (float)GYRO_CALIB_SAMPLE_CNT;
+	gyro_bias_window_reset();
+}
+
+/* called by the attitude task, a pending store waits until disarmed */
+void mpu6500_set_armed(bool armed)
+{
+	mpu6500_armed = armed;
+}
+
+/* writes a refined gyro bias into the flash, blocking, called by the idle task.
+ * only disarmed, a sector erase takes the idle task for ~2s */
+void mpu6500_gyro_bias_store(void)
+{
+	if(gyro_bias_store_pending == false || mpu6500_armed == true) {
+		return;
+	}
+
+	taskENTER_CRITICAL();
+	gyro_bias_param_t param = gyro_bias;
+	gyro_bias_store_pending = false;
+	taskEXIT_CRITICAL();
+
+	if(flash_param_store(FLASH_PARAM_GYRO_BIAS, &param, sizeof(param)) == true) {
+		gyro_bias_stored = param;
+		gyro_bias_stored_valid = true;
+	}
 }
 
 void mpu6500_init(imu_t *imu)
 {
 	mpu6500 = imu;
+	mpu6500_boot_state = MPU6500_BOOT_PROBE;
 
-	while((mpu6500_read_who_am_i() != 0x70));
-	blocked_delay_ms(100);
+	gyro_bias_window_reset();
+	imu_preint_init(&imu_preint);
+	gyro_bias_stored_valid = flash_param_load(FLASH_PARAM_GYRO_BIAS, &gyro_bias_stored,
+	                         sizeof(gyro_bias_stored));
 
-	mpu6500_reset();
+	/* the polynomials are only evaluated here, on the table grid */
+	static imu_calib_param_t calib;
+	if(flash_param_load(FLASH_PARAM_IMU_CALIB, &calib, sizeof(calib)) == false) {
+		calib = mpu6500_calib_default;
+	}
+	imu_calib_lut_build(&accel_calib_lut, &calib.accel);
+	imu_calib_lut_build(&gyro_calib_lut, &calib.gyro);
 
-	mpu6500_write_byte(MPU6500_GYRO_CONFIG, 0x18); //gyro sensing range: +-2000dps
-	blocked_delay_ms(100);
-	mpu6500_write_byte(MPU6500_ACCEL_CONFIG2, 0x08); //accel update rate: 4KHz, disable internel lpf
-	blocked_delay_ms(100);
-	mpu6500_write_byte(MPU6500_ACCEL_CONFIG, 0x18); //accel sensing range: +-16g
-	blocked_delay_ms(100);
-	mpu6500_write_byte(MPU6500_INT_ENABLE, 0x01); //enable data ready interrupt
-	blocked_delay_ms(100);
+	mpu6500_rotation_pack(&accel_rotation, mpu6500_accel_rotation);
+	mpu6500_rotation_pack(&gyro_rotation, mpu6500_gyro_rotation);
+}
 
-	while(mpu6500_init_finished == false);
+/* non-blocking initialization, called periodically by the boot sequence
+ * until the gyro calibration is finished and true is returned */
+bool mpu6500_init_step(void)
+{
+	switch(mpu6500_boot_state) {
+	case MPU6500_BOOT_PROBE:
+		/* wait for the sensor to power up */
+		if(mpu6500_read_who_am_i() == 0x70) {
+			mpu6500_reset();
+			mpu6500_boot_time = profiler_get_cycles();
+			mpu6500_boot_state = MPU6500_BOOT_RESET;
+		}
+		break;
+	case MPU6500_BOOT_RESET:
+		if(delay_elapsed_ms(mpu6500_boot_time, MPU6500_RESET_TIME_MS) == false) {
+			break;
+		}
+
+		/* register writes take effect immediately, no delay required */
+		mpu6500_write_byte(MPU6500_GYRO_CONFIG, 0x18); //gyro sensing range: +-2000dps
+		mpu6500_write_byte(MPU6500_ACCEL_CONFIG2, 0x08); //accel update rate: 4KHz, disable internel lpf
+		mpu6500_write_byte(MPU6500_ACCEL_CONFIG, 0x18); //accel sensing range: +-16g
+		mpu6500_write_byte(MPU6500_INT_ENABLE, 0x01); //enable data ready interrupt
+		mpu6500_boot_state = MPU6500_BOOT_CALIB;
+		break;
+	case MPU6500_BOOT_CALIB:
+		/* gyro bias is restored from the flash or averaged by the sample decoding */
+		if(mpu6500_init_finished == true) {
+			mpu6500_boot_state = MPU6500_BOOT_READY;
+		}
+		break;
+	}
+
+	return mpu6500_boot_state == MPU6500_BOOT_READY;
 }
 
+/* data ready interrupt, only captures the raw sample */
 void mpu6500_int_handler(void)
 {
-	uint8_t buffer[14];
+	mpu6500_raw_t raw;
+
+	raw.sample_time = profiler_get_cycles();
 
 	/* read sensor datas via spi */
 	mpu6500_chip_select();
 	spi_read_write(SPI1, MPU6500_ACCEL_XOUT_H | 0x80);
-	buffer[0] = spi_read_write(SPI1, 0xff);
-	buffer[1] = spi_read_write(SPI1, 0xff);
-	buffer[2] = spi_read_write(SPI1, 0xff);
-	buffer[3] = spi_read_write(SPI1, 0xff);
-	buffer[4] = spi_read_write(SPI1, 0xff);
-	buffer[5] = spi_read_write(SPI1, 0xff);
-	buffer[6] = spi_read_write(SPI1, 0xff);
-	buffer[7] = spi_read_write(SPI1, 0xff);
-	buffer[8] = spi_read_write(SPI1, 0xff);
-	buffer[9] = spi_read_write(SPI1, 0xff);
-	buffer[10] = spi_read_write(SPI1, 0xff);
-	buffer[11] = spi_read_write(SPI1, 0xff);
-	buffer[12] = spi_read_write(SPI1, 0xff);
-	buffer[13] = spi_read_write(SPI1, 0xff);
-
-	/* composite sensor data */
-	mpu6500->accel_unscaled.x = -((int16_t)buffer[0] << 8) | (int16_t)buffer[1];
-	mpu6500->accel_unscaled.y = -((int16_t)buffer[2] << 8) | (int16_t)buffer[3];
-	mpu6500->accel_unscaled.z = -((int16_t)buffer[4] << 8) | (int16_t)buffer[5];
-	mpu6500->temp_unscaled = ((int16_t)buffer[6] << 8) | (int16_t)buffer[7];
-	mpu6500->gyro_unscaled.x = -((int16_t)buffer[8] << 8) | (int16_t)buffer[9];
-	mpu6500->gyro_unscaled.y = -((int16_t)buffer[10] << 8) | (int16_t)buffer[11];
-	mpu6500->gyro_unscaled.z = +((int16_t)buffer[12] << 8) | (int16_t)buffer[13];
+	uint8_t *buffer = (uint8_t *)raw.frame;
+	int i;
+	for(i = 0; i < 14; i++) {
+		buffer[i] = spi_read_write(SPI1, 0xff);
+	}
+	mpu6500_chip_deselect();
+
+	ring_push(&mpu6500_ring, &raw);
+	deferred_work_signal_from_isr(DEFERRED_WORK_IMU);
+}
+
+static void mpu6500_decode(mpu6500_raw_t *raw)
+{
+	/* the conversion is timed without the gyro bias windows in between */
+	uint32_t convert_start = profiler_get_cycles();
+	mpu6500_frame_rotate(raw->frame, &accel_rotation, &gyro_rotation, &mpu6500->accel_unscaled,
+	                     &mpu6500->gyro_unscaled, &mpu6500->temp_unscaled);
+	uint32_t convert_cycles = profiler_get_cycles() - convert_start;
+
+	static bool first_sample = true;
+	if(first_sample == true) {
+		first_sample = false;
+		mpu6500_gyro_bias_restore(mpu6500->temp_unscaled);
+	}
+
+	mpu6500_gyro_bias_calc(&mpu6500->gyro_unscaled, &mpu6500->accel_unscaled, mpu6500->temp_unscaled);
 
 	if(mpu6500_init_finished == false) {
-		mpu6500_gyro_bias_calc(&mpu6500->accel_unscaled);
 		return;
 	}
 
-	/* bias cancelling */
-	mpu6500_fix_bias(&mpu6500->accel_unscaled, &mpu6500->gyro_unscaled);
-
-	/* sensor data unit conversion */
-	mpu6500_accel_convert_to_scale(&mpu6500->accel_unscaled, &mpu6500->accel_raw);
-	mpu6500_gyro_convert_to_scale(&mpu6500->gyro_unscaled, &mpu6500->gyro_raw);
+	/* bias, scale and misalignment correction of the current temperature, the
+	 * gyro bias windows above see the integer samples of the same frame */
+	convert_start = profiler_get_cycles();
+	imu_calib_apply(&accel_calib, &mpu6500->accel_unscaled, &mpu6500->accel_raw);
+	imu_calib_apply(&gyro_calib, &mpu6500->gyro_unscaled, &mpu6500->gyro_raw);
+	profiler_update(&mpu6500_convert_profiler, convert_cycles + (profiler_get_cycles() - convert_start));
+
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_DSHOT600)
+	/* suppress motor noise before low pass filtering */
+	rpm_filter_apply(&mpu6500->gyro_raw);
+#endif
+
+#if (SELECT_GYRO_DYN_NOTCH == GYRO_DYN_NOTCH_ENABLED)
+	/* the spectrum is analyzed before the tracked peaks are removed */
+	gyro_fft_push(&mpu6500->gyro_raw);
+	dyn_notch_apply(&mpu6500->gyro_raw);
+#endif
+
+	mpu6500->sample_time = raw->sample_time;
+
+	/* integrate every sample, the estimator runs slower than the imu */
+	vector3d_f_t gyro_rad = {
+		.x = deg_to_rad(mpu6500->gyro_raw.x),
+		.y = deg_to_rad(mpu6500->gyro_raw.y),
+		.z = deg_to_rad(mpu6500->gyro_raw.z)
+	};
+	imu_preint_add(&imu_preint, &gyro_rad, &mpu6500->accel_raw, 1.0f / MPU6500_SAMPLE_RATE);
 
 	/* low pass filtering */
-	lpf(mpu6500->accel_raw.x, &(mpu6500->accel_lpf.x), 0.03);
-	lpf(mpu6500->accel_raw.y, &(mpu6500->accel_lpf.y), 0.03);
-	lpf(mpu6500->accel_raw.z, &(mpu6500->accel_lpf.z), 0.03);
-	lpf(mpu6500->gyro_raw.x, &(mpu6500->gyro_lpf.x), 0.03);
-	lpf(mpu6500->gyro_raw.y, &(mpu6500->gyro_lpf.y), 0.03);
-	lpf(mpu6500->gyro_raw.z, &(mpu6500->gyro_lpf.z), 0.03);
-
-	mpu6500_chip_deselect();
+	lpf(mpu6500->accel_raw.x, &(mpu6500->accel_lpf.x), 0.03f);
+	lpf(mpu6500->accel_raw.y, &(mpu6500->accel_lpf.y), 0.03f);
+	lpf(mpu6500->accel_raw.z, &(mpu6500->accel_lpf.z), 0.03f);
+	lpf(mpu6500->gyro_raw.x, &(mpu6500->gyro_lpf.x), 0.03f);
+	lpf(mpu6500->gyro_raw.y, &(mpu6500->gyro_lpf.y), 0.03f);
+	lpf(mpu6500->gyro_raw.z, &(mpu6500->gyro_lpf.z), 0.03f);
+
+#if (SELECT_FLIGHT_CTL_TRIGGER == FLIGHT_CTL_TRIGGER_IMU)
+	/* release the flight control loop right after a fresh sample, phase aligned
+	 * to the imu instead of beating against the system timer */
+	static int flight_ctl_cnt = IMU_SAMPLES_PER_CTL_LOOP;
+	if(--flight_ctl_cnt == 0) {
+		flight_ctl_cnt = IMU_SAMPLES_PER_CTL_LOOP;
+		flight_ctl_trigger_handler();
+	}
+#endif
 }
 
-void mpu6500_fix_bias(vector3d_16_t *accel_unscaled, vector3d_16_t *gyro_unscaled)
+/* integrated samples since the last call, returns false if there is no new sample */
+bool mpu6500_preint_take(imu_delta_t *delta)
 {
-	gyro_unscaled->x -= gyro_bias.x;
-	gyro_unscaled->y -= gyro_bias.y;
-	gyro_unscaled->z -= gyro_bias.z;
+	/* the deferred work has a higher priority than the estimator task */
+	taskENTER_CRITICAL();
+	bool ready = imu_preint_take(&imu_preint, delta);
+	delta->accel_lpf = mpu6500->accel_lpf;
+	taskEXIT_CRITICAL();
+
+	return ready;
 }
 
-void mpu6500_accel_convert_to_scale(vector3d_16_t *accel_unscaled, vector3d_f_t *accel_scaled)
+/* latest stationary window, returns its publish count */
+uint32_t mpu6500_still_window_read(mpu6500_still_window_t *window)
 {
-	float gx_max = +2020, gx_min = -2111;
-	float gy_max = +2079, gy_min = -2043;
-	float gz_max = +2558, gz_min = -2048;
-
-	float bias_x = +450;//60;
-	float bias_y = +200;//30;
-	float bias_z = 480;
-
-	float rescale_x = 4096.0f / (gx_max - gx_min);
-	float rescale_y = 4096.0f / (gy_max - gy_min);
-	float rescale_z = 4096.0f / (gz_max - gz_min);
-
-	accel_scaled->x = ((float)accel_unscaled->x - bias_x) * rescale_x * MPU6500_ACCEL_SCALE;
-	accel_scaled->y = ((float)accel_unscaled->y - bias_y) * rescale_y * MPU6500_ACCEL_SCALE;
-	accel_scaled->z = ((float)accel_unscaled->z - bias_z) * rescale_z * MPU6500_ACCEL_SCALE;
+	return slot_read(&mpu6500_still_slot, window);
 }
 
-void mpu6500_gyro_convert_to_scale(vector3d_16_t *gyro_unscaled, vector3d_f_t *gyro_scaled)
+/* deferred work, decodes every captured sample in order */
+void mpu6500_process(void)
 {
-	gyro_scaled->x = gyro_unscaled->x * MPU6500_GYRO_SCALE;
-	gyro_scaled->y = gyro_unscaled->y * MPU6500_GYRO_SCALE;
-	gyro_scaled->z = gyro_unscaled->z * MPU6500_GYRO_SCALE;
+	mpu6500_raw_t raw;
+
+	while(ring_pop(&mpu6500_ring, &raw) == true) {
+		mpu6500_decode(&raw);
+	}
 }
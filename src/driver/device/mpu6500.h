@@ -1,10 +1,14 @@
 #ifndef __MPU6500_H__
 #define __MPU6500_H__
 
+#include <stdbool.h>
 #include "stm32f4xx_conf.h"
 #include "spi.h"
 #include "vector.h"
 #include "imu.h"
+#include "imu_preint.h"
+
+#define MPU6500_SAMPLE_RATE 8000.0f //[Hz], data ready rate with dlpf_cfg = 0
 
 #define mpu6500_chip_select() GPIO_ResetBits(GPIOA, GPIO_Pin_4)
 #define mpu6500_chip_deselect() GPIO_SetBits(GPIOA, GPIO_Pin_4)
@@ -48,7 +52,7 @@
 #define MPU6500_I2C_SLV4_DO 0x40
 
 #define MPU6500A_2g 0.00059815365f
-#define MPU6500A_4g 0.00119630731
+#define MPU6500A_4g 0.00119630731f
 #define MPU6500A_8g 0.00239261463f
 #define MPU6500A_16g 0.00478522926f
 
@@ -59,11 +63,21 @@
 
 #define MPU6500T_85degC 0.00294f
 
+/* sensor means of a stationary gyro bias window */
+typedef struct {
+	float temp;         //[degC]
+	vector3d_f_t accel; //[lsb]
+	vector3d_f_t gyro;  //[lsb]
+} mpu6500_still_window_t;
+
 void mpu6500_init(imu_t *imu);
+bool mpu6500_init_step(void);
 void mpu6500_int_handler(void);
+void mpu6500_process(void);
+void mpu6500_set_armed(bool armed);
+void mpu6500_gyro_bias_store(void);
+bool mpu6500_preint_take(imu_delta_t *delta);
 
-void mpu6500_fix_bias(vector3d_16_t *accel_unscaled, vector3d_16_t *gyro_unscaled);
-void mpu6500_accel_convert_to_scale(vector3d_16_t *accel_unscaled, vector3d_f_t *accel_scaled);
-void mpu6500_gyro_convert_to_scale(vector3d_16_t *gyro_unscaled, vector3d_f_t *gyro_scaled);
+uint32_t mpu6500_still_window_read(mpu6500_still_window_t *window);
 
 #endif
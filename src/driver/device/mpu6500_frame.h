@@ -0,0 +1,66 @@
+#ifndef __MPU6500_FRAME_H__
+#define __MPU6500_FRAME_H__
+
+#include <stdint.h>
+#include "stm32f4xx.h"
+#include "vector.h"
+
+/* chip to body frame of this board. integer matrices only (90 degree steps),
+ * the rotation runs on the raw halfword pairs with the dsp multiply-accumulate
+ * instructions, finer mounting errors belong to the calibration misalignment.
+ * the accel matrix also carries the sign convention of the accel samples */
+#define MPU6500_GYRO_ROTATION { \
+	{-1,  0,  0}, \
+	{ 0, -1,  0}, \
+	{ 0,  0, +1}}
+#define MPU6500_ACCEL_ROTATION { \
+	{-1,  0,  0}, \
+	{ 0, -1,  0}, \
+	{ 0,  0, -1}}
+
+/* rows of an integer 3x3 matrix packed as the halfword pairs of smuad/smlad:
+ * (m[i][0], m[i][1]) and (m[i][2], 0) */
+typedef struct {
+	uint32_t xy[3];
+	uint32_t z[3];
+} mpu6500_rotation_t;
+
+static inline void mpu6500_rotation_pack(mpu6500_rotation_t *rotation, const int16_t m[3][3])
+{
+	int i;
+	for(i = 0; i < 3; i++) {
+		rotation->xy[i] = (uint16_t)m[i][0] | ((uint32_t)(uint16_t)m[i][1] << 16);
+		rotation->z[i] = (uint16_t)m[i][2];
+	}
+}
+
+/* one row of the rotation on a (x, y) and a (z, next) pair, the sum is
+ * saturated, the inverted -32768 does not fit back into int16 */
+static inline int16_t mpu6500_rotate_row(const mpu6500_rotation_t *rotation, int i,
+                                         uint32_t xy, uint32_t z)
+{
+	return __SSAT((int32_t)__SMLAD(z, rotation->z[i], __SMUAD(xy, rotation->xy[i])), 16);
+}
+
+/* the raw frame (14 bytes of big endian halfwords from ACCEL_XOUT_H on) to
+ * body frame integer samples: rev16 swaps two big endian halfwords at once,
+ * after that the words hold the pairs smuad and smlad take */
+static inline void mpu6500_frame_rotate(const uint32_t frame[4], const mpu6500_rotation_t *accel_rotation,
+                                        const mpu6500_rotation_t *gyro_rotation,
+                                        vector3d_16_t *accel, vector3d_16_t *gyro, int16_t *temp)
+{
+	uint32_t accel_xy = __REV16(frame[0]);
+	uint32_t accel_z_temp = __REV16(frame[1]);
+	uint32_t gyro_xy = __REV16(frame[2]);
+	uint32_t gyro_z = __REV16(frame[3]);
+
+	accel->x = mpu6500_rotate_row(accel_rotation, 0, accel_xy, accel_z_temp);
+	accel->y = mpu6500_rotate_row(accel_rotation, 1, accel_xy, accel_z_temp);
+	accel->z = mpu6500_rotate_row(accel_rotation, 2, accel_xy, accel_z_temp);
+	*temp = (int16_t)(accel_z_temp >> 16);
+	gyro->x = mpu6500_rotate_row(gyro_rotation, 0, gyro_xy, gyro_z);
+	gyro->y = mpu6500_rotate_row(gyro_rotation, 1, gyro_xy, gyro_z);
+	gyro->z = mpu6500_rotate_row(gyro_rotation, 2, gyro_xy, gyro_z);
+}
+
+#endif
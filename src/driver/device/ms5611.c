@@ -1,76 +1,213 @@
 #include <stdint.h>
+#include <stdbool.h>
 #include "delay.h"
 #include "ms5611.h"
+#include "profiler.h"
+#include "sys_time.h"
+#include "slot.h"
 
-uint16_t c1, c2, c3, c4, c5, c6;
+#define MS5611_CMD_RESET 0x1e
+#define MS5611_CMD_CONVERT_D1 0x48 //pressure, osr 4096
+#define MS5611_CMD_CONVERT_D2 0x58 //temperature, osr 4096
+#define MS5611_CMD_ADC_READ 0x00
+#define MS5611_CMD_PROM_READ 0xa0
 
-void ms5611_reset(void)
+#define MS5611_RESET_TIME_MS 3       //prom reload after the reset
+#define MS5611_CONVERSION_TIME_MS 10 //osr 4096 takes 9.04ms at most
+#define MS5611_TEMP_INTERVAL 10      //one temperature conversion every n pressure conversions
+#define MS5611_RESET_RETRY 3
+
+/* boot state machine */
+enum {
+	MS5611_BOOT_RESET,
+	MS5611_BOOT_PROM,
+	MS5611_BOOT_READY,
+	MS5611_BOOT_FAILED
+};
+
+static int ms5611_boot_state;
+static int ms5611_reset_cnt;
+static uint32_t ms5611_boot_time;
+
+static uint16_t prom[8]; //factory data, c1 ~ c6 are prom[1] ~ prom[6]
+
+static int ms5611_conversion;
+static uint32_t ms5611_conversion_start;
+static int ms5611_pressure_cnt;
+static uint32_t d2;
+static bool d2_valid;
+
+SLOT_ALLOC(ms5611_slot, ms5611_sample_t);
+
+static void ms5611_command(uint8_t command)
 {
 	ms5611_chip_select();
-	spi_read_write(SPI3, 0x1e);
+	spi_read_write(SPI3, command);
 	ms5611_chip_deselect();
-
-	blocked_delay_ms(10);
 }
 
-void ms5611_read_uint16(uint8_t address, uint16_t *data)
+static uint16_t ms5611_read_uint16(uint8_t address)
 {
-	uint8_t byte1, byte2;
-
 	ms5611_chip_select();
 	spi_read_write(SPI3, address);
-	byte1 = spi_read_write(SPI3, 0x00);
-	byte2 = spi_read_write(SPI3, 0x00);
-	*data = ((uint16_t)byte1 << 8) | (int32_t)byte2;
+	uint8_t byte1 = spi_read_write(SPI3, 0x00);
+	uint8_t byte2 = spi_read_write(SPI3, 0x00);
 	ms5611_chip_deselect();
+
+	return ((uint16_t)byte1 << 8) | (uint16_t)byte2;
 }
 
-void ms5611_read_int24(uint8_t address, int32_t *data)
+static uint32_t ms5611_read_adc(void)
 {
-	uint8_t byte1, byte2, byte3, byte4;
-
 	ms5611_chip_select();
-	spi_read_write(SPI3, address);
-	byte1 = spi_read_write(SPI3, 0x00);
-	byte2 = spi_read_write(SPI3, 0x00);
-	byte3 = spi_read_write(SPI3, 0x00);
-	byte4 = spi_read_write(SPI3, 0x00);
-	*data = ((int32_t)byte1 << 24) | ((int32_t)byte2 << 16) | ((int32_t)byte3 << 8) | (int32_t)byte4;
+	spi_read_write(SPI3, MS5611_CMD_ADC_READ);
+	uint8_t byte1 = spi_read_write(SPI3, 0x00);
+	uint8_t byte2 = spi_read_write(SPI3, 0x00);
+	uint8_t byte3 = spi_read_write(SPI3, 0x00);
 	ms5611_chip_deselect();
+
+	return ((uint32_t)byte1 << 16) | ((uint32_t)byte2 << 8) | (uint32_t)byte3;
 }
 
-void ms5611_read_prom(void)
+/* check: measurement specialties, an520 "c-code example for ms56xx" */
+static bool ms5611_prom_check(void)
 {
-	ms5611_chip_select();
-	//ms5611_read_uint16(0xa0, &d1);
-	ms5611_read_uint16(0xa2, &c1);
-	ms5611_read_uint16(0xa4, &c2);
-	ms5611_read_uint16(0xa6, &c3);
-	ms5611_read_uint16(0xa8, &c4);
-	ms5611_read_uint16(0xaa, &c5);
-	ms5611_read_uint16(0xac, &c6);
-	//ms5611_read_uint16(0xae, &d7);
-	ms5611_chip_deselect();
+	uint16_t n_rem = 0;
+
+	int i, bit;
+	for(i = 0; i < 16; i++) {
+		uint16_t word = (i == 14 || i == 15) ? (prom[7] & 0xff00) : prom[i >> 1];
+		n_rem ^= (i & 1) ? (word & 0x00ff) : (word >> 8);
+
+		for(bit = 0; bit < 8; bit++) {
+			n_rem = (n_rem & 0x8000) ? ((n_rem << 1) ^ 0x3000) : (n_rem << 1);
+		}
+	}
+
+	/* an unconnected bus reads all zeros or all ones, which pass the crc */
+	for(i = 1; i <= 6; i++) {
+		if(prom[i] == 0x0000 || prom[i] == 0xffff) {
+			return false;
+		}
+	}
+
+	return ((n_rem >> 12) & 0x000f) == (prom[7] & 0x000f);
+}
+
+/* first and second order temperature compensation of the datasheet */
+static void ms5611_compensate(uint32_t d1, ms5611_sample_t *sample)
+{
+	int64_t dt = (int64_t)d2 - ((int64_t)prom[5] << 8);
+	int64_t temp = 2000 + ((dt * prom[6]) >> 23);
+	int64_t off = ((int64_t)prom[2] << 16) + (((int64_t)prom[4] * dt) >> 7);
+	int64_t sens = ((int64_t)prom[1] << 15) + (((int64_t)prom[3] * dt) >> 8);
+
+	if(temp < 2000) {
+		int64_t t2 = (dt * dt) >> 31;
+		int64_t temp_low = (temp - 2000) * (temp - 2000);
+		int64_t off2 = (5 * temp_low) >> 1;
+		int64_t sens2 = (5 * temp_low) >> 2;
+
+		if(temp < -1500) {
+			int64_t temp_very_low = (temp + 1500) * (temp + 1500);
+			off2 += 7 * temp_very_low;
+			sens2 += (11 * temp_very_low) >> 1;
+		}
+
+		temp -= t2;
+		off -= off2;
+		sens -= sens2;
+	}
+
+	int64_t pressure = ((((int64_t)d1 * sens) >> 21) - off) >> 15;
+
+	sample->pressure = (float)pressure; //[0.01mbar] = [Pa]
+	sample->temp = (float)temp * 0.01f;
 }
 
 void ms5611_init(void)
 {
-	ms5611_reset();
-	ms5611_read_prom();
+	ms5611_boot_state = MS5611_BOOT_RESET;
+	ms5611_reset_cnt = 0;
+	d2_valid = false;
+}
+
+/* non-blocking initialization, called periodically by the boot sequence.
+ * a missing or broken sensor does not hold the boot, it is just never sampled */
+bool ms5611_init_step(void)
+{
+	int i;
+
+	switch(ms5611_boot_state) {
+	case MS5611_BOOT_RESET:
+		ms5611_command(MS5611_CMD_RESET);
+		ms5611_boot_time = profiler_get_cycles();
+		ms5611_boot_state = MS5611_BOOT_PROM;
+		break;
+	case MS5611_BOOT_PROM:
+		if(delay_elapsed_ms(ms5611_boot_time, MS5611_RESET_TIME_MS) == false) {
+			break;
+		}
+
+		for(i = 0; i < 8; i++) {
+			prom[i] = ms5611_read_uint16(MS5611_CMD_PROM_READ + 2 * i);
+		}
+
+		if(ms5611_prom_check() == true) {
+			/* start the first conversion */
+			ms5611_command(MS5611_CMD_CONVERT_D2);
+			ms5611_conversion = MS5611_CMD_CONVERT_D2;
+			ms5611_conversion_start = profiler_get_cycles();
+			ms5611_boot_state = MS5611_BOOT_READY;
+		} else if(++ms5611_reset_cnt < MS5611_RESET_RETRY) {
+			ms5611_boot_state = MS5611_BOOT_RESET;
+		} else {
+			ms5611_boot_state = MS5611_BOOT_FAILED;
+		}
+		break;
+	}
+
+	return ms5611_boot_state == MS5611_BOOT_READY || ms5611_boot_state == MS5611_BOOT_FAILED;
 }
 
-void ms5611_read_pressure(int32_t *temp, int32_t *pressure)
+/* called periodically (slower than the conversion time), reads the finished
+ * conversion and starts the next one */
+void ms5611_update(void)
 {
-	int32_t d1, d2;
-	int64_t off, sens, dt;
+	if(ms5611_boot_state != MS5611_BOOT_READY) {
+		return;
+	}
 
-	ms5611_read_int24(0x40, &d1);
-	ms5611_read_int24(0x50, &d2);
+	if(delay_elapsed_ms(ms5611_conversion_start, MS5611_CONVERSION_TIME_MS) == false) {
+		return;
+	}
 
-	dt = (int64_t)d2 - (int64_t)c5 * (1 << 8);
-	*temp = 2000 + (dt * (int64_t)c6) / (1 << 23);
+	uint32_t adc = ms5611_read_adc();
+	uint32_t start = ms5611_conversion_start;
 
-	off = (int64_t)c3 * (1 << 16) + ((int64_t)c4 * dt) / (1 << 7);
-	sens = (int64_t)c1 * (1 << 15) + ((int64_t)c3 * dt) / (1 << 8);
-	*pressure = ((d1 * sens) / (1 << 21) - off) / (1 << 15);
+	if(ms5611_conversion == MS5611_CMD_CONVERT_D2) {
+		d2 = adc;
+		d2_valid = true;
+	} else if(d2_valid == true) {
+		ms5611_sample_t sample;
+		ms5611_compensate(adc, &sample);
+		sample.time_ms = get_sys_time_ms_at(start) + 0.5f * MS5611_CONVERSION_TIME_MS;
+		slot_publish(&ms5611_slot, &sample);
+	}
+
+	/* the temperature changes slowly, most conversions are pressure */
+	if(++ms5611_pressure_cnt >= MS5611_TEMP_INTERVAL) {
+		ms5611_pressure_cnt = 0;
+		ms5611_conversion = MS5611_CMD_CONVERT_D2;
+	} else {
+		ms5611_conversion = MS5611_CMD_CONVERT_D1;
+	}
+	ms5611_command(ms5611_conversion);
+	ms5611_conversion_start = profiler_get_cycles();
+}
+
+/* returns the publish count, changes with every new sample */
+uint32_t ms5611_read(ms5611_sample_t *sample)
+{
+	return slot_read(&ms5611_slot, sample);
 }
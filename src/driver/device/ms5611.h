@@ -1,13 +1,24 @@
 #ifndef __MS5611_H__
 #define __MS5611_H__
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "stm32f4xx_conf.h"
 #include "spi.h"
 
 #define ms5611_chip_select() GPIO_ResetBits(GPIOA, GPIO_Pin_15)
 #define ms5611_chip_deselect() GPIO_SetBits(GPIOA, GPIO_Pin_15)
 
+/* temperature compensated sample */
+typedef struct {
+	float pressure; //[Pa]
+	float temp;     //[degC]
+	float time_ms;  //middle of the pressure conversion
+} ms5611_sample_t;
+
 void ms5611_init(void);
-void ms5611_read_pressure(int32_t *temp, int32_t *pressure);
+bool ms5611_init_step(void);
+void ms5611_update(void);
+uint32_t ms5611_read(ms5611_sample_t *sample);
 
 #endif
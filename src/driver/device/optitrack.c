@@ -9,6 +9,10 @@
 #include "vector.h"
 #include "sys_time.h"
 #include "lpf.h"
+#include "profiler.h"
+#include "ring.h"
+#include "deferred_work.h"
+#include "slot.h"
 
 #define OPTITRACK_SERIAL_MSG_SIZE 32
 
@@ -19,6 +23,14 @@ optitrack_t optitrack;
 vector3d_f_t pos_last;
 bool vel_init_ready = false;
 
+typedef struct {
+	uint32_t time; //dwt timestamp [cycles]
+	uint8_t c;
+} optitrack_rx_t;
+
+RING_ALLOC(optitrack_ring, optitrack_rx_t, 64);
+SLOT_ALLOC(optitrack_pose_slot, optitrack_pose_t);
+
 void optitrack_init(int id)
 {
 	optitrack.id = id;
@@ -34,6 +46,12 @@ bool optitrack_available(void)
 	return true;
 }
 
+/* returns the publish count, changes with every new pose */
+uint32_t optitrack_pose_read(optitrack_pose_t *pose)
+{
+	return slot_read(&optitrack_pose_slot, pose);
+}
+
 void optitrack_buf_push(uint8_t c)
 {
 	if(optitrack_buf_pos >= OPTITRACK_SERIAL_MSG_SIZE) {
@@ -53,14 +71,27 @@ void optitrack_buf_push(uint8_t c)
 	}
 }
 
+/* uart7 rx interrupt, only captures the byte */
 void optitrack_handler(uint8_t c)
 {
-	optitrack_buf_push(c);
-	if(c == '+' && optitrack_buf[0] == '@') {
-		/* decode optitrack message */
-		if(optitrack_serial_decoder(optitrack_buf) == 0) {
-			led_on(LED_G);
-			optitrack_buf_pos = 0; //reset position pointer
+	optitrack_rx_t rx = {.time = profiler_get_cycles(), .c = c};
+	ring_push(&optitrack_ring, &rx);
+	deferred_work_signal_from_isr(DEFERRED_WORK_OPTITRACK);
+}
+
+/* deferred work, decodes the captured bytes */
+void optitrack_process(void)
+{
+	optitrack_rx_t rx;
+
+	while(ring_pop(&optitrack_ring, &rx) == true) {
+		optitrack_buf_push(rx.c);
+		if(rx.c == '+' && optitrack_buf[0] == '@') {
+			/* decode optitrack message, stamped with the reception time of its last byte */
+			if(optitrack_serial_decoder(optitrack_buf, get_sys_time_ms_at(rx.time)) == 0) {
+				led_on(LED_G);
+				optitrack_buf_pos = 0; //reset position pointer
+			}
 		}
 	}
 }
@@ -84,15 +115,15 @@ void optitrack_numerical_vel_calc(void)
 	optitrack.vel_raw_y = (optitrack.pos_y - pos_last.y) / dt;
 	optitrack.vel_raw_z = (optitrack.pos_z - pos_last.z) / dt;
 
-	float received_period = (optitrack.time_now - optitrack.time_last) * 0.001;
+	float received_period = (optitrack.time_now - optitrack.time_last) * 0.001f;
 	optitrack.recv_freq = 1.0f / received_period;
 
-	lpf(optitrack.vel_raw_x, &(optitrack.vel_lpf_x), 0.45);
-	lpf(optitrack.vel_raw_y, &(optitrack.vel_lpf_y), 0.45);
-	lpf(optitrack.vel_raw_z, &(optitrack.vel_lpf_z), 0.45);
+	lpf(optitrack.vel_raw_x, &(optitrack.vel_lpf_x), 0.45f);
+	lpf(optitrack.vel_raw_y, &(optitrack.vel_lpf_y), 0.45f);
+	lpf(optitrack.vel_raw_z, &(optitrack.vel_lpf_z), 0.45f);
 }
 
-int optitrack_serial_decoder(uint8_t *buf)
+int optitrack_serial_decoder(uint8_t *buf, float recv_time_ms)
 {
 	uint8_t recv_checksum = buf[1];
 	uint8_t checksum = generate_optitrack_checksum_byte(&buf[3], OPTITRACK_SERIAL_MSG_SIZE - 4);
@@ -101,7 +132,7 @@ int optitrack_serial_decoder(uint8_t *buf)
 		return 1; //error detected
 	}
 
-	optitrack.time_now = get_sys_time_ms();
+	optitrack.time_now = recv_time_ms;
 
 	float ned_pos_x, ned_pos_y, ned_pos_z;
 
@@ -116,8 +147,14 @@ int optitrack_serial_decoder(uint8_t *buf)
 	memcpy(&optitrack.q[3], &buf[23], sizeof(float));
 	memcpy(&optitrack.q[0], &buf[27], sizeof(float));
 
+	optitrack_pose_t pose = {
+		.pos = {optitrack.pos_x, optitrack.pos_y, optitrack.pos_z},
+		.time_ms = recv_time_ms - OPTITRACK_LATENCY_MS
+	};
+	slot_publish(&optitrack_pose_slot, &pose);
+
 	if(vel_init_ready == false) {
-		optitrack.time_last = get_sys_time_ms();
+		optitrack.time_last = recv_time_ms;
 		pos_last.x = optitrack.pos_x;
 		pos_last.y = optitrack.pos_y;
 		pos_last.z = optitrack.pos_z;
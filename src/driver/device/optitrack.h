@@ -28,9 +28,23 @@ typedef struct {
 	float recv_freq;
 } optitrack_t ;
 
-int optitrack_serial_decoder(uint8_t *buf);
+/* position handed over to the estimator */
+typedef struct {
+	float pos[3];  //north, east, up [cm]
+	float time_ms; //time of the capture
+} optitrack_pose_t;
+
+/* camera exposure to the reception of the last byte, the capture time of a
+ * pose is its reception time minus this latency */
+#define OPTITRACK_LATENCY_MS 10.0f
+
+#define OPTITRACK_POS_NOISE 1.0f //position measurement [cm]
+
+int optitrack_serial_decoder(uint8_t *buf, float recv_time_ms);
 void optitrack_handler(uint8_t c);
+void optitrack_process(void);
 void optitrack_init(int id);
 bool optitrack_available(void);
+uint32_t optitrack_pose_read(optitrack_pose_t *pose);
 
 #endif
@@ -7,6 +7,12 @@
 #include "uart.h"
 #include "sbus_receiver.h"
 #include "sys_time.h"
+#include "profiler.h"
+#include "ring.h"
+#include "deferred_work.h"
+
+/* a gap longer than this starts a new frame */
+#define SBUS_FRAME_GAP_CYCLES (2 * (PROFILER_CPU_FREQ / 1000)) //2ms
 
 void parse_sbus(uint8_t *raw_buff, uint16_t *rc_val);
 void debug_print_raw_sbus(void);
@@ -17,16 +23,28 @@ uint8_t sbus_buff[25] = {0};
 int sbus_cnt = 0;
 uint16_t rc_val[15];
 
+typedef struct {
+	uint32_t time; //dwt timestamp [cycles]
+	uint8_t c;
+} sbus_rx_t;
+
+RING_ALLOC(sbus_ring, sbus_rx_t, 64);
+
+/* uart4 rx interrupt, only captures the byte */
 void sbus_rc_handler(uint8_t byte)
 {
-	static float curr_time_ms;
-	static float last_time_ms;
+	sbus_rx_t rx = {.time = profiler_get_cycles(), .c = byte};
+	ring_push(&sbus_ring, &rx);
+	deferred_work_signal_from_isr(DEFERRED_WORK_SBUS);
+}
 
-	curr_time_ms = get_sys_time_ms();
+static void sbus_decode(uint8_t byte, uint32_t time)
+{
+	static uint32_t last_time;
 
 	/* use reception interval time to deteminate
 	   whether it is a new s-bus frame */
-	if((curr_time_ms - last_time_ms) > 2.0f) {
+	if((time - last_time) > SBUS_FRAME_GAP_CYCLES) {
 		sbus_cnt = 0;
 	}
 
@@ -38,7 +56,22 @@ void sbus_rc_handler(uint8_t byte)
 		sbus_cnt = 0;
 	}
 
-	last_time_ms = curr_time_ms;
+	/* a corrupted gap detection must not overflow the frame buffer */
+	if(sbus_cnt >= 25) {
+		sbus_cnt = 0;
+	}
+
+	last_time = time;
+}
+
+/* deferred work, decodes the captured bytes */
+void sbus_process(void)
+{
+	sbus_rx_t rx;
+
+	while(ring_pop(&sbus_ring, &rx) == true) {
+		sbus_decode(rx.c, rx.time);
+	}
 }
 
 void parse_sbus(uint8_t *raw_buff, uint16_t *rc_val)
@@ -72,6 +105,7 @@ void read_rc_info(radio_t *rc)
 	float yaw_raw = (float)rc_val[3]; //channel 4
 	float safety_raw = (float)rc_val[4]; //channel 5
 	float flight_mode_raw = (float)rc_val[5]; //channel 6
+	float aux1_raw = (float)rc_val[6]; //channel 7
 
 	if(safety_raw > RC_SAFETY_THRESH) {
 		rc->safety = false; //disarmed
@@ -104,6 +138,17 @@ void read_rc_info(radio_t *rc)
 		rc->flight_mode = FLIGHT_MODE_MANUAL;
 	}
 
+	/* auxiliary switch */
+	float aux_up_thresh = (RC_AUX_MAX + RC_AUX_MID) / 2.0f;
+	float aux_low_thresh = (RC_AUX_MID + RC_AUX_MIN) / 2.0f;
+	if(aux1_raw < aux_low_thresh) {
+		rc->aux1 = RC_SWITCH_LOW;
+	} else if(aux1_raw > aux_up_thresh) {
+		rc->aux1 = RC_SWITCH_HIGH;
+	} else {
+		rc->aux1 = RC_SWITCH_MID;
+	}
+
 	bound_float(&rc->roll, RC_ROLL_RANGE_MAX, RC_ROLL_RANGE_MIN);
 	bound_float(&rc->pitch, RC_PITCH_RANGE_MAX, RC_PITCH_RANGE_MIN);
 	bound_float(&rc->yaw, RC_YAW_RANGE_MAX, RC_YAW_RANGE_MIN);
@@ -161,12 +206,16 @@ void debug_print_rc_info(radio_t *rc)
 		flight_mode_s = navigation_mode_s;
 	}
 
+	/* variadic arguments are always promoted, the explicit casts keep
+	 * -Wdouble-promotion quiet for this debug print */
 	if(rc->safety == true) {
 		sprintf(s, "[disarmed]%s roll:%lf,pitch:%lf,yaw:%lf,throttle:%lf\n\r",
-		        flight_mode_s, rc->roll, rc->pitch, rc->yaw, rc->throttle);
+		        flight_mode_s, (double)rc->roll, (double)rc->pitch, (double)rc->yaw,
+		        (double)rc->throttle);
 	} else {
 		sprintf(s, "[armed]%s roll:%lf,pitch:%lf,yaw:%lf,throttle:%lf\n\r",
-		        flight_mode_s, rc->roll, rc->pitch, rc->yaw, rc->throttle);
+		        flight_mode_s, (double)rc->roll, (double)rc->pitch, (double)rc->yaw,
+		        (double)rc->throttle);
 	}
 	uart3_puts(s, strlen(s));
 	blocked_delay_ms(100);
@@ -18,6 +18,9 @@
 #define RC_FLIGHT_MODE_MAX 1904
 #define RC_FLIGHT_MODE_MID 1024
 #define RC_FLIGHT_MODE_MIN 144
+#define RC_AUX_MAX 1904
+#define RC_AUX_MID 1024
+#define RC_AUX_MIN 144
 
 /* define radio control range */
 #define RC_THROTTLE_RANGE_MAX 100.0f
@@ -28,7 +31,7 @@
 #define RC_PITCH_RANGE_MIN -35.0f
 #define RC_YAW_RANGE_MAX +35.0f
 #define RC_YAW_RANGE_MIN -35.0f
-#define RC_SAFETY_THRESH ((float)(RC_SAFETY_MAX - RC_SAFETY_MIN) / 2.0)
+#define RC_SAFETY_THRESH ((float)(RC_SAFETY_MAX - RC_SAFETY_MIN) / 2.0f)
 
 enum {
 	FLIGHT_MODE_MANUAL = 0,
@@ -36,6 +39,13 @@ enum {
 	FLIGHT_MODE_NAVIGATION = 2
 } FLIGHT_MODE;
 
+/* three position switch */
+enum {
+	RC_SWITCH_LOW = 0,
+	RC_SWITCH_MID = 1,
+	RC_SWITCH_HIGH = 2
+};
+
 typedef struct {
 	float throttle;
 	float roll;
@@ -43,9 +53,11 @@ typedef struct {
 	float yaw;
 	bool safety;
 	int flight_mode;
+	int aux1; //channel 7 switch position
 } radio_t;
 
 void sbus_rc_handler(uint8_t byte);
+void sbus_process(void);
 void read_rc_info(radio_t *rc);
 int rc_safety_check(radio_t *rc);
 void debug_print_rc_info(radio_t *rc);
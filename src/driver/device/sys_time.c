@@ -4,6 +4,7 @@
 #include "stm32f4xx_conf.h"
 #include "uart.h"
 #include "sys_time.h"
+#include "profiler.h"
 
 sys_time_t sys_tim;
 
@@ -27,6 +28,13 @@ float get_sys_time_ms(void)
 	return (sys_tim.time_s + sys_tim.tick_s) * 1000.0f;
 }
 
+/* system time of an earlier dwt timestamp, e.g. of data captured in an interrupt */
+float get_sys_time_ms_at(uint32_t timestamp)
+{
+	float age_ms = profiler_cycles_to_us((float)(profiler_get_cycles() - timestamp)) * 0.001f;
+	return get_sys_time_ms() - age_ms;
+}
+
 float get_sys_time_s(void)
 {
 	return sys_tim.time_s + sys_tim.tick_s;
@@ -36,6 +44,6 @@ void debug_print_sys_tim(void)
 {
 	char s[100] = {0};
 	sprintf(s, "sys_tim_sec: %f, sys_time_ms: %f\n\r",
-	        get_sys_time_s(), get_sys_time_ms());
+	        (double)get_sys_time_s(), (double)get_sys_time_ms());
 	uart3_puts(s, strlen(s));
 }
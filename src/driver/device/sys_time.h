@@ -11,6 +11,7 @@ typedef struct {
 
 void sys_time_update_handler(void);
 float get_sys_time_ms(void);
+float get_sys_time_ms_at(uint32_t timestamp);
 float get_sys_time_s(void);
 void debug_print_sys_tim(void);
 
@@ -0,0 +1,288 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "stm32f4xx_conf.h"
+#include "uart.h"
+#include "delay.h"
+#include "sys_time.h"
+#include "profiler.h"
+#include "ublox.h"
+
+/*
+ * u-blox receiver with ubx binary protocol. the uart dma writes into
+ * ublox_rx_buf circularly, the parser is triggered by the uart idle line and
+ * dma half/full transfer interrupts, frames are validated and decoded in
+ * place without copying them out of the ring buffer.
+ */
+
+#define UBX_SYNC_CHAR_1 0xb5
+#define UBX_SYNC_CHAR_2 0x62
+#define UBX_HEADER_SIZE 6   //sync chars, class, id, length
+#define UBX_CHECKSUM_SIZE 2
+
+#define UBX_CLASS_NAV 0x01
+#define UBX_CLASS_CFG 0x06
+#define UBX_NAV_PVT 0x07
+#define UBX_CFG_PRT 0x00
+#define UBX_CFG_MSG 0x01
+#define UBX_CFG_RATE 0x08
+#define UBX_CFG_NAV5 0x24
+
+#define UBX_NAV_PVT_SIZE 92
+
+#define UBX_DYN_MODEL_AIRBORNE_4G 8
+
+#define RING_MASK (UBLOX_RX_BUF_SIZE - 1)
+
+uint8_t ublox_rx_buf[UBLOX_RX_BUF_SIZE];
+static uint32_t ublox_rx_read_pos = 0;
+
+/* boot state machine */
+enum {
+	UBLOX_BOOT_DEFAULT_BAUDRATE,
+	UBLOX_BOOT_NEW_BAUDRATE,
+	UBLOX_BOOT_READY
+};
+
+#define UBLOX_CFG_WAIT_MS 100 //time for the receiver to apply the port setting
+
+static int ublox_boot_state;
+static uint32_t ublox_boot_time;
+
+/* published with a sequence lock, the sequence is odd while writing */
+static volatile uint32_t gps_fix_seq = 0;
+static gps_fix_t gps_fix;
+
+uint32_t ubx_checksum_error_cnt = 0;
+
+static inline uint32_t ring_write_pos(void)
+{
+	return (UBLOX_RX_BUF_SIZE - DMA_GetCurrDataCounter(DMA1_Stream3)) & RING_MASK;
+}
+
+static inline uint8_t ring_u8(uint32_t pos)
+{
+	return ublox_rx_buf[pos & RING_MASK];
+}
+
+static inline uint16_t ring_u16(uint32_t pos)
+{
+	return (uint16_t)ring_u8(pos) | ((uint16_t)ring_u8(pos + 1) << 8);
+}
+
+static inline uint32_t ring_u32(uint32_t pos)
+{
+	return (uint32_t)ring_u16(pos) | ((uint32_t)ring_u16(pos + 2) << 16);
+}
+
+static inline int32_t ring_i32(uint32_t pos)
+{
+	return (int32_t)ring_u32(pos);
+}
+
+/* 8-bit fletcher algorithm over class, id, length and payload */
+static bool ubx_checksum_verify(uint32_t frame_pos, uint16_t payload_len)
+{
+	uint8_t ck_a = 0, ck_b = 0;
+
+	uint32_t pos = frame_pos + 2;
+	uint32_t end = frame_pos + UBX_HEADER_SIZE + payload_len;
+	for(; pos != end; pos++) {
+		ck_a += ring_u8(pos);
+		ck_b += ck_a;
+	}
+
+	return (ck_a == ring_u8(end)) && (ck_b == ring_u8(end + 1));
+}
+
+static void ubx_nav_pvt_decode(uint32_t payload)
+{
+	gps_fix_seq++;
+	__DMB();
+
+	gps_fix.timestamp_ms = get_sys_time_ms();
+	gps_fix.itow = ring_u32(payload + 0);
+	gps_fix.fix_type = ring_u8(payload + 20);
+	gps_fix.fix_ok = (ring_u8(payload + 21) & 0x01) ? true : false;
+	gps_fix.num_sv = ring_u8(payload + 23);
+	gps_fix.longitude = ring_i32(payload + 24);
+	gps_fix.latitude = ring_i32(payload + 28);
+	gps_fix.height_msl = (float)ring_i32(payload + 36) * 0.001f;
+	gps_fix.h_acc = (float)ring_u32(payload + 40) * 0.001f;
+	gps_fix.v_acc = (float)ring_u32(payload + 44) * 0.001f;
+	gps_fix.vel_n = (float)ring_i32(payload + 48) * 0.001f;
+	gps_fix.vel_e = (float)ring_i32(payload + 52) * 0.001f;
+	gps_fix.vel_d = (float)ring_i32(payload + 56) * 0.001f;
+	gps_fix.s_acc = (float)ring_u32(payload + 68) * 0.001f;
+	gps_fix.pdop = (float)ring_u16(payload + 76) * 0.01f;
+	gps_fix.update_cnt++;
+
+	__DMB();
+	gps_fix_seq++;
+}
+
+/* deferred work, signaled by the uart7 idle line and dma1 stream3 interrupts */
+void ublox_rx_handler(void)
+{
+	uint32_t write_pos = ring_write_pos();
+
+	while(1) {
+		uint32_t received = (write_pos - ublox_rx_read_pos) & RING_MASK;
+		if(received < UBX_HEADER_SIZE + UBX_CHECKSUM_SIZE) {
+			break;
+		}
+
+		uint32_t frame = ublox_rx_read_pos;
+
+		/* search the sync chars */
+		if(ring_u8(frame) != UBX_SYNC_CHAR_1 || ring_u8(frame + 1) != UBX_SYNC_CHAR_2) {
+			ublox_rx_read_pos = (ublox_rx_read_pos + 1) & RING_MASK;
+			continue;
+		}
+
+		uint16_t payload_len = ring_u16(frame + 4);
+		uint32_t frame_size = UBX_HEADER_SIZE + payload_len + UBX_CHECKSUM_SIZE;
+
+		if(frame_size > UBLOX_RX_BUF_SIZE / 2) {
+			/* corrupted length, skip the sync chars */
+			ublox_rx_read_pos = (ublox_rx_read_pos + 1) & RING_MASK;
+			continue;
+		}
+
+		if(received < frame_size) {
+			break; //wait for the rest of the frame
+		}
+
+		if(ubx_checksum_verify(frame, payload_len) == false) {
+			ubx_checksum_error_cnt++;
+			ublox_rx_read_pos = (ublox_rx_read_pos + 1) & RING_MASK;
+			continue;
+		}
+
+		uint8_t class = ring_u8(frame + 2);
+		uint8_t id = ring_u8(frame + 3);
+		if(class == UBX_CLASS_NAV && id == UBX_NAV_PVT && payload_len == UBX_NAV_PVT_SIZE) {
+			ubx_nav_pvt_decode(frame + UBX_HEADER_SIZE);
+		}
+
+		ublox_rx_read_pos = (ublox_rx_read_pos + frame_size) & RING_MASK;
+	}
+}
+
+/* copy the latest fix, returns the update count for detecting new fixes */
+uint32_t ublox_get_fix(gps_fix_t *fix)
+{
+	uint32_t seq;
+
+	do {
+		seq = gps_fix_seq;
+		__DMB();
+		*fix = gps_fix;
+		__DMB();
+	} while((seq & 1) || seq != gps_fix_seq);
+
+	return fix->update_cnt;
+}
+
+static void ubx_send(uint8_t class, uint8_t id, uint8_t *payload, uint16_t len)
+{
+	uint8_t header[UBX_HEADER_SIZE] = {
+		UBX_SYNC_CHAR_1, UBX_SYNC_CHAR_2, class, id, len & 0xff, len >> 8
+	};
+
+	uint8_t ck_a = 0, ck_b = 0;
+	int i;
+	for(i = 2; i < UBX_HEADER_SIZE; i++) {
+		ck_a += header[i];
+		ck_b += ck_a;
+	}
+	for(i = 0; i < len; i++) {
+		ck_a += payload[i];
+		ck_b += ck_a;
+	}
+
+	usart_puts(UART7, (char *)header, UBX_HEADER_SIZE);
+	usart_puts(UART7, (char *)payload, len);
+	uart_putc(UART7, ck_a);
+	uart_putc(UART7, ck_b);
+}
+
+static void ubx_cfg_prt(uint32_t baudrate)
+{
+	uint8_t payload[20] = {
+		1, 0, 0, 0,             //uart1, reserved, tx ready
+		0xd0, 0x08, 0x00, 0x00, //mode: 8 bits, no parity, 1 stop bit
+		baudrate & 0xff, (baudrate >> 8) & 0xff, (baudrate >> 16) & 0xff, baudrate >> 24,
+		0x01, 0x00,             //input protocol: ubx
+		0x01, 0x00,             //output protocol: ubx (nmea disabled)
+		0, 0, 0, 0              //flags, reserved
+	};
+	ubx_send(UBX_CLASS_CFG, UBX_CFG_PRT, payload, sizeof(payload));
+}
+
+static void ubx_cfg_rate(uint16_t meas_rate_ms)
+{
+	uint8_t payload[6] = {
+		meas_rate_ms & 0xff, meas_rate_ms >> 8,
+		1, 0, //navigation rate: one solution per measurement
+		1, 0  //time reference: gps time
+	};
+	ubx_send(UBX_CLASS_CFG, UBX_CFG_RATE, payload, sizeof(payload));
+}
+
+static void ubx_cfg_msg(uint8_t class, uint8_t id, uint8_t rate)
+{
+	uint8_t payload[3] = {class, id, rate};
+	ubx_send(UBX_CLASS_CFG, UBX_CFG_MSG, payload, sizeof(payload));
+}
+
+static void ubx_cfg_nav5(uint8_t dyn_model)
+{
+	uint8_t payload[36] = {0};
+	payload[0] = 0x01; //mask: apply dynamic model only
+	payload[2] = dyn_model;
+	ubx_send(UBX_CLASS_CFG, UBX_CFG_NAV5, payload, sizeof(payload));
+}
+
+void ublox_init(void)
+{
+	/* switch the receiver from factory baudrate and disable nmea output */
+	uart7_init(UBLOX_DEFAULT_BAUDRATE);
+	ubx_cfg_prt(UBLOX_BAUDRATE);
+
+	ublox_boot_time = profiler_get_cycles();
+	ublox_boot_state = UBLOX_BOOT_DEFAULT_BAUDRATE;
+}
+
+/* non-blocking configuration, called periodically by the boot sequence
+ * until the receiver is configured and true is returned */
+bool ublox_init_step(void)
+{
+	switch(ublox_boot_state) {
+	case UBLOX_BOOT_DEFAULT_BAUDRATE:
+		if(delay_elapsed_ms(ublox_boot_time, UBLOX_CFG_WAIT_MS) == false) {
+			break;
+		}
+
+		/* repeat with the new baudrate in case the receiver was already configured */
+		uart7_init(UBLOX_BAUDRATE);
+		ublox_rx_read_pos = 0;
+		ubx_cfg_prt(UBLOX_BAUDRATE);
+
+		ublox_boot_time = profiler_get_cycles();
+		ublox_boot_state = UBLOX_BOOT_NEW_BAUDRATE;
+		break;
+	case UBLOX_BOOT_NEW_BAUDRATE:
+		if(delay_elapsed_ms(ublox_boot_time, UBLOX_CFG_WAIT_MS) == false) {
+			break;
+		}
+
+		ubx_cfg_nav5(UBX_DYN_MODEL_AIRBORNE_4G);
+		ubx_cfg_rate(1000 / UBLOX_UPDATE_RATE);
+		ubx_cfg_msg(UBX_CLASS_NAV, UBX_NAV_PVT, 1);
+
+		ublox_boot_state = UBLOX_BOOT_READY;
+		break;
+	}
+
+	return ublox_boot_state == UBLOX_BOOT_READY;
+}
@@ -0,0 +1,58 @@
+#ifndef __UBLOX_H__
+#define __UBLOX_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UBLOX_DEFAULT_BAUDRATE 9600 //factory setting of the receiver
+#define UBLOX_BAUDRATE 115200
+#define UBLOX_UPDATE_RATE 10 //[Hz], 10~25Hz depending on the receiver and gnss constellations
+
+#define UBLOX_RX_BUF_SIZE 512 //must be power of 2
+
+/* measurement epoch to the reception of the nav-pvt frame, the navigation
+ * solution and the 115200 baud transfer */
+#define UBLOX_LATENCY_MS 60.0f
+
+/* fix types of nav-pvt */
+enum {
+	GPS_FIX_NONE = 0,
+	GPS_FIX_DEAD_RECKONING = 1,
+	GPS_FIX_2D = 2,
+	GPS_FIX_3D = 3,
+	GPS_FIX_GNSS_DEAD_RECKONING = 4,
+	GPS_FIX_TIME_ONLY = 5
+};
+
+typedef struct {
+	float timestamp_ms; //system time when the frame is received [ms]
+	uint32_t itow;      //gps time of week [ms]
+	uint32_t update_cnt;
+
+	uint8_t fix_type;
+	bool fix_ok;        //fix is within the dop and accuracy masks
+	uint8_t num_sv;
+
+	/* latitude and longitude are kept in integer to preserve the precision */
+	int32_t latitude;   //[1e-7 deg]
+	int32_t longitude;  //[1e-7 deg]
+	float height_msl;   //[m]
+
+	float vel_n;        //[m/s]
+	float vel_e;        //[m/s]
+	float vel_d;        //[m/s]
+
+	float h_acc;        //[m]
+	float v_acc;        //[m]
+	float s_acc;        //[m/s]
+	float pdop;
+} gps_fix_t;
+
+extern uint8_t ublox_rx_buf[UBLOX_RX_BUF_SIZE];
+
+void ublox_init(void);
+bool ublox_init_step(void);
+void ublox_rx_handler(void);
+uint32_t ublox_get_fix(gps_fix_t *fix);
+
+#endif
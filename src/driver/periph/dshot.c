@@ -0,0 +1,442 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "stm32f4xx_conf.h"
+#include "isr.h"
+#include "dshot.h"
+
+/*
+ * bidirectional dshot600, both timers are clocked with 90MHz:
+ * m1: pd12 (timer4 channel1, dma1 channel2 stream0)
+ * m2: pd13 (timer4 channel2, dma1 channel2 stream3)
+ * m3: pe14 (timer1 channel4, dma2 channel6 stream4)
+ * m4: pe13 (timer1 channel3, dma2 channel6 stream6)
+ *
+ * motor 5 and 6 (timer4 channel3/4) are not driven: channel4 has no dma
+ * request, channel3 alone (dma1 channel2 stream7) would only give a five motor
+ * airframe.
+ *
+ * dma1 stream3 is also used by uart3 tx, which is moved to dma1 stream4 if
+ * dshot is selected. dma2 stream6 is shared with uart6 tx, uart6_puts() falls
+ * back to polling together with dshot.
+ *
+ * after a frame is sent the channels are switched to input capture (both
+ * edges) and the dma records the edge timestamps of the gcr encoded erpm
+ * telemetry replied by the esc. the edges are decoded before the next frame
+ * is sent.
+ */
+
+#define DSHOT_BIT_PERIOD 150 //90MHz / 600KHz
+#define DSHOT_BIT_1 112      //75% duty
+#define DSHOT_BIT_0 56       //37.5% duty
+#define DSHOT_FRAME_BITS 16
+#define DSHOT_FRAME_SIZE (DSHOT_FRAME_BITS + 2) //2 idle slots at the end of the frame
+
+#define DSHOT_TELEM_BIT_PERIOD 120 //90MHz / 750KHz, telemetry is replied with 5/4 bitrate
+#define DSHOT_TELEM_GCR_BITS 21    //start bit + 4 * 5 bits gcr
+#define DSHOT_EDGE_BUF_SIZE 32
+
+#define DSHOT_BUF_SIZE DSHOT_EDGE_BUF_SIZE
+
+#define GCR_INVALID 0xff
+
+typedef struct {
+	TIM_TypeDef *tim;
+	uint16_t tim_channel;
+	uint16_t tim_dma_source;
+	DMA_Stream_TypeDef *dma_stream;
+	uint32_t dma_channel;
+	uint32_t dma_flags;
+	volatile uint32_t *ccr;
+
+	uint16_t buf[DSHOT_BUF_SIZE]; //output frame or captured telemetry edges
+	volatile bool telem_capturing;
+
+	float erpm;
+	uint32_t telem_error_cnt;
+} dshot_motor_t;
+
+volatile uint32_t dshot_throttle[6] = {0};
+
+static dshot_motor_t dshot_motors[DSHOT_MOTOR_CNT] = {
+	{
+		.tim = TIM4,
+		.tim_channel = TIM_Channel_1,
+		.tim_dma_source = TIM_DMA_CC1,
+		.dma_stream = DMA1_Stream0,
+		.dma_channel = DMA_Channel_2,
+		.dma_flags = DMA_FLAG_TCIF0 | DMA_FLAG_HTIF0 | DMA_FLAG_TEIF0 | DMA_FLAG_DMEIF0 | DMA_FLAG_FEIF0,
+		.ccr = &TIM4->CCR1
+	},
+	{
+		.tim = TIM4,
+		.tim_channel = TIM_Channel_2,
+		.tim_dma_source = TIM_DMA_CC2,
+		.dma_stream = DMA1_Stream3,
+		.dma_channel = DMA_Channel_2,
+		.dma_flags = DMA_FLAG_TCIF3 | DMA_FLAG_HTIF3 | DMA_FLAG_TEIF3 | DMA_FLAG_DMEIF3 | DMA_FLAG_FEIF3,
+		.ccr = &TIM4->CCR2
+	},
+	{
+		.tim = TIM1,
+		.tim_channel = TIM_Channel_4,
+		.tim_dma_source = TIM_DMA_CC4,
+		.dma_stream = DMA2_Stream4,
+		.dma_channel = DMA_Channel_6,
+		.dma_flags = DMA_FLAG_TCIF4 | DMA_FLAG_HTIF4 | DMA_FLAG_TEIF4 | DMA_FLAG_DMEIF4 | DMA_FLAG_FEIF4,
+		.ccr = &TIM1->CCR4
+	},
+	{
+		.tim = TIM1,
+		.tim_channel = TIM_Channel_3,
+		.tim_dma_source = TIM_DMA_CC3,
+		.dma_stream = DMA2_Stream6,
+		.dma_channel = DMA_Channel_6,
+		.dma_flags = DMA_FLAG_TCIF6 | DMA_FLAG_HTIF6 | DMA_FLAG_TEIF6 | DMA_FLAG_DMEIF6 | DMA_FLAG_FEIF6,
+		.ccr = &TIM1->CCR3
+	}
+};
+
+/* gcr 5 bits to 4 bits lookup table */
+static const uint8_t gcr_decode_table[32] = {
+	GCR_INVALID, GCR_INVALID, GCR_INVALID, GCR_INVALID,
+	GCR_INVALID, GCR_INVALID, GCR_INVALID, GCR_INVALID,
+	GCR_INVALID, 0x9, 0xa, 0xb, GCR_INVALID, 0xd, 0xe, 0xf,
+	GCR_INVALID, GCR_INVALID, 0x2, 0x3, GCR_INVALID, 0x5, 0x6, 0x7,
+	GCR_INVALID, 0x0, 0x8, 0x1, GCR_INVALID, 0x4, 0xc, GCR_INVALID
+};
+
+static void dshot_channel_output_config(dshot_motor_t *motor)
+{
+	/* inverted output (idle high) for bidirectional dshot */
+	TIM_OCInitTypeDef TIM_OCInitStruct = {
+		.TIM_OCMode = TIM_OCMode_PWM1,
+		.TIM_OutputState = TIM_OutputState_Enable,
+		.TIM_OCPolarity = TIM_OCPolarity_Low,
+		.TIM_OCIdleState = TIM_OCIdleState_Set,
+		.TIM_Pulse = 0
+	};
+
+	switch(motor->tim_channel) {
+	case TIM_Channel_1:
+		TIM_OC1Init(motor->tim, &TIM_OCInitStruct);
+		TIM_OC1PreloadConfig(motor->tim, TIM_OCPreload_Enable);
+		break;
+	case TIM_Channel_2:
+		TIM_OC2Init(motor->tim, &TIM_OCInitStruct);
+		TIM_OC2PreloadConfig(motor->tim, TIM_OCPreload_Enable);
+		break;
+	case TIM_Channel_3:
+		TIM_OC3Init(motor->tim, &TIM_OCInitStruct);
+		TIM_OC3PreloadConfig(motor->tim, TIM_OCPreload_Enable);
+		break;
+	case TIM_Channel_4:
+		TIM_OC4Init(motor->tim, &TIM_OCInitStruct);
+		TIM_OC4PreloadConfig(motor->tim, TIM_OCPreload_Enable);
+		break;
+	}
+}
+
+static void dshot_channel_input_config(dshot_motor_t *motor)
+{
+	TIM_ICInitTypeDef TIM_ICInitStruct = {
+		.TIM_Channel = motor->tim_channel,
+		.TIM_ICPolarity = TIM_ICPolarity_BothEdge,
+		.TIM_ICSelection = TIM_ICSelection_DirectTI,
+		.TIM_ICPrescaler = TIM_ICPSC_DIV1,
+		.TIM_ICFilter = 0x2
+	};
+	TIM_ICInit(motor->tim, &TIM_ICInitStruct);
+}
+
+static void dshot_dma_config(dshot_motor_t *motor, uint32_t direction, uint32_t size)
+{
+	DMA_Cmd(motor->dma_stream, DISABLE);
+	while(DMA_GetCmdStatus(motor->dma_stream) == ENABLE);
+
+	DMA_ClearFlag(motor->dma_stream, motor->dma_flags);
+
+	DMA_InitTypeDef DMA_InitStructure = {
+		.DMA_BufferSize = size,
+		.DMA_FIFOMode = DMA_FIFOMode_Disable,
+		.DMA_FIFOThreshold = DMA_FIFOThreshold_Full,
+		.DMA_MemoryBurst = DMA_MemoryBurst_Single,
+		.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord,
+		.DMA_MemoryInc = DMA_MemoryInc_Enable,
+		.DMA_Mode = DMA_Mode_Normal,
+		.DMA_PeripheralBaseAddr = (uint32_t)motor->ccr,
+		.DMA_PeripheralBurst = DMA_PeripheralBurst_Single,
+		.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord,
+		.DMA_PeripheralInc = DMA_PeripheralInc_Disable,
+		.DMA_Priority = DMA_Priority_High,
+		.DMA_Channel = motor->dma_channel,
+		.DMA_DIR = direction,
+		.DMA_Memory0BaseAddr = (uint32_t)motor->buf
+	};
+	DMA_Init(motor->dma_stream, &DMA_InitStructure);
+
+	DMA_Cmd(motor->dma_stream, ENABLE);
+}
+
+static uint16_t dshot_make_packet(uint16_t throttle)
+{
+	uint16_t packet = throttle << 1; //telemetry request bit is unused in bidirectional mode
+
+	/* bidirectional dshot uses inverted crc */
+	uint16_t crc = (~(packet ^ (packet >> 4) ^ (packet >> 8))) & 0x0f;
+
+	return (packet << 4) | crc;
+}
+
+static void dshot_encode_frame(dshot_motor_t *motor, uint16_t throttle)
+{
+	uint16_t packet = dshot_make_packet(throttle);
+
+	int i;
+	for(i = 0; i < DSHOT_FRAME_BITS; i++) {
+		motor->buf[i] = (packet & (0x8000 >> i)) ? DSHOT_BIT_1 : DSHOT_BIT_0;
+	}
+
+	/* keep the line idle after the frame */
+	motor->buf[DSHOT_FRAME_BITS] = 0;
+	motor->buf[DSHOT_FRAME_BITS + 1] = 0;
+}
+
+/* convert the captured edge timestamps to erpm, returns 0 if succeeded */
+static int dshot_decode_telemetry(uint16_t *edges, int edge_cnt, float *erpm)
+{
+	if(edge_cnt < 2) {
+		return 1; //esc did not reply
+	}
+
+	/* every edge represents a "1" of the gcr code, the bit count between
+	   two edges is decided by the time interval */
+	uint32_t gcr = 0;
+	int bits = 0;
+	int len;
+
+	int i;
+	for(i = 1; i <= edge_cnt; i++) {
+		if(i < edge_cnt) {
+			uint16_t interval = edges[i] - edges[i - 1];
+			len = (interval + DSHOT_TELEM_BIT_PERIOD / 2) / DSHOT_TELEM_BIT_PERIOD;
+		} else {
+			/* line stays idle after the last edge */
+			len = DSHOT_TELEM_GCR_BITS - bits;
+		}
+
+		if(len <= 0 || (bits + len) > DSHOT_TELEM_GCR_BITS) {
+			return 1;
+		}
+
+		gcr = (gcr << len) | (1 << (len - 1));
+		bits += len;
+
+		if(bits == DSHOT_TELEM_GCR_BITS) {
+			break;
+		}
+	}
+
+	if(bits != DSHOT_TELEM_GCR_BITS) {
+		return 1;
+	}
+
+	/* 20 bits gcr to 16 bits value (12 bits period + 4 bits crc) */
+	uint32_t value = 0;
+	for(i = 0; i < 4; i++) {
+		uint8_t nibble = gcr_decode_table[(gcr >> (i * 5)) & 0x1f];
+		if(nibble == GCR_INVALID) {
+			return 1;
+		}
+		value |= (uint32_t)nibble << (i * 4);
+	}
+
+	uint32_t crc = value ^ (value >> 8);
+	crc = crc ^ (crc >> 4);
+	if((crc & 0x0f) != 0x0f) {
+		return 1;
+	}
+
+	value >>= 4;
+
+	if(value == 0x0fff) {
+		*erpm = 0.0f; //motor stopped
+		return 0;
+	}
+
+	/* period [us] = mantissa (9 bits) << exponent (3 bits) */
+	uint32_t period_us = (value & 0x01ff) << (value >> 9);
+	if(period_us == 0) {
+		return 1;
+	}
+
+	*erpm = 60000000.0f / (float)period_us;
+
+	return 0;
+}
+
+static void dshot_timer_start_output(TIM_TypeDef *tim)
+{
+	TIM_Cmd(tim, DISABLE);
+	TIM_SelectCCDMA(tim, ENABLE); //request dma with update event
+
+	int i;
+	for(i = 0; i < DSHOT_MOTOR_CNT; i++) {
+		dshot_motor_t *motor = &dshot_motors[i];
+		if(motor->tim != tim) {
+			continue;
+		}
+
+		TIM_DMACmd(tim, motor->tim_dma_source, DISABLE);
+
+		/* decode the telemetry received after the previous frame */
+		if(motor->telem_capturing == true) {
+			DMA_Cmd(motor->dma_stream, DISABLE);
+			while(DMA_GetCmdStatus(motor->dma_stream) == ENABLE);
+
+			int edge_cnt = DSHOT_EDGE_BUF_SIZE - DMA_GetCurrDataCounter(motor->dma_stream);
+			if(dshot_decode_telemetry(motor->buf, edge_cnt, &motor->erpm) != 0) {
+				motor->telem_error_cnt++;
+			}
+			motor->telem_capturing = false;
+		}
+
+		dshot_channel_output_config(motor);
+		dshot_encode_frame(motor, dshot_throttle[i]);
+		dshot_dma_config(motor, DMA_DIR_MemoryToPeripheral, DSHOT_FRAME_SIZE);
+
+		TIM_DMACmd(tim, motor->tim_dma_source, ENABLE);
+	}
+
+	TIM_SetAutoreload(tim, DSHOT_BIT_PERIOD - 1);
+	TIM_SetCounter(tim, 0);
+	TIM_Cmd(tim, ENABLE);
+}
+
+static void dshot_timer_start_capture(TIM_TypeDef *tim)
+{
+	TIM_Cmd(tim, DISABLE);
+	TIM_SelectCCDMA(tim, DISABLE); //request dma with capture event
+
+	int i;
+	for(i = 0; i < DSHOT_MOTOR_CNT; i++) {
+		dshot_motor_t *motor = &dshot_motors[i];
+		if(motor->tim != tim) {
+			continue;
+		}
+
+		TIM_DMACmd(tim, motor->tim_dma_source, DISABLE);
+
+		dshot_channel_input_config(motor);
+		dshot_dma_config(motor, DMA_DIR_PeripheralToMemory, DSHOT_EDGE_BUF_SIZE);
+		motor->telem_capturing = true;
+
+		TIM_DMACmd(tim, motor->tim_dma_source, ENABLE);
+	}
+
+	TIM_SetAutoreload(tim, 0xffff);
+	TIM_SetCounter(tim, 0);
+	TIM_Cmd(tim, ENABLE);
+}
+
+void dshot_init(void)
+{
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOD, ENABLE);
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOE, ENABLE);
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA1, ENABLE);
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA2, ENABLE);
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM4, ENABLE);
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM1, ENABLE);
+
+	GPIO_PinAFConfig(GPIOD, GPIO_PinSource12, GPIO_AF_TIM4);
+	GPIO_PinAFConfig(GPIOD, GPIO_PinSource13, GPIO_AF_TIM4);
+	GPIO_PinAFConfig(GPIOE, GPIO_PinSource13, GPIO_AF_TIM1);
+	GPIO_PinAFConfig(GPIOE, GPIO_PinSource14, GPIO_AF_TIM1);
+
+	/* pull-up keeps the line idle while the esc is not replying */
+	GPIO_InitTypeDef GPIO_InitStruct = {
+		.GPIO_Pin =  GPIO_Pin_12 | GPIO_Pin_13,
+		.GPIO_Mode = GPIO_Mode_AF,
+		.GPIO_Speed = GPIO_Speed_100MHz,
+		.GPIO_OType = GPIO_OType_PP,
+		.GPIO_PuPd = GPIO_PuPd_UP
+	};
+	GPIO_Init(GPIOD, &GPIO_InitStruct);
+
+	GPIO_InitStruct.GPIO_Pin = GPIO_Pin_13 | GPIO_Pin_14;
+	GPIO_Init(GPIOE, &GPIO_InitStruct);
+
+	/* 90MHz / (150 * 1) = 600KHz */
+	TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStruct = {
+		.TIM_Period = DSHOT_BIT_PERIOD - 1,
+		.TIM_Prescaler = 1 - 1,
+		.TIM_ClockDivision = TIM_CKD_DIV1,
+		.TIM_CounterMode = TIM_CounterMode_Up
+	};
+	TIM_TimeBaseInit(TIM4, &TIM_TimeBaseInitStruct);
+
+	/* 180MHz / (150 * 2) = 600KHz */
+	TIM_TimeBaseInitStruct.TIM_Prescaler = 2 - 1;
+	TIM_TimeBaseInit(TIM1, &TIM_TimeBaseInitStruct);
+
+	int i;
+	for(i = 0; i < DSHOT_MOTOR_CNT; i++) {
+		dshot_channel_output_config(&dshot_motors[i]);
+	}
+
+	TIM_CtrlPWMOutputs(TIM1, ENABLE);
+
+	/* the end of a frame is detected by the first motor of each timer */
+	DMA_ITConfig(DMA1_Stream0, DMA_IT_TC, ENABLE);
+	DMA_ITConfig(DMA2_Stream4, DMA_IT_TC, ENABLE);
+
+	NVIC_InitTypeDef NVIC_InitStruct = {
+		.NVIC_IRQChannel = DMA1_Stream0_IRQn,
+		.NVIC_IRQChannelPreemptionPriority = DSHOT_DMA_ISR_PRIORITY,
+		.NVIC_IRQChannelSubPriority = 0,
+		.NVIC_IRQChannelCmd = ENABLE
+	};
+	NVIC_Init(&NVIC_InitStruct);
+
+	NVIC_InitStruct.NVIC_IRQChannel = DMA2_Stream4_IRQn;
+	NVIC_Init(&NVIC_InitStruct);
+}
+
+void dshot_write(void)
+{
+	dshot_timer_start_output(TIM4);
+	dshot_timer_start_output(TIM1);
+}
+
+float dshot_get_erpm(int motor)
+{
+	return dshot_motors[motor].erpm;
+}
+
+float dshot_get_motor_freq(int motor)
+{
+	/* erpm to rotation per second */
+	return dshot_motors[motor].erpm * (1.0f / (60.0f * DSHOT_MOTOR_POLE_PAIRS));
+}
+
+void DMA1_Stream0_IRQHandler(void)
+{
+	if(DMA_GetITStatus(DMA1_Stream0, DMA_IT_TCIF0) == SET) {
+		DMA_ClearITPendingBit(DMA1_Stream0, DMA_IT_TCIF0);
+
+		/* frame is sent, prepare for receiving the telemetry */
+		if(dshot_motors[0].telem_capturing == false) {
+			dshot_timer_start_capture(TIM4);
+		}
+	}
+}
+
+void DMA2_Stream4_IRQHandler(void)
+{
+	if(DMA_GetITStatus(DMA2_Stream4, DMA_IT_TCIF4) == SET) {
+		DMA_ClearITPendingBit(DMA2_Stream4, DMA_IT_TCIF4);
+
+		if(dshot_motors[2].telem_capturing == false) {
+			dshot_timer_start_capture(TIM1);
+		}
+	}
+}
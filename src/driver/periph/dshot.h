@@ -0,0 +1,24 @@
+#ifndef __DSHOT_H__
+#define __DSHOT_H__
+
+#include <stdint.h>
+
+#define DSHOT_MOTOR_CNT 4
+
+#define DSHOT_THROTTLE_MIN 48
+#define DSHOT_THROTTLE_MAX 2047
+#define DSHOT_CMD_MOTOR_STOP 0
+
+#define DSHOT_MOTOR_POLE_PAIRS 7 //14 poles motor
+
+/* throttle commands, written by set_motor_pwm_pulse() and sent by dshot_write().
+ * the last two elements are placeholders for MOTOR5 and MOTOR6 which are not
+ * supported by the dshot output */
+extern volatile uint32_t dshot_throttle[6];
+
+void dshot_init(void);
+void dshot_write(void);
+float dshot_get_erpm(int motor);
+float dshot_get_motor_freq(int motor);
+
+#endif
@@ -4,6 +4,7 @@
 #include "isr.h"
 #include "led.h"
 #include "mpu6500.h"
+#include "sys_stats.h"
 
 void exti10_init(void)
 {
@@ -38,8 +39,12 @@ void exti10_init(void)
 
 void EXTI15_10_IRQHandler(void)
 {
+	sys_stats_isr_enter(SYS_STATS_ISR_IMU_EXTI);
+
 	if(EXTI_GetITStatus(EXTI_Line10) == SET) {
 		mpu6500_int_handler();
 		EXTI_ClearITPendingBit(EXTI_Line10);
 	}
+
+	sys_stats_isr_exit(SYS_STATS_ISR_IMU_EXTI);
 }
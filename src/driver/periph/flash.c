@@ -0,0 +1,141 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "stm32f4xx_conf.h"
+#include "flash.h"
+
+/* records are appended to the sector and the latest valid one of an id wins,
+ * the sector is only erased once it is full:
+ * | id (16 bits) | size (16 bits) | checksum (32 bits) | data, padded to words |
+ *
+ * a record is programmed header first and checksum last, the checksum commits
+ * it. a store interrupted by a reset leaves a header whose size still skips
+ * the record, and an erased or wrong checksum which never matches */
+
+#define FLASH_PARAM_HEADER_SIZE 8
+#define FLASH_PARAM_ERASED 0xffffffff
+
+#define FLASH_PARAM_END (FLASH_PARAM_ADDR + FLASH_PARAM_SIZE)
+
+#define flash_word(addr) (*(volatile uint32_t *)(uintptr_t)(addr))
+
+static uint32_t flash_param_checksum(const uint8_t *data, size_t size)
+{
+	/* fnv-1a */
+	uint32_t hash = 2166136261u;
+
+	size_t i;
+	for(i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+static uint32_t flash_param_record_size(uint16_t size)
+{
+	return FLASH_PARAM_HEADER_SIZE + ((size + 3) & ~3);
+}
+
+static bool flash_param_is_erased(uint32_t addr, uint32_t size)
+{
+	uint32_t offset;
+	for(offset = 0; offset < size; offset += 4) {
+		if(flash_word(addr + offset) != FLASH_PARAM_ERASED) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* walk the records, returns the first free address */
+static uint32_t flash_param_scan(uint16_t id, uint32_t *latest)
+{
+	uint32_t addr = FLASH_PARAM_ADDR;
+
+	*latest = 0;
+
+	while(addr + FLASH_PARAM_HEADER_SIZE <= FLASH_PARAM_END) {
+		uint32_t header = flash_word(addr);
+		if(header == FLASH_PARAM_ERASED) {
+			break;
+		}
+
+		uint16_t size = header >> 16;
+		uint32_t record_size = flash_param_record_size(size);
+		if(addr + record_size > FLASH_PARAM_END) {
+			break; //corrupted header
+		}
+
+		if((header & 0xffff) == id &&
+		    flash_word(addr + 4) == flash_param_checksum((uint8_t *)(uintptr_t)(addr + FLASH_PARAM_HEADER_SIZE), size)) {
+			*latest = addr;
+		}
+
+		addr += record_size;
+	}
+
+	return addr;
+}
+
+bool flash_param_load(uint16_t id, void *data, size_t size)
+{
+	uint32_t latest;
+	flash_param_scan(id, &latest);
+
+	if(latest == 0 || (flash_word(latest) >> 16) != size) {
+		return false;
+	}
+
+	memcpy(data, (uint8_t *)(uintptr_t)(latest + FLASH_PARAM_HEADER_SIZE), size);
+
+	return true;
+}
+
+/* blocks while programming, and for about 2s if the sector has to be erased,
+ * call from a low priority context only */
+bool flash_param_store(uint16_t id, const void *data, size_t size)
+{
+	uint32_t latest;
+	uint32_t addr = flash_param_scan(id, &latest);
+	uint32_t record_size = flash_param_record_size(size);
+
+	if(record_size > FLASH_PARAM_SIZE) {
+		return false;
+	}
+
+	FLASH_Unlock();
+	FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+	                FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+
+	/* sector full, or the free space behind the last record is not erased
+	 * (corrupted header), the other records are dropped as well */
+	if(addr + record_size > FLASH_PARAM_END || flash_param_is_erased(addr, record_size) == false) {
+		if(FLASH_EraseSector(FLASH_PARAM_SECTOR, VoltageRange_3) != FLASH_COMPLETE) {
+			FLASH_Lock();
+			return false;
+		}
+		addr = FLASH_PARAM_ADDR;
+	}
+
+	uint32_t checksum = flash_param_checksum(data, size);
+	bool success = FLASH_ProgramWord(addr, ((uint32_t)size << 16) | id) == FLASH_COMPLETE;
+
+	uint32_t offset;
+	for(offset = 0; offset < size; offset += 4) {
+		uint32_t word = FLASH_PARAM_ERASED;
+		memcpy(&word, (uint8_t *)data + offset, (size - offset) < 4 ? (size - offset) : 4);
+		success &= FLASH_ProgramWord(addr + FLASH_PARAM_HEADER_SIZE + offset, word) == FLASH_COMPLETE;
+	}
+
+	/* the data has to read back before the checksum commits the record */
+	success &= memcmp((uint8_t *)(uintptr_t)(addr + FLASH_PARAM_HEADER_SIZE), data, size) == 0;
+	if(success == true) {
+		success = FLASH_ProgramWord(addr + 4, checksum) == FLASH_COMPLETE;
+	}
+
+	FLASH_Lock();
+
+	return success && flash_word(addr + 4) == checksum;
+}
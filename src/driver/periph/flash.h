@@ -0,0 +1,22 @@
+#ifndef __FLASH_H__
+#define __FLASH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* last 128KB sector of bank 2, excluded from the firmware region by the
+ * linker script so it can be programmed while the code runs from bank 1 */
+#define FLASH_PARAM_SECTOR FLASH_Sector_23
+#define FLASH_PARAM_ADDR 0x081E0000
+#define FLASH_PARAM_SIZE (128 * 1024)
+
+/* parameter record ids */
+#define FLASH_PARAM_GYRO_BIAS 3 //1 held the bias of the old mpu6500 byte composition
+#define FLASH_PARAM_MAG_CALIB 4 //hmc5983_calib_param_t
+#define FLASH_PARAM_IMU_CALIB 5 //imu_calib_param_t, 2 held a fit of the old byte composition
+
+bool flash_param_load(uint16_t id, void *data, size_t size);
+bool flash_param_store(uint16_t id, const void *data, size_t size);
+
+#endif
@@ -1,4 +1,6 @@
 #include "stm32f4xx.h"
+#include "motor.h"
+#include "proj_config.h"
 
 /*
  * m1: pd12 (timer4 channel1)
@@ -27,6 +29,7 @@ void pwm_timer1_init(void)
 
 	GPIO_Init(GPIOE, &GPIO_InitStruct);
 
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_PWM)
 	/* 180MHz / (25000 * 18) = 400Hz = 0.0025s */
 	TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStruct = {
 		.TIM_Period = 25000 - 1,
@@ -47,6 +50,30 @@ void pwm_timer1_init(void)
 	TIM_OC4Init(TIM1, &TIM_OCInitStruct);
 
 	TIM_Cmd(TIM1, ENABLE);
+#elif (SELECT_MOTOR_OUTPUT != MOTOR_OUTPUT_DSHOT600)
+	/* the counter stops after every period, a pulse is fired each time
+	 * motor_output_trigger() re-enables it */
+	TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStruct = {
+		.TIM_Period = ONESHOT_PULSE_MAX,
+		.TIM_Prescaler = ONESHOT_TIM1_PRESCALER - 1,
+		.TIM_ClockDivision = TIM_CKD_DIV1,
+		.TIM_CounterMode = TIM_CounterMode_Up
+	};
+
+	TIM_TimeBaseInit(TIM1, &TIM_TimeBaseInitStruct);
+	TIM_SelectOnePulseMode(TIM1, TIM_OPMode_Single);
+
+	/* pwm2: output stays low until the counter reaches ccr, so the idle
+	 * (stopped) timer never drives the esc input high */
+	TIM_OCInitTypeDef TIM_OCInitStruct = {
+		.TIM_OCMode = TIM_OCMode_PWM2,
+		.TIM_OutputState = TIM_OutputState_Enable,
+		.TIM_Pulse = ONESHOT_PULSE_MAX,
+	};
+
+	TIM_OC3Init(TIM1, &TIM_OCInitStruct);
+	TIM_OC4Init(TIM1, &TIM_OCInitStruct);
+#endif
 
 	TIM_CtrlPWMOutputs(TIM1, ENABLE);
 }
@@ -71,6 +98,7 @@ void pwm_timer4_init(void)
 
 	GPIO_Init(GPIOD, &GPIO_InitStruct);
 
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_PWM)
 	/* 90MHz / (25000 * 9) = 400Hz = 0.0025s */
 	TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStruct = {
 		.TIM_Period = 25000 - 1,
@@ -93,4 +121,27 @@ void pwm_timer4_init(void)
 	TIM_OC4Init(TIM4, &TIM_OCInitStruct);
 
 	TIM_Cmd(TIM4, ENABLE);
+#elif (SELECT_MOTOR_OUTPUT != MOTOR_OUTPUT_DSHOT600)
+	/* one-pulse mode, see pwm_timer1_init() */
+	TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStruct = {
+		.TIM_Period = ONESHOT_PULSE_MAX,
+		.TIM_Prescaler = ONESHOT_TIM4_PRESCALER - 1,
+		.TIM_ClockDivision = TIM_CKD_DIV1,
+		.TIM_CounterMode = TIM_CounterMode_Up
+	};
+
+	TIM_TimeBaseInit(TIM4, &TIM_TimeBaseInitStruct);
+	TIM_SelectOnePulseMode(TIM4, TIM_OPMode_Single);
+
+	TIM_OCInitTypeDef TIM_OCInitStruct = {
+		.TIM_OCMode = TIM_OCMode_PWM2,
+		.TIM_OutputState = TIM_OutputState_Enable,
+		.TIM_Pulse = ONESHOT_PULSE_MAX,
+	};
+
+	TIM_OC1Init(TIM4, &TIM_OCInitStruct);
+	TIM_OC2Init(TIM4, &TIM_OCInitStruct);
+	TIM_OC3Init(TIM4, &TIM_OCInitStruct);
+	TIM_OC4Init(TIM4, &TIM_OCInitStruct);
+#endif
 }
@@ -1,4 +1,5 @@
 #include "stm32f4xx_conf.h"
+#include "hmc5983.h"
 
 /* <spi1>
  * usage: mpu6500 (imu)
@@ -48,8 +49,8 @@ void spi1_init(void)
 }
 
 /* <spi3>
- * usage: ms5611 (barometer)
- * cs: gpio_pin_a_15
+ * usage: ms5611 (barometer), hmc5983 (magnetometer)
+ * cs: gpio_pin_a_15 (ms5611), HMC5983_CS_PIN (hmc5983, see hmc5983.h)
  * sck: gpio_pin_b_3
  * miso: gpio_pin_b_4
  * mosi: gpio_pin_b_5
@@ -57,6 +58,7 @@ void spi1_init(void)
 void spi3_init(void)
 {
 	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOB, ENABLE);
+	RCC_AHB1PeriphClockCmd(HMC5983_CS_GPIO_CLK, ENABLE);
 	RCC_APB1PeriphClockCmd(RCC_APB1Periph_SPI3, ENABLE);
 
 	GPIO_PinAFConfig(GPIOB, GPIO_PinSource3, GPIO_AF_SPI3);
@@ -77,6 +79,12 @@ void spi3_init(void)
 	GPIO_InitStruct.GPIO_Mode = GPIO_Mode_OUT;
 	GPIO_InitStruct.GPIO_PuPd = GPIO_PuPd_UP;
 	GPIO_Init(GPIOA, &GPIO_InitStruct);
+	GPIO_InitStruct.GPIO_Pin = HMC5983_CS_PIN;
+	GPIO_Init(HMC5983_CS_GPIO, &GPIO_InitStruct);
+
+	/* both devices are deselected before the first transfer */
+	GPIO_SetBits(GPIOA, GPIO_Pin_15);
+	GPIO_SetBits(HMC5983_CS_GPIO, HMC5983_CS_PIN);
 
 	SPI_InitTypeDef SPI_InitStruct = {
 		.SPI_Direction = SPI_Direction_2Lines_FullDuplex,
@@ -85,7 +93,7 @@ void spi3_init(void)
 		.SPI_CPOL = SPI_CPOL_High,
 		.SPI_CPHA = SPI_CPHA_2Edge,
 		.SPI_NSS = SPI_NSS_Soft,
-		.SPI_BaudRatePrescaler = SPI_BaudRatePrescaler_4,
+		.SPI_BaudRatePrescaler = SPI_BaudRatePrescaler_8, //5.6MHz, the hmc5983 allows 8MHz at most
 		.SPI_FirstBit = SPI_FirstBit_MSB,
 		.SPI_CRCPolynomial = 7
 	};
@@ -6,10 +6,10 @@
 #include "led.h"
 #include "fc_task.h"
 #include "sys_time.h"
+#include "sys_stats.h"
+#include "proj_config.h"
 
-#define FLIGHT_CTL_PRESCALER_RELOAD 10
-
-extern SemaphoreHandle_t flight_ctl_semphr;
+#define FLIGHT_CTL_PRESCALER_RELOAD (4000 / RATE_CTL_RATE)
 
 void timer12_init(void)
 {
@@ -36,15 +36,23 @@ void timer12_init(void)
 
 void TIM8_BRK_TIM12_IRQHandler(void)
 {
+#if (SELECT_FLIGHT_CTL_TRIGGER == FLIGHT_CTL_TRIGGER_TIMER)
 	static int flight_ctl_cnt = FLIGHT_CTL_PRESCALER_RELOAD;
+#endif
+	sys_stats_isr_enter(SYS_STATS_ISR_SYS_TIMER);
+
 	if(TIM_GetITStatus(TIM12, TIM_IT_Update) == SET) {
 		TIM_ClearITPendingBit(TIM12, TIM_IT_Update);
 
 		sys_time_update_handler();
 
-		if((flight_ctl_cnt--) == 0) {
+#if (SELECT_FLIGHT_CTL_TRIGGER == FLIGHT_CTL_TRIGGER_TIMER)
+		if(--flight_ctl_cnt == 0) {
 			flight_ctl_cnt = FLIGHT_CTL_PRESCALER_RELOAD;
 			flight_ctl_semaphore_handler();
 		}
+#endif
 	}
+
+	sys_stats_isr_exit(SYS_STATS_ISR_SYS_TIMER);
 }
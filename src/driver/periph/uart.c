@@ -10,6 +10,25 @@
 #include "isr.h"
 #include "sbus_receiver.h"
 #include "optitrack.h"
+#include "ublox.h"
+#include "sys_stats.h"
+#include "deferred_work.h"
+#include "proj_config.h"
+
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_DSHOT600) && (SELECT_LOCALIZATION == LOCALIZATION_USE_GPS)
+#error "dma1 stream3 can not be shared by dshot and gps"
+#endif
+
+/* dma1 stream3 is occupied by the dshot output of motor 2 or the gps receiver */
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_DSHOT600) || (SELECT_LOCALIZATION == LOCALIZATION_USE_GPS)
+#define UART3_TX_DMA_STREAM DMA1_Stream4
+#define UART3_TX_DMA_CHANNEL DMA_Channel_7
+#define UART3_TX_DMA_FLAG_TC DMA_FLAG_TCIF4
+#else
+#define UART3_TX_DMA_STREAM DMA1_Stream3
+#define UART3_TX_DMA_CHANNEL DMA_Channel_4
+#define UART3_TX_DMA_FLAG_TC DMA_FLAG_TCIF3
+#endif
 
 SemaphoreHandle_t uart3_tx_semphr;
 
@@ -54,7 +73,7 @@ void uart1_init(int baudrate)
 /*
  * <uart3>
  * usage: telecommunication
- * tx: gpio_pin_d8 (dma1 channel4 stream3)
+ * tx: gpio_pin_d8 (dma1 channel4 stream3, or dma1 channel7 stream4 with dshot or gps)
  * rx: gpio_pin_d9 (dma1 channel4 stream4)
  */
 void uart3_init(int baudrate)
@@ -186,9 +205,9 @@ void uart6_init(int baudrate)
 
 /*
  * <uart7>
- * usage: telecommunication
+ * usage: gps or optitrack
  * tx: gpio_pin_e8
- * rx: gpio_pin_e7
+ * rx: gpio_pin_e7 (dma1 channel5 stream3 circular mode with gps)
  */
 void uart7_init(int baudrate)
 {
@@ -219,6 +238,50 @@ void uart7_init(int baudrate)
 
 	USART_ClearFlag(UART7, USART_FLAG_TC);
 
+#if (SELECT_LOCALIZATION == LOCALIZATION_USE_GPS)
+	/* the receiver is parsed when the line becomes idle or half of the
+	 * buffer is filled, no interrupt is generated for every byte */
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA1, ENABLE);
+
+	DMA_Cmd(DMA1_Stream3, DISABLE);
+	while(DMA_GetCmdStatus(DMA1_Stream3) == ENABLE);
+	DMA_ClearFlag(DMA1_Stream3, DMA_FLAG_TCIF3 | DMA_FLAG_HTIF3 | DMA_FLAG_TEIF3 |
+	              DMA_FLAG_DMEIF3 | DMA_FLAG_FEIF3);
+
+	DMA_InitTypeDef DMA_InitStructure = {
+		.DMA_BufferSize = (uint32_t)UBLOX_RX_BUF_SIZE,
+		.DMA_FIFOMode = DMA_FIFOMode_Disable,
+		.DMA_FIFOThreshold = DMA_FIFOThreshold_Full,
+		.DMA_MemoryBurst = DMA_MemoryBurst_Single,
+		.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte,
+		.DMA_MemoryInc = DMA_MemoryInc_Enable,
+		.DMA_Mode = DMA_Mode_Circular,
+		.DMA_PeripheralBaseAddr = (uint32_t)(&UART7->DR),
+		.DMA_PeripheralBurst = DMA_PeripheralBurst_Single,
+		.DMA_PeripheralInc = DMA_PeripheralInc_Disable,
+		.DMA_Priority = DMA_Priority_Medium,
+		.DMA_Channel = DMA_Channel_5,
+		.DMA_DIR = DMA_DIR_PeripheralToMemory,
+		.DMA_Memory0BaseAddr = (uint32_t)ublox_rx_buf
+	};
+	DMA_Init(DMA1_Stream3, &DMA_InitStructure);
+	DMA_ITConfig(DMA1_Stream3, DMA_IT_HT | DMA_IT_TC, ENABLE);
+	DMA_Cmd(DMA1_Stream3, ENABLE);
+
+	USART_DMACmd(UART7, USART_DMAReq_Rx, ENABLE);
+	USART_ITConfig(UART7, USART_IT_IDLE, ENABLE);
+
+	NVIC_InitTypeDef NVIC_InitStruct = {
+		.NVIC_IRQChannel = DMA1_Stream3_IRQn,
+		.NVIC_IRQChannelPreemptionPriority = GPS_OPTITRACK_UART_ISR,
+		.NVIC_IRQChannelSubPriority = 0,
+		.NVIC_IRQChannelCmd = ENABLE
+	};
+	NVIC_Init(&NVIC_InitStruct);
+
+	NVIC_InitStruct.NVIC_IRQChannel = UART7_IRQn;
+	NVIC_Init(&NVIC_InitStruct);
+#else
 	USART_ITConfig(UART7, USART_IT_RXNE, ENABLE);
 
 	NVIC_InitTypeDef NVIC_InitStruct = {
@@ -228,6 +291,7 @@ void uart7_init(int baudrate)
 		.NVIC_IRQChannelCmd = ENABLE
 	};
 	NVIC_Init(&NVIC_InitStruct);
+#endif
 }
 
 void uart_putc(USART_TypeDef *uart, char c)
@@ -285,8 +349,8 @@ void uart3_puts(char *s, int size)
 {
 	xSemaphoreTake(uart3_tx_semphr, portMAX_DELAY);
 
-	//uart3 tx: dma1 channel4 stream3
-	DMA_ClearFlag(DMA1_Stream3, DMA_FLAG_TCIF3);
+	//uart3 tx: dma1 channel4 stream3 (dma1 channel7 stream4 with dshot or gps)
+	DMA_ClearFlag(UART3_TX_DMA_STREAM, UART3_TX_DMA_FLAG_TC);
 
 	DMA_InitTypeDef DMA_InitStructure = {
 		.DMA_BufferSize = (uint32_t)size,
@@ -300,19 +364,23 @@ void uart3_puts(char *s, int size)
 		.DMA_PeripheralBurst = DMA_PeripheralBurst_Single,
 		.DMA_PeripheralInc = DMA_PeripheralInc_Disable,
 		.DMA_Priority = DMA_Priority_Medium,
-		.DMA_Channel = DMA_Channel_4,
+		.DMA_Channel = UART3_TX_DMA_CHANNEL,
 		.DMA_DIR = DMA_DIR_MemoryToPeripheral,
 		.DMA_Memory0BaseAddr = (uint32_t)s
 	};
-	DMA_Init(DMA1_Stream3, &DMA_InitStructure);
+	DMA_Init(UART3_TX_DMA_STREAM, &DMA_InitStructure);
 
 	//send data from memory to uart data register
-	DMA_Cmd(DMA1_Stream3, ENABLE);
+	DMA_Cmd(UART3_TX_DMA_STREAM, ENABLE);
 	USART_DMACmd(USART3, USART_DMAReq_Tx, ENABLE);
 }
 
 void uart6_puts(char *s, int size)
 {
+#if (SELECT_MOTOR_OUTPUT == MOTOR_OUTPUT_DSHOT600)
+	/* dma2 stream6 carries the dshot frames of motor 4, send without dma */
+	usart_puts(USART6, s, size);
+#else
 	//uart6 tx: dma2 channel5 stream6
 	DMA_ClearFlag(DMA2_Stream6, DMA_FLAG_TCIF6);
 
@@ -339,17 +407,22 @@ void uart6_puts(char *s, int size)
 	USART_DMACmd(USART6, USART_DMAReq_Tx, ENABLE);
 
 	while(DMA_GetFlagStatus(DMA2_Stream6, DMA_FLAG_TCIF6) == RESET);
+#endif
 }
 
 void USART3_IRQHandler(void)
 {
+	sys_stats_isr_enter(SYS_STATS_ISR_TELEM_USART3);
+
 	if(USART_GetITStatus(USART3, USART_IT_TC) == SET) {
 		USART_ClearFlag(USART3, USART_FLAG_TC);
 
-		static BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+		BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 		xSemaphoreGiveFromISR(uart3_tx_semphr, &xHigherPriorityTaskWoken);
 		portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
 	}
+
+	sys_stats_isr_exit(SYS_STATS_ISR_TELEM_USART3);
 }
 
 void UART4_IRQHandler(void)
@@ -358,21 +431,65 @@ void UART4_IRQHandler(void)
 	   sbus message */
 	uint8_t c;
 
+	sys_stats_isr_enter(SYS_STATS_ISR_SBUS_UART4);
+
 	if(USART_GetITStatus(UART4, USART_IT_RXNE) == SET) {
 		c = USART_ReceiveData(UART4);
 		UART4->SR;
 
 		sbus_rc_handler(c);
 	}
+
+	sys_stats_isr_exit(SYS_STATS_ISR_SBUS_UART4);
+}
+
+#if (SELECT_LOCALIZATION == LOCALIZATION_USE_GPS)
+void UART7_IRQHandler(void)
+{
+	sys_stats_isr_enter(SYS_STATS_ISR_GPS_OPTITRACK_UART7);
+
+	if(USART_GetITStatus(UART7, USART_IT_IDLE) == SET) {
+		/* clear idle flag by reading sr then dr */
+		UART7->SR;
+		UART7->DR;
+
+		deferred_work_signal_from_isr(DEFERRED_WORK_GPS);
+	}
+
+	sys_stats_isr_exit(SYS_STATS_ISR_GPS_OPTITRACK_UART7);
 }
 
+/* accounted together with uart7, same priority so they never nest */
+void DMA1_Stream3_IRQHandler(void)
+{
+	sys_stats_isr_enter(SYS_STATS_ISR_GPS_OPTITRACK_UART7);
+
+	if(DMA_GetITStatus(DMA1_Stream3, DMA_IT_HTIF3) == SET) {
+		DMA_ClearITPendingBit(DMA1_Stream3, DMA_IT_HTIF3);
+		deferred_work_signal_from_isr(DEFERRED_WORK_GPS);
+	}
+
+	if(DMA_GetITStatus(DMA1_Stream3, DMA_IT_TCIF3) == SET) {
+		DMA_ClearITPendingBit(DMA1_Stream3, DMA_IT_TCIF3);
+		deferred_work_signal_from_isr(DEFERRED_WORK_GPS);
+	}
+
+	sys_stats_isr_exit(SYS_STATS_ISR_GPS_OPTITRACK_UART7);
+}
+#else
 void UART7_IRQHandler(void)
 {
 	uint8_t c;
+
+	sys_stats_isr_enter(SYS_STATS_ISR_GPS_OPTITRACK_UART7);
+
 	if(USART_GetITStatus(UART7, USART_IT_RXNE) == SET) {
 		c = USART_ReceiveData(UART7);
 		UART7->SR;
 
 		optitrack_handler(c);
 	}
+
+	sys_stats_isr_exit(SYS_STATS_ISR_GPS_OPTITRACK_UART7);
 }
+#endif
@@ -6,6 +6,8 @@
 
 /* uav type */
 #define UAV_TYPE_QUADROTOR 0
+#define UAV_TYPE_HEXAROTOR 1 //6 motor outputs, not supported by dshot
+#define UAV_TYPE_OCTOROTOR 2 //8 motor outputs, not supported by this board
 #define SELECT_UAV_TYPE UAV_TYPE_QUADROTOR
 
 /* heading sensor */
@@ -13,11 +15,13 @@
 #define HEADING_USE_OPTITRACK 1
 #define SELECT_HEADING HEADING_USE_OPTITRACK
 
-/* ahrs algorithm */
+/* ahrs algorithm, every estimator runs and the others shadow the selected
+ * one, the primary can be switched while disarmed (see ahrs_registry.c) */
 #define AHRS_COMPLEMENTARY_FILTER 0
 #define AHRS_EKF 1
 #define AHRS_MADGWICK_FILTER 2
-#define SELECT_AHRS AHRS_COMPLEMENTARY_FILTER
+#define AHRS_EKF_UD 3 //ekf with the ud factorized covariance
+#define SELECT_AHRS AHRS_COMPLEMENTARY_FILTER //primary after boot
 
 /* quadrotor parameters */
 #define QUADROTOR_USE_PID 0
@@ -29,4 +33,32 @@
 #define LOCALIZATION_USE_OPTITRACK 1
 #define SELECT_LOCALIZATION LOCALIZATION_USE_OPTITRACK
 
+/* motor output protocol */
+#define MOTOR_OUTPUT_PWM 0        //free running 400Hz pwm
+#define MOTOR_OUTPUT_ONESHOT125 1 //125~250us pulse, fired by the flight controller
+#define MOTOR_OUTPUT_ONESHOT42 2  //42~84us pulse, fired by the flight controller
+#define MOTOR_OUTPUT_MULTISHOT 3  //5~25us pulse, fired by the flight controller
+#define MOTOR_OUTPUT_DSHOT600 4   //bidirectional dshot600 with erpm telemetry (motor 1~4 only)
+#define SELECT_MOTOR_OUTPUT MOTOR_OUTPUT_PWM
+
+/* flight control loop trigger */
+#define FLIGHT_CTL_TRIGGER_TIMER 0 //released by the 4kHz system timer
+#define FLIGHT_CTL_TRIGGER_IMU 1   //released by every n-th imu data ready interrupt
+#define SELECT_FLIGHT_CTL_TRIGGER FLIGHT_CTL_TRIGGER_IMU
+
+/* memory of the flight control stacks and hot state (compare the loop timing by switching) */
+#define HOT_STATE_IN_SRAM 0
+#define HOT_STATE_IN_CCM 1
+#define SELECT_HOT_STATE_MEMORY HOT_STATE_IN_CCM
+
+/* gyro notch filters placed by the background spectrum analysis */
+#define GYRO_DYN_NOTCH_DISABLED 0
+#define GYRO_DYN_NOTCH_ENABLED 1
+#define SELECT_GYRO_DYN_NOTCH GYRO_DYN_NOTCH_ENABLED
+
+/* cycle benchmark of the math functions once at boot (see math_bench.c) */
+#define MATH_BENCH_DISABLED 0
+#define MATH_BENCH_ENABLED 1
+#define SELECT_MATH_BENCH MATH_BENCH_DISABLED
+
 #endif
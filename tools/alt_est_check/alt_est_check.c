@@ -0,0 +1,178 @@
+/* software in the loop check of the barometric altitude estimator, the
+ * alt_est.c of the flight code runs against a simulated flight with a noisy
+ * accelerometer and a delayed barometer.
+ *
+ * usage: make check
+ *
+ * the vehicle takes off at 4s, climbs to 1.5m and 3m and lands again. the
+ * accelerometer has a constant bias and white noise, the barometer samples
+ * at 45Hz with 20ms delay and reads 30cm low in the ground effect. the
+ * scenarios cut the barometer for 2s in flight and on the ground: armed the
+ * takeoff reference has to be kept and the estimate coasts as invalid until
+ * the barometer is back, disarmed the estimator restarts with the new ground
+ * pressure. returns non-zero if any scenario fails */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include "alt_est.h"
+
+#define IMU_RATE 400.0    //[Hz]
+#define BARO_RATE 45.0    //[Hz]
+#define BARO_DELAY 20.0   //[ms]
+#define BARO_NOISE 10.0   //[cm]
+#define ACCEL_BIAS 40.0   //[cm/s^2]
+#define ACCEL_NOISE 30.0  //[cm/s^2]
+#define GROUND_EFFECT_ERROR 30.0 //[cm], below 40cm
+#define SEA_LEVEL_PRESSURE 101325.0 //[Pa]
+#define SIM_TIME 26.0     //[s]
+
+#define BARO_QUEUE_SIZE 64
+
+typedef struct {
+	const char *name;
+	double outage_start;   //barometer cut [s], negative for none
+	double outage_time;    //[s]
+	double armed_start;    //[s]
+	double armed_end;      //[s]
+	double pressure_step;  //ground pressure change at the outage [Pa]
+	bool expect_restart;
+	double alt_rms_max;    //[cm]
+	double vel_rms_max;    //[cm/s]
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+	{"nominal flight", -1.0, 0.0, 3.0, 25.0, 0.0, false, 6.0, 6.0},
+	{"barometer outage in flight, armed", 14.0, 2.0, 3.0, 25.0, 0.0, false, 12.0, 8.0},
+	{"barometer outage on the ground, disarmed", 1.5, 1.0, 3.0, 25.0, -60.0, true, 6.0, 6.0}
+};
+
+static double randn(void)
+{
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/* smooth steps of the altitude [cm] */
+static double true_alt(double t, double *vel, double *accel)
+{
+	const double steps[][3] = {{4.0, 150.0, 2.0}, {12.0, 300.0, 2.0}, {20.0, 0.0, 3.0}}; //start, height, duration
+	double alt = 0.0, prev = 0.0;
+	*vel = *accel = 0.0;
+
+	int i;
+	for(i = 0; i < 3; i++) {
+		double d = steps[i][1] - prev, duration = steps[i][2];
+		double x = (t - steps[i][0]) / duration;
+		if(x > 0.0 && x < 1.0) {
+			alt += d * (x - sin(2.0 * M_PI * x) / (2.0 * M_PI));
+			*vel += d / duration * (1.0 - cos(2.0 * M_PI * x));
+			*accel += d / (duration * duration) * 2.0 * M_PI * sin(2.0 * M_PI * x);
+		} else if(x >= 1.0) {
+			alt += d;
+		}
+		prev = steps[i][1];
+	}
+
+	return alt;
+}
+
+static bool run_scenario(const scenario_t *s)
+{
+	srand(1);
+	alt_est_set_armed(false);
+	alt_est_init();
+
+	double queue_time[BARO_QUEUE_SIZE], queue_pressure[BARO_QUEUE_SIZE];
+	int queue_head = 0, queue_cnt = 0;
+
+	double alt_sq_sum = 0.0, vel_sq_sum = 0.0;
+	int err_cnt = 0;
+	bool restarted = false, invalid_in_outage = false, valid_after_outage = false;
+	bool was_valid = false, outage_seen = false;
+	double outage_end = s->outage_start + s->outage_time;
+
+	int k;
+	for(k = 1; k <= (int)(SIM_TIME * IMU_RATE); k++) {
+		double t = k / IMU_RATE, vel, accel;
+		double alt = true_alt(t, &vel, &accel);
+
+		alt_est_set_armed(t >= s->armed_start && t < s->armed_end);
+		alt_est_predict(accel + ACCEL_BIAS + ACCEL_NOISE * randn(), 1.0 / IMU_RATE, t * 1000.0);
+
+		bool outage = s->outage_start >= 0.0 && t >= s->outage_start && t < outage_end;
+		if((k % (int)(IMU_RATE / BARO_RATE)) == 0 && outage == false) {
+			double baro_alt = alt + BARO_NOISE * randn();
+			if(t > 3.0 && alt < 40.0) {
+				baro_alt -= GROUND_EFFECT_ERROR;
+			}
+			double p0 = SEA_LEVEL_PRESSURE;
+			if(s->outage_start >= 0.0 && t >= outage_end) {
+				p0 += s->pressure_step;
+			}
+			int tail = (queue_head + queue_cnt) % BARO_QUEUE_SIZE;
+			queue_time[tail] = t * 1000.0;
+			queue_pressure[tail] = p0 * pow(1.0 - baro_alt / 4433000.0, 1.0 / 0.190263);
+			queue_cnt++;
+		}
+		while(queue_cnt > 0 && queue_time[queue_head] + BARO_DELAY <= t * 1000.0 + 1e-6) {
+			alt_est_fuse_baro(queue_pressure[queue_head], queue_time[queue_head]);
+			queue_head = (queue_head + 1) % BARO_QUEUE_SIZE;
+			queue_cnt--;
+		}
+
+		alt_est_state_t state;
+		alt_est_read(&state);
+
+		/* a restart publishes zero with the valid flag cleared */
+		if(was_valid == true && state.valid == false && state.alt == 0.0f && state.vel == 0.0f) {
+			restarted = true;
+		}
+		if(outage == true) {
+			outage_seen = true;
+			if(t > s->outage_start + 0.6 && state.valid == false) {
+				invalid_in_outage = true;
+			}
+		}
+		if(outage_seen == true && outage == false && state.valid == true) {
+			valid_after_outage = true;
+		}
+		was_valid = state.valid;
+
+		if(t > 3.0 && state.valid == true) {
+			alt_sq_sum += (state.alt - alt) * (state.alt - alt);
+			vel_sq_sum += (state.vel - vel) * (state.vel - vel);
+			err_cnt++;
+		}
+	}
+
+	double alt_rms = sqrt(alt_sq_sum / err_cnt);
+	double vel_rms = sqrt(vel_sq_sum / err_cnt);
+
+	bool pass = alt_rms <= s->alt_rms_max && vel_rms <= s->vel_rms_max && restarted == s->expect_restart;
+	if(s->outage_start >= 0.0) {
+		pass &= invalid_in_outage == true && valid_after_outage == true;
+	}
+
+	printf("%-42s rms alt %5.2fcm/%.0f, rms vel %5.2fcm/s/%.0f, %s %s\n", s->name,
+	       alt_rms, s->alt_rms_max, vel_rms, s->vel_rms_max,
+	       (restarted == true) ? "restarted" : "kept the reference", (pass == true) ? "ok" : "FAIL");
+
+	return pass;
+}
+
+int main(void)
+{
+	bool pass = true;
+
+	unsigned int i;
+	for(i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+		pass &= run_scenario(&scenarios[i]);
+	}
+
+	printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}
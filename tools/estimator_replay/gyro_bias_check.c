@@ -0,0 +1,318 @@
+/* host check of ahrs_gyro_bias_update(): every registered estimator with a
+ * gyro bias state flies a simulated manoeuvre with a constant gyro bias.
+ *
+ * usage: make check
+ *
+ * the gyro carries gyro_bias plus white noise, the accelerometer white noise
+ * and the optitrack poses arrive like in replay_gen.c. after BIAS_SETTLE_S
+ * the bias state has to stay within BIAS_BOUND of the injected bias and its
+ * mean over the rest of the flight within BIAS_TOLERANCE, on the axes the
+ * estimator observes. the ekf fuses gravity only, its heading is not
+ * measured, so its z bias has to stay at zero and its heading is not
+ * checked.
+ *
+ * between the corrections the attitude comes from the gyro alone. from
+ * several points after the settling time the simulated attitude is coasted
+ * COAST_S on the same gyro samples, once with the estimated bias removed and
+ * once without a bias state. with the estimate the attitude error has to
+ * stay below COAST_BOUND, without it the error grows with the bias.
+ * returns non-zero if any estimator fails */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "arm_math.h"
+#include "ahrs.h"
+#include "ahrs_registry.h"
+#include "proj_config.h"
+#include "fc_task.h"
+#include "host_stub.h"
+
+#define CHECK_GRAVITY 9.81      //[m/s^2]
+#define CHECK_DURATION_S 180.0
+#define CHECK_POSE_RATE 120.0   //[Hz]
+#define CHECK_POSE_LATENCY 0.010 //OPTITRACK_LATENCY_MS [s]
+
+#define CHECK_ACCEL_NOISE 0.3   //standard deviation [m/s^2]
+#define CHECK_GYRO_NOISE 0.2    //standard deviation [deg/s]
+
+/* below AHRS_GYRO_BIAS_MAX (5dps) on every axis */
+static const double gyro_bias[3] = {+2.0, -1.5, +1.0}; //[deg/s]
+
+#define BIAS_SETTLE_S 90.0   //4.5 time constants of AHRS_GYRO_BIAS_GAIN
+#define BIAS_TOLERANCE 0.05  //mean after the settling time [deg/s]
+#define BIAS_BOUND 0.3       //every period after the settling time [deg/s]
+
+#define COAST_S 10.0
+#define COAST_INTERVAL_S 10.0 //between the coast starts
+#define COAST_BOUND 2.0       //[deg]
+
+/* roll, pitch, yaw [rad] at t [s], the manoeuvre of replay_gen.c */
+static void check_attitude(double t, double *euler)
+{
+	double deg2rad = M_PI / 180.0;
+	euler[0] = 20.0 * deg2rad * sin(2.0 * M_PI * 0.3 * t);
+	euler[1] = 15.0 * deg2rad * sin(2.0 * M_PI * 0.23 * t + 1.0);
+	euler[2] = fmod(10.0 * deg2rad * t + M_PI, 2.0 * M_PI) - M_PI;
+}
+
+static void check_euler_to_quat(const double *euler, float *q)
+{
+	double cr = cos(euler[0] / 2.0), sr = sin(euler[0] / 2.0);
+	double cp = cos(euler[1] / 2.0), sp = sin(euler[1] / 2.0);
+	double cy = cos(euler[2] / 2.0), sy = sin(euler[2] / 2.0);
+	q[0] = cr * cp * cy + sr * sp * sy;
+	q[1] = sr * cp * cy - cr * sp * sy;
+	q[2] = cr * sp * cy + sr * cp * sy;
+	q[3] = cr * cp * sy - sr * sp * cy;
+}
+
+/* body rates [deg/s] and the accelerometer [m/s^2] at t, in the axes and
+ * signs the filters take (see replay_gen.c) */
+static void check_imu(double t, vector3d_f_t *accel, vector3d_f_t *gyro)
+{
+	double rad2deg = 180.0 / M_PI;
+	double w_roll = 2.0 * M_PI * 0.3, w_pitch = 2.0 * M_PI * 0.23;
+
+	double euler[3];
+	check_attitude(t, euler);
+	double roll = euler[0], pitch = euler[1];
+
+	double roll_rate = 20.0 / rad2deg * w_roll * cos(w_roll * t);
+	double pitch_rate = 15.0 / rad2deg * w_pitch * cos(w_pitch * t + 1.0);
+	double yaw_rate = 10.0 / rad2deg;
+
+	gyro->x = (roll_rate - yaw_rate * sin(pitch)) * rad2deg;
+	gyro->y = (pitch_rate * cos(roll) + yaw_rate * sin(roll) * cos(pitch)) * rad2deg;
+	gyro->z = (-pitch_rate * sin(roll) + yaw_rate * cos(roll) * cos(pitch)) * rad2deg;
+
+	accel->x = +CHECK_GRAVITY * sin(pitch);
+	accel->y = -CHECK_GRAVITY * sin(roll) * cos(pitch);
+	accel->z = +CHECK_GRAVITY * cos(roll) * cos(pitch);
+}
+
+static double gaussian(void)
+{
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static void quat_mult(const double *a, const double *b, double *q)
+{
+	q[0] = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+	q[1] = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+	q[2] = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+	q[3] = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+}
+
+/* q = q * exp(w * dt / 2), body rates [deg/s] */
+static void quat_integrate(double *q, const double *w, double dt)
+{
+	double deg2rad = M_PI / 180.0;
+	double v[3] = {w[0] * deg2rad * dt, w[1] * deg2rad * dt, w[2] * deg2rad * dt};
+	double angle = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	double s = (angle < 1e-12) ? 0.5 : sin(0.5 * angle) / angle;
+	double dq[4] = {cos(0.5 * angle), v[0] * s, v[1] * s, v[2] * s};
+
+	double q_last[4] = {q[0], q[1], q[2], q[3]};
+	quat_mult(q_last, dq, q);
+}
+
+/* rotation angle between two attitudes [deg], the tilt alone if the heading
+ * is not compared */
+static double quat_error(const double *q, const double *q_ref, bool heading)
+{
+	if(heading == false) {
+		/* gravity in the body frame, third row of the rotation matrix */
+		double r[3] = {2.0 * (q[1] * q[3] - q[0] * q[2]), 2.0 * (q[0] * q[1] + q[2] * q[3]),
+		               1.0 - 2.0 * (q[1] * q[1] + q[2] * q[2])};
+		double ref[3] = {2.0 * (q_ref[1] * q_ref[3] - q_ref[0] * q_ref[2]),
+		                 2.0 * (q_ref[0] * q_ref[1] + q_ref[2] * q_ref[3]),
+		                 1.0 - 2.0 * (q_ref[1] * q_ref[1] + q_ref[2] * q_ref[2])};
+		double dot = r[0] * ref[0] + r[1] * ref[1] + r[2] * ref[2];
+		return acos(fmax(-1.0, fmin(1.0, dot))) * 180.0 / M_PI;
+	}
+
+	double dot = fabs(q[0] * q_ref[0] + q[1] * q_ref[1] + q[2] * q_ref[2] + q[3] * q_ref[3]);
+	return 2.0 * acos(fmin(1.0, dot)) * 180.0 / M_PI;
+}
+
+/* gyro coasting from the simulated attitude, with and without the estimate */
+typedef struct {
+	bool active;
+	double end_s;
+	double bias[3];        //estimated at the start [deg/s]
+	double q_with[4];
+	double q_without[4];
+} check_coast_t;
+
+typedef struct {
+	double bias_err_max[3]; //after the settling time [deg/s]
+	double bias_err_sum[3];
+	long bias_cnt;
+	double bias_z_max;      //largest z estimate [deg/s]
+	double coast_with_max;    //[deg]
+	double coast_without_min;
+	int coast_cnt;
+} check_result_t;
+
+static void check_fly(const ahrs_estimator_t *estimator, bool observe_z, check_result_t *result)
+{
+	double dt = 1.0 / ATTITUDE_CTL_RATE;
+	long period_cnt = (long)(CHECK_DURATION_S * ATTITUDE_CTL_RATE);
+
+	srand(1);
+	memset(result, 0, sizeof(*result));
+	result->coast_without_min = 1e9;
+
+	vector3d_f_t accel, gyro;
+	check_imu(0.0, &accel, &gyro);
+	estimator->init(estimator->state, accel, ATTITUDE_CTL_RATE);
+
+	check_coast_t coast = {false};
+	double pose_next = 0.0, coast_next = BIAS_SETTLE_S;
+
+	long k;
+	for(k = 1; k <= period_cnt; k++) {
+		double t = k * dt;
+
+		/* the pose received now was captured one latency earlier */
+		if(t >= pose_next) {
+			double capture[3];
+			float q_pose[4];
+			check_attitude(t - CHECK_POSE_LATENCY, capture);
+			check_euler_to_quat(capture, q_pose);
+			host_stub_set_optitrack(t * 1000.0, q_pose);
+			pose_next += 1.0 / CHECK_POSE_RATE;
+		}
+		host_stub_set_time(t * 1000.0);
+
+		check_imu(t, &accel, &gyro);
+		accel.x += CHECK_ACCEL_NOISE * gaussian();
+		accel.y += CHECK_ACCEL_NOISE * gaussian();
+		accel.z += CHECK_ACCEL_NOISE * gaussian();
+		gyro.x += gyro_bias[0] + CHECK_GYRO_NOISE * gaussian();
+		gyro.y += gyro_bias[1] + CHECK_GYRO_NOISE * gaussian();
+		gyro.z += gyro_bias[2] + CHECK_GYRO_NOISE * gaussian();
+
+		/* the coast takes the samples of the period before the update */
+		if(coast.active == true) {
+			double w_with[3] = {gyro.x - coast.bias[0], gyro.y - coast.bias[1], gyro.z - coast.bias[2]};
+			double w_without[3] = {gyro.x, gyro.y, gyro.z};
+			quat_integrate(coast.q_with, w_with, dt);
+			quat_integrate(coast.q_without, w_without, dt);
+
+			if(t >= coast.end_s - 0.5 * dt) {
+				double euler[3];
+				float q_ref_f[4];
+				check_attitude(t, euler);
+				check_euler_to_quat(euler, q_ref_f);
+				double q_ref[4] = {q_ref_f[0], q_ref_f[1], q_ref_f[2], q_ref_f[3]};
+
+				result->coast_with_max = fmax(result->coast_with_max, quat_error(coast.q_with, q_ref, observe_z));
+				result->coast_without_min = fmin(result->coast_without_min,
+				                                 quat_error(coast.q_without, q_ref, observe_z));
+				result->coast_cnt++;
+				coast.active = false;
+			}
+		}
+
+		estimator->update(estimator->state, accel, gyro, dt);
+
+		float bias[3];
+		estimator->get_gyro_bias(estimator->state, bias);
+
+		result->bias_z_max = fmax(result->bias_z_max, fabs(rad_to_deg(bias[2])));
+
+		if(t > BIAS_SETTLE_S) {
+			int i;
+			for(i = 0; i < 3; i++) {
+				double err = rad_to_deg(bias[i]) - gyro_bias[i];
+				result->bias_err_max[i] = fmax(result->bias_err_max[i], fabs(err));
+				result->bias_err_sum[i] += err;
+			}
+			result->bias_cnt++;
+		}
+
+		if(coast.active == false && t >= coast_next - 0.5 * dt && t + COAST_S <= CHECK_DURATION_S) {
+			double euler[3];
+			float q_ref[4];
+			check_attitude(t, euler);
+			check_euler_to_quat(euler, q_ref);
+
+			int i;
+			for(i = 0; i < 4; i++) {
+				coast.q_with[i] = coast.q_without[i] = q_ref[i];
+			}
+			for(i = 0; i < 3; i++) {
+				coast.bias[i] = rad_to_deg(bias[i]);
+			}
+			coast.end_s = t + COAST_S;
+			coast.active = true;
+			coast_next += COAST_INTERVAL_S;
+		}
+	}
+}
+
+int main(void)
+{
+	host_stub_map_dwt();
+
+	printf("gyro bias %+.1f %+.1f %+.1f deg/s, %.0fs manoeuvre, settling time %.0fs, %.0fs coasts\n",
+	       gyro_bias[0], gyro_bias[1], gyro_bias[2], CHECK_DURATION_S, BIAS_SETTLE_S, COAST_S);
+
+	bool pass = true;
+
+	int id;
+	for(id = 0; id < AHRS_ESTIMATOR_CNT; id++) {
+		const ahrs_estimator_t *estimator = ahrs_registry_get_estimator(id);
+		if(estimator->get_gyro_bias == NULL) {
+			continue;
+		}
+
+		/* only the ekf fuses gravity alone */
+		bool observe_z = (id != AHRS_EKF);
+		int axis_cnt = (observe_z == true) ? 3 : 2;
+
+		check_result_t result;
+		check_fly(estimator, observe_z, &result);
+
+		bool ok = (result.coast_cnt > 0) && (result.coast_with_max < COAST_BOUND) &&
+		          (result.coast_without_min > result.coast_with_max) &&
+		          (observe_z == true || result.bias_z_max == 0.0);
+
+		double mean[3];
+		int i;
+		for(i = 0; i < 3; i++) {
+			mean[i] = result.bias_err_sum[i] / result.bias_cnt;
+			if(i < axis_cnt) {
+				ok &= (fabs(mean[i]) < BIAS_TOLERANCE) && (result.bias_err_max[i] < BIAS_BOUND);
+			}
+		}
+
+		/* the z column is the estimate itself where it is not observed */
+		char z_mean[16], z_max[32];
+		if(observe_z == true) {
+			snprintf(z_mean, sizeof(z_mean), "%+.3f", mean[2]);
+			snprintf(z_max, sizeof(z_max), "%.3f", result.bias_err_max[2]);
+		} else {
+			snprintf(z_mean, sizeof(z_mean), "-");
+			snprintf(z_max, sizeof(z_max), "-, z held at %.3f", result.bias_z_max);
+		}
+
+		printf("%-8s bias error mean %+.3f %+.3f %s max %.3f %.3f %s deg/s, %d coasts, %s error max %.2f deg, "
+		       "without the bias state min %.2f deg %s\n", estimator->name,
+		       mean[0], mean[1], z_mean, result.bias_err_max[0], result.bias_err_max[1], z_max,
+		       result.coast_cnt, (observe_z == true) ? "attitude" : "tilt", result.coast_with_max,
+		       result.coast_without_min, (ok == true) ? "ok" : "FAIL");
+
+		pass &= ok;
+	}
+
+	printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "stm32f4xx_conf.h"
+#include "optitrack.h"
+#include "profiler.h"
+#include "host_stub.h"
+
+/* the few symbols the estimator sources need from the drivers, the replay
+ * sets the recorded state before every update */
+
+optitrack_t optitrack;
+
+static uint32_t optitrack_read_cycles;
+
+/* the recorded times stay double, optitrack.time_now is only the float copy
+ * the driver would hold */
+static double replay_time_ms;
+static double replay_optitrack_time_ms;
+
+void host_stub_set_time(double time_ms)
+{
+	replay_time_ms = time_ms;
+}
+
+/* latest pose, a negative time before the first one */
+void host_stub_set_optitrack(double recv_time_ms, float *q)
+{
+	replay_optitrack_time_ms = (recv_time_ms < 0.0) ? -1e9 : recv_time_ms;
+	optitrack.time_now = (float)replay_optitrack_time_ms;
+	memcpy(optitrack.q, q, sizeof(optitrack.q));
+}
+
+/* the profiler and ahrs_registry_run_shadows() read the dwt cycle counter
+ * at its target address, a private page there stands in for it. nothing
+ * advances it but the check */
+void host_stub_map_dwt(void)
+{
+	void *page = mmap((void *)DWT_BASE, 4096, PROT_READ | PROT_WRITE,
+	                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if(page != (void *)DWT_BASE) {
+		perror("mmap dwt");
+		exit(1);
+	}
+}
+
+/* the next optitrack_available() advances the cycle counter, the cf and
+ * ekf_ud updates call it, so the check sets their cost with it */
+void host_stub_set_optitrack_cost(uint32_t cycles)
+{
+	optitrack_read_cycles = cycles;
+}
+
+/* same timeout as optitrack.c, against the recorded time */
+bool optitrack_available(void)
+{
+	DWT->CYCCNT += optitrack_read_cycles;
+	optitrack_read_cycles = 0;
+
+	if((replay_time_ms - replay_optitrack_time_ms) > 300) {
+		return false;
+	}
+	return true;
+}
+
+/* only reached by MAT_ASSERT(), the target spins with the red led on */
+void GPIO_SetBits(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin)
+{
+	fprintf(stderr, "matrix operation failed\n");
+	exit(1);
+}
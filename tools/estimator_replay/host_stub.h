@@ -0,0 +1,11 @@
+#ifndef __HOST_STUB_H__
+#define __HOST_STUB_H__
+
+#include <stdint.h>
+
+void host_stub_set_time(double time_ms);
+void host_stub_set_optitrack(double recv_time_ms, float *q);
+void host_stub_map_dwt(void);
+void host_stub_set_optitrack_cost(uint32_t cycles);
+
+#endif
@@ -0,0 +1,215 @@
+/* host check of madgwick_marg_gradient(): the closed form gradient against
+ * J' * f / 2 with the 6x4 jacobian of the objective function built
+ * numerically.
+ *
+ * usage: make check
+ *
+ * q, a and m are random unit vectors. the reference evaluates equation (25)
+ * ~ (31) of the paper in double precision, the field b = [bx, 0, bz] is
+ * taken from q like in the flight code and held constant, the jacobian is
+ * the central difference of f. the error of the flight code has to stay
+ * below GRADIENT_TOLERANCE relative to the reference. the old gradient of
+ * Madgwick_MARG_AHRS() is run through the same comparison: its _2bx held
+ * b_x and not 2 * b_x, so it has to exceed the tolerance. returns non-zero
+ * if a scenario fails */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include "madgwick_ahrs.h"
+#include "fastmath.h"
+
+#define SAMPLE_CNT 200000
+#define JACOBIAN_STEP 1e-6
+#define GRADIENT_TOLERANCE 1e-3 //relative to |J' * f / 2|, single precision reaches 5e-5 here
+#define GRADIENT_MIN 1e-3       //smaller references are skipped, the relative error is meaningless
+
+static double gaussian(void)
+{
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static void random_unit(double *v, int n)
+{
+	double norm_sq;
+	int i;
+	do {
+		norm_sq = 0.0;
+		for(i = 0; i < n; i++) {
+			v[i] = gaussian();
+			norm_sq += v[i] * v[i];
+		}
+	} while(norm_sq < 1e-6);
+
+	for(i = 0; i < n; i++) {
+		v[i] /= sqrt(norm_sq);
+	}
+}
+
+/* equation (25) and (31), b = [bx, 0, bz] */
+static void objective(const double *q, const double *a, const double *m, double bx, double bz, double *f)
+{
+	f[0] = 2.0 * (q[1] * q[3] - q[0] * q[2]) - a[0];
+	f[1] = 2.0 * (q[0] * q[1] + q[2] * q[3]) - a[1];
+	f[2] = 2.0 * (0.5 - q[1] * q[1] - q[2] * q[2]) - a[2];
+	f[3] = 2.0 * bx * (0.5 - q[2] * q[2] - q[3] * q[3]) + 2.0 * bz * (q[1] * q[3] - q[0] * q[2]) - m[0];
+	f[4] = 2.0 * bx * (q[1] * q[2] - q[0] * q[3]) + 2.0 * bz * (q[0] * q[1] + q[2] * q[3]) - m[1];
+	f[5] = 2.0 * bx * (q[0] * q[2] + q[1] * q[3]) + 2.0 * bz * (0.5 - q[1] * q[1] - q[2] * q[2]) - m[2];
+}
+
+/* J' * f / 2 with the numerical jacobian */
+static void reference_gradient(const double *q, const double *a, const double *m, double *g)
+{
+	/* h = R * m, the body to earth rotation of the unit quaternion */
+	double hx = (1.0 - 2.0 * (q[2] * q[2] + q[3] * q[3])) * m[0] + 2.0 * (q[1] * q[2] - q[0] * q[3]) * m[1] +
+	            2.0 * (q[0] * q[2] + q[1] * q[3]) * m[2];
+	double hy = 2.0 * (q[1] * q[2] + q[0] * q[3]) * m[0] + (1.0 - 2.0 * (q[1] * q[1] + q[3] * q[3])) * m[1] +
+	            2.0 * (q[2] * q[3] - q[0] * q[1]) * m[2];
+	double hz = 2.0 * (q[1] * q[3] - q[0] * q[2]) * m[0] + 2.0 * (q[0] * q[1] + q[2] * q[3]) * m[1] +
+	            (1.0 - 2.0 * (q[1] * q[1] + q[2] * q[2])) * m[2];
+	double bx = sqrt(hx * hx + hy * hy);
+	double bz = hz;
+
+	double f[6], J[6][4];
+	objective(q, a, m, bx, bz, f);
+
+	int i, j;
+	for(j = 0; j < 4; j++) {
+		double q_plus[4] = {q[0], q[1], q[2], q[3]};
+		double q_minus[4] = {q[0], q[1], q[2], q[3]};
+		q_plus[j] += JACOBIAN_STEP;
+		q_minus[j] -= JACOBIAN_STEP;
+
+		double f_plus[6], f_minus[6];
+		objective(q_plus, a, m, bx, bz, f_plus);
+		objective(q_minus, a, m, bx, bz, f_minus);
+		for(i = 0; i < 6; i++) {
+			J[i][j] = (f_plus[i] - f_minus[i]) / (2.0 * JACOBIAN_STEP);
+		}
+	}
+
+	for(j = 0; j < 4; j++) {
+		g[j] = 0.0;
+		for(i = 0; i < 6; i++) {
+			g[j] += 0.5 * J[i][j] * f[i];
+		}
+	}
+}
+
+/* the gradient of Madgwick_MARG_AHRS() before it moved into
+ * madgwick_marg_gradient(), J' * f with b_x in _2bx */
+static void old_gradient(const float *q, float ax, float ay, float az, float mx, float my, float mz, float *g)
+{
+	float _2q0mx = 2.0f * q[0] * mx;
+	float _2q0my = 2.0f * q[0] * my;
+	float _2q0mz = 2.0f * q[0] * mz;
+	float _2q1mx = 2.0f * q[1] * mx;
+	float _2q0 = 2.0f*q[0];
+	float _2q1 = 2.0f*q[1];
+	float _2q2 = 2.0f*q[2];
+	float _2q3 = 2.0f*q[3];
+	float _4q0 = 4.0f*q[0];
+	float _4q1 = 4.0f*q[1];
+	float _4q2 = 4.0f*q[2];
+	float _4q3 = 4.0f*q[3];
+	float q0q0 = q[0] * q[0];
+	float q0q1 = q[0] * q[1];
+	float q0q2 = q[0] * q[2];
+	float q0q3 = q[0] * q[3];
+	float q1q1 = q[1] * q[1];
+	float q1q2 = q[1] * q[2];
+	float q1q3 = q[1] * q[3];
+	float q2q2 = q[2] * q[2];
+	float q2q3 = q[2] * q[3];
+	float q3q3 = q[3] * q[3];
+	float q1q1_q2q2 = q1q1 + q2q2;
+
+	float hx = mx * q0q0 - _2q0my * q[3] + _2q0mz * q[2] + mx * q1q1 + _2q1 * my * q[2] + _2q1 * mz * q[3] - mx * q2q2 - mx * q3q3;
+	float hy = _2q0mx * q[3] + my * q0q0 - _2q0mz * q[1] + _2q1mx * q[2] - my * q1q1 + my * q2q2 + _2q2 * mz * q[3] - my * q3q3;
+	float _2bx = (hx * hx + hy * hy) * fast_invsqrtf(hx * hx + hy * hy);
+	float _2bz = -_2q0mx * q[2] + _2q0my * q[1] + mz * q0q0 + _2q1mx * q[3] - mz * q1q1 + _2q2 * my * q[3] - mz * q2q2 + mz * q3q3;
+	float _4bx = 2.0f * _2bx;
+	float _4bz = 2.0f * _2bz;
+
+	g[0] = _4q0*q1q1_q2q2 + _2q2*ax - _2q1*ay - _2bz * q[2] * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * q[3] + _2bz * q[1]) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * q[2] * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+	g[1] = _4q1*q1q1_q2q2 - _2q3*ax - _2q0*ay + _4q1*az + _2bz * q[3] * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * q[2] + _2bz * q[0]) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * q[3] - _4bz * q[1]) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+	g[2] = _4q2*q1q1_q2q2 + _2q0*ax - _2q3*ay + _4q2*az + (-_4bx * q[2] - _2bz * q[0]) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * q[1] + _2bz * q[3]) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * q[0] - _4bz * q[2]) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+	g[3] = _4q3*q1q1_q2q2 - _2q1*ax - _2q2*ay + (-_4bx * q[3] + _2bz * q[1]) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * q[0] + _2bz * q[2]) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * q[1] * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+
+	/* J' * f / 2 like the reference */
+	int i;
+	for(i = 0; i < 4; i++) {
+		g[i] *= 0.5f;
+	}
+}
+
+typedef void (*gradient_t)(const float *q, float ax, float ay, float az, float mx, float my, float mz, float *g);
+
+/* largest relative error of the gradient against the reference */
+static double check_gradient(gradient_t gradient, int *skip_cnt)
+{
+	srand(1);
+	double err_max = 0.0;
+	*skip_cnt = 0;
+
+	int n;
+	for(n = 0; n < SAMPLE_CNT; n++) {
+		double q[4], a[3], m[3];
+		random_unit(q, 4);
+		random_unit(a, 3);
+		random_unit(m, 3);
+
+		/* the reference sees the inputs rounded like the flight code */
+		float q_f[4] = {q[0], q[1], q[2], q[3]};
+		double q_ref[4] = {q_f[0], q_f[1], q_f[2], q_f[3]};
+		float a_f[3] = {a[0], a[1], a[2]}, m_f[3] = {m[0], m[1], m[2]};
+		double a_ref[3] = {a_f[0], a_f[1], a_f[2]}, m_ref[3] = {m_f[0], m_f[1], m_f[2]};
+
+		double g_ref[4];
+		reference_gradient(q_ref, a_ref, m_ref, g_ref);
+
+		float g[4];
+		gradient(q_f, a_f[0], a_f[1], a_f[2], m_f[0], m_f[1], m_f[2], g);
+
+		double ref_sq = 0.0, err_sq = 0.0;
+		int i;
+		for(i = 0; i < 4; i++) {
+			ref_sq += g_ref[i] * g_ref[i];
+			err_sq += (g[i] - g_ref[i]) * (g[i] - g_ref[i]);
+		}
+		if(ref_sq < GRADIENT_MIN * GRADIENT_MIN) {
+			(*skip_cnt)++;
+			continue;
+		}
+
+		double err = sqrt(err_sq / ref_sq);
+		if(err > err_max) {
+			err_max = err;
+		}
+	}
+
+	return err_max;
+}
+
+int main(void)
+{
+	int skip_cnt;
+	double err = check_gradient(madgwick_marg_gradient, &skip_cnt);
+	bool pass = err <= GRADIENT_TOLERANCE;
+	printf("%-24s %d samples (%d skipped), relative error max %.2e/%.0e %s\n", "madgwick_marg_gradient()",
+	       SAMPLE_CNT, skip_cnt, err, GRADIENT_TOLERANCE, (pass == true) ? "ok" : "FAIL");
+
+	/* the check has to catch the old b_x */
+	double old_err = check_gradient(old_gradient, &skip_cnt);
+	bool old_rejected = old_err > GRADIENT_TOLERANCE;
+	printf("%-24s %d samples (%d skipped), relative error max %.2e/%.0e %s\n", "old half b_x gradient",
+	       SAMPLE_CNT, skip_cnt, old_err, GRADIENT_TOLERANCE, (old_rejected == true) ? "rejected ok" : "accepted FAIL");
+	pass &= old_rejected;
+
+	printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}
@@ -0,0 +1,270 @@
+/* host check of ahrs_registry.c: every registered estimator gets the same
+ * simulated imu periods through the registry like attitude_estimate() and
+ * task_attitude_ctl() hand them over.
+ *
+ * usage: make check
+ *
+ * the estimators have to agree on the tilt with each other and with the
+ * simulated attitude. the cycle counter only moves when the check moves it,
+ * so the cost of the cf shadow and the time taken by the attitude loop are
+ * set per period to starve it, it has to recover and a starved shadow has
+ * to be consistent when it is promoted. returns non-zero if any scenario
+ * fails */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include "arm_math.h"
+#include "ahrs.h"
+#include "ahrs_registry.h"
+#include "imu_preint.h"
+#include "profiler.h"
+#include "proj_config.h"
+#include "fc_task.h"
+#include "host_stub.h"
+
+#define CHECK_GRAVITY 9.81 //[m/s^2]
+#define CHECK_CYCLES_PER_US (PROFILER_CPU_FREQ / 1000000)
+#define CHECK_PERIOD_CYCLES (PROFILER_CPU_FREQ / ATTITUDE_CTL_RATE)
+
+#define CHECK_UPDATE_US 20      //cost of a cf update [us]
+#define CHECK_SLOW_UPDATE_US 2000
+#define CHECK_LOOP_US 1500      //attitude loop before the shadows run [us]
+
+typedef struct {
+	double roll_amplitude;  //[deg]
+	double pitch_amplitude; //[deg]
+	double yaw_rate;        //[deg/s]
+	double roll_offset;     //[deg]
+	double pitch_offset;    //[deg]
+} check_motion_t;
+
+static const check_motion_t check_static = {0.0, 0.0, 0.0, -9.28, 17.88};
+static const check_motion_t check_manoeuvre = {20.0, 15.0, 10.0, 0.0, 0.0};
+
+static ahrs_t check_ahrs;
+
+/* roll and pitch [rad] of the motion at t [s] */
+static void check_attitude(const check_motion_t *m, double t, double *roll, double *pitch)
+{
+	double deg2rad = M_PI / 180.0;
+	*roll = (m->roll_offset + m->roll_amplitude * sin(2.0 * M_PI * 0.3 * t)) * deg2rad;
+	*pitch = (m->pitch_offset + m->pitch_amplitude * sin(2.0 * M_PI * 0.23 * t + 1.0)) * deg2rad;
+}
+
+/* one attitude period starting at t, in the axes and signs the filters take
+ * (see replay_gen.c) */
+static void check_imu_delta(const check_motion_t *m, double t, imu_delta_t *imu_delta)
+{
+	double dt = 1.0 / ATTITUDE_CTL_RATE;
+	double deg2rad = M_PI / 180.0;
+	double tm = t + 0.5 * dt;
+
+	double roll, pitch;
+	check_attitude(m, tm, &roll, &pitch);
+
+	double w_roll = 2.0 * M_PI * 0.3, w_pitch = 2.0 * M_PI * 0.23;
+	double roll_rate = m->roll_amplitude * deg2rad * w_roll * cos(w_roll * tm);
+	double pitch_rate = m->pitch_amplitude * deg2rad * w_pitch * cos(w_pitch * tm + 1.0);
+	double yaw_rate = m->yaw_rate * deg2rad;
+
+	imu_delta->delta_angle.x = (roll_rate - yaw_rate * sin(pitch)) * dt;
+	imu_delta->delta_angle.y = (pitch_rate * cos(roll) + yaw_rate * sin(roll) * cos(pitch)) * dt;
+	imu_delta->delta_angle.z = (-pitch_rate * sin(roll) + yaw_rate * cos(roll) * cos(pitch)) * dt;
+
+	check_attitude(m, t + dt, &roll, &pitch);
+	imu_delta->accel_lpf.x = +CHECK_GRAVITY * sin(pitch);
+	imu_delta->accel_lpf.y = -CHECK_GRAVITY * sin(roll) * cos(pitch);
+	imu_delta->accel_lpf.z = +CHECK_GRAVITY * cos(roll) * cos(pitch);
+
+	imu_delta->delta_velocity.x = imu_delta->accel_lpf.x * dt;
+	imu_delta->delta_velocity.y = imu_delta->accel_lpf.y * dt;
+	imu_delta->delta_velocity.z = imu_delta->accel_lpf.z * dt;
+	imu_delta->dt = dt;
+}
+
+/* angle between the gravity directions, the third rows of the rotation matrices [deg] */
+static double check_tilt_error(const float *q, const double *down)
+{
+	double r20 = 2.0 * (q[1] * q[3] - q[0] * q[2]);
+	double r21 = 2.0 * (q[0] * q[1] + q[2] * q[3]);
+	double r22 = 1.0 - 2.0 * (q[1] * q[1] + q[2] * q[2]);
+	double norm = sqrt(r20 * r20 + r21 * r21 + r22 * r22);
+	double cos_tilt = (r20 * down[0] + r21 * down[1] + r22 * down[2]) / norm;
+	return acos(fmax(-1.0, fmin(1.0, cos_tilt))) * 180.0 / M_PI;
+}
+
+/* the third row of the simulated attitude as the filters hold it */
+static void check_down(const check_motion_t *m, double t, double *down)
+{
+	double roll, pitch;
+	check_attitude(m, t, &roll, &pitch);
+	down[0] = -sin(pitch);
+	down[1] = sin(roll) * cos(pitch);
+	down[2] = cos(roll) * cos(pitch);
+}
+
+static void check_init(const check_motion_t *m)
+{
+	imu_delta_t imu_delta;
+	check_imu_delta(m, 0.0, &imu_delta);
+	ahrs_registry_init(imu_delta.accel_lpf, ATTITUDE_CTL_RATE);
+
+	/* no pose, the tilt comes from the accelerometer only */
+	float q_none[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+	host_stub_set_time(0.0);
+	host_stub_set_optitrack(-1.0, q_none);
+	DWT->CYCCNT = 0;
+}
+
+/* one attitude period, loop_us is spent before the shadows and a cf shadow
+ * update costs cf_us */
+static void check_period(const check_motion_t *m, double t, int loop_us, int cf_us)
+{
+	imu_delta_t imu_delta;
+	check_imu_delta(m, t, &imu_delta);
+
+	uint32_t release_time = profiler_get_cycles();
+	ahrs_registry_update(&imu_delta, &check_ahrs);
+
+	DWT->CYCCNT = release_time + loop_us * CHECK_CYCLES_PER_US;
+	host_stub_set_optitrack_cost(cf_us * CHECK_CYCLES_PER_US);
+	ahrs_registry_run_shadows(release_time, CHECK_PERIOD_CYCLES);
+
+	host_stub_set_optitrack_cost(0);
+	DWT->CYCCNT = release_time + CHECK_PERIOD_CYCLES;
+}
+
+/* largest tilt error of every estimator against the simulation after the settle time */
+static bool check_agreement(const char *name, const check_motion_t *m, double sim_time, double error_max)
+{
+	check_init(m);
+
+	double dt = 1.0 / ATTITUDE_CTL_RATE;
+	double error[AHRS_ESTIMATOR_CNT] = {0.0};
+
+	long k;
+	for(k = 0; k < (long)(sim_time * ATTITUDE_CTL_RATE); k++) {
+		double t = k * dt;
+		check_period(m, t, 0, CHECK_UPDATE_US);
+
+		if(t > 10.0) {
+			double down[3];
+			check_down(m, t + dt, down);
+
+			int id;
+			for(id = 0; id < AHRS_ESTIMATOR_CNT; id++) {
+				float q[4];
+				ahrs_registry_get_quat(id, q);
+				error[id] = fmax(error[id], check_tilt_error(q, down));
+			}
+		}
+	}
+
+	bool pass = true;
+	int id;
+	printf("%-22s", name);
+	for(id = 0; id < AHRS_ESTIMATOR_CNT; id++) {
+		printf(" %s %5.2fdeg", ahrs_registry_get_estimator(id)->name, error[id]);
+		pass &= error[id] <= error_max;
+	}
+	printf(", max %.1fdeg %s\n", error_max, (pass == true) ? "ok" : "FAIL");
+
+	return pass;
+}
+
+/* one slow cf update must not keep the shadow out for good, its pending
+ * imu data is bounded and it has to settle again */
+static bool check_starved_shadow(void)
+{
+	const check_motion_t *m = &check_static;
+	check_init(m);
+	ahrs_registry_set_primary(AHRS_EKF_UD, false);
+
+	double dt = 1.0 / ATTITUDE_CTL_RATE;
+	uint32_t skip_last_second = 0;
+
+	long k;
+	for(k = 0; k < 10 * ATTITUDE_CTL_RATE; k++) {
+		int cf_us = (k == 2 * ATTITUDE_CTL_RATE) ? CHECK_SLOW_UPDATE_US : CHECK_UPDATE_US;
+		check_period(m, k * dt, CHECK_LOOP_US, cf_us);
+
+		if(k == 9 * ATTITUDE_CTL_RATE) {
+			skip_last_second = ahrs_registry_get_skip_cnt(AHRS_COMPLEMENTARY_FILTER);
+		}
+	}
+
+	uint32_t skip_cnt = ahrs_registry_get_skip_cnt(AHRS_COMPLEMENTARY_FILTER);
+	skip_last_second = skip_cnt - skip_last_second;
+
+	double down[3];
+	check_down(m, 10.0, down);
+	float q[4];
+	ahrs_registry_get_quat(AHRS_COMPLEMENTARY_FILTER, q);
+	double error = check_tilt_error(q, down);
+
+	bool pass = skip_cnt > 0 && skip_last_second == 0 && error <= 1.0;
+
+	printf("%-22s cf skipped %lu periods, %lu in the last second, tilt error %.2fdeg/1.0 %s\n",
+	       "starved shadow", (unsigned long)skip_cnt, (unsigned long)skip_last_second, error,
+	       (pass == true) ? "ok" : "FAIL");
+
+	return pass;
+}
+
+/* a shadow that misses its periods is only promoted disarmed, and it takes
+ * over with an attitude that is consistent with the accelerometer */
+static bool check_promotion(void)
+{
+	const check_motion_t *m = &check_static;
+	check_init(m);
+	ahrs_registry_set_primary(AHRS_EKF_UD, false);
+
+	double dt = 1.0 / ATTITUDE_CTL_RATE;
+
+	long k;
+	for(k = 0; k < 4 * ATTITUDE_CTL_RATE; k++) {
+		check_period(m, k * dt, CHECK_LOOP_US, CHECK_UPDATE_US);
+	}
+
+	/* the cf shadow misses the last periods before the switch */
+	check_period(m, k++ * dt, CHECK_LOOP_US, CHECK_SLOW_UPDATE_US);
+	for(; k < 4 * ATTITUDE_CTL_RATE + 10; k++) {
+		check_period(m, k * dt, CHECK_LOOP_US, CHECK_UPDATE_US);
+	}
+
+	bool refused = ahrs_registry_set_primary(AHRS_COMPLEMENTARY_FILTER, true) == false &&
+	               ahrs_registry_get_primary() == AHRS_EKF_UD;
+	bool accepted = ahrs_registry_set_primary(AHRS_COMPLEMENTARY_FILTER, false) == true &&
+	                ahrs_registry_get_primary() == AHRS_COMPLEMENTARY_FILTER;
+
+	check_period(m, k * dt, CHECK_LOOP_US, CHECK_UPDATE_US);
+
+	double down[3];
+	check_down(m, (k + 1) * dt, down);
+	double error = check_tilt_error(check_ahrs.q, down);
+
+	bool pass = refused == true && accepted == true && error <= 0.5;
+
+	printf("%-22s armed switch %s, disarmed switch %s, tilt error %.2fdeg/0.5 %s\n", "promotion",
+	       (refused == true) ? "refused" : "ACCEPTED", (accepted == true) ? "accepted" : "REFUSED",
+	       error, (pass == true) ? "ok" : "FAIL");
+
+	return pass;
+}
+
+int main(void)
+{
+	host_stub_map_dwt();
+
+	bool pass = true;
+	pass &= check_agreement("static tilt", &check_static, 20.0, 0.5);
+	pass &= check_agreement("manoeuvre, no heading", &check_manoeuvre, 60.0, 3.0);
+	pass &= check_starved_shadow();
+	pass &= check_promotion();
+
+	printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}
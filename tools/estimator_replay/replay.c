@@ -0,0 +1,515 @@
+/* replays recorded flights through the attitude estimators of the flight
+ * code on the host and compares them against the optitrack attitude.
+ *
+ * usage: estimator_replay [-e cf,ekf,madgwick,ekf_ud] [-j workers]
+ *                         [-s segment_s] [-w warmup_s] [-t tilt_rms_max]
+ *                         log.csv...
+ *        make check (replays a log of replay_gen.c)
+ *
+ * log format, one line per attitude period, '#' starts a comment line:
+ * time_ms, ax, ay, az, gx, gy, gz, optitrack_time_ms, qw, qx, qy, qz
+ * accel [m/s^2] and gyro [deg/s] are the mean of the period, as
+ * attitude_estimate() hands them to the filters. optitrack_time_ms and the
+ * quaternion are the reception time and optitrack.q of the latest pose,
+ * the time is negative before the first pose.
+ *
+ * the estimators are the ones registered in ahrs_registry.c, each owns its
+ * state but ahrs.c shares the matrix scratch between the instances, so every
+ * estimator instance runs in its own worker process. long logs are cut into segments which
+ * replay in parallel, each one starts the warmup time early and only the
+ * poses after the warmup are compared. only roll and pitch are compared, the
+ * estimators do not share a heading source: the ekf fuses gravity alone, the
+ * cf and the ekf_ud also the optitrack yaw (HEADING_USE_OPTITRACK) and the
+ * madgwick the magnetometer. with -t it returns non-zero if the tilt rms error
+ * of an estimator exceeds tilt_rms_max [deg] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "arm_math.h"
+#include "matrix.h"
+#include "vector.h"
+#include "ahrs.h"
+#include "ahrs_registry.h"
+#include "optitrack.h"
+#include "fc_task.h"
+#include "host_stub.h"
+
+#define REPLAY_SEGMENT_S 300.0f //default length of the parallel segments [s]
+#define REPLAY_WARMUP_S 30.0f   //default convergence time before the comparison starts [s]
+#define REPLAY_COLUMN_CNT 12
+
+typedef struct {
+	double time_ms; //[ms], a float would step by 2ms beyond 2^24ms (4.7h)
+	vector3d_f_t accel;
+	vector3d_f_t gyro;
+	double optitrack_time_ms;
+	float optitrack_q[4];
+} replay_sample_t;
+
+typedef struct {
+	const char *name;
+	replay_sample_t *samples;
+	int sample_cnt;
+} replay_log_t;
+
+/* replays samples [replay_begin, end), compares the poses received in [begin, end) */
+typedef struct {
+	int log;
+	int estimator;
+	int replay_begin;
+	int begin;
+	int end;
+} replay_job_t;
+
+typedef struct {
+	bool done;
+	double update_ns;    //summed execution time of the updates
+	long update_cnt;
+	double sq_err[2];    //roll, pitch [deg^2]
+	double tilt_sq_err;  //[deg^2]
+	double tilt_max_err; //[deg]
+	long pose_cnt;
+} replay_result_t;
+
+static replay_log_t *replay_logs;
+static replay_job_t *replay_jobs;
+static replay_result_t *replay_results; //shared with the workers
+
+static bool replay_log_load(replay_log_t *log, const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if(file == NULL) {
+		perror(path);
+		return false;
+	}
+
+	log->name = path;
+	log->samples = NULL;
+	log->sample_cnt = 0;
+
+	int size = 0;
+	int line_num = 0;
+	char line[512];
+	while(fgets(line, sizeof(line), file) != NULL) {
+		line_num++;
+		if(line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+			continue;
+		}
+
+		double val[REPLAY_COLUMN_CNT];
+		char *pos = line;
+		int i;
+		for(i = 0; i < REPLAY_COLUMN_CNT; i++) {
+			char *end;
+			val[i] = strtod(pos, &end);
+			if(end == pos) {
+				break;
+			}
+			pos = end + strspn(end, " \t,");
+		}
+		if(i != REPLAY_COLUMN_CNT) {
+			fprintf(stderr, "%s:%d: expected %d columns\n", path, line_num, REPLAY_COLUMN_CNT);
+			fclose(file);
+			return false;
+		}
+
+		if(log->sample_cnt == size) {
+			size = (size == 0) ? 65536 : size * 2;
+			log->samples = realloc(log->samples, size * sizeof(replay_sample_t));
+		}
+
+		replay_sample_t *sample = &log->samples[log->sample_cnt];
+		sample->time_ms = val[0];
+		sample->accel.x = val[1];
+		sample->accel.y = val[2];
+		sample->accel.z = val[3];
+		sample->gyro.x = val[4];
+		sample->gyro.y = val[5];
+		sample->gyro.z = val[6];
+		sample->optitrack_time_ms = val[7];
+		sample->optitrack_q[0] = val[8];
+		sample->optitrack_q[1] = val[9];
+		sample->optitrack_q[2] = val[10];
+		sample->optitrack_q[3] = val[11];
+
+		if(log->sample_cnt > 0 && sample->time_ms <= sample[-1].time_ms) {
+			fprintf(stderr, "%s:%d: time is not increasing\n", path, line_num);
+			fclose(file);
+			return false;
+		}
+		log->sample_cnt++;
+	}
+
+	fclose(file);
+	return true;
+}
+
+/* first sample at or after time_ms */
+static int replay_log_find(replay_log_t *log, double time_ms)
+{
+	int low = 0, high = log->sample_cnt;
+	while(low < high) {
+		int mid = (low + high) / 2;
+		if(log->samples[mid].time_ms < time_ms) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+static double replay_wrap_deg(double angle)
+{
+	angle = fmod(angle + 180.0, 360.0);
+	return (angle < 0.0) ? angle + 180.0 : angle - 180.0;
+}
+
+/* the reference is optitrack.q as received, the yaw is left out */
+static void replay_compare(float *q, float *q_ref, replay_result_t *result)
+{
+	double rad2deg = 180.0 / M_PI;
+
+	/* third row of the rotation matrix, gravity seen from the body frame */
+	double r20 = 2.0 * (q[1] * q[3] - q[0] * q[2]);
+	double r21 = 2.0 * (q[0] * q[1] + q[2] * q[3]);
+	double r22 = 1.0 - 2.0 * (q[1] * q[1] + q[2] * q[2]);
+
+	double ref20 = 2.0 * (q_ref[1] * q_ref[3] - q_ref[0] * q_ref[2]);
+	double ref21 = 2.0 * (q_ref[0] * q_ref[1] + q_ref[2] * q_ref[3]);
+	double ref22 = 1.0 - 2.0 * (q_ref[1] * q_ref[1] + q_ref[2] * q_ref[2]);
+
+	double err[2];
+	err[0] = replay_wrap_deg((atan2(r21, r22) - atan2(ref21, ref22)) * rad2deg);
+	err[1] = replay_wrap_deg((asin(fmax(-1.0, fmin(1.0, -r20))) -
+	                          asin(fmax(-1.0, fmin(1.0, -ref20)))) * rad2deg);
+
+	double norm = sqrt((r20 * r20 + r21 * r21 + r22 * r22) * (ref20 * ref20 + ref21 * ref21 + ref22 * ref22));
+	double cos_tilt = (r20 * ref20 + r21 * ref21 + r22 * ref22) / norm;
+	double tilt = acos(fmax(-1.0, fmin(1.0, cos_tilt))) * rad2deg;
+
+	int i;
+	for(i = 0; i < 2; i++) {
+		result->sq_err[i] += err[i] * err[i];
+	}
+	result->tilt_sq_err += tilt * tilt;
+	if(tilt > result->tilt_max_err) {
+		result->tilt_max_err = tilt;
+	}
+	result->pose_cnt++;
+}
+
+static void replay_run(replay_job_t *job, replay_result_t *result)
+{
+	replay_log_t *log = &replay_logs[job->log];
+	const ahrs_estimator_t *estimator = ahrs_registry_get_estimator(job->estimator);
+	replay_sample_t *samples = log->samples;
+
+	int first = job->replay_begin;
+	float (*q)[4] = malloc((job->end - first) * sizeof(*q));
+
+	estimator->init(estimator->state, samples[first].accel, ATTITUDE_CTL_RATE);
+
+	/* timed pass, the estimates are kept for the comparison */
+	struct timespec start, stop;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	int i;
+	for(i = first + 1; i < job->end; i++) {
+		replay_sample_t *sample = &samples[i];
+		float dt = (float)((sample->time_ms - sample[-1].time_ms) * 0.001);
+
+		host_stub_set_time(sample->time_ms);
+		host_stub_set_optitrack(sample->optitrack_time_ms, sample->optitrack_q);
+
+		estimator->update(estimator->state, sample->accel, sample->gyro, dt);
+		estimator->get_quat(estimator->state, q[i - first]);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	result->update_ns = (stop.tv_sec - start.tv_sec) * 1e9 + (stop.tv_nsec - start.tv_nsec);
+	result->update_cnt = job->end - first - 1;
+
+	/* every pose is compared once, against the estimate at its capture time */
+	for(i = (job->begin > first + 1) ? job->begin : first + 1; i < job->end; i++) {
+		double pose_ms = samples[i].optitrack_time_ms;
+		if(pose_ms < 0.0 || pose_ms == samples[i - 1].optitrack_time_ms) {
+			continue;
+		}
+
+		double capture_ms = pose_ms - OPTITRACK_LATENCY_MS;
+		int j = i;
+		while(j > first + 1 && samples[j].time_ms > capture_ms) {
+			j--;
+		}
+		if(samples[j].time_ms > capture_ms) {
+			continue;
+		}
+
+		replay_compare(q[j - first], samples[i].optitrack_q, result);
+	}
+
+	free(q);
+	result->done = true;
+}
+
+/* at most worker_cnt jobs run at the same time */
+static bool replay_run_jobs(int job_cnt, int worker_cnt)
+{
+	int next = 0, running = 0;
+	bool failed = false;
+
+	while(next < job_cnt || running > 0) {
+		if(next < job_cnt && running < worker_cnt) {
+			pid_t pid = fork();
+			if(pid < 0) {
+				perror("fork");
+				return false;
+			}
+			if(pid == 0) {
+				replay_run(&replay_jobs[next], &replay_results[next]);
+				_exit(0);
+			}
+			next++;
+			running++;
+		} else {
+			int status;
+			if(wait(&status) < 0) {
+				perror("wait");
+				return false;
+			}
+			if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+				failed = true;
+			}
+			running--;
+		}
+	}
+
+	return !failed;
+}
+
+static int replay_plan_jobs(int log_cnt, bool *selected, float segment_s, float warmup_s)
+{
+	int job_cnt = 0, size = 0;
+	int log_idx, est;
+	for(log_idx = 0; log_idx < log_cnt; log_idx++) {
+		replay_log_t *log = &replay_logs[log_idx];
+		if(log->sample_cnt < 2) {
+			continue;
+		}
+
+		double log_end_ms = log->samples[log->sample_cnt - 1].time_ms;
+		double compare_ms = log->samples[0].time_ms + warmup_s * 1000.0;
+		double segment_ms = (segment_s > 0.0f) ? segment_s * 1000.0 : log_end_ms - compare_ms + 1.0;
+
+		double begin_ms;
+		for(begin_ms = compare_ms; begin_ms <= log_end_ms; begin_ms += segment_ms) {
+			for(est = 0; est < AHRS_ESTIMATOR_CNT; est++) {
+				if(selected[est] == false) {
+					continue;
+				}
+
+				if(job_cnt == size) {
+					size = (size == 0) ? 64 : size * 2;
+					replay_jobs = realloc(replay_jobs, size * sizeof(replay_job_t));
+				}
+
+				replay_job_t *job = &replay_jobs[job_cnt++];
+				job->log = log_idx;
+				job->estimator = est;
+				job->replay_begin = replay_log_find(log, begin_ms - warmup_s * 1000.0);
+				job->begin = replay_log_find(log, begin_ms);
+				job->end = replay_log_find(log, begin_ms + segment_ms);
+			}
+		}
+	}
+
+	return job_cnt;
+}
+
+static bool replay_report(int log_cnt, int job_cnt, bool *selected, float tilt_rms_max)
+{
+	bool pass = true;
+	int log_idx, est, i;
+	for(log_idx = 0; log_idx < log_cnt; log_idx++) {
+		replay_log_t *log = &replay_logs[log_idx];
+		double duration_s = (log->sample_cnt > 1) ?
+		                    (log->samples[log->sample_cnt - 1].time_ms - log->samples[0].time_ms) * 0.001 : 0.0;
+		printf("%s: %.1fs, %d samples\n", log->name, duration_s, log->sample_cnt);
+		printf("  %-10s %8s %8s %8s %8s %8s %10s\n", "estimator", "poses",
+		       "roll", "pitch", "tilt", "tilt_max", "update");
+		printf("  %-10s %8s %8s %8s %8s %8s %10s\n", "", "",
+		       "rms[deg]", "rms[deg]", "rms[deg]", "[deg]", "[ns]");
+
+		for(est = 0; est < AHRS_ESTIMATOR_CNT; est++) {
+			if(selected[est] == false) {
+				continue;
+			}
+
+			replay_result_t sum = {0};
+			for(i = 0; i < job_cnt; i++) {
+				replay_result_t *result = &replay_results[i];
+				if(replay_jobs[i].log != log_idx || replay_jobs[i].estimator != est) {
+					continue;
+				}
+				sum.update_ns += result->update_ns;
+				sum.update_cnt += result->update_cnt;
+				sum.sq_err[0] += result->sq_err[0];
+				sum.sq_err[1] += result->sq_err[1];
+				sum.tilt_sq_err += result->tilt_sq_err;
+				sum.tilt_max_err = fmax(sum.tilt_max_err, result->tilt_max_err);
+				sum.pose_cnt += result->pose_cnt;
+			}
+
+			if(sum.pose_cnt == 0) {
+				printf("  %-10s %8ld %8s %8s %8s %8s %10.1f\n", ahrs_registry_get_estimator(est)->name, 0L,
+				       "-", "-", "-", "-", (sum.update_cnt > 0) ? sum.update_ns / sum.update_cnt : 0.0);
+				pass = false;
+				continue;
+			}
+
+			printf("  %-10s %8ld %8.3f %8.3f %8.3f %8.3f %10.1f\n", ahrs_registry_get_estimator(est)->name,
+			       sum.pose_cnt,
+			       sqrt(sum.sq_err[0] / sum.pose_cnt),
+			       sqrt(sum.sq_err[1] / sum.pose_cnt),
+			       sqrt(sum.tilt_sq_err / sum.pose_cnt),
+			       sum.tilt_max_err,
+			       sum.update_ns / sum.update_cnt);
+
+			if(tilt_rms_max > 0.0f && sqrt(sum.tilt_sq_err / sum.pose_cnt) > tilt_rms_max) {
+				pass = false;
+			}
+		}
+	}
+
+	return pass;
+}
+
+static bool replay_select(const char *list, bool *selected)
+{
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%s", list);
+
+	char *name;
+	for(name = strtok(buf, ","); name != NULL; name = strtok(NULL, ",")) {
+		int est;
+		for(est = 0; est < AHRS_ESTIMATOR_CNT; est++) {
+			if(strcmp(name, ahrs_registry_get_estimator(est)->name) == 0) {
+				selected[est] = true;
+				break;
+			}
+		}
+		if(est == AHRS_ESTIMATOR_CNT) {
+			fprintf(stderr, "unknown estimator: %s\n", name);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void replay_usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-e cf,ekf,madgwick,ekf_ud] [-j workers] "
+	        "[-s segment_s (0: whole log)] [-w warmup_s] [-t tilt_rms_max] log.csv...\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	bool selected[AHRS_ESTIMATOR_CNT] = {false};
+	const char *estimator_list = "cf,ekf,madgwick,ekf_ud";
+	int worker_cnt = sysconf(_SC_NPROCESSORS_ONLN);
+	float segment_s = REPLAY_SEGMENT_S;
+	float warmup_s = REPLAY_WARMUP_S;
+	float tilt_rms_max = 0.0f; //no bound
+
+	int opt;
+	while((opt = getopt(argc, argv, "e:j:s:t:w:")) != -1) {
+		switch(opt) {
+		case 'e':
+			estimator_list = optarg;
+			break;
+		case 'j':
+			worker_cnt = atoi(optarg);
+			break;
+		case 's':
+			segment_s = atof(optarg);
+			break;
+		case 't':
+			tilt_rms_max = atof(optarg);
+			break;
+		case 'w':
+			warmup_s = atof(optarg);
+			break;
+		default:
+			replay_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(optind >= argc || worker_cnt < 1 || segment_s < 0.0f || warmup_s < 0.0f) {
+		replay_usage(argv[0]);
+		return 1;
+	}
+
+	if(replay_select(estimator_list, selected) == false) {
+		return 1;
+	}
+
+	host_stub_map_dwt();
+
+	struct timespec start, stop;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	int log_cnt = argc - optind;
+	replay_logs = calloc(log_cnt, sizeof(replay_log_t));
+	int i;
+	for(i = 0; i < log_cnt; i++) {
+		if(replay_log_load(&replay_logs[i], argv[optind + i]) == false) {
+			return 1;
+		}
+	}
+
+	int job_cnt = replay_plan_jobs(log_cnt, selected, segment_s, warmup_s);
+
+	replay_results = mmap(NULL, (job_cnt + 1) * sizeof(replay_result_t), PROT_READ | PROT_WRITE,
+	                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(replay_results == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	memset(replay_results, 0, (job_cnt + 1) * sizeof(replay_result_t));
+
+	if(replay_run_jobs(job_cnt, worker_cnt) == false) {
+		fprintf(stderr, "a replay worker failed\n");
+		return 1;
+	}
+
+	long update_cnt = 0;
+	for(i = 0; i < job_cnt; i++) {
+		if(replay_results[i].done == false) {
+			fprintf(stderr, "a replay worker did not finish\n");
+			return 1;
+		}
+		update_cnt += replay_results[i].update_cnt;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	double wall_s = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+
+	bool pass = replay_report(log_cnt, job_cnt, selected, tilt_rms_max);
+	printf("%ld updates in %d jobs on %d workers, %.2fs\n", update_cnt, job_cnt, worker_cnt, wall_s);
+
+	if(tilt_rms_max > 0.0f) {
+		printf("%s\n", (pass == true) ? "pass" : "FAIL");
+		return (pass == true) ? 0 : 1;
+	}
+
+	return 0;
+}
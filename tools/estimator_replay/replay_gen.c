@@ -0,0 +1,124 @@
+/* writes a synthetic flight log in the format of estimator_replay, the input
+ * of its check. there is no recorder on the target, a log row is twelve
+ * columns at 400Hz, about 40kB/s, beyond what the telemetry uart carries.
+ *
+ * usage: replay_gen duration_s [start_s] > log.csv
+ *
+ * the attitude rolls 20deg at 0.3Hz, pitches 15deg at 0.23Hz and turns at
+ * 10deg/s, so the yaw wraps around +-180deg every 36s. the gyro carries a
+ * constant bias and white noise, the accelerometer white noise. the poses
+ * arrive at 120Hz, OPTITRACK_LATENCY_MS after their capture. start_s offsets
+ * the time column, beyond 2^24ms a float time steps by 2ms */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define GEN_RATE 400.0          //ATTITUDE_CTL_RATE [Hz]
+#define GEN_POSE_RATE 120.0     //[Hz]
+#define GEN_POSE_LATENCY 0.010  //OPTITRACK_LATENCY_MS [s]
+#define GEN_GRAVITY 9.81        //[m/s^2]
+
+#define GEN_ROLL_AMPLITUDE 20.0 //[deg]
+#define GEN_ROLL_FREQ 0.3       //[Hz]
+#define GEN_PITCH_AMPLITUDE 15.0
+#define GEN_PITCH_FREQ 0.23
+#define GEN_YAW_RATE 10.0       //[deg/s]
+
+#define GEN_ACCEL_NOISE 0.3     //standard deviation [m/s^2]
+#define GEN_GYRO_NOISE 0.2      //standard deviation [deg/s]
+
+static const double gen_gyro_bias[3] = {+0.5, -0.3, +0.2}; //[deg/s]
+
+static double gaussian(void)
+{
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/* roll, pitch, yaw [rad] at t [s] */
+static void gen_attitude(double t, double *euler)
+{
+	double deg2rad = M_PI / 180.0;
+	euler[0] = GEN_ROLL_AMPLITUDE * deg2rad * sin(2.0 * M_PI * GEN_ROLL_FREQ * t);
+	euler[1] = GEN_PITCH_AMPLITUDE * deg2rad * sin(2.0 * M_PI * GEN_PITCH_FREQ * t + 1.0);
+	euler[2] = fmod(GEN_YAW_RATE * deg2rad * t + M_PI, 2.0 * M_PI) - M_PI;
+}
+
+static void gen_euler_to_quat(double roll, double pitch, double yaw, double *q)
+{
+	double cr = cos(roll / 2.0), sr = sin(roll / 2.0);
+	double cp = cos(pitch / 2.0), sp = sin(pitch / 2.0);
+	double cy = cos(yaw / 2.0), sy = sin(yaw / 2.0);
+	q[0] = cr * cp * cy + sr * sp * sy;
+	q[1] = sr * cp * cy - cr * sp * sy;
+	q[2] = cr * sp * cy + sr * cp * sy;
+	q[3] = cr * cp * sy - sr * sp * cy;
+}
+
+int main(int argc, char **argv)
+{
+	if(argc < 2 || argc > 3) {
+		fprintf(stderr, "usage: %s duration_s [start_s] > log.csv\n", argv[0]);
+		return 1;
+	}
+
+	double duration = atof(argv[1]);
+	double start = (argc > 2) ? atof(argv[2]) : 0.0;
+	double rad2deg = 180.0 / M_PI;
+	double w_roll = 2.0 * M_PI * GEN_ROLL_FREQ;
+	double w_pitch = 2.0 * M_PI * GEN_PITCH_FREQ;
+	double yaw_rate = GEN_YAW_RATE / rad2deg;
+
+	srand(1);
+	printf("# synthetic flight, %.0fs\n", duration);
+
+	double pose_time_ms = -1.0, pose_next = 0.0;
+	double pose_q[4] = {1.0, 0.0, 0.0, 0.0};
+
+	long k;
+	for(k = 0; k < (long)(duration * GEN_RATE); k++) {
+		double t = k / GEN_RATE;
+
+		double euler[3];
+		gen_attitude(t, euler);
+		double roll = euler[0], pitch = euler[1];
+
+		/* euler rates to body rates */
+		double roll_rate = GEN_ROLL_AMPLITUDE / rad2deg * w_roll * cos(w_roll * t);
+		double pitch_rate = GEN_PITCH_AMPLITUDE / rad2deg * w_pitch * cos(w_pitch * t + 1.0);
+		double gyro[3] = {
+			roll_rate - yaw_rate * sin(pitch),
+			pitch_rate * cos(roll) + yaw_rate * sin(roll) * cos(pitch),
+			-pitch_rate * sin(roll) + yaw_rate * cos(roll) * cos(pitch)
+		};
+
+		/* gravity as the filters take the accelerometer, +z up when level */
+		double accel[3] = {
+			+GEN_GRAVITY * sin(pitch),
+			-GEN_GRAVITY * sin(roll) * cos(pitch),
+			+GEN_GRAVITY * cos(roll) * cos(pitch)
+		};
+
+		/* the pose received now was captured one latency earlier */
+		if(t >= pose_next) {
+			double capture[3];
+			gen_attitude(t - GEN_POSE_LATENCY, capture);
+			gen_euler_to_quat(capture[0], capture[1], capture[2], pose_q);
+			pose_time_ms = (start + t) * 1000.0;
+			pose_next += 1.0 / GEN_POSE_RATE;
+		}
+
+		printf("%.3f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.3f,%.6f,%.6f,%.6f,%.6f\n", (start + t) * 1000.0,
+		       accel[0] + GEN_ACCEL_NOISE * gaussian(),
+		       accel[1] + GEN_ACCEL_NOISE * gaussian(),
+		       accel[2] + GEN_ACCEL_NOISE * gaussian(),
+		       gyro[0] * rad2deg + gen_gyro_bias[0] + GEN_GYRO_NOISE * gaussian(),
+		       gyro[1] * rad2deg + gen_gyro_bias[1] + GEN_GYRO_NOISE * gaussian(),
+		       gyro[2] * rad2deg + gen_gyro_bias[2] + GEN_GYRO_NOISE * gaussian(),
+		       pose_time_ms, pose_q[0], pose_q[1], pose_q[2], pose_q[3]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,167 @@
+/* accuracy check of the fastmath.h approximations against the double
+ * precision libm, and of the cmsis-dsp arm_sin_f32()/arm_cos_f32() for
+ * comparison.
+ *
+ * usage: make check       every 61st float of each domain, ~15s
+ *        make exhaustive  every float of each domain, ~15min on one core
+ *
+ * fast_invsqrtf() is scale invariant by powers of 4 (the bit trick and the
+ * newton steps only shift the exponent), so [1, 4) is always checked
+ * exhaustively and covers every normal float, the exhaustive mode walks the
+ * whole normal range anyway. fast_atan2f() is checked on every octant with
+ * the ratio operand running over [0, 1]. returns non-zero if a documented
+ * bound of fastmath.h is exceeded */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "fastmath.h"
+#include "arm_math.h"
+
+#define CHECK_STRIDE 61
+
+/* documented bounds in fastmath.h */
+#define INVSQRT_BOUND 4.8e-6 //relative
+#define ATAN2_BOUND 1.2e-5   //[rad]
+#define ASIN_BOUND 7.4e-6    //[rad]
+#define SINCOS_BOUND 9.4e-8
+
+/* cmsis errors above this are a table index fault, not interpolation */
+#define CMSIS_FAULT 1e-3
+
+#define FLOAT_ONE 0x3f800000
+#define FLOAT_FOUR 0x40800000
+#define FLOAT_MIN_NORMAL 0x00800000
+#define FLOAT_MAX_NORMAL 0x7f7fffff
+#define FLOAT_THOUSAND 0x447a0000
+
+typedef struct {
+	double max;
+	float worst; //argument of the maximum error
+} approx_error_t;
+
+static float bits_to_float(uint32_t i)
+{
+	float x;
+	memcpy(&x, &i, sizeof(x));
+	return x;
+}
+
+static void error_add(approx_error_t *err, double e, float x)
+{
+	if(e > err->max) {
+		err->max = e;
+		err->worst = x;
+	}
+}
+
+static void check_invsqrt(uint32_t begin, uint32_t end, uint32_t stride, approx_error_t *err)
+{
+	uint32_t i;
+	for(i = begin; i <= end; i += stride) {
+		float x = bits_to_float(i);
+		double ref = 1.0 / sqrt((double)x);
+		error_add(err, fabs(fast_invsqrtf(x) - ref) / ref, x);
+	}
+}
+
+/* y / x and x / y over [0, 1] in the four quadrants, -0.0 is compared as +0.0 */
+static void check_atan2(uint32_t stride, approx_error_t *err)
+{
+	uint32_t i;
+	for(i = 0; i <= FLOAT_ONE; i += stride) {
+		float t = bits_to_float(i);
+		float args[8][2] = {
+			{t, 1.0f}, {1.0f, t}, {-t, 1.0f}, {1.0f, -t},
+			{t, -1.0f}, {-1.0f, t}, {-t, -1.0f}, {-1.0f, -t}
+		};
+
+		int k;
+		for(k = 0; k < 8; k++) {
+			float y = args[k][0], x = args[k][1];
+			double ref = atan2((double)y + 0.0, (double)x);
+			error_add(err, fabs(fast_atan2f(y, x) - ref), t);
+		}
+	}
+}
+
+static void check_asin(uint32_t stride, approx_error_t *err)
+{
+	uint32_t i;
+	for(i = 0; i <= FLOAT_ONE; i += stride) {
+		float x = bits_to_float(i);
+		error_add(err, fabs(fast_asinf(x) - asin((double)x)), x);
+		error_add(err, fabs(fast_asinf(-x) - asin((double)-x)), -x);
+	}
+}
+
+static void check_sincos(uint32_t stride, approx_error_t *err, approx_error_t *cmsis_err,
+                         uint32_t *cmsis_fault_cnt)
+{
+	uint32_t i;
+	for(i = 0; i <= FLOAT_THOUSAND; i += stride) {
+		float x = bits_to_float(i);
+
+		int k;
+		for(k = 0; k < 2; k++) {
+			float s, c;
+			fast_sincosf(x, &s, &c);
+
+			double ref_s = sin((double)x);
+			double ref_c = cos((double)x);
+			error_add(err, fmax(fabs(s - ref_s), fabs(c - ref_c)), x);
+
+			double cmsis_e = fmax(fabs(arm_sin_f32(x) - ref_s), fabs(arm_cos_f32(x) - ref_c));
+			if(cmsis_e > CMSIS_FAULT) {
+				(*cmsis_fault_cnt)++;
+			} else {
+				error_add(cmsis_err, cmsis_e, x);
+			}
+
+			x = -x;
+		}
+	}
+}
+
+static bool report(const char *name, approx_error_t *err, double bound)
+{
+	bool pass = err->max <= bound;
+	printf("%-18s max error %.3g at %.9g, bound %.3g %s\n", name, err->max, err->worst, bound,
+	       (pass == true) ? "ok" : "exceeded");
+	return pass;
+}
+
+int main(int argc, char **argv)
+{
+	bool exhaustive = (argc > 1 && strcmp(argv[1], "-e") == 0);
+	uint32_t stride = exhaustive ? 1 : CHECK_STRIDE;
+
+	printf("%s\n", exhaustive ? "every float of each domain" : "every 61st float of each domain");
+
+	approx_error_t invsqrt_err = {0}, atan2_err = {0}, asin_err = {0}, sincos_err = {0}, cmsis_err = {0};
+	uint32_t cmsis_fault_cnt = 0;
+
+	check_invsqrt(FLOAT_ONE, FLOAT_FOUR - 1, 1, &invsqrt_err);
+	check_invsqrt(FLOAT_MIN_NORMAL, FLOAT_MAX_NORMAL, exhaustive ? 1 : 4099, &invsqrt_err);
+	check_atan2(stride, &atan2_err);
+	check_asin(stride, &asin_err);
+	check_sincos(stride, &sincos_err, &cmsis_err, &cmsis_fault_cnt);
+
+	bool pass = true;
+	pass &= report("fast_invsqrtf", &invsqrt_err, INVSQRT_BOUND);
+	pass &= report("fast_atan2f", &atan2_err, ATAN2_BOUND);
+	pass &= report("fast_asinf", &asin_err, ASIN_BOUND);
+	pass &= report("fast_sincosf", &sincos_err, SINCOS_BOUND);
+
+	/* table interpolation of the cmsis-dsp, not used by the flight code. arm_cos_f32()
+	 * of this cmsis version lacks the findex >= 512 wrap of arm_sin_f32(), so
+	 * arguments which land exactly on a period return up to ~6.3 */
+	printf("%-18s max error %.3g at %.9g, %u arguments with a table index fault\n",
+	       "arm_sin/cos_f32", cmsis_err.max, cmsis_err.worst, cmsis_fault_cnt);
+
+	printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}
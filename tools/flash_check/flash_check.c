@@ -0,0 +1,222 @@
+/* host check of the flash parameter records with a simulated power loss, the
+ * flash.c of the flight code programs an emulated sector mapped at the
+ * address of the real one.
+ *
+ * usage: make check
+ *
+ * programming only clears bits and a word can only be set again by erasing
+ * the whole sector, like the stm32 flash. every store is cut off after each
+ * possible number of programmed words, the word being programmed at that
+ * moment keeps a random part of its bits. after the cut the previous record
+ * of the id has to load, and the next store has to succeed and load back.
+ * also covers the full sector and non erased free space behind the records.
+ * returns non-zero if any check fails */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <setjmp.h>
+#include <sys/mman.h>
+#include "stm32f4xx_conf.h"
+#include "flash.h"
+
+#define ID_A 7
+#define ID_B 8
+
+typedef struct {
+	uint32_t seq;
+	float value[8];
+} record_t;
+
+static uint32_t *sector;
+static bool unlocked = false;
+static int erase_cnt = 0;
+
+/* programmed words left before the power is cut, negative for none */
+static int power_budget = -1;
+static jmp_buf power_loss;
+
+void FLASH_Unlock(void)
+{
+	unlocked = true;
+}
+
+void FLASH_Lock(void)
+{
+	unlocked = false;
+}
+
+void FLASH_ClearFlag(uint32_t FLASH_FLAG)
+{
+}
+
+FLASH_Status FLASH_EraseSector(uint32_t FLASH_Sector, uint8_t VoltageRange)
+{
+	if(unlocked == false || FLASH_Sector != FLASH_PARAM_SECTOR) {
+		return FLASH_ERROR_PROGRAM;
+	}
+
+	memset(sector, 0xff, FLASH_PARAM_SIZE);
+	erase_cnt++;
+
+	return FLASH_COMPLETE;
+}
+
+FLASH_Status FLASH_ProgramWord(uint32_t Address, uint32_t Data)
+{
+	if(unlocked == false || Address < FLASH_PARAM_ADDR ||
+	    Address + 4 > FLASH_PARAM_ADDR + FLASH_PARAM_SIZE || (Address & 3) != 0) {
+		return FLASH_ERROR_PROGRAM;
+	}
+
+	uint32_t *word = &sector[(Address - FLASH_PARAM_ADDR) / 4];
+
+	if(power_budget == 0) {
+		/* torn word, some of the cleared bits made it */
+		*word &= Data | (uint32_t)rand();
+		unlocked = false;
+		longjmp(power_loss, 1);
+	}
+	if(power_budget > 0) {
+		power_budget--;
+	}
+
+	*word &= Data;
+
+	return FLASH_COMPLETE;
+}
+
+static void record_fill(record_t *record, uint32_t seq)
+{
+	record->seq = seq;
+
+	int i;
+	for(i = 0; i < 8; i++) {
+		record->value[i] = (float)seq + 0.125f * i;
+	}
+}
+
+/* the stored record of the id has to be the one of seq, 0 for none */
+static bool record_check(uint16_t id, uint32_t seq)
+{
+	record_t record;
+	bool found = flash_param_load(id, &record, sizeof(record));
+
+	if(seq == 0) {
+		return found == false;
+	}
+
+	record_t expected;
+	record_fill(&expected, seq);
+
+	return found == true && memcmp(&record, &expected, sizeof(record)) == 0;
+}
+
+static bool store(uint16_t id, uint32_t seq)
+{
+	record_t record;
+	record_fill(&record, seq);
+
+	return flash_param_store(id, &record, sizeof(record));
+}
+
+/* cut the store of a after every programmed word */
+static bool check_power_loss(void)
+{
+	const int record_words = (8 + sizeof(record_t)) / 4;
+	int fail_cnt = 0, dropped_cnt = 0, cut_cnt = 0;
+
+	int cut;
+	for(cut = 0; cut < record_words; cut++) {
+		int trial;
+		for(trial = 0; trial < 32; trial++) {
+			memset(sector, 0xff, FLASH_PARAM_SIZE);
+			bool pass = store(ID_A, 1) && store(ID_B, 1);
+
+			power_budget = cut;
+			if(setjmp(power_loss) == 0) {
+				store(ID_A, 2);
+			}
+			power_budget = -1;
+			cut_cnt++;
+
+			pass &= record_check(ID_A, 1) && record_check(ID_B, 1);
+
+			/* a torn header which runs past the sector forces an erase */
+			int erase_last = erase_cnt;
+			pass &= store(ID_A, 3) && record_check(ID_A, 3);
+			if(erase_cnt != erase_last) {
+				pass &= record_check(ID_B, 0);
+				dropped_cnt++;
+			} else {
+				pass &= record_check(ID_B, 1);
+			}
+
+			if(pass == false) {
+				fail_cnt++;
+			}
+		}
+	}
+
+	printf("power loss: %d cut stores, %d failed, %d recovered by an erase\n",
+	       cut_cnt, fail_cnt, dropped_cnt);
+
+	return fail_cnt == 0;
+}
+
+/* keep storing until the sector wraps a few times */
+static bool check_sector_full(void)
+{
+	memset(sector, 0xff, FLASH_PARAM_SIZE);
+	erase_cnt = 0;
+
+	bool pass = true;
+	uint32_t seq;
+	for(seq = 1; seq <= 10000 && pass == true; seq++) {
+		pass &= store(ID_A, seq) && record_check(ID_A, seq);
+	}
+
+	printf("sector full: %u stores, %d erases %s\n", seq - 1, erase_cnt,
+	       (pass == true) ? "ok" : "FAIL");
+
+	return pass && erase_cnt > 0;
+}
+
+/* a stray word behind the last record, nothing may be programmed over it */
+static bool check_dirty_free_space(void)
+{
+	memset(sector, 0xff, FLASH_PARAM_SIZE);
+	erase_cnt = 0;
+
+	bool pass = store(ID_A, 1);
+	sector[(8 + sizeof(record_t)) / 4 + 3] = 0x12345678;
+
+	pass &= store(ID_A, 2) && record_check(ID_A, 2) && erase_cnt == 1;
+
+	printf("dirty free space: %s\n", (pass == true) ? "ok" : "FAIL");
+
+	return pass;
+}
+
+int main(void)
+{
+	sector = mmap((void *)(uintptr_t)FLASH_PARAM_ADDR, FLASH_PARAM_SIZE, PROT_READ | PROT_WRITE,
+	              MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if(sector != (uint32_t *)(uintptr_t)FLASH_PARAM_ADDR) {
+		printf("can not map the sector at 0x%08x\n", FLASH_PARAM_ADDR);
+		return 1;
+	}
+
+	srand(1);
+
+	bool pass = true;
+	pass &= check_power_loss();
+	pass &= check_sector_full();
+	pass &= check_dirty_free_space();
+
+	printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}
@@ -0,0 +1,31 @@
+#ifndef __STM32F4xx_CONF_H
+#define __STM32F4xx_CONF_H
+
+/* host replacement of the device headers, flash.c only needs the flash
+ * programming interface of the standard peripheral library */
+
+#include <stdint.h>
+
+typedef enum {
+	FLASH_BUSY = 1,
+	FLASH_ERROR_PROGRAM,
+	FLASH_COMPLETE
+} FLASH_Status;
+
+#define FLASH_Sector_23 ((uint16_t)0x00D8)
+#define VoltageRange_3 ((uint8_t)0x02)
+
+#define FLASH_FLAG_EOP ((uint32_t)0x00000001)
+#define FLASH_FLAG_OPERR ((uint32_t)0x00000002)
+#define FLASH_FLAG_WRPERR ((uint32_t)0x00000010)
+#define FLASH_FLAG_PGAERR ((uint32_t)0x00000020)
+#define FLASH_FLAG_PGPERR ((uint32_t)0x00000040)
+#define FLASH_FLAG_PGSERR ((uint32_t)0x00000080)
+
+void FLASH_Unlock(void);
+void FLASH_Lock(void);
+void FLASH_ClearFlag(uint32_t FLASH_FLAG);
+FLASH_Status FLASH_EraseSector(uint32_t FLASH_Sector, uint8_t VoltageRange);
+FLASH_Status FLASH_ProgramWord(uint32_t Address, uint32_t Data);
+
+#endif
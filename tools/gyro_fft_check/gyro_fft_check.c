@@ -0,0 +1,150 @@
+/* software in the loop check of the gyro spectrum analysis and the dynamic
+ * notches, gyro_fft.c, dyn_notch.c and the cmsis-dsp fft of the flight code
+ * run against a simulated 8kHz gyro.
+ *
+ * usage: make check
+ *
+ * the analysis runs one axis every GYRO_FFT_PERIOD_MS like task_gyro_fft().
+ * the gyro carries a slow manoeuvre, white noise and the motor tones. the
+ * notches run on the combined signal, the manoeuvre alone is passed through
+ * the same coefficient sequence, so the residual of the tones and the noise
+ * is exact. returns non-zero if any scenario fails */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include "stm32f4xx.h"
+#include "gyro_fft.h"
+#include "dyn_notch.h"
+
+#define SAMPLE_RATE 8000.0   //MPU6500_SAMPLE_RATE [Hz]
+#define ANALYSIS_PERIOD 80   //GYRO_FFT_PERIOD_MS of fc_task.h [samples]
+#define SETTLE_TIME 1.0      //before the errors are taken [s]
+#define SIM_TIME 6.0         //[s]
+
+#define MOTION_AMPLITUDE 20.0 //[deg/s]
+#define NOISE_AMPLITUDE 0.5   //peak to peak [deg/s]
+
+DWT_Type host_dwt;
+CoreDebug_Type host_core_debug;
+
+extern dyn_notch_t dyn_notch;
+
+typedef struct {
+	const char *name;
+	double freq_start;     //motor fundamental [Hz]
+	double freq_end;
+	double amplitude[3];   //fundamental on x/y/z, the harmonic has 3/8 of it [deg/s]
+	double track_error_max; //[Hz]
+	double attenuation_min; //of the tones on x [dB]
+	int false_peak_max;    //analyses of z with a tracked peak
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+	{"steady motors", 210.0, 210.0, {8.0, 4.0, 0.0}, 2.0, 20.0, 0},
+	{"motor sweep 150 to 300Hz", 150.0, 300.0, {8.0, 4.0, 0.0}, 8.0, 17.0, 0},
+	{"motor sweep 300 to 150Hz", 300.0, 150.0, {8.0, 4.0, 0.0}, 8.0, 17.0, 0}
+};
+
+static double uniform(void)
+{
+	return (double)rand() / RAND_MAX - 0.5;
+}
+
+static bool run_scenario(const scenario_t *s)
+{
+	srand(2);
+	gyro_fft_init(SAMPLE_RATE);
+	dyn_notch_init(SAMPLE_RATE);
+
+	biquad_state_t motion_state[DYN_NOTCH_CNT];
+	int n;
+	for(n = 0; n < DYN_NOTCH_CNT; n++) {
+		biquad_reset(&motion_state[n]);
+	}
+
+	double phase = 0.0, tone_sq_sum = 0.0, residual_sq_sum = 0.0, track_error_max = 0.0;
+	int axis = 0, false_peak_cnt = 0;
+
+	long k;
+	for(k = 0; k < (long)(SAMPLE_RATE * SIM_TIME); k++) {
+		double t = k / SAMPLE_RATE;
+		double f1 = s->freq_start + (s->freq_end - s->freq_start) * t / SIM_TIME;
+		phase += 2.0 * M_PI * f1 / SAMPLE_RATE;
+
+		double motion = MOTION_AMPLITUDE * sin(2.0 * M_PI * 2.0 * t);
+		double tone = sin(phase) + 0.375 * sin(2.0 * phase);
+		double noise = NOISE_AMPLITUDE * uniform();
+
+		vector3d_f_t gyro = {
+			motion + s->amplitude[0] * tone + noise,
+			motion + s->amplitude[1] * tone + noise,
+			motion + s->amplitude[2] * tone + noise
+		};
+		gyro_fft_push(&gyro);
+		dyn_notch_apply(&gyro);
+
+		/* the manoeuvre through the coefficients dyn_notch_apply() just used */
+		double motion_out = motion;
+		for(n = 0; n < DYN_NOTCH_CNT; n++) {
+			motion_out = biquad_apply(&dyn_notch.coeff[0][n], &motion_state[n], motion_out);
+		}
+
+		if((k % ANALYSIS_PERIOD) == 0) {
+			gyro_fft_analyze(axis);
+			for(n = 0; n < GYRO_FFT_PEAK_CNT; n++) {
+				dyn_notch_set_freq(axis, n, gyro_fft_get_peak_freq(axis, n));
+			}
+
+			if(t > SETTLE_TIME) {
+				if(axis == 0) {
+					/* the closest notch of x on the fundamental */
+					double error = 1e9;
+					for(n = 0; n < GYRO_FFT_PEAK_CNT; n++) {
+						error = fmin(error, fabs(gyro_fft_get_peak_freq(0, n) - f1));
+					}
+					track_error_max = fmax(track_error_max, error);
+				} else if(axis == 2 && s->amplitude[2] == 0.0) {
+					if(gyro_fft_get_peak_freq(2, 0) != 0.0f || gyro_fft_get_peak_freq(2, 1) != 0.0f) {
+						false_peak_cnt++;
+					}
+				}
+			}
+			axis = (axis + 1) % 3;
+		}
+
+		if(t > SETTLE_TIME) {
+			double tone_x = s->amplitude[0] * tone;
+			double residual = gyro.x - motion_out;
+			tone_sq_sum += tone_x * tone_x;
+			residual_sq_sum += residual * residual;
+		}
+	}
+
+	double attenuation = 10.0 * log10(tone_sq_sum / residual_sq_sum);
+
+	bool pass = track_error_max <= s->track_error_max && attenuation >= s->attenuation_min &&
+	            false_peak_cnt <= s->false_peak_max;
+
+	printf("%-26s tracking error %5.2fHz/%.0f, x tone attenuation %5.1fdB/%.0f, "
+	       "false peaks on z %d/%d %s\n", s->name, track_error_max, s->track_error_max,
+	       attenuation, s->attenuation_min, false_peak_cnt, s->false_peak_max,
+	       (pass == true) ? "ok" : "FAIL");
+
+	return pass;
+}
+
+int main(void)
+{
+	bool pass = true;
+
+	unsigned int i;
+	for(i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+		pass &= run_scenario(&scenarios[i]);
+	}
+
+	printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}
@@ -0,0 +1,525 @@
+/* fits the thermal imu calibration model of common/imu_calib.h from a
+ * thermal soak log and writes it as a flash parameter record.
+ *
+ * usage: imu_calib_fit [-n order] [-o record.bin] [-a accel_rms_max]
+ *                      [-g gyro_rms_max] log...
+ *        make check (fits a log of soak_gen.py)
+ *
+ * the log is the output of send_imu_thermal_calib_debug_message(), one line
+ * per stationary window, other lines are skipped:
+ * temp [degC], ax, ay, az, gx, gy, gz [lsb]
+ * the board rests on each of its 6 faces while the temperature sweeps the
+ * operating range, e.g. cooled down first and then heated up by the
+ * electronics or a heat gun. the face is recognized from the gravity axis.
+ *
+ * gyro: the bias polynomial is fitted per axis. the runtime bias estimation
+ * of mpu6500.c still removes the turn-on offset, only the drift matters.
+ * the scale can not be observed without a rate table and stays nominal.
+ * accel: the 2 faces of an axis give its bias and sensitivity polynomials,
+ * raw = bias(t) +- g * sens(t), which is linear in the coefficients. the
+ * misalignment is the least squares map of the corrected samples onto the
+ * ideal gravity vectors.
+ *
+ * the record replaces the whole parameter sector, the stored gyro bias is
+ * measured again after the next boot:
+ * st-flash write record.bin 0x081E0000
+ *
+ * with -a or -g it returns non-zero if the fitted residual rms exceeds the
+ * bound [m/s^2, deg/s] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "imu_calib.h"
+#include "flash.h"
+#include "mpu6500.h"
+
+#define GRAVITY 9.8f //[m/s^2], same as MPU6500A_16g * 2048
+#define FIT_FACE_MIN_CNT 3
+#define FIT_UNKNOWN_MAX (2 * (IMU_CALIB_POLY_ORDER + 1))
+
+typedef struct {
+	float temp;
+	float accel[3];
+	float gyro[3];
+	int face; //gravity axis * 2 + (1 if negative)
+} fit_sample_t;
+
+static fit_sample_t *fit_samples;
+static int fit_sample_cnt;
+
+static void fit_log_load(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if(file == NULL) {
+		fprintf(stderr, "%s: can not open\n", path);
+		exit(1);
+	}
+
+	int skipped = 0;
+	char line[256];
+	while(fgets(line, sizeof(line), file) != NULL) {
+		fit_sample_t s;
+		if(sscanf(line, "%f, %f, %f, %f, %f, %f, %f", &s.temp, &s.accel[0], &s.accel[1],
+		          &s.accel[2], &s.gyro[0], &s.gyro[1], &s.gyro[2]) != 7) {
+			skipped++;
+			continue;
+		}
+
+		/* dominant axis of the gravity */
+		int i, axis = 0;
+		for(i = 1; i < 3; i++) {
+			if(fabsf(s.accel[i]) > fabsf(s.accel[axis])) {
+				axis = i;
+			}
+		}
+		s.face = axis * 2 + (s.accel[axis] < 0.0f ? 1 : 0);
+
+		fit_samples = realloc(fit_samples, (fit_sample_cnt + 1) * sizeof(fit_sample_t));
+		fit_samples[fit_sample_cnt++] = s;
+	}
+	fclose(file);
+
+	printf("%s: %d windows loaded, %d lines skipped\n", path, fit_sample_cnt, skipped);
+}
+
+/* solves the normal equations a * x = b of size n in place, gaussian
+ * elimination with partial pivoting, false if singular */
+static bool fit_solve(double *a, double *b, double *x, int n)
+{
+	int i, j, k;
+	for(k = 0; k < n; k++) {
+		int pivot = k;
+		for(i = k + 1; i < n; i++) {
+			if(fabs(a[i * n + k]) > fabs(a[pivot * n + k])) pivot = i;
+		}
+		if(fabs(a[pivot * n + k]) < 1e-12 * fabs(a[0])) {
+			return false;
+		}
+
+		for(j = 0; j < n; j++) {
+			double tmp = a[k * n + j];
+			a[k * n + j] = a[pivot * n + j];
+			a[pivot * n + j] = tmp;
+		}
+		double tmp = b[k];
+		b[k] = b[pivot];
+		b[pivot] = tmp;
+
+		for(i = k + 1; i < n; i++) {
+			double f = a[i * n + k] / a[k * n + k];
+			for(j = k; j < n; j++) {
+				a[i * n + j] -= f * a[k * n + j];
+			}
+			b[i] -= f * b[k];
+		}
+	}
+
+	for(i = n - 1; i >= 0; i--) {
+		double sum = b[i];
+		for(j = i + 1; j < n; j++) {
+			sum -= a[i * n + j] * x[j];
+		}
+		x[i] = sum / a[i * n + i];
+	}
+
+	return true;
+}
+
+/* least squares of y = sum(c[k] * t^k) + sign * sum(d[k] * t^k), the second
+ * polynomial is only fitted if sign is given */
+static bool fit_poly(int order, const float *t, const float *y, const float *sign, int cnt,
+                     float *c, float *d)
+{
+	int n = (sign != NULL) ? 2 * (order + 1) : order + 1;
+	double a[FIT_UNKNOWN_MAX * FIT_UNKNOWN_MAX] = {0};
+	double b[FIT_UNKNOWN_MAX] = {0};
+	double x[FIT_UNKNOWN_MAX];
+
+	int s, i, j;
+	for(s = 0; s < cnt; s++) {
+		double basis[FIT_UNKNOWN_MAX];
+		double power = 1.0;
+		for(i = 0; i <= order; i++) {
+			basis[i] = power;
+			if(sign != NULL) basis[order + 1 + i] = power * sign[s];
+			power *= t[s];
+		}
+
+		for(i = 0; i < n; i++) {
+			for(j = 0; j < n; j++) {
+				a[i * n + j] += basis[i] * basis[j];
+			}
+			b[i] += basis[i] * y[s];
+		}
+	}
+
+	if(fit_solve(a, b, x, n) == false) {
+		return false;
+	}
+
+	for(i = 0; i <= IMU_CALIB_POLY_ORDER; i++) {
+		c[i] = (i <= order) ? (float)x[i] : 0.0f;
+		if(sign != NULL) d[i] = (i <= order) ? (float)x[order + 1 + i] : 0.0f;
+	}
+
+	return true;
+}
+
+static float fit_poly_eval(const float *c, float t)
+{
+	float y = 0.0f, power = 1.0f;
+
+	int i;
+	for(i = 0; i <= IMU_CALIB_POLY_ORDER; i++) {
+		y += c[i] * power;
+		power *= t;
+	}
+
+	return y;
+}
+
+static bool fit_invert3(const double *m, double *inv)
+{
+	double det = m[0] * (m[4] * m[8] - m[5] * m[7]) -
+	             m[1] * (m[3] * m[8] - m[5] * m[6]) +
+	             m[2] * (m[3] * m[7] - m[4] * m[6]);
+	if(fabs(det) < 1e-12) {
+		return false;
+	}
+
+	inv[0] = (m[4] * m[8] - m[5] * m[7]) / det;
+	inv[1] = (m[2] * m[7] - m[1] * m[8]) / det;
+	inv[2] = (m[1] * m[5] - m[2] * m[4]) / det;
+	inv[3] = (m[5] * m[6] - m[3] * m[8]) / det;
+	inv[4] = (m[0] * m[8] - m[2] * m[6]) / det;
+	inv[5] = (m[2] * m[3] - m[0] * m[5]) / det;
+	inv[6] = (m[3] * m[7] - m[4] * m[6]) / det;
+	inv[7] = (m[1] * m[6] - m[0] * m[7]) / det;
+	inv[8] = (m[0] * m[4] - m[1] * m[3]) / det;
+
+	return true;
+}
+
+static bool fit_gyro(int order, imu_calib_model_t *model)
+{
+	float *t = malloc(fit_sample_cnt * sizeof(float));
+	float *y = malloc(fit_sample_cnt * sizeof(float));
+
+	int s, axis;
+	for(axis = 0; axis < 3; axis++) {
+		for(s = 0; s < fit_sample_cnt; s++) {
+			t[s] = fit_samples[s].temp - IMU_CALIB_TEMP_REF;
+			y[s] = fit_samples[s].gyro[axis];
+		}
+		if(fit_poly(order, t, y, NULL, fit_sample_cnt, model->bias[axis], NULL) == false) {
+			fprintf(stderr, "gyro %c: the temperature range is too small for order %d\n",
+			        'x' + axis, order);
+			return false;
+		}
+
+		memset(model->sens[axis], 0, sizeof(model->sens[axis]));
+		model->sens[axis][0] = 1.0f / MPU6500G_2000dps;
+	}
+
+	memset(model->misalign, 0, sizeof(model->misalign));
+	model->misalign[0] = model->misalign[4] = model->misalign[8] = 1.0f;
+
+	free(t);
+	free(y);
+	return true;
+}
+
+static bool fit_accel(int order, imu_calib_model_t *model)
+{
+	float *t = malloc(fit_sample_cnt * sizeof(float));
+	float *y = malloc(fit_sample_cnt * sizeof(float));
+	float *sign = malloc(fit_sample_cnt * sizeof(float));
+
+	/* bias and sensitivity, the faces of one axis */
+	int s, i, j, axis;
+	for(axis = 0; axis < 3; axis++) {
+		int cnt = 0, face_cnt[2] = {0};
+		for(s = 0; s < fit_sample_cnt; s++) {
+			if(fit_samples[s].face / 2 != axis) {
+				continue;
+			}
+			face_cnt[fit_samples[s].face % 2]++;
+			t[cnt] = fit_samples[s].temp - IMU_CALIB_TEMP_REF;
+			y[cnt] = fit_samples[s].accel[axis];
+			sign[cnt] = (fit_samples[s].face % 2 == 0) ? +1.0f : -1.0f;
+			cnt++;
+		}
+
+		if(face_cnt[0] < FIT_FACE_MIN_CNT || face_cnt[1] < FIT_FACE_MIN_CNT) {
+			fprintf(stderr, "accel %c: +%c face %d windows, -%c face %d windows, %d required\n",
+			        'x' + axis, 'x' + axis, face_cnt[0], 'x' + axis, face_cnt[1], FIT_FACE_MIN_CNT);
+			return false;
+		}
+
+		/* raw = bias(t) + sign * g * sens(t) */
+		float g_sens[IMU_CALIB_POLY_ORDER + 1];
+		if(fit_poly(order, t, y, sign, cnt, model->bias[axis], g_sens) == false) {
+			fprintf(stderr, "accel %c: the temperature range is too small for order %d\n",
+			        'x' + axis, order);
+			return false;
+		}
+		for(i = 0; i <= IMU_CALIB_POLY_ORDER; i++) {
+			model->sens[axis][i] = g_sens[i] / GRAVITY;
+		}
+	}
+
+	/* misalignment = sum(ref * u') * inv(sum(u * u')) */
+	double ref_u[9] = {0}, u_u[9] = {0}, u_u_inv[9];
+	for(s = 0; s < fit_sample_cnt; s++) {
+		float ts = fit_samples[s].temp - IMU_CALIB_TEMP_REF;
+		double u[3], ref[3] = {0};
+		for(i = 0; i < 3; i++) {
+			u[i] = (fit_samples[s].accel[i] - fit_poly_eval(model->bias[i], ts)) /
+			       fit_poly_eval(model->sens[i], ts);
+		}
+		ref[fit_samples[s].face / 2] = (fit_samples[s].face % 2 == 0) ? +GRAVITY : -GRAVITY;
+
+		for(i = 0; i < 3; i++) {
+			for(j = 0; j < 3; j++) {
+				ref_u[i * 3 + j] += ref[i] * u[j];
+				u_u[i * 3 + j] += u[i] * u[j];
+			}
+		}
+	}
+	if(fit_invert3(u_u, u_u_inv) == false) {
+		fprintf(stderr, "accel: misalignment is not observable\n");
+		return false;
+	}
+	for(i = 0; i < 3; i++) {
+		for(j = 0; j < 3; j++) {
+			model->misalign[i * 3 + j] = (float)(ref_u[i * 3 + 0] * u_u_inv[0 * 3 + j] +
+			                                     ref_u[i * 3 + 1] * u_u_inv[1 * 3 + j] +
+			                                     ref_u[i * 3 + 2] * u_u_inv[2 * 3 + j]);
+		}
+	}
+
+	free(t);
+	free(y);
+	free(sign);
+	return true;
+}
+
+static int16_t fit_round(float raw)
+{
+	return (int16_t)lrintf(raw);
+}
+
+/* residuals through the firmware conversion: the accel norm against the
+ * gravity [m/s^2], the gyro against zero rate [deg/s]. the gyro bias of the
+ * firmware is measured at boot, so it is aligned at the first window */
+/* accel_rms [m/s^2], gyro_rms [deg/s] */
+static void fit_report(const char *label, const imu_calib_param_t *param,
+                       double *accel_rms, double *gyro_rms)
+{
+	imu_calib_lut_t accel_lut, gyro_lut;
+	imu_calib_lut_build(&accel_lut, &param->accel);
+	imu_calib_lut_build(&gyro_lut, &param->gyro);
+
+	imu_calib_kernel_t boot;
+	imu_calib_lut_lookup(&gyro_lut, fit_samples[0].temp, &boot);
+	float gyro_offset[3];
+	int i;
+	for(i = 0; i < 3; i++) {
+		gyro_offset[i] = fit_samples[0].gyro[i] - boot.bias[i];
+	}
+
+	double accel_sq = 0.0, accel_max = 0.0, gyro_sq = 0.0, gyro_max = 0.0;
+
+	int s;
+	for(s = 0; s < fit_sample_cnt; s++) {
+		fit_sample_t *sample = &fit_samples[s];
+		imu_calib_kernel_t kernel;
+		vector3d_f_t out;
+
+		imu_calib_lut_lookup(&accel_lut, sample->temp, &kernel);
+		vector3d_16_t accel = {
+			fit_round(sample->accel[0]), fit_round(sample->accel[1]), fit_round(sample->accel[2])
+		};
+		imu_calib_apply(&kernel, &accel, &out);
+		double err = fabs(sqrt(out.x * out.x + out.y * out.y + out.z * out.z) - GRAVITY);
+		accel_sq += err * err;
+		if(err > accel_max) accel_max = err;
+
+		imu_calib_lut_lookup(&gyro_lut, sample->temp, &kernel);
+		for(i = 0; i < 3; i++) {
+			kernel.bias[i] += gyro_offset[i];
+		}
+		vector3d_16_t gyro = {
+			fit_round(sample->gyro[0]), fit_round(sample->gyro[1]), fit_round(sample->gyro[2])
+		};
+		imu_calib_apply(&kernel, &gyro, &out);
+		err = sqrt(out.x * out.x + out.y * out.y + out.z * out.z);
+		gyro_sq += err * err;
+		if(err > gyro_max) gyro_max = err;
+	}
+
+	*accel_rms = sqrt(accel_sq / fit_sample_cnt);
+	*gyro_rms = sqrt(gyro_sq / fit_sample_cnt);
+	printf("  %-10s accel |g| error rms %.4f max %.4f [m/s^2], gyro rate rms %.4f max %.4f [deg/s]\n",
+	       label, *accel_rms, accel_max, *gyro_rms, gyro_max);
+}
+
+static void fit_print_model(const char *name, const imu_calib_model_t *model)
+{
+	int i, k;
+	for(i = 0; i < 3; i++) {
+		printf("  %s %c bias:", name, 'x' + i);
+		for(k = 0; k <= IMU_CALIB_POLY_ORDER; k++) printf(" %+.6e", model->bias[i][k]);
+		printf("\n  %s %c sens:", name, 'x' + i);
+		for(k = 0; k <= IMU_CALIB_POLY_ORDER; k++) printf(" %+.6e", model->sens[i][k]);
+		printf("\n");
+	}
+	for(i = 0; i < 3; i++) {
+		printf("  %s misalign: %+.6f %+.6f %+.6f\n", name, model->misalign[i * 3],
+		       model->misalign[i * 3 + 1], model->misalign[i * 3 + 2]);
+	}
+}
+
+/* same checksum as flash.c (fnv-1a) */
+static uint32_t fit_checksum(const uint8_t *data, size_t size)
+{
+	uint32_t hash = 2166136261u;
+
+	size_t i;
+	for(i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+/* | id (16 bits) | size (16 bits) | checksum (32 bits) | data, padded to words | */
+static bool fit_record_write(const char *path, const imu_calib_param_t *param)
+{
+	FILE *file = fopen(path, "wb");
+	if(file == NULL) {
+		fprintf(stderr, "%s: can not open\n", path);
+		return false;
+	}
+
+	uint32_t header[2] = {
+		((uint32_t)sizeof(*param) << 16) | FLASH_PARAM_IMU_CALIB,
+		fit_checksum((const uint8_t *)param, sizeof(*param))
+	};
+	uint8_t padding[3] = {0xff, 0xff, 0xff};
+
+	bool success = fwrite(header, sizeof(header), 1, file) == 1 &&
+	               fwrite(param, sizeof(*param), 1, file) == 1 &&
+	               fwrite(padding, (4 - sizeof(*param) % 4) % 4, 1, file) <= 1;
+	success &= fclose(file) == 0;
+
+	return success;
+}
+
+static void fit_usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n order] [-o record.bin] [-a accel_rms_max] [-g gyro_rms_max] log...\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int order = IMU_CALIB_POLY_ORDER;
+	const char *record_path = NULL;
+	double accel_rms_max = 0.0, gyro_rms_max = 0.0; //no bound
+
+	int opt;
+	while((opt = getopt(argc, argv, "a:g:n:o:")) != -1) {
+		switch(opt) {
+		case 'a':
+			accel_rms_max = atof(optarg);
+			break;
+		case 'g':
+			gyro_rms_max = atof(optarg);
+			break;
+		case 'n':
+			order = atoi(optarg);
+			if(order < 0 || order > IMU_CALIB_POLY_ORDER) {
+				fprintf(stderr, "order has to be within 0 ~ %d\n", IMU_CALIB_POLY_ORDER);
+				return 1;
+			}
+			break;
+		case 'o':
+			record_path = optarg;
+			break;
+		default:
+			fit_usage(argv[0]);
+		}
+	}
+	if(optind >= argc) {
+		fit_usage(argv[0]);
+	}
+
+	int i;
+	for(i = optind; i < argc; i++) {
+		fit_log_load(argv[i]);
+	}
+	if(fit_sample_cnt == 0) {
+		fprintf(stderr, "no windows\n");
+		return 1;
+	}
+
+	float temp_min = fit_samples[0].temp, temp_max = fit_samples[0].temp;
+	for(i = 1; i < fit_sample_cnt; i++) {
+		if(fit_samples[i].temp < temp_min) temp_min = fit_samples[i].temp;
+		if(fit_samples[i].temp > temp_max) temp_max = fit_samples[i].temp;
+	}
+	printf("temperature %.1f ~ %.1f degC, table %.1f ~ %.1f degC\n", temp_min, temp_max,
+	       IMU_CALIB_LUT_TEMP_MIN,
+	       IMU_CALIB_LUT_TEMP_MIN + (IMU_CALIB_LUT_SIZE - 1) * IMU_CALIB_LUT_TEMP_STEP);
+
+	imu_calib_param_t param;
+	if(fit_gyro(order, &param.gyro) == false || fit_accel(order, &param.accel) == false) {
+		return 1;
+	}
+
+	printf("model, polynomials in ascending powers of (temp - %.1f degC):\n", IMU_CALIB_TEMP_REF);
+	fit_print_model("accel", &param.accel);
+	fit_print_model("gyro", &param.gyro);
+
+	/* the firmware default is a constant bias and scale */
+	imu_calib_param_t constant = param;
+	for(i = 0; i < 3; i++) {
+		int k;
+		float t0 = (temp_min + temp_max) * 0.5f - IMU_CALIB_TEMP_REF;
+		constant.accel.bias[i][0] = fit_poly_eval(param.accel.bias[i], t0);
+		constant.accel.sens[i][0] = fit_poly_eval(param.accel.sens[i], t0);
+		constant.gyro.bias[i][0] = 0.0f;
+		for(k = 1; k <= IMU_CALIB_POLY_ORDER; k++) {
+			constant.accel.bias[i][k] = constant.accel.sens[i][k] = constant.gyro.bias[i][k] = 0.0f;
+		}
+	}
+
+	printf("residuals:\n");
+	double accel_rms, gyro_rms;
+	fit_report("constant", &constant, &accel_rms, &gyro_rms);
+	fit_report("fitted", &param, &accel_rms, &gyro_rms);
+
+	if(record_path != NULL) {
+		if(fit_record_write(record_path, &param) == false) {
+			fprintf(stderr, "%s: write failed\n", record_path);
+			return 1;
+		}
+		printf("flash record written to %s (id %d, %d bytes)\n", record_path, FLASH_PARAM_IMU_CALIB,
+		       (int)sizeof(param));
+	}
+
+	if(accel_rms_max > 0.0 || gyro_rms_max > 0.0) {
+		bool pass = (accel_rms_max <= 0.0 || accel_rms <= accel_rms_max) &&
+		            (gyro_rms_max <= 0.0 || gyro_rms <= gyro_rms_max);
+		printf("%s\n", (pass == true) ? "pass" : "FAIL");
+		return (pass == true) ? 0 : 1;
+	}
+
+	return 0;
+}
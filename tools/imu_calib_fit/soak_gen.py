@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+# writes a synthetic thermal soak log in the format of
+# send_imu_thermal_calib_debug_message(), the input of imu_calib_fit's check.
+#
+# the board rests on each of its 6 faces while the temperature sweeps -10 to
+# 70 degC. the raw samples follow the model of common/imu_calib.h with known
+# cubic bias and sensitivity drifts and a misalignment, plus the noise of a
+# stationary window. the lines end in "\n\r" and a screen line is mixed in,
+# as a capture of the debug link has them.
+#
+# usage:
+#   python3 soak_gen.py > soak.csv
+#   python3 soak_gen.py --model   (prints the model the fit has to recover)
+
+import random
+import sys
+
+GRAVITY = 9.8           # [m/s^2], same as imu_calib_fit.c
+TEMP_REF = 25.0         # IMU_CALIB_TEMP_REF [degC]
+WINDOWS_PER_FACE = 60
+ACCEL_NOISE = 0.3       # standard deviation of a window mean [lsb]
+GYRO_NOISE = 0.05
+
+# body = MISALIGN * diag(1 / sens) * (raw - bias), so the sensor axes see MISALIGN^-1 * g
+MISALIGN = [[1.0, 0.01, -0.005],
+            [0.004, 1.0, 0.008],
+            [-0.006, 0.003, 1.0]]
+
+# polynomials in ascending powers of (temp - TEMP_REF)
+ACCEL_BIAS = [[450.0, 2.0, -0.02, 1e-4],
+              [200.0, -1.5, 0.01, 0.0],
+              [480.0, 3.0, 0.0, 0.0]]        # [lsb]
+ACCEL_SENS = [2065.0, 2061.0, 2300.0]        # at TEMP_REF [lsb/g]
+ACCEL_SENS_DRIFT = [2e-4, -1e-4, 3e-4]       # [1/degC]
+GYRO_BIAS = [[-12.0, 0.3, 0.004, 0.0],
+             [5.0, -0.2, 0.0, 0.0],
+             [20.0, 0.1, -0.002, 2e-5]]      # [lsb]
+
+def poly(c, t):
+    return sum(c[k] * t ** k for k in range(len(c)))
+
+def inverse3(m):
+    a, b, c = m[0]
+    d, e, f = m[1]
+    g, h, i = m[2]
+    det = a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g)
+    return [[(e * i - f * h) / det, (c * h - b * i) / det, (b * f - c * e) / det],
+            [(f * g - d * i) / det, (a * i - c * g) / det, (c * d - a * f) / det],
+            [(d * h - e * g) / det, (b * g - a * h) / det, (a * e - b * d) / det]]
+
+# [lsb per m/s^2], linear over the temperature
+def accel_sens(axis, t):
+    return ACCEL_SENS[axis] / GRAVITY * (1.0 + ACCEL_SENS_DRIFT[axis] * t)
+
+def print_model():
+    for i in range(3):
+        print('accel %c bias: %s' % ('xyz'[i], ' '.join('%+.6e' % c for c in ACCEL_BIAS[i])))
+        print('accel %c sens: %+.6e %+.6e' % ('xyz'[i], accel_sens(i, 0.0), accel_sens(i, 1.0) - accel_sens(i, 0.0)))
+    for row in MISALIGN:
+        print('accel misalign: %s' % ' '.join('%+.6f' % c for c in row))
+    for i in range(3):
+        print('gyro %c bias: %s' % ('xyz'[i], ' '.join('%+.6e' % c for c in GYRO_BIAS[i])))
+
+def write_log(out):
+    random.seed(1)
+    misalign_inv = inverse3(MISALIGN)
+
+    out.write('garbage line from screen\n')
+    for face in range(6):
+        gravity = [0.0, 0.0, 0.0]
+        gravity[face // 2] = GRAVITY if face % 2 == 0 else -GRAVITY
+        sensor = [sum(misalign_inv[i][j] * gravity[j] for j in range(3)) for i in range(3)]
+
+        for n in range(WINDOWS_PER_FACE):
+            temp = -10.0 + 80.0 * n / (WINDOWS_PER_FACE - 1)
+            t = temp - TEMP_REF
+            accel = [poly(ACCEL_BIAS[i], t) + accel_sens(i, t) * sensor[i] + random.gauss(0.0, ACCEL_NOISE)
+                     for i in range(3)]
+            gyro = [poly(GYRO_BIAS[i], t) + random.gauss(0.0, GYRO_NOISE) for i in range(3)]
+            out.write('%.2f, %.2f, %.2f, %.2f, %.2f, %.2f, %.2f\n\r' % (temp, *accel, *gyro))
+
+if __name__ == '__main__':
+    if len(sys.argv) > 1 and sys.argv[1] == '--model':
+        print_model()
+    else:
+        write_log(sys.stdout)
@@ -0,0 +1,456 @@
+/* fits the hard and soft iron calibration of the hmc5983 from a rotation log
+ * and writes it as a flash parameter record.
+ *
+ * usage: mag_calib_fit [-o record.bin] log...
+ *        mag_calib_fit -t    fits a synthetic log with known distortion, make check
+ *
+ * the log is the output of send_mag_calib_debug_message(), one line per
+ * magnetometer sample, other lines are skipped:
+ * mag x, y, z of the chip frame [lsb]
+ * the vehicle is turned slowly through every orientation away from steel and
+ * currents, with the motors and the battery in place since they are part of
+ * the hard and soft iron.
+ *
+ * the samples lie on an ellipsoid (raw - c)' * M * (raw - c) = 1. the general
+ * quadric is fitted by least squares, c is the hard iron and the symmetric
+ * square root of M, scaled to keep the mean field magnitude, is the soft iron.
+ *
+ * the record is appended to a parameter sector image, e.g. after the one of
+ * tools/imu_calib_fit, since flashing it alone replaces the whole sector:
+ * cat imu_record.bin mag_record.bin > param.bin
+ * st-flash write param.bin 0x081E0000 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "hmc5983.h"
+#include "flash.h"
+
+#define FIT_SAMPLE_MIN 50
+#define FIT_UNKNOWN_CNT 9
+
+/* synthetic log of -t */
+#define TEST_SAMPLE_CNT 2000
+#define TEST_FIELD 685.0      //0.5 gauss [lsb]
+#define TEST_NOISE 2.0        //[lsb]
+#define TEST_HARD_IRON_MAX 3.0  //error of the fitted hard iron [lsb]
+#define TEST_RADIUS_STD_MAX 0.005 //of the calibrated magnitude, relative
+
+typedef struct {
+	double raw[3]; //[lsb]
+} fit_sample_t;
+
+static fit_sample_t *fit_samples;
+static int fit_sample_cnt;
+
+static void fit_sample_add(double x, double y, double z)
+{
+	fit_samples = realloc(fit_samples, (fit_sample_cnt + 1) * sizeof(fit_sample_t));
+	fit_samples[fit_sample_cnt].raw[0] = x;
+	fit_samples[fit_sample_cnt].raw[1] = y;
+	fit_samples[fit_sample_cnt].raw[2] = z;
+	fit_sample_cnt++;
+}
+
+static void fit_log_load(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if(file == NULL) {
+		fprintf(stderr, "%s: can not open\n", path);
+		exit(1);
+	}
+
+	int skipped = 0, loaded = 0;
+	char line[256];
+	while(fgets(line, sizeof(line), file) != NULL) {
+		int x, y, z;
+		if(sscanf(line, "%d, %d, %d", &x, &y, &z) != 3) {
+			skipped++;
+			continue;
+		}
+
+		fit_sample_add(x, y, z);
+		loaded++;
+	}
+	fclose(file);
+
+	printf("%s: %d samples loaded, %d lines skipped\n", path, loaded, skipped);
+}
+
+/* solves the normal equations a * x = b of size n in place, gaussian
+ * elimination with partial pivoting, false if singular */
+static bool fit_solve(double *a, double *b, double *x, int n)
+{
+	int i, j, k;
+	for(k = 0; k < n; k++) {
+		int pivot = k;
+		for(i = k + 1; i < n; i++) {
+			if(fabs(a[i * n + k]) > fabs(a[pivot * n + k])) pivot = i;
+		}
+		if(fabs(a[pivot * n + k]) < 1e-12 * fabs(a[0])) {
+			return false;
+		}
+
+		for(j = 0; j < n; j++) {
+			double tmp = a[k * n + j];
+			a[k * n + j] = a[pivot * n + j];
+			a[pivot * n + j] = tmp;
+		}
+		double tmp = b[k];
+		b[k] = b[pivot];
+		b[pivot] = tmp;
+
+		for(i = k + 1; i < n; i++) {
+			double f = a[i * n + k] / a[k * n + k];
+			for(j = k; j < n; j++) {
+				a[i * n + j] -= f * a[k * n + j];
+			}
+			b[i] -= f * b[k];
+		}
+	}
+
+	for(i = n - 1; i >= 0; i--) {
+		double sum = b[i];
+		for(j = i + 1; j < n; j++) {
+			sum -= a[i * n + j] * x[j];
+		}
+		x[i] = sum / a[i * n + i];
+	}
+
+	return true;
+}
+
+/* eigen decomposition of a symmetric 3x3 matrix by jacobi rotations,
+ * m = v * diag(e) * v', m is destroyed */
+static void fit_eigen3(double m[3][3], double e[3], double v[3][3])
+{
+	int i, j, k, sweep;
+	for(i = 0; i < 3; i++) {
+		for(j = 0; j < 3; j++) {
+			v[i][j] = (i == j) ? 1.0 : 0.0;
+		}
+	}
+
+	for(sweep = 0; sweep < 50; sweep++) {
+		double off = m[0][1] * m[0][1] + m[0][2] * m[0][2] + m[1][2] * m[1][2];
+		if(off < 1e-30) {
+			break;
+		}
+
+		int p, q;
+		for(p = 0; p < 2; p++) {
+			for(q = p + 1; q < 3; q++) {
+				if(m[p][q] == 0.0) {
+					continue;
+				}
+
+				double theta = (m[q][q] - m[p][p]) / (2.0 * m[p][q]);
+				double t = ((theta >= 0.0) ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+				double c = 1.0 / sqrt(t * t + 1.0), s = t * c;
+
+				for(k = 0; k < 3; k++) {
+					double mkp = m[k][p], mkq = m[k][q];
+					m[k][p] = c * mkp - s * mkq;
+					m[k][q] = s * mkp + c * mkq;
+				}
+				for(k = 0; k < 3; k++) {
+					double mpk = m[p][k], mqk = m[q][k];
+					m[p][k] = c * mpk - s * mqk;
+					m[q][k] = s * mpk + c * mqk;
+				}
+				for(k = 0; k < 3; k++) {
+					double vkp = v[k][p], vkq = v[k][q];
+					v[k][p] = c * vkp - s * vkq;
+					v[k][q] = s * vkp + c * vkq;
+				}
+			}
+		}
+	}
+
+	for(i = 0; i < 3; i++) {
+		e[i] = m[i][i];
+	}
+}
+
+/* a x^2 + b y^2 + c z^2 + 2d xy + 2e xz + 2f yz + 2g x + 2h y + 2i z = 1 */
+static bool fit_ellipsoid(hmc5983_calib_param_t *param)
+{
+	if(fit_sample_cnt < FIT_SAMPLE_MIN) {
+		fprintf(stderr, "%d samples, at least %d needed\n", fit_sample_cnt, FIT_SAMPLE_MIN);
+		return false;
+	}
+
+	/* the samples are centered on their mean for the conditioning */
+	double mean[3] = {0.0, 0.0, 0.0};
+	int i, j, k;
+	for(i = 0; i < fit_sample_cnt; i++) {
+		for(k = 0; k < 3; k++) {
+			mean[k] += fit_samples[i].raw[k] / fit_sample_cnt;
+		}
+	}
+
+	double ata[FIT_UNKNOWN_CNT * FIT_UNKNOWN_CNT] = {0.0}, atb[FIT_UNKNOWN_CNT] = {0.0};
+	for(i = 0; i < fit_sample_cnt; i++) {
+		double x = fit_samples[i].raw[0] - mean[0];
+		double y = fit_samples[i].raw[1] - mean[1];
+		double z = fit_samples[i].raw[2] - mean[2];
+		double row[FIT_UNKNOWN_CNT] = {x * x, y * y, z * z, 2 * x * y, 2 * x * z, 2 * y * z, 2 * x, 2 * y, 2 * z};
+
+		for(j = 0; j < FIT_UNKNOWN_CNT; j++) {
+			for(k = 0; k < FIT_UNKNOWN_CNT; k++) {
+				ata[j * FIT_UNKNOWN_CNT + k] += row[j] * row[k];
+			}
+			atb[j] += row[j];
+		}
+	}
+
+	double u[FIT_UNKNOWN_CNT];
+	if(fit_solve(ata, atb, u, FIT_UNKNOWN_CNT) == false) {
+		fprintf(stderr, "the samples do not span an ellipsoid, turn through more orientations\n");
+		return false;
+	}
+
+	double q[3][3] = {{u[0], u[3], u[4]}, {u[3], u[1], u[5]}, {u[4], u[5], u[2]}};
+	double g[3] = {u[6], u[7], u[8]};
+
+	/* center: q * c = -g */
+	double qa[9] = {q[0][0], q[0][1], q[0][2], q[1][0], q[1][1], q[1][2], q[2][0], q[2][1], q[2][2]};
+	double rhs[3] = {-g[0], -g[1], -g[2]}, center[3];
+	if(fit_solve(qa, rhs, center, 3) == false) {
+		return false;
+	}
+
+	/* (p - c)' * q * (p - c) = 1 + c' * q * c */
+	double scale = 1.0;
+	for(j = 0; j < 3; j++) {
+		for(k = 0; k < 3; k++) {
+			scale += center[j] * q[j][k] * center[k];
+		}
+	}
+
+	double e[3], v[3][3];
+	for(j = 0; j < 3; j++) {
+		for(k = 0; k < 3; k++) {
+			q[j][k] /= scale;
+		}
+	}
+	fit_eigen3(q, e, v);
+	if(e[0] <= 0.0 || e[1] <= 0.0 || e[2] <= 0.0) {
+		fprintf(stderr, "the fitted quadric is not an ellipsoid\n");
+		return false;
+	}
+
+	/* the symmetric square root maps the ellipsoid on the unit sphere, the
+	 * geometric mean of the semi-axes keeps the field magnitude */
+	double radius = pow(e[0] * e[1] * e[2], -1.0 / 6.0);
+	for(j = 0; j < 3; j++) {
+		param->hard_iron[j] = center[j] + mean[j];
+		for(k = 0; k < 3; k++) {
+			double sum = 0.0;
+			for(i = 0; i < 3; i++) {
+				sum += v[j][i] * sqrt(e[i]) * v[k][i];
+			}
+			param->soft_iron[j * 3 + k] = sum * radius;
+		}
+	}
+
+	return true;
+}
+
+/* magnitude of the samples after the calibration, relative standard deviation */
+static double fit_radius_spread(const hmc5983_calib_param_t *param, double *mean_radius)
+{
+	double sum = 0.0, sq_sum = 0.0;
+
+	int i, j, k;
+	for(i = 0; i < fit_sample_cnt; i++) {
+		double r2 = 0.0;
+		for(j = 0; j < 3; j++) {
+			double m = 0.0;
+			for(k = 0; k < 3; k++) {
+				m += param->soft_iron[j * 3 + k] * (fit_samples[i].raw[k] - param->hard_iron[k]);
+			}
+			r2 += m * m;
+		}
+		sum += sqrt(r2);
+		sq_sum += r2;
+	}
+
+	*mean_radius = sum / fit_sample_cnt;
+	return sqrt(sq_sum / fit_sample_cnt - *mean_radius * *mean_radius) / *mean_radius;
+}
+
+static void fit_report(const char *label, const hmc5983_calib_param_t *param)
+{
+	double radius;
+	double spread = fit_radius_spread(param, &radius);
+	printf("%-10s field %.1f lsb (%.3f gauss), magnitude spread %.2f%%\n", label, radius,
+	       radius * HMC5983_SCALE_1, spread * 100.0);
+}
+
+static double uniform(void)
+{
+	return (double)rand() / RAND_MAX;
+}
+
+/* sphere distorted by a known soft and hard iron, plus noise */
+static void fit_test_generate(double hard_iron[3])
+{
+	const double soft_iron[3][3] = {
+		{1.10, 0.05, -0.03},
+		{0.02, 0.92, 0.04},
+		{-0.06, 0.03, 1.04}
+	};
+	hard_iron[0] = 120.0;
+	hard_iron[1] = -85.0;
+	hard_iron[2] = 40.0;
+
+	srand(1);
+
+	int i;
+	for(i = 0; i < TEST_SAMPLE_CNT; i++) {
+		double z = 2.0 * uniform() - 1.0, phi = 2.0 * M_PI * uniform();
+		double s = sqrt(1.0 - z * z);
+		double field[3] = {TEST_FIELD * s * cos(phi), TEST_FIELD * s * sin(phi), TEST_FIELD * z};
+
+		double raw[3];
+		int j, k;
+		for(j = 0; j < 3; j++) {
+			raw[j] = hard_iron[j];
+			for(k = 0; k < 3; k++) {
+				raw[j] += soft_iron[j][k] * field[k];
+			}
+			raw[j] += TEST_NOISE * (uniform() + uniform() + uniform() - 1.5) * 2.0;
+			raw[j] = round(raw[j]);
+		}
+		fit_sample_add(raw[0], raw[1], raw[2]);
+	}
+}
+
+/* | id (16 bits) | size (16 bits) | checksum (32 bits) | data, padded to words |
+ * same checksum as flash.c (fnv-1a) */
+static uint32_t fit_checksum(const uint8_t *data, size_t size)
+{
+	uint32_t hash = 2166136261u;
+
+	size_t i;
+	for(i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+static bool fit_record_write(const char *path, const hmc5983_calib_param_t *param)
+{
+	FILE *file = fopen(path, "wb");
+	if(file == NULL) {
+		fprintf(stderr, "%s: can not open\n", path);
+		return false;
+	}
+
+	uint32_t header[2] = {
+		((uint32_t)sizeof(*param) << 16) | FLASH_PARAM_MAG_CALIB,
+		fit_checksum((const uint8_t *)param, sizeof(*param))
+	};
+	uint8_t padding[3] = {0xff, 0xff, 0xff};
+
+	bool success = fwrite(header, sizeof(header), 1, file) == 1 &&
+	               fwrite(param, sizeof(*param), 1, file) == 1 &&
+	               fwrite(padding, (4 - sizeof(*param) % 4) % 4, 1, file) <= 1;
+	success &= fclose(file) == 0;
+
+	return success;
+}
+
+static void fit_usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-o record.bin] log...\n"
+	        "       %s -t\n", name, name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *record_path = NULL;
+	bool test = false;
+
+	int opt;
+	while((opt = getopt(argc, argv, "o:t")) != -1) {
+		switch(opt) {
+		case 'o':
+			record_path = optarg;
+			break;
+		case 't':
+			test = true;
+			break;
+		default:
+			fit_usage(argv[0]);
+		}
+	}
+	if(optind >= argc && test == false) {
+		fit_usage(argv[0]);
+	}
+
+	double test_hard_iron[3];
+	int i;
+	if(test == true) {
+		fit_test_generate(test_hard_iron);
+		printf("synthetic log: %d samples\n", fit_sample_cnt);
+	} else {
+		for(i = optind; i < argc; i++) {
+			fit_log_load(argv[i]);
+		}
+	}
+
+	hmc5983_calib_param_t param;
+	if(fit_ellipsoid(&param) == false) {
+		return 1;
+	}
+
+	printf("hard iron [lsb]: %.1f, %.1f, %.1f\n", param.hard_iron[0], param.hard_iron[1],
+	       param.hard_iron[2]);
+	printf("soft iron:\n");
+	for(i = 0; i < 3; i++) {
+		printf("  %+.5f %+.5f %+.5f\n", param.soft_iron[i * 3], param.soft_iron[i * 3 + 1],
+		       param.soft_iron[i * 3 + 2]);
+	}
+
+	const hmc5983_calib_param_t none = {
+		.hard_iron = {0, 0, 0},
+		.soft_iron = {1, 0, 0, 0, 1, 0, 0, 0, 1}
+	};
+	fit_report("raw", &none);
+	fit_report("fitted", &param);
+
+	if(test == true) {
+		double radius;
+		double spread = fit_radius_spread(&param, &radius);
+		double hard_iron_error = 0.0;
+		for(i = 0; i < 3; i++) {
+			hard_iron_error = fmax(hard_iron_error, fabs(param.hard_iron[i] - test_hard_iron[i]));
+		}
+
+		bool pass = hard_iron_error <= TEST_HARD_IRON_MAX && spread <= TEST_RADIUS_STD_MAX;
+		printf("hard iron error %.2f lsb, bound %.1f, magnitude spread %.3f%%, bound %.1f%%\n",
+		       hard_iron_error, TEST_HARD_IRON_MAX, spread * 100.0, TEST_RADIUS_STD_MAX * 100.0);
+		printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+		return (pass == true) ? 0 : 1;
+	}
+
+	if(record_path != NULL) {
+		if(fit_record_write(record_path, &param) == false) {
+			fprintf(stderr, "%s: write failed\n", record_path);
+			return 1;
+		}
+		printf("flash record written to %s (id %d, %d bytes)\n", record_path, FLASH_PARAM_MAG_CALIB,
+		       (int)sizeof(param));
+	}
+
+	return 0;
+}
@@ -0,0 +1,310 @@
+/* checks the generated mixer matrix of one airframe against the
+ * pseudo-inverse of its allocation matrix and runs the mixer of the flight
+ * code through unsaturated and saturated commands.
+ *
+ * usage: make check
+ *
+ * the allocation matrix is rebuilt from the motor layout of
+ * octave/mixer_matrix_gen.m and inverted in double precision, so the check
+ * does not depend on octave. returns non-zero if any check fails */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include "mixer_matrix.h"
+#include "proj_config.h"
+
+#define DEG_TO_RAD (M_PI / 180.0)
+
+#define MATRIX_TOLERANCE 1e-5 //the header is printed with 6 decimals, summed over the motors
+#define MIX_TOLERANCE 1e-4    //float mixer against the double reference
+#define MIX_TEST_CNT 1000000
+
+/* motor angle from the nose toward the right side and spin direction seen
+ * from the top (ccw = +1), same layouts as octave/mixer_matrix_gen.m */
+#if (SELECT_UAV_TYPE == UAV_TYPE_QUADROTOR)
+#define AIRFRAME_NAME "quadrotor"
+static const double motor_angle[] = {45, -45, -135, 135};
+static const double motor_spin[] = {-1, 1, -1, 1};
+#elif (SELECT_UAV_TYPE == UAV_TYPE_HEXAROTOR)
+#define AIRFRAME_NAME "hexarotor"
+static const double motor_angle[] = {30, -30, -90, -150, 150, 90};
+static const double motor_spin[] = {-1, 1, -1, 1, -1, 1};
+#elif (SELECT_UAV_TYPE == UAV_TYPE_OCTOROTOR)
+#define AIRFRAME_NAME "octorotor"
+static const double motor_angle[] = {22.5, -22.5, -67.5, -112.5, -157.5, 157.5, 112.5, 67.5};
+static const double motor_spin[] = {-1, 1, -1, 1, -1, 1, -1, 1};
+#endif
+
+static const float mixer_matrix_gen[MIXER_MOTOR_CNT][4] = MIXER_MATRIX;
+static const float mixer_scale[4] = MIXER_COLUMN_SCALE;
+
+static double allocation[4][MIXER_MOTOR_CNT];
+static double allocation_pinv[MIXER_MOTOR_CNT][4];
+
+#if (MIXER_MOTOR_CNT <= 6)
+#include "mixer.h"
+
+/* the mixer writes the motors at the end, nothing is connected on the host */
+void set_motor_pwm_pulse(volatile uint32_t *motor, uint16_t pulse)
+{
+}
+
+void motor_output_trigger(void)
+{
+}
+#endif
+
+/* gauss-jordan with partial pivoting, the 4x4 normal matrix is well conditioned */
+static bool invert_4x4(double m[4][4], double inv[4][4])
+{
+	int i, j, k;
+	for(i = 0; i < 4; i++) {
+		for(j = 0; j < 4; j++) {
+			inv[i][j] = (i == j) ? 1.0 : 0.0;
+		}
+	}
+
+	for(k = 0; k < 4; k++) {
+		int pivot = k;
+		for(i = k + 1; i < 4; i++) {
+			if(fabs(m[i][k]) > fabs(m[pivot][k])) {
+				pivot = i;
+			}
+		}
+		if(fabs(m[pivot][k]) < 1e-12) {
+			return false;
+		}
+
+		for(j = 0; j < 4; j++) {
+			double tmp = m[k][j];
+			m[k][j] = m[pivot][j];
+			m[pivot][j] = tmp;
+			tmp = inv[k][j];
+			inv[k][j] = inv[pivot][j];
+			inv[pivot][j] = tmp;
+		}
+
+		double div = 1.0 / m[k][k];
+		for(j = 0; j < 4; j++) {
+			m[k][j] *= div;
+			inv[k][j] *= div;
+		}
+
+		for(i = 0; i < 4; i++) {
+			if(i == k) {
+				continue;
+			}
+			double factor = m[i][k];
+			for(j = 0; j < 4; j++) {
+				m[i][j] -= factor * m[k][j];
+				inv[i][j] -= factor * inv[k][j];
+			}
+		}
+	}
+
+	return true;
+}
+
+/* [f_total; m_roll; m_pitch; m_yaw] = A * f with unit arm length, the matrix
+ * has full row rank so pinv(A) = A' * inv(A * A') */
+static bool allocation_init(void)
+{
+	int i, j, k;
+	for(i = 0; i < MIXER_MOTOR_CNT; i++) {
+		allocation[0][i] = 1.0;
+		allocation[1][i] = -sin(motor_angle[i] * DEG_TO_RAD);
+		allocation[2][i] = cos(motor_angle[i] * DEG_TO_RAD);
+		allocation[3][i] = motor_spin[i];
+	}
+
+	double normal[4][4], normal_inv[4][4];
+	for(i = 0; i < 4; i++) {
+		for(j = 0; j < 4; j++) {
+			normal[i][j] = 0.0;
+			for(k = 0; k < MIXER_MOTOR_CNT; k++) {
+				normal[i][j] += allocation[i][k] * allocation[j][k];
+			}
+		}
+	}
+
+	if(invert_4x4(normal, normal_inv) == false) {
+		return false;
+	}
+
+	for(i = 0; i < MIXER_MOTOR_CNT; i++) {
+		for(j = 0; j < 4; j++) {
+			allocation_pinv[i][j] = 0.0;
+			for(k = 0; k < 4; k++) {
+				allocation_pinv[i][j] += allocation[k][i] * normal_inv[k][j];
+			}
+		}
+	}
+
+	return true;
+}
+
+/* the generated matrix times its column scales must be the pseudo-inverse */
+static bool check_matrix(void)
+{
+	double max_err = 0.0, max_identity_err = 0.0;
+
+	int i, j, k;
+	for(i = 0; i < MIXER_MOTOR_CNT; i++) {
+		for(j = 0; j < 4; j++) {
+			double err = fabs((double)mixer_matrix_gen[i][j] * mixer_scale[j] - allocation_pinv[i][j]);
+			max_err = (err > max_err) ? err : max_err;
+		}
+	}
+
+	for(i = 0; i < 4; i++) {
+		for(j = 0; j < 4; j++) {
+			double sum = 0.0;
+			for(k = 0; k < MIXER_MOTOR_CNT; k++) {
+				sum += allocation[i][k] * mixer_matrix_gen[k][j] * mixer_scale[j];
+			}
+			double err = fabs(sum - ((i == j) ? 1.0 : 0.0));
+			max_identity_err = (err > max_identity_err) ? err : max_identity_err;
+		}
+	}
+
+	printf("matrix: max |M * diag(scale) - pinv(A)| = %.2e, max |A * M * diag(scale) - I| = %.2e\n",
+	       max_err, max_identity_err);
+
+	return (max_err < MATRIX_TOLERANCE) && (max_identity_err < MATRIX_TOLERANCE);
+}
+
+#if (MIXER_MOTOR_CNT <= 6)
+static float rand_range(float min, float max)
+{
+	return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+}
+
+/* force and moments of the outputs above output_min, in the mixer input unit */
+static void outputs_to_commands(float *outputs, float output_min, double *commands)
+{
+	int i, j;
+	for(i = 0; i < 4; i++) {
+		double sum = 0.0;
+		for(j = 0; j < MIXER_MOTOR_CNT; j++) {
+			sum += allocation[i][j] * (outputs[j] - output_min);
+		}
+		commands[i] = sum * mixer_scale[i];
+	}
+}
+
+/* commands inside the output range must come out exactly */
+static bool check_unsaturated(void)
+{
+	const float output_min = 0.0f, output_max = 1000.0f;
+	double max_err = 0.0;
+
+	int n;
+	for(n = 0; n < MIX_TEST_CNT; n++) {
+		float cmd[4] = {
+			rand_range(400.0f, 600.0f),
+			rand_range(-50.0f, 50.0f),
+			rand_range(-50.0f, 50.0f),
+			rand_range(-50.0f, 50.0f)
+		};
+
+		float outputs[MIXER_MOTOR_CNT];
+		mixer_allocate(outputs, cmd[0], cmd[1], cmd[2], cmd[3], output_min, output_max);
+
+		double result[4];
+		outputs_to_commands(outputs, output_min, result);
+
+		int i;
+		for(i = 0; i < 4; i++) {
+			double err = fabs(result[i] - cmd[i]) / output_max;
+			max_err = (err > max_err) ? err : max_err;
+		}
+	}
+
+	printf("unsaturated: max relative command error = %.2e\n", max_err);
+
+	return max_err < MIX_TOLERANCE;
+}
+
+/* saturated commands: outputs stay in range, roll/pitch keep their direction
+ * and ratio, and are only reduced if they alone exceed the range */
+static bool check_saturated(void)
+{
+	const float output_min = 0.0f, output_max = 1000.0f;
+	long range_fail = 0, direction_fail = 0, priority_fail = 0;
+
+	int n;
+	for(n = 0; n < MIX_TEST_CNT; n++) {
+		float cmd[4] = {
+			rand_range(0.0f, 1000.0f),
+			rand_range(-600.0f, 600.0f),
+			rand_range(-600.0f, 600.0f),
+			rand_range(-600.0f, 600.0f)
+		};
+
+		float outputs[MIXER_MOTOR_CNT];
+		mixer_allocate(outputs, cmd[0], cmd[1], cmd[2], cmd[3], output_min, output_max);
+
+		int i;
+		float rp_min = 0.0f, rp_max = 0.0f;
+		for(i = 0; i < MIXER_MOTOR_CNT; i++) {
+			if(outputs[i] < output_min - 1e-3f || outputs[i] > output_max + 1e-3f) {
+				range_fail++;
+				break;
+			}
+			float rp = mixer_matrix_gen[i][1] * cmd[1] + mixer_matrix_gen[i][2] * cmd[2];
+			rp_min = (i == 0 || rp < rp_min) ? rp : rp_min;
+			rp_max = (i == 0 || rp > rp_max) ? rp : rp_max;
+		}
+
+		double result[4];
+		outputs_to_commands(outputs, output_min, result);
+
+		/* same direction and roll to pitch ratio as commanded */
+		double cross = result[1] * cmd[2] - result[2] * cmd[1];
+		if((result[1] * cmd[1] < -1e-3) || (result[2] * cmd[2] < -1e-3) ||
+		   (fabs(cross) > MIX_TOLERANCE * 600.0 * 600.0)) {
+			direction_fail++;
+		}
+
+		/* roll/pitch that fit into the range are never traded for yaw or collective */
+		if((rp_max - rp_min) <= (output_max - output_min)) {
+			if((fabs(result[1] - cmd[1]) > MIX_TOLERANCE * output_max) ||
+			   (fabs(result[2] - cmd[2]) > MIX_TOLERANCE * output_max)) {
+				priority_fail++;
+			}
+		}
+	}
+
+	printf("saturated: out of range %ld, roll/pitch direction %ld, roll/pitch priority %ld of %d\n",
+	       range_fail, direction_fail, priority_fail, MIX_TEST_CNT);
+
+	return (range_fail == 0) && (direction_fail == 0) && (priority_fail == 0);
+}
+#endif
+
+int main(void)
+{
+	printf("%s, %d motors\n", AIRFRAME_NAME, MIXER_MOTOR_CNT);
+
+	if(allocation_init() == false) {
+		printf("allocation matrix is singular\n");
+		return 1;
+	}
+
+	bool pass = check_matrix();
+
+#if (MIXER_MOTOR_CNT <= 6)
+	srand(1);
+	pass &= check_unsaturated();
+	pass &= check_saturated();
+#else
+	printf("mixer: not built, the board drives at most 6 motors\n");
+#endif
+
+	printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}
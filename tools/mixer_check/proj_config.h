@@ -0,0 +1,5 @@
+/* the flight code configuration with the airframe selected by the makefile */
+#include "../../src/proj_config.h"
+
+#undef SELECT_UAV_TYPE
+#define SELECT_UAV_TYPE MIXER_CHECK_UAV_TYPE
@@ -0,0 +1,179 @@
+/* host check of the mpu6500 frame conversion, mpu6500_frame.h with the
+ * byte reverse and dsp instructions of the local device header.
+ *
+ * usage: make check
+ *
+ * the integer samples have to be bit identical to the byte by byte decoding
+ * with the signs of this board, and so the calibrated floats of
+ * imu_calib_apply(). a negated -32768 saturates to 32767. the default accel
+ * calibration of mpu6500.c was measured with the old byte composition
+ * -((int16_t)hi << 8) | lo, composing its values the old way has to give the
+ * recorded ones back. returns non-zero if any scenario fails */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "mpu6500_frame.h"
+#include "imu_calib.h"
+
+#define RANDOM_FRAME_CNT 20000000
+
+/* signs of the decoding before the rotation matrices: accel x/y/z, temp, gyro x/y/z */
+static const int frame_sign[7] = {-1, -1, -1, +1, -1, -1, +1};
+
+static const int16_t gyro_rotation_m[3][3] = MPU6500_GYRO_ROTATION;
+static const int16_t accel_rotation_m[3][3] = MPU6500_ACCEL_ROTATION;
+static mpu6500_rotation_t accel_rotation;
+static mpu6500_rotation_t gyro_rotation;
+
+/* some kernel with every coefficient in use */
+static const imu_calib_kernel_t kernel = {
+	{0.0048f, 1e-5f, -2e-5f, 3e-5f, 0.0047f, 1e-5f, -1e-5f, 2e-5f, 0.0046f},
+	{62.3f, -200.7f, 32.1f}
+};
+
+/* value measured with the old composition and the default of mpu6500.c */
+typedef struct {
+	const char *name;
+	int16_t recorded;
+	int16_t value;
+} old_constant_t;
+
+static const old_constant_t old_constants[] = {
+	{"accel x bias", +450, +62},
+	{"accel y bias", +200, -200},
+	{"accel z bias", +480, +32},
+	{"accel x max", +2020, +1564},
+	{"accel x min", -2111, -2497},
+	{"accel y max", +2079, +2017},
+	{"accel y min", -2043, -2053},
+	{"accel z max", +2558, +2050},
+	{"accel z min", -2048, -2048}
+};
+
+static int16_t decode_reference(const uint8_t *b, int i)
+{
+	int32_t v = frame_sign[i] * (int16_t)((b[2 * i] << 8) | b[2 * i + 1]);
+	return (v > 32767) ? 32767 : v;
+}
+
+/* returns false on any difference of the integer or the calibrated samples */
+static bool frame_compare(const uint8_t *b)
+{
+	uint32_t frame[4] = {0};
+	memcpy(frame, b, 14);
+
+	vector3d_16_t accel, gyro;
+	int16_t temp;
+	mpu6500_frame_rotate(frame, &accel_rotation, &gyro_rotation, &accel, &gyro, &temp);
+
+	vector3d_16_t accel_ref = {decode_reference(b, 0), decode_reference(b, 1), decode_reference(b, 2)};
+	vector3d_16_t gyro_ref = {decode_reference(b, 4), decode_reference(b, 5), decode_reference(b, 6)};
+	int16_t temp_ref = decode_reference(b, 3);
+
+	vector3d_f_t accel_f, accel_ref_f, gyro_f, gyro_ref_f;
+	imu_calib_apply(&kernel, &accel, &accel_f);
+	imu_calib_apply(&kernel, &accel_ref, &accel_ref_f);
+	imu_calib_apply(&kernel, &gyro, &gyro_f);
+	imu_calib_apply(&kernel, &gyro_ref, &gyro_ref_f);
+
+	return memcmp(&accel, &accel_ref, sizeof(accel)) == 0 && memcmp(&gyro, &gyro_ref, sizeof(gyro)) == 0 &&
+	       temp == temp_ref && memcmp(&accel_f, &accel_ref_f, sizeof(accel_f)) == 0 &&
+	       memcmp(&gyro_f, &gyro_ref_f, sizeof(gyro_f)) == 0;
+}
+
+/* every halfword value on every channel at once */
+static bool check_all_values(void)
+{
+	long mismatch_cnt = 0;
+
+	long v;
+	for(v = 0; v < 65536; v++) {
+		uint8_t b[14];
+		int i;
+		for(i = 0; i < 7; i++) {
+			b[2 * i] = v >> 8;
+			b[2 * i + 1] = v & 0xff;
+		}
+		mismatch_cnt += (frame_compare(b) == false);
+	}
+
+	/* -32768 on a negated axis */
+	uint8_t b[14] = {0x80, 0x00};
+	uint32_t frame[4] = {0};
+	memcpy(frame, b, 14);
+	vector3d_16_t accel, gyro;
+	int16_t temp;
+	mpu6500_frame_rotate(frame, &accel_rotation, &gyro_rotation, &accel, &gyro, &temp);
+
+	bool pass = mismatch_cnt == 0 && accel.x == 32767;
+
+	printf("%-22s 65536 frames, %ld mismatches, negated -32768 gives %d %s\n", "every value",
+	       mismatch_cnt, accel.x, (pass == true) ? "ok" : "FAIL");
+
+	return pass;
+}
+
+static bool check_random_frames(void)
+{
+	srand(1);
+	long mismatch_cnt = 0;
+
+	long n;
+	for(n = 0; n < RANDOM_FRAME_CNT; n++) {
+		uint8_t b[14];
+		int i;
+		for(i = 0; i < 14; i++) {
+			b[i] = rand();
+		}
+		mismatch_cnt += (frame_compare(b) == false);
+	}
+
+	bool pass = mismatch_cnt == 0;
+
+	printf("%-22s %d frames, %ld mismatches %s\n", "random frames", RANDOM_FRAME_CNT, mismatch_cnt,
+	       (pass == true) ? "ok" : "FAIL");
+
+	return pass;
+}
+
+/* the old composition of a negated axis from the sample value */
+static int16_t old_compose(int16_t value)
+{
+	uint16_t raw = (uint16_t)-value;
+	uint8_t hi = raw >> 8, lo = raw & 0xff;
+	return -((int16_t)hi << 8) | (int16_t)lo;
+}
+
+static bool check_old_constants(void)
+{
+	bool pass = true;
+
+	unsigned int i;
+	for(i = 0; i < sizeof(old_constants) / sizeof(old_constants[0]); i++) {
+		const old_constant_t *c = &old_constants[i];
+		int16_t composed = old_compose(c->value);
+		bool ok = composed == c->recorded;
+		printf("%-22s %+6d composed the old way %+6d, recorded %+6d %s\n", c->name, c->value, composed,
+		       c->recorded, (ok == true) ? "ok" : "FAIL");
+		pass &= ok;
+	}
+
+	return pass;
+}
+
+int main(void)
+{
+	mpu6500_rotation_pack(&accel_rotation, accel_rotation_m);
+	mpu6500_rotation_pack(&gyro_rotation, gyro_rotation_m);
+
+	bool pass = true;
+	pass &= check_all_values();
+	pass &= check_random_frames();
+	pass &= check_old_constants();
+
+	printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}
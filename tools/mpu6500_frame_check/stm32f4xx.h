@@ -0,0 +1,37 @@
+#ifndef __STM32F4xx_H
+#define __STM32F4xx_H
+
+/* host replacement of the device header, the cortex-m4 byte reverse and dsp
+ * instructions the frame conversion uses, with the semantics of the armv7-m
+ * reference manual */
+
+#include <stdint.h>
+
+static inline uint32_t __REV16(uint32_t value)
+{
+	return ((value & 0x00ff00ffUL) << 8) | ((value & 0xff00ff00UL) >> 8);
+}
+
+/* dual signed 16 bit multiply with addition of the products */
+static inline uint32_t __SMUAD(uint32_t op1, uint32_t op2)
+{
+	int32_t lo = (int32_t)(int16_t)op1 * (int16_t)op2;
+	int32_t hi = (int32_t)(int16_t)(op1 >> 16) * (int16_t)(op2 >> 16);
+	return (uint32_t)lo + (uint32_t)hi;
+}
+
+/* same as smuad with a 32 bit accumulate */
+static inline uint32_t __SMLAD(uint32_t op1, uint32_t op2, uint32_t op3)
+{
+	return __SMUAD(op1, op2) + op3;
+}
+
+/* signed saturation to a bits wide range */
+static inline int32_t __SSAT(int32_t value, uint32_t bits)
+{
+	int32_t max = (int32_t)((1UL << (bits - 1)) - 1);
+	int32_t min = -max - 1;
+	return (value > max) ? max : ((value < min) ? min : value);
+}
+
+#endif
@@ -0,0 +1,137 @@
+/* checks the single precision local tangent plane conversion of
+ * navigation.c against a double precision wgs-84 reference.
+ *
+ * usage: make check
+ *
+ * the reference converts both points to earth-centered earth-fixed
+ * coordinates and rotates their difference into the ned frame of the home,
+ * which is exact up to the double rounding. the grid covers +-10km around
+ * homes from the equator up to 78 deg latitude, the error is bucketed by the
+ * horizontal distance and compared against the bounds documented in
+ * navigation.h. returns non-zero if any bound is exceeded */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include "navigation.h"
+
+#define WGS84_A 6378137.0
+#define WGS84_E2 6.69437999014e-3
+
+#define DEG_E7_TO_RAD (M_PI / 180.0 * 1e-7)
+
+#define HOME_LONGITUDE 1215650000 //[1e-7 deg]
+#define HOME_ALTITUDE 50.0f       //[m]
+
+#define GRID_STEP 1000  //[1e-7 deg * 45], about 500m
+#define GRID_RANGE 20000
+
+enum {
+	RANGE_2KM,
+	RANGE_5KM,
+	RANGE_BEYOND,
+	RANGE_CNT
+};
+
+static const char *range_name[RANGE_CNT] = {"<2km", "<5km", ">=5km"};
+
+/* documented bounds, nothing is promised beyond 5km [m] */
+static const double range_bound[RANGE_CNT] = {0.01, 0.03, INFINITY};
+
+static const int32_t home_latitude[] = {0, 250330000, -337000000, 600000000, 780000000}; //[1e-7 deg]
+
+static void geodetic_to_ecef(double lat, double lon, double h, double *ecef)
+{
+	double sin_lat = sin(lat);
+	double r_n = WGS84_A / sqrt(1.0 - WGS84_E2 * sin_lat * sin_lat);
+
+	ecef[0] = (r_n + h) * cos(lat) * cos(lon);
+	ecef[1] = (r_n + h) * cos(lat) * sin(lon);
+	ecef[2] = (r_n * (1.0 - WGS84_E2) + h) * sin_lat;
+}
+
+static void reference_ned(int32_t home_lat, int32_t home_lon, double home_alt,
+                          int32_t latitude, int32_t longitude, double altitude, double *ned)
+{
+	double lat0 = home_lat * DEG_E7_TO_RAD;
+	double lon0 = home_lon * DEG_E7_TO_RAD;
+
+	double ecef0[3], ecef[3], d[3];
+	geodetic_to_ecef(lat0, lon0, home_alt, ecef0);
+	geodetic_to_ecef(latitude * DEG_E7_TO_RAD, longitude * DEG_E7_TO_RAD, altitude, ecef);
+
+	int i;
+	for(i = 0; i < 3; i++) {
+		d[i] = ecef[i] - ecef0[i];
+	}
+
+	double sin_lat = sin(lat0), cos_lat = cos(lat0);
+	double sin_lon = sin(lon0), cos_lon = cos(lon0);
+
+	ned[0] = -sin_lat * cos_lon * d[0] - sin_lat * sin_lon * d[1] + cos_lat * d[2];
+	ned[1] = -sin_lon * d[0] + cos_lon * d[1];
+	ned[2] = -cos_lat * cos_lon * d[0] - cos_lat * sin_lon * d[1] - sin_lat * d[2];
+}
+
+int main(void)
+{
+	double worst[RANGE_CNT] = {0.0};
+
+	unsigned int h;
+	for(h = 0; h < sizeof(home_latitude) / sizeof(home_latitude[0]); h++) {
+		nav_home_t home;
+		nav_set_home(&home, home_latitude[h], HOME_LONGITUDE, HOME_ALTITUDE);
+
+		double home_worst = 0.0;
+
+		int dn, de;
+		for(dn = -GRID_RANGE; dn <= GRID_RANGE; dn += GRID_STEP) {
+			for(de = -GRID_RANGE; de <= GRID_RANGE; de += GRID_STEP) {
+				int32_t latitude = home_latitude[h] + dn * 45;
+				int32_t longitude = HOME_LONGITUDE + de * 45;
+				float altitude = HOME_ALTITUDE + de * 0.001f;
+
+				float ned[3];
+				nav_geodetic_to_ned(&home, latitude, longitude, altitude, ned);
+
+				double ref[3];
+				reference_ned(home_latitude[h], HOME_LONGITUDE, HOME_ALTITUDE,
+				              latitude, longitude, altitude, ref);
+
+				double dist = sqrt(ref[0] * ref[0] + ref[1] * ref[1]);
+				double err = sqrt((ref[0] - ned[0]) * (ref[0] - ned[0]) +
+				                  (ref[1] - ned[1]) * (ref[1] - ned[1]) +
+				                  (ref[2] - ned[2]) * (ref[2] - ned[2]));
+
+				int range = (dist < 2000.0) ? RANGE_2KM :
+				            (dist < 5000.0) ? RANGE_5KM : RANGE_BEYOND;
+
+				worst[range] = (err > worst[range]) ? err : worst[range];
+				if(range <= RANGE_5KM) {
+					home_worst = (err > home_worst) ? err : home_worst;
+				}
+			}
+		}
+
+		printf("home latitude %+6.2f deg: max error within 5km %.4f m\n",
+		       home_latitude[h] * 1e-7, home_worst);
+	}
+
+	bool pass = true;
+
+	int i;
+	for(i = 0; i < RANGE_CNT; i++) {
+		bool ok = worst[i] <= range_bound[i];
+		printf("%-6s max error %.4f m", range_name[i], worst[i]);
+		if(isinf(range_bound[i]) == 0) {
+			printf(", bound %.4f m %s", range_bound[i], (ok == true) ? "ok" : "exceeded");
+		}
+		printf("\n");
+		pass &= ok;
+	}
+
+	printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}
@@ -0,0 +1,235 @@
+/* software in the loop check of the translational kalman filter, the pos_kf.c
+ * of the flight code runs against a simulated flight with a biased, noisy
+ * accelerometer and delayed, noisy position fixes.
+ *
+ * usage: make check
+ *
+ * the vehicle circles and moves up and down by 1m, the world frame
+ * accelerometer has a constant bias of up to 40cm/s^2 on every axis and white
+ * noise. the position source is the optitrack (100Hz, 10ms delay, 1cm, 2.5m/s
+ * circle) or the gps (10Hz, 60ms delay, 80cm horizontal and 150cm vertical,
+ * 10m/s circle). every source is run three times: fused at the measurement
+ * time the position and velocity errors are bounded and the bias estimate
+ * converges from zero, fused at the reception time (no replay of the history)
+ * the errors have to be clearly larger, and with one extra fix far outside the
+ * gate of 5 sigma on every axis the estimate has to be bit identical to the
+ * run without it. returns non-zero if any scenario fails */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "pos_kf.h"
+
+#define IMU_RATE 400.0    //[Hz]
+#define ACCEL_NOISE 30.0  //[cm/s^2]
+#define SIM_TIME 60.0     //[s]
+#define SETTLE_TIME 10.0  //error statistics start [s]
+#define BIAS_TIME 30.0    //bias convergence checked from here [s]
+#define OUTLIER_TIME 32.0 //[s]
+
+#define STEP_CNT 24000 //SIM_TIME * IMU_RATE
+#define FIX_QUEUE_SIZE 64
+
+static const double accel_bias[3] = {30.0, -25.0, 40.0}; //[cm/s^2]
+
+typedef struct {
+	const char *name;
+	double rate;             //[Hz]
+	double delay;            //[ms]
+	double radius;           //of the circle [cm]
+	double period;           //of the circle [s]
+	double noise[3];         //[cm]
+	double outlier[3];       //offset of the extra fix [cm]
+	double pos_rms_max;      //[cm]
+	double vel_rms_max;      //[cm/s]
+	double bias_err_max;     //[cm/s^2]
+	double no_replay_ratio;  //minimum error ratio of the fusion at the reception time
+} source_t;
+
+static const source_t sources[] = {
+	{"optitrack", 100.0, 10.0, 400.0, 10.0, {1.0, 1.0, 1.0}, {50.0, -50.0, 50.0}, 1.0, 6.0, 8.0, 3.0},
+	{"gps", 10.0, 60.0, 2000.0, 12.0, {80.0, 80.0, 150.0}, {2500.0, -2500.0, 4000.0}, 60.0, 35.0, 20.0, 1.5}
+};
+
+enum {
+	FUSE_AT_MEASUREMENT_TIME,
+	FUSE_AT_RECEPTION_TIME,
+	FUSE_WITH_OUTLIER
+};
+
+typedef struct {
+	double pos_rms;
+	double vel_rms;
+	double bias_err_max;
+	bool always_valid;
+	bool identical;     //to the trace of the run at the measurement time
+} result_t;
+
+/* estimate of every step, the outlier run is compared against it */
+static pos_kf_state_t trace[STEP_CNT];
+
+static double randn(void)
+{
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/* circle of the source and 1m up and down in 8s, north-east-up [cm] */
+static void true_motion(const source_t *s, double t, double *pos, double *vel, double *accel)
+{
+	const double r = s->radius, w = 2.0 * M_PI / s->period;
+	const double h = 100.0, wz = 2.0 * M_PI / 8.0;
+
+	pos[0] = r * cos(w * t);
+	pos[1] = r * sin(w * t);
+	pos[2] = 200.0 + h * sin(wz * t);
+	vel[0] = -r * w * sin(w * t);
+	vel[1] = r * w * cos(w * t);
+	vel[2] = h * wz * cos(wz * t);
+	accel[0] = -r * w * w * cos(w * t);
+	accel[1] = -r * w * w * sin(w * t);
+	accel[2] = -h * wz * wz * sin(wz * t);
+}
+
+static void run_source(const source_t *s, int mode, result_t *result)
+{
+	srand(1);
+	pos_kf_init();
+
+	double queue_capture[FIX_QUEUE_SIZE], queue_pos[FIX_QUEUE_SIZE][3];
+	int queue_head = 0, queue_cnt = 0;
+
+	double pos_sq_sum = 0.0, vel_sq_sum = 0.0;
+	int err_cnt = 0;
+	result->bias_err_max = 0.0;
+	result->always_valid = true;
+	result->identical = true;
+
+	int fix_divider = (int)(IMU_RATE / s->rate);
+
+	int k, i;
+	for(k = 1; k <= STEP_CNT; k++) {
+		double t = k / IMU_RATE, t_ms = t * 1000.0;
+		double pos[3], vel[3], accel[3];
+		true_motion(s, t, pos, vel, accel);
+
+		float accel_meas[3];
+		for(i = 0; i < 3; i++) {
+			accel_meas[i] = accel[i] + accel_bias[i] + ACCEL_NOISE * randn();
+		}
+		pos_kf_predict(accel_meas, 1.0f / IMU_RATE, t_ms);
+
+		/* the fix is captured now and received after the delay */
+		if((k % fix_divider) == 0) {
+			int tail = (queue_head + queue_cnt) % FIX_QUEUE_SIZE;
+			queue_capture[tail] = t_ms;
+			for(i = 0; i < 3; i++) {
+				queue_pos[tail][i] = pos[i] + s->noise[i] * randn();
+			}
+			queue_cnt++;
+
+			/* one more fix of the same time, no noise is drawn for it so the
+			 * other fixes are the ones of the run without it */
+			if(mode == FUSE_WITH_OUTLIER && fabs(t - OUTLIER_TIME) < 0.5 / IMU_RATE) {
+				int outlier = (tail + 1) % FIX_QUEUE_SIZE;
+				queue_capture[outlier] = t_ms;
+				for(i = 0; i < 3; i++) {
+					queue_pos[outlier][i] = pos[i] + s->outlier[i];
+				}
+				queue_cnt++;
+			}
+		}
+		while(queue_cnt > 0 && queue_capture[queue_head] + s->delay <= t_ms + 1e-6) {
+			float fix[3], noise[3];
+			for(i = 0; i < 3; i++) {
+				fix[i] = queue_pos[queue_head][i];
+				noise[i] = s->noise[i];
+			}
+			float time_ms = (mode == FUSE_AT_RECEPTION_TIME) ? t_ms : queue_capture[queue_head];
+			pos_kf_fuse_position(fix, noise, time_ms);
+			queue_head = (queue_head + 1) % FIX_QUEUE_SIZE;
+			queue_cnt--;
+		}
+
+		pos_kf_state_t state;
+		pos_kf_read(&state);
+
+		if(mode == FUSE_WITH_OUTLIER) {
+			/* the whole published state, the bias included */
+			if(memcmp(&state, &trace[k - 1], sizeof(state)) != 0) {
+				result->identical = false;
+			}
+		} else if(mode == FUSE_AT_MEASUREMENT_TIME) {
+			trace[k - 1] = state;
+		}
+
+		if(t < SETTLE_TIME) {
+			continue;
+		}
+		if(state.valid == false) {
+			result->always_valid = false;
+			continue;
+		}
+
+		for(i = 0; i < 3; i++) {
+			pos_sq_sum += (state.pos[i] - pos[i]) * (state.pos[i] - pos[i]);
+			vel_sq_sum += (state.vel[i] - vel[i]) * (state.vel[i] - vel[i]);
+			double bias_err = fabs(state.accel_bias[i] - accel_bias[i]);
+			if(t >= BIAS_TIME && bias_err > result->bias_err_max) {
+				result->bias_err_max = bias_err;
+			}
+		}
+		err_cnt++;
+	}
+
+	/* rms of the error vector */
+	result->pos_rms = sqrt(pos_sq_sum / err_cnt);
+	result->vel_rms = sqrt(vel_sq_sum / err_cnt);
+}
+
+static bool check_source(const source_t *s)
+{
+	result_t replay, no_replay, outlier;
+	run_source(s, FUSE_AT_MEASUREMENT_TIME, &replay);
+	run_source(s, FUSE_AT_RECEPTION_TIME, &no_replay);
+	run_source(s, FUSE_WITH_OUTLIER, &outlier);
+
+	bool replay_ok = replay.pos_rms <= s->pos_rms_max && replay.vel_rms <= s->vel_rms_max &&
+	                 replay.bias_err_max <= s->bias_err_max && replay.always_valid == true;
+	printf("%-10s measurement time  rms pos %6.2fcm/%.0f, rms vel %6.2fcm/s/%.0f, bias err %5.2fcm/s^2/%.0f %s\n",
+	       s->name, replay.pos_rms, s->pos_rms_max, replay.vel_rms, s->vel_rms_max,
+	       replay.bias_err_max, s->bias_err_max, (replay_ok == true) ? "ok" : "FAIL");
+
+	double pos_ratio = no_replay.pos_rms / replay.pos_rms;
+	double vel_ratio = no_replay.vel_rms / replay.vel_rms;
+	bool no_replay_ok = pos_ratio >= s->no_replay_ratio && vel_ratio > 1.0;
+	printf("%-10s reception time    rms pos %6.2fcm (x%.2f/%.1f), rms vel %6.2fcm/s (x%.2f/1.0) %s\n",
+	       s->name, no_replay.pos_rms, pos_ratio, s->no_replay_ratio, no_replay.vel_rms, vel_ratio,
+	       (no_replay_ok == true) ? "ok" : "FAIL");
+
+	/* the outlier run is only valid and identical if the gate dropped the fix */
+	bool outlier_ok = outlier.identical == true;
+	printf("%-10s outlier %+5.0f/%+5.0f/%+5.0fcm at %.0fs %s %s\n", s->name,
+	       s->outlier[0], s->outlier[1], s->outlier[2], OUTLIER_TIME,
+	       (outlier_ok == true) ? "rejected, estimate bit identical" : "changed the estimate",
+	       (outlier_ok == true) ? "ok" : "FAIL");
+
+	return replay_ok && no_replay_ok && outlier_ok;
+}
+
+int main(void)
+{
+	bool pass = true;
+
+	unsigned int i;
+	for(i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+		pass &= check_source(&sources[i]);
+	}
+
+	printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}
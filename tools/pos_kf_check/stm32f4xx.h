@@ -0,0 +1,8 @@
+#ifndef __STM32F4xx_H
+#define __STM32F4xx_H
+
+/* host replacement of the device header, the slots only need the barrier */
+
+#define __DMB() __sync_synchronize()
+
+#endif
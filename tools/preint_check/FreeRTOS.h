@@ -0,0 +1,17 @@
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+/* host replacement of the kernel, the replay runs the interrupt, the
+ * deferred work and the estimator task one after another in one thread */
+
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define pdTRUE ((BaseType_t)1)
+#define pdFALSE ((BaseType_t)0)
+
+#define tskIDLE_PRIORITY ((UBaseType_t)0)
+
+#endif
@@ -0,0 +1,367 @@
+/* host replay of the imu preintegration, the mpu6500.c of the flight code
+ * decodes simulated spi frames and the attitude task side takes the periods
+ * through mpu6500_preint_take().
+ *
+ * usage: make check
+ *
+ * the vehicle cones (gyro x/y in quadrature) and sculls (accel x/y in phase
+ * with the rotation) at 20hz. the frames are quantized to the lsb of the
+ * 2000dps and 16g ranges and go through the chip to body rotation, the
+ * calibration and the preintegration of the driver at 8khz, taken at the
+ * 400hz of the attitude loop. the reference integrates the continuous motion
+ * in double precision. the delta velocities are rotated with the reference
+ * attitude of their period start, so the velocity error is the one of the
+ * sculling compensation alone. the same samples integrated without coning
+ * and sculling compensation show what is corrected. returns non-zero if an
+ * error bound is exceeded */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "stm32f4xx_conf.h"
+#include "mpu6500.h"
+#include "imu_calib.h"
+#include "flash.h"
+
+#define SAMPLE_RATE 8000  //mpu6500 data ready [Hz]
+#define TAKE_RATE 400     //attitude loop [Hz]
+#define SIM_TIME 10.0     //[s]
+#define SUBSTEPS 50       //reference integration steps per sample
+
+#define GRAVITY 9.80665
+#define DEG_TO_RAD (M_PI / 180.0)
+
+/* coning and sculling motion */
+#define MOTION_FREQ 20.0 //[Hz]
+#define CONING_ANGLE 0.1 //half cone angle [rad]
+#define SCULLING_ACCEL 20.0 //[m/s^2]
+
+#define GYRO_LSB 16.4                //[lsb / (deg/s)], 2000dps range
+#define ACCEL_LSB (2048.0 / GRAVITY) //[lsb / (m/s^2)], 16g range
+
+/* error bounds after SIM_TIME. the gyro quantization dominates the attitude,
+ * the velocity bound fails without the 1/6 sculling terms (~1.2e-3 m/s) */
+#define ATTITUDE_BOUND 0.02 //[deg]
+#define VELOCITY_BOUND 1e-3 //[m/s]
+
+SPI_TypeDef host_spi1;
+GPIO_TypeDef host_gpioa;
+DWT_Type host_dwt;
+CoreDebug_Type host_core_debug;
+
+typedef struct {
+	double w, x, y, z;
+} quat_t;
+
+static imu_t imu;
+
+/* frame clocked out by the next spi transfers, -1 is the register address */
+static uint8_t spi_frame[14];
+static int spi_pos = -1;
+
+/* stubs of the drivers and tasks mpu6500.c talks to */
+void GPIO_SetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+}
+
+void GPIO_ResetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+	spi_pos = -1; //chip select starts a transfer
+}
+
+uint8_t spi_read_write(SPI_TypeDef *spi_channel, uint8_t data)
+{
+	uint8_t read = (spi_pos >= 0 && spi_pos < 14) ? spi_frame[spi_pos] : 0xff;
+	spi_pos++;
+	return read;
+}
+
+bool delay_elapsed_ms(uint32_t start, uint32_t ms)
+{
+	return true;
+}
+
+void deferred_work_signal_from_isr(int src)
+{
+}
+
+void flight_ctl_trigger_handler(void)
+{
+}
+
+void gyro_fft_push(vector3d_f_t *gyro)
+{
+}
+
+void dyn_notch_apply(vector3d_f_t *gyro)
+{
+}
+
+void rpm_filter_apply(vector3d_f_t *gyro)
+{
+}
+
+/* the gyro bias is restored at the temperature of the frames (raw 0 = 21degC),
+ * the calibration record converts with the nominal sensitivities */
+bool flash_param_load(uint16_t id, void *data, size_t size)
+{
+	if(id == FLASH_PARAM_GYRO_BIAS && size == sizeof(float) * 4) {
+		float bias[4] = {0.0f, 0.0f, 0.0f, 21.0f};
+		memcpy(data, bias, size);
+		return true;
+	}
+
+	if(id == FLASH_PARAM_IMU_CALIB && size == sizeof(imu_calib_param_t)) {
+		imu_calib_param_t calib;
+		memset(&calib, 0, sizeof(calib));
+
+		int i;
+		for(i = 0; i < 3; i++) {
+			calib.accel.sens[i][0] = ACCEL_LSB;
+			calib.gyro.sens[i][0] = GYRO_LSB;
+			calib.accel.misalign[i * 3 + i] = 1.0f;
+			calib.gyro.misalign[i * 3 + i] = 1.0f;
+		}
+
+		memcpy(data, &calib, size);
+		return true;
+	}
+
+	return false;
+}
+
+bool flash_param_store(uint16_t id, const void *data, size_t size)
+{
+	return true;
+}
+
+static quat_t quat_mult(quat_t a, quat_t b)
+{
+	quat_t q = {
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w
+	};
+	return q;
+}
+
+/* rotation vector to quaternion */
+static quat_t quat_exp(const double *v)
+{
+	double angle = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	double s = (angle < 1e-12) ? 0.5 : sin(0.5 * angle) / angle;
+	quat_t q = {cos(0.5 * angle), v[0] * s, v[1] * s, v[2] * s};
+	return q;
+}
+
+/* body to reference frame */
+static void quat_rotate(quat_t q, const double *v, double *out)
+{
+	quat_t p = {0.0, v[0], v[1], v[2]};
+	quat_t q_conj = {q.w, -q.x, -q.y, -q.z};
+	quat_t r = quat_mult(quat_mult(q, p), q_conj);
+	out[0] = r.x;
+	out[1] = r.y;
+	out[2] = r.z;
+}
+
+static double quat_angle_diff(quat_t a, quat_t b)
+{
+	quat_t a_conj = {a.w, -a.x, -a.y, -a.z};
+	quat_t d = quat_mult(a_conj, b);
+	return 2.0 * asin(fmin(1.0, sqrt(d.x * d.x + d.y * d.y + d.z * d.z)));
+}
+
+static void motion(double t, double *gyro, double *accel)
+{
+	const double w = 2.0 * M_PI * MOTION_FREQ;
+	gyro[0] = CONING_ANGLE * w * cos(w * t);
+	gyro[1] = CONING_ANGLE * w * sin(w * t);
+	gyro[2] = 0.0;
+	accel[0] = SCULLING_ACCEL * cos(w * t);
+	accel[1] = SCULLING_ACCEL * sin(w * t);
+	accel[2] = GRAVITY;
+}
+
+static int16_t quantize(double value)
+{
+	double lsb = round(value);
+	return (int16_t)((lsb > 32767.0) ? 32767.0 : ((lsb < -32768.0) ? -32768.0 : lsb));
+}
+
+static void frame_put(int offset, int16_t value)
+{
+	spi_frame[offset] = (uint8_t)((uint16_t)value >> 8);
+	spi_frame[offset + 1] = (uint8_t)value;
+}
+
+/* chip frame samples through the interrupt and the deferred work */
+static void imu_sample(const int16_t *accel_chip, const int16_t *gyro_chip)
+{
+	int i;
+	for(i = 0; i < 3; i++) {
+		frame_put(2 * i, accel_chip[i]);
+		frame_put(8 + 2 * i, gyro_chip[i]);
+	}
+	frame_put(6, 0);
+
+	mpu6500_int_handler();
+	mpu6500_process();
+	host_dwt.CYCCNT += 180000000 / SAMPLE_RATE;
+}
+
+/* chip to body rotations of the driver, one chip axis at a time */
+static void rotation_probe(int accel_rotation[3][3], int gyro_rotation[3][3])
+{
+	int j;
+	for(j = 0; j < 3; j++) {
+		int16_t chip[3] = {0, 0, 0};
+		chip[j] = 1000;
+		imu_sample(chip, chip);
+
+		int16_t accel_body[3] = {imu.accel_unscaled.x, imu.accel_unscaled.y, imu.accel_unscaled.z};
+		int16_t gyro_body[3] = {imu.gyro_unscaled.x, imu.gyro_unscaled.y, imu.gyro_unscaled.z};
+		int i;
+		for(i = 0; i < 3; i++) {
+			accel_rotation[i][j] = accel_body[i] / 1000;
+			gyro_rotation[i][j] = gyro_body[i] / 1000;
+		}
+	}
+}
+
+int main(void)
+{
+	mpu6500_init(&imu);
+
+	int accel_rotation[3][3], gyro_rotation[3][3];
+	rotation_probe(accel_rotation, gyro_rotation);
+
+	/* start over with the probed rotation, the gyro bias stays restored */
+	memset(&imu, 0, sizeof(imu));
+	mpu6500_init(&imu);
+
+	const double dt = 1.0 / SAMPLE_RATE;
+	const double h = dt / SUBSTEPS;
+	const int take_div = SAMPLE_RATE / TAKE_RATE;
+
+	quat_t q_ref = {1.0, 0.0, 0.0, 0.0};
+	quat_t q_preint = q_ref, q_plain = q_ref;
+	quat_t q_period_start = q_ref;
+	double v_ref[3] = {0}, v_preint[3] = {0}, v_plain[3] = {0};
+	double angle_plain[3] = {0}, vel_plain[3] = {0};
+	double gyro_last[3], accel_last[3];
+	long take_cnt = 0, take_miss = 0;
+
+	long sample_cnt = (long)(SIM_TIME * SAMPLE_RATE);
+	long k;
+	for(k = 0; k <= sample_cnt; k++) {
+		double t = k * dt;
+
+		/* reference from the last sample to this one */
+		if(k > 0) {
+			int s;
+			for(s = 0; s < SUBSTEPS; s++) {
+				double t_mid = t - dt + (s + 0.5) * h;
+				double gyro[3], accel[3], accel_ref[3];
+				motion(t_mid, gyro, accel);
+
+				double half[3] = {0.5 * h * gyro[0], 0.5 * h * gyro[1], 0.5 * h * gyro[2]};
+				double full[3] = {h * gyro[0], h * gyro[1], h * gyro[2]};
+				quat_rotate(quat_mult(q_ref, quat_exp(half)), accel, accel_ref);
+				v_ref[0] += accel_ref[0] * h;
+				v_ref[1] += accel_ref[1] * h;
+				v_ref[2] += accel_ref[2] * h;
+				q_ref = quat_mult(q_ref, quat_exp(full));
+			}
+		}
+
+		/* body frame sample, quantized in the chip frame */
+		double gyro[3], accel[3];
+		motion(t, gyro, accel);
+
+		int16_t gyro_chip[3], accel_chip[3];
+		int i;
+		for(i = 0; i < 3; i++) {
+			/* the rotation is a signed permutation, the transpose is the inverse */
+			double gyro_axis = 0.0, accel_axis = 0.0;
+			int j;
+			for(j = 0; j < 3; j++) {
+				gyro_axis += gyro_rotation[j][i] * gyro[j];
+				accel_axis += accel_rotation[j][i] * accel[j];
+			}
+			gyro_chip[i] = quantize(gyro_axis / DEG_TO_RAD * GYRO_LSB);
+			accel_chip[i] = quantize(accel_axis * ACCEL_LSB);
+		}
+		imu_sample(accel_chip, gyro_chip);
+
+		/* the same converted samples without compensation */
+		double gyro_conv[3] = {imu.gyro_raw.x * DEG_TO_RAD, imu.gyro_raw.y * DEG_TO_RAD, imu.gyro_raw.z * DEG_TO_RAD};
+		double accel_conv[3] = {imu.accel_raw.x, imu.accel_raw.y, imu.accel_raw.z};
+		if(k > 0) {
+			for(i = 0; i < 3; i++) {
+				angle_plain[i] += 0.5 * (gyro_last[i] + gyro_conv[i]) * dt;
+				vel_plain[i] += 0.5 * (accel_last[i] + accel_conv[i]) * dt;
+			}
+		}
+		memcpy(gyro_last, gyro_conv, sizeof(gyro_last));
+		memcpy(accel_last, accel_conv, sizeof(accel_last));
+
+		/* the first sample only starts the integration */
+		imu_delta_t delta;
+		if(k == 0) {
+			mpu6500_preint_take(&delta);
+			continue;
+		}
+
+		if(k % take_div != 0) {
+			continue;
+		}
+
+		if(mpu6500_preint_take(&delta) == false) {
+			take_miss++;
+			continue;
+		}
+		take_cnt++;
+
+		double delta_angle[3] = {delta.delta_angle.x, delta.delta_angle.y, delta.delta_angle.z};
+		double delta_velocity[3] = {delta.delta_velocity.x, delta.delta_velocity.y, delta.delta_velocity.z};
+		double dv[3];
+
+		q_preint = quat_mult(q_preint, quat_exp(delta_angle));
+		quat_rotate(q_period_start, delta_velocity, dv);
+		for(i = 0; i < 3; i++) {
+			v_preint[i] += dv[i];
+		}
+
+		q_plain = quat_mult(q_plain, quat_exp(angle_plain));
+		quat_rotate(q_period_start, vel_plain, dv);
+		for(i = 0; i < 3; i++) {
+			v_plain[i] += dv[i];
+			angle_plain[i] = 0.0;
+			vel_plain[i] = 0.0;
+		}
+
+		q_period_start = q_ref;
+	}
+
+	double att_preint = quat_angle_diff(q_ref, q_preint) / DEG_TO_RAD;
+	double att_plain = quat_angle_diff(q_ref, q_plain) / DEG_TO_RAD;
+	double vel_preint = sqrt(pow(v_preint[0] - v_ref[0], 2) + pow(v_preint[1] - v_ref[1], 2) +
+	                         pow(v_preint[2] - v_ref[2], 2));
+	double vel_plain_err = sqrt(pow(v_plain[0] - v_ref[0], 2) + pow(v_plain[1] - v_ref[1], 2) +
+	                            pow(v_plain[2] - v_ref[2], 2));
+
+	printf("%ld periods taken, %ld empty, %.0fs of %.0fhz coning (%.2f rad) and sculling (%.0f m/s^2)\n",
+	       take_cnt, take_miss, SIM_TIME, MOTION_FREQ, CONING_ANGLE, SCULLING_ACCEL);
+	printf("%-24s attitude error %8.4f deg, velocity error %8.4f m/s\n", "uncompensated", att_plain, vel_plain_err);
+	printf("%-24s attitude error %8.4f deg, velocity error %8.4f m/s\n", "mpu6500_preint_take", att_preint, vel_preint);
+
+	bool pass = (take_miss == 0) && (att_preint < ATTITUDE_BOUND) && (vel_preint < VELOCITY_BOUND);
+
+	printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}
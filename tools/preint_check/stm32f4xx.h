@@ -0,0 +1,7 @@
+#ifndef __STM32F4xx_H
+#define __STM32F4xx_H
+
+/* see stm32f4xx_conf.h */
+#include "stm32f4xx_conf.h"
+
+#endif
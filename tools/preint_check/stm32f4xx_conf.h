@@ -0,0 +1,75 @@
+#ifndef __STM32F4xx_CONF_H
+#define __STM32F4xx_CONF_H
+
+/* host replacement of the device headers. the cmsis intrinsics are arm
+ * instructions, mpu6500.c gets c versions with the same results instead:
+ * rev16 swaps the bytes of both halfwords, smuad is the sum of the two
+ * signed halfword products and smlad adds an accumulator to it */
+
+#include <stdint.h>
+
+typedef struct {
+	int unused;
+} SPI_TypeDef;
+
+typedef struct {
+	int unused;
+} USART_TypeDef;
+
+typedef struct {
+	int unused;
+} GPIO_TypeDef;
+
+typedef struct {
+	volatile uint32_t CTRL;
+	volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+	volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern SPI_TypeDef host_spi1;
+extern GPIO_TypeDef host_gpioa;
+extern DWT_Type host_dwt;
+extern CoreDebug_Type host_core_debug;
+
+#define SPI1 (&host_spi1)
+#define GPIOA (&host_gpioa)
+#define DWT (&host_dwt)
+#define CoreDebug (&host_core_debug)
+
+#define GPIO_Pin_4 ((uint16_t)0x0010)
+
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+
+#define __DMB() __sync_synchronize()
+
+void GPIO_SetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void GPIO_ResetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+
+static inline uint32_t __REV16(uint32_t value)
+{
+	return ((value & 0x00ff00ffu) << 8) | ((value & 0xff00ff00u) >> 8);
+}
+
+static inline uint32_t __SMUAD(uint32_t op1, uint32_t op2)
+{
+	return (uint32_t)((int32_t)(int16_t)op1 * (int16_t)op2 +
+	                  (int32_t)(int16_t)(op1 >> 16) * (int16_t)(op2 >> 16));
+}
+
+static inline uint32_t __SMLAD(uint32_t op1, uint32_t op2, uint32_t op3)
+{
+	return __SMUAD(op1, op2) + op3;
+}
+
+static inline int32_t __SSAT(int32_t value, uint32_t bits)
+{
+	int32_t max = (1 << (bits - 1)) - 1;
+	int32_t min = -(1 << (bits - 1));
+	return (value > max) ? max : ((value < min) ? min : value);
+}
+
+#endif
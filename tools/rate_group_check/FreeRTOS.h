@@ -0,0 +1,20 @@
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+/* host replacement of the kernel, the rate groups only use a binary
+ * semaphore and the simulation decides when the interrupt, the deferred
+ * work and the tasks run */
+
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define pdTRUE ((BaseType_t)1)
+#define pdFALSE ((BaseType_t)0)
+
+#define portMAX_DELAY 0xffffffffUL
+
+#define tskIDLE_PRIORITY ((UBaseType_t)0)
+
+#endif
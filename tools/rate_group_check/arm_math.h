@@ -0,0 +1,25 @@
+#ifndef _ARM_MATH_H
+#define _ARM_MATH_H
+
+/* host replacement of the cmsis-dsp header, the imu driver only sees the
+ * types of the estimator headers it includes. the real one pulls in the
+ * arm intrinsics of core_cm4.h */
+
+#include <stdint.h>
+#include <math.h>
+
+typedef float float32_t;
+
+typedef struct {
+	uint16_t numRows;
+	uint16_t numCols;
+	float32_t *pData;
+} arm_matrix_instance_f32;
+
+typedef struct {
+	uint16_t fftLenRFFT;
+	const float32_t *pTwiddleRFFT;
+	const void *Sint;
+} arm_rfft_fast_instance_f32;
+
+#endif
@@ -0,0 +1,593 @@
+/* software in the loop check of the rate group timing accounting, the
+ * rate_group.c of the flight code runs against a simulated trigger, cycle
+ * counter and task with injected load.
+ *
+ * usage: make check
+ *
+ * every scenario runs a reference model of the expected behaviour next to
+ * the flight code: a release while the task still runs is an overrun, a
+ * release while the previous one was not taken yet is skipped, and a cycle
+ * which completes later than the deadline after the imu sample of its
+ * release is a deadline miss. the counters and the execution time histogram
+ * must match the model exactly, the cycle counter wraps during every run.
+ *
+ * the slots that hand data between the rate groups are checked by
+ * preempting a reader at every byte of its copy, the writer publishes up to
+ * three times meanwhile. the reader must never return a torn value and has
+ * to retry after a single publish already.
+ *
+ * the imu trigger runs the mpu6500.c of the flight code on 8khz data ready
+ * interrupts with a random interrupt latency, followed by the deferred work
+ * with a random delay. its divider has to release the rate loop on every
+ * fourth sample and the slower groups phase aligned with it. the dt of every
+ * group is taken from the imu sample timestamps, so it may only jitter with
+ * the interrupt latency while the wake up period jitters with the deferred
+ * work as well. the wake up and response profilers must match the model.
+ * returns non-zero if any scenario fails */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "stm32f4xx.h"
+#include "profiler.h"
+#include "rate_group.h"
+#include "slot.h"
+#include "mpu6500.h"
+#include "flash.h"
+#include "fc_task.h"
+
+#define TRIGGER_RATE 2000                             //flight control trigger [Hz]
+#define TRIGGER_CYCLES (PROFILER_CPU_FREQ / TRIGGER_RATE)
+#define TRIGGER_CNT (TRIGGER_RATE * 120)               //simulated time of every scenario
+#define WAKE_CYCLES 360                                //release to task wake up, 2us
+#define CYCCNT_START 0xf0000000                        //wraps after ~1.5s
+
+#define US_TO_CYCLES(us) ((uint32_t)(us) * (PROFILER_CPU_FREQ / 1000000))
+
+#define SLOT_WORDS 16 //a vector3d_f_t sample with its time and a quaternion fit in less
+#define SLOT_PREEMPT_MAX 3 //publishes during one preempted copy
+
+#define IMU_SAMPLE_CYCLES (PROFILER_CPU_FREQ / 8000)   //mpu6500 data ready period
+#define IMU_SAMPLE_CNT (8000 * 10)                     //simulated time of the imu trigger
+#define IMU_ISR_LATENCY_MAX 180                        //data ready to interrupt entry, 1us
+#define IMU_DEFERRED_MIN 360                           //interrupt to sample decoding, 2us
+#define IMU_DEFERRED_MAX 1800                          //10us
+
+SPI_TypeDef host_spi1;
+GPIO_TypeDef host_gpioa;
+DWT_Type host_dwt;
+CoreDebug_Type host_core_debug;
+
+typedef struct {
+	const char *name;
+	int rate;            //[Hz]
+	float deadline_us;
+	uint32_t load_us;    //execution time of a normal cycle
+	int spike_interval;  //every n-th cycle executes spike_us instead, 0 for none
+	uint32_t spike_us;
+	bool expect_faults;  //the injected load must produce timing faults
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+	{"rate loop, nominal load", 2000, 500.0f, 300, 0, 0, false},
+	{"rate loop, spikes over the period", 2000, 500.0f, 300, 50, 700, true},
+	{"rate loop, spikes over two periods", 2000, 500.0f, 300, 200, 1400, true},
+	{"attitude loop, nominal load", 400, 2500.0f, 1500, 0, 0, false},
+	{"attitude loop, spikes over the deadline", 400, 2500.0f, 1500, 100, 3000, true},
+	{"attitude loop, spikes over several periods", 400, 2500.0f, 1500, 500, 12000, true},
+	{"position loop, overloaded", 50, 20000.0f, 25000, 0, 0, true}
+};
+
+typedef struct {
+	uint32_t cycle_cnt;
+	uint32_t deadline_miss;
+	uint32_t overrun;
+	uint32_t skipped;
+	uint32_t exec_hist[RATE_GROUP_HIST_BINS];
+} accounting_t;
+
+enum {
+	TASK_WAITING,
+	TASK_WAKING,
+	TASK_RUNNING
+};
+
+/* same binning as rate_group_hist_add(), bin n counts [2^(n-1), 2^n) us */
+static int hist_bin(uint32_t cycles)
+{
+	uint32_t us = cycles / (PROFILER_CPU_FREQ / 1000000);
+	int bin = 0;
+	while(us != 0 && bin < RATE_GROUP_HIST_BINS - 1) {
+		us >>= 1;
+		bin++;
+	}
+	return bin;
+}
+
+static void advance(uint64_t *now, uint64_t time)
+{
+	host_dwt.CYCCNT += (uint32_t)(time - *now);
+	*now = time;
+}
+
+static bool run_scenario(const scenario_t *s)
+{
+	rate_group_t group;
+	accounting_t expected;
+	memset(&expected, 0, sizeof(expected));
+
+	host_dwt.CYCCNT = CYCCNT_START;
+	rate_group_init(&group, TRIGGER_RATE, s->rate, s->deadline_us);
+
+	int divider = TRIGGER_RATE / s->rate;
+	uint32_t deadline = US_TO_CYCLES(s->deadline_us);
+
+	/* reference model of the semaphore and the task */
+	bool given = false;
+	int task = TASK_WAITING;
+	uint32_t release_time = 0, cycle_release_time = 0;
+	uint64_t wake_at = 0, done_at = 0, start = 0;
+	uint32_t wake_cnt = 0;
+
+	uint64_t now = 0, next_trigger = 0;
+	int trigger_cnt = 0, tick = 0;
+	double dt_sum = 0.0;
+
+	while(trigger_cnt < TRIGGER_CNT) {
+		/* next event, a completion is handled before a trigger at the same time */
+		uint64_t next = next_trigger;
+		if(task == TASK_WAKING && wake_at < next) {
+			next = wake_at;
+		}
+		if(task == TASK_RUNNING && done_at <= next) {
+			next = done_at;
+		}
+		advance(&now, next);
+
+		if(task == TASK_RUNNING && now == done_at) {
+			rate_group_complete(&group);
+
+			if(expected.cycle_cnt > 0 &&
+			   (uint32_t)(host_dwt.CYCCNT - cycle_release_time) > deadline) {
+				expected.deadline_miss++;
+			}
+			expected.exec_hist[hist_bin((uint32_t)(now - start))]++;
+			expected.cycle_cnt++;
+
+			/* the semaphore was given meanwhile, the task takes it right away */
+			if(given == true) {
+				task = TASK_WAKING;
+				wake_at = now + WAKE_CYCLES;
+			} else {
+				task = TASK_WAITING;
+			}
+		} else if(task == TASK_WAKING && now == wake_at) {
+			dt_sum += rate_group_wait(&group);
+
+			given = false;
+			cycle_release_time = release_time;
+			start = now;
+			wake_cnt++;
+
+			uint32_t load = s->load_us;
+			if(s->spike_interval > 0 && (wake_cnt % s->spike_interval) == 0) {
+				load = s->spike_us;
+			}
+			done_at = now + US_TO_CYCLES(load);
+			task = TASK_RUNNING;
+		} else {
+			BaseType_t woken;
+			rate_group_trigger_from_isr(&group, host_dwt.CYCCNT, &woken);
+
+			if(tick == 0) {
+				if(task == TASK_RUNNING && expected.cycle_cnt > 0) {
+					expected.overrun++;
+				}
+				if(given == true) {
+					if(expected.cycle_cnt > 0) {
+						expected.skipped++;
+					}
+				} else {
+					given = true;
+					release_time = host_dwt.CYCCNT;
+					if(task == TASK_WAITING) {
+						task = TASK_WAKING;
+						wake_at = now + WAKE_CYCLES;
+					}
+				}
+			}
+			tick = (tick + 1) % divider;
+
+			next_trigger += TRIGGER_CYCLES;
+			trigger_cnt++;
+		}
+	}
+
+	uint32_t jitter_cnt = 0;
+	bool hist_ok = true;
+	int i;
+	for(i = 0; i < RATE_GROUP_HIST_BINS; i++) {
+		jitter_cnt += group.jitter_hist[i];
+		hist_ok &= (group.exec_hist[i] == expected.exec_hist[i]);
+	}
+
+	bool pass = (group.cycle_cnt == expected.cycle_cnt) &&
+	            (group.deadline_miss == expected.deadline_miss) &&
+	            (group.overrun == expected.overrun) &&
+	            (group.skipped == expected.skipped) &&
+	            (hist_ok == true) &&
+	            (jitter_cnt + 1 == wake_cnt); //no period before the first wake up
+
+	/* the injected load has to show up, otherwise the check proves nothing */
+	uint32_t faults = expected.deadline_miss + expected.overrun + expected.skipped;
+	pass &= (s->expect_faults == true) ? (faults > 0) : (faults == 0);
+
+	printf("%-44s cycles %6u, miss %5u/%5u, overrun %5u/%5u, skipped %5u/%5u, mean dt %.3fms %s\n",
+	       s->name, group.cycle_cnt,
+	       group.deadline_miss, expected.deadline_miss,
+	       group.overrun, expected.overrun,
+	       group.skipped, expected.skipped,
+	       dt_sum / wake_cnt * 1000.0, (pass == true) ? "ok" : "FAIL");
+
+	if(hist_ok == false) {
+		printf("  exec histogram [us, measured/expected]:");
+		for(i = 0; i < RATE_GROUP_HIST_BINS; i++) {
+			printf(" <%d:%u/%u", 1 << i, group.exec_hist[i], expected.exec_hist[i]);
+		}
+		printf("\n");
+	}
+
+	return pass;
+}
+
+/* every word of a slot value holds its publish count */
+typedef struct {
+	uint32_t word[SLOT_WORDS];
+} slot_value_t;
+
+SLOT_ALLOC(check_slot, slot_value_t);
+
+void *__real_memcpy(void *dst, const void *src, size_t n);
+
+/* reader copy that gets preempted: slot_read() copies into slot_reader_buf,
+ * at byte slot_preempt_offset of its first copy the writer runs */
+static slot_value_t slot_reader_buf;
+static bool slot_preempt_armed = false;
+static size_t slot_preempt_offset;
+static int slot_preempt_publish_cnt;
+static int slot_copy_cnt;
+static bool slot_first_copy_torn;
+
+static uint32_t slot_writer_cnt;
+
+static void slot_writer_publish(void)
+{
+	slot_value_t value;
+	slot_writer_cnt++;
+	int i;
+	for(i = 0; i < SLOT_WORDS; i++) {
+		value.word[i] = slot_writer_cnt;
+	}
+	slot_publish(&check_slot, &value);
+}
+
+static bool slot_value_torn(const slot_value_t *value)
+{
+	int i;
+	for(i = 1; i < SLOT_WORDS; i++) {
+		if(value->word[i] != value->word[0]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void *__wrap_memcpy(void *dst, const void *src, size_t n)
+{
+	if(dst != &slot_reader_buf || slot_preempt_armed == false) {
+		return __real_memcpy(dst, src, n);
+	}
+
+	slot_copy_cnt++;
+	if(slot_copy_cnt > 1) {
+		return __real_memcpy(dst, src, n);
+	}
+
+	/* byte by byte, the writer preempts the first copy */
+	uint8_t *d = dst;
+	const volatile uint8_t *s = src;
+	size_t i;
+	for(i = 0; i <= n; i++) {
+		if(i == slot_preempt_offset) {
+			int p;
+			for(p = 0; p < slot_preempt_publish_cnt; p++) {
+				slot_writer_publish();
+			}
+		}
+		if(i < n) {
+			d[i] = s[i];
+		}
+	}
+
+	slot_first_copy_torn = slot_value_torn(dst);
+	return dst;
+}
+
+/* preempts the reader at every byte of the copy and right after it */
+static bool run_slot_scenario(int publish_cnt)
+{
+	uint32_t torn_cnt = 0, wrong_cnt = 0, retry_miss_cnt = 0, first_torn_cnt = 0, read_cnt = 0;
+
+	size_t offset;
+	for(offset = 0; offset <= sizeof(slot_value_t); offset++) {
+		slot_writer_publish();
+
+		slot_preempt_armed = true;
+		slot_preempt_offset = offset;
+		slot_preempt_publish_cnt = publish_cnt;
+		slot_copy_cnt = 0;
+		slot_first_copy_torn = false;
+
+		uint32_t seq = slot_read(&check_slot, &slot_reader_buf);
+		slot_preempt_armed = false;
+		read_cnt++;
+
+		torn_cnt += slot_value_torn(&slot_reader_buf);
+		wrong_cnt += (slot_reader_buf.word[0] != seq) || (seq != slot_writer_cnt);
+		retry_miss_cnt += (slot_copy_cnt != ((publish_cnt > 0) ? 2 : 1));
+		first_torn_cnt += slot_first_copy_torn;
+	}
+
+	/* a single publish leaves the copied buffer alone, a second one overwrites it */
+	bool pass = torn_cnt == 0 && wrong_cnt == 0 && retry_miss_cnt == 0 &&
+	            ((publish_cnt >= 2) ? (first_torn_cnt > 0) : (first_torn_cnt == 0));
+
+	char name[64];
+	snprintf(name, sizeof(name), "slot, %d publish%s during the copy", publish_cnt, (publish_cnt == 1) ? "" : "es");
+	printf("%-44s reads %3u, torn %u, stale %u, retry missing %u, torn without the retry %3u %s\n",
+	       name, read_cnt, torn_cnt, wrong_cnt, retry_miss_cnt, first_torn_cnt, (pass == true) ? "ok" : "FAIL");
+
+	return pass;
+}
+
+/* stubs of the drivers and tasks mpu6500.c talks to, the frames are all zero */
+void GPIO_SetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+}
+
+void GPIO_ResetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+}
+
+uint8_t spi_read_write(SPI_TypeDef *spi_channel, uint8_t data)
+{
+	return 0;
+}
+
+bool delay_elapsed_ms(uint32_t start, uint32_t ms)
+{
+	return true;
+}
+
+void deferred_work_signal_from_isr(int src)
+{
+}
+
+void gyro_fft_push(vector3d_f_t *gyro)
+{
+}
+
+void dyn_notch_apply(vector3d_f_t *gyro)
+{
+}
+
+void rpm_filter_apply(vector3d_f_t *gyro)
+{
+}
+
+/* the gyro bias is restored at the temperature of the frames (raw 0 = 21degC),
+ * the first sample already finishes the initialization */
+bool flash_param_load(uint16_t id, void *data, size_t size)
+{
+	if(id == FLASH_PARAM_GYRO_BIAS && size == sizeof(float) * 4) {
+		float bias[4] = {0.0f, 0.0f, 0.0f, 21.0f};
+		memcpy(data, bias, size);
+		return true;
+	}
+
+	return false;
+}
+
+bool flash_param_store(uint16_t id, const void *data, size_t size)
+{
+	return true;
+}
+
+typedef struct {
+	const char *name;
+	int rate;          //[Hz]
+	float deadline_us;
+	uint32_t load_us;  //execution time of every cycle
+} imu_group_scenario_t;
+
+/* the groups of fc_task.h with loads that fit into one imu sample period
+ * together, so every task completes before the next data ready */
+static const imu_group_scenario_t imu_group_scenarios[] = {
+	{"imu trigger, rate loop", RATE_CTL_RATE, RATE_CTL_DEADLINE, 40},
+	{"imu trigger, attitude loop", ATTITUDE_CTL_RATE, ATTITUDE_CTL_DEADLINE, 40},
+	{"imu trigger, position loop", POSITION_CTL_RATE, POSITION_CTL_DEADLINE, 15}
+};
+
+#define IMU_GROUP_CNT (sizeof(imu_group_scenarios) / sizeof(imu_group_scenarios[0]))
+
+static imu_t imu;
+static rate_group_t imu_groups[IMU_GROUP_CNT];
+static long imu_sample_index;
+static long imu_trigger_cnt;
+static long imu_trigger_misaligned;
+
+/* same as the one of fc_task.c, mpu6500_decode() calls it on every n-th sample */
+void flight_ctl_trigger_handler(void)
+{
+	uint32_t sample_time = imu.sample_time;
+
+	unsigned int i;
+	for(i = 0; i < IMU_GROUP_CNT; i++) {
+		rate_group_trigger(&imu_groups[i], sample_time);
+	}
+
+	imu_trigger_cnt++;
+	imu_trigger_misaligned += ((imu_sample_index % (8000 / RATE_CTL_RATE)) != (8000 / RATE_CTL_RATE) - 1);
+}
+
+/* expected accounting of one group, the model knows when the sample was
+ * taken, when the task woke up and when it completed */
+typedef struct {
+	uint32_t cycle_cnt;
+	long release_index_error;
+	uint32_t sample_time_last;
+	uint64_t wake_first, wake_last;
+	double dt_sum, dt_err_max, period_err_max;
+	uint32_t wake_max, wake_last_latency, response_max;
+	double wake_avg;
+} imu_group_model_t;
+
+static bool run_imu_trigger_scenario(void)
+{
+	imu_group_model_t model[IMU_GROUP_CNT];
+	memset(model, 0, sizeof(model));
+
+	host_dwt.CYCCNT = CYCCNT_START;
+	srand(1);
+
+	unsigned int g;
+	for(g = 0; g < IMU_GROUP_CNT; g++) {
+		const imu_group_scenario_t *s = &imu_group_scenarios[g];
+		rate_group_init(&imu_groups[g], RATE_CTL_RATE, s->rate, s->deadline_us);
+	}
+	mpu6500_init(&imu);
+
+	uint64_t now = 0;
+	long overrun_sample_cnt = 0;
+
+	for(imu_sample_index = 0; imu_sample_index < IMU_SAMPLE_CNT; imu_sample_index++) {
+		uint64_t data_ready = (uint64_t)imu_sample_index * IMU_SAMPLE_CYCLES;
+		if(now > data_ready) {
+			overrun_sample_cnt++;
+		}
+
+		advance(&now, data_ready + rand() % (IMU_ISR_LATENCY_MAX + 1));
+		uint32_t sample_time = host_dwt.CYCCNT;
+		mpu6500_int_handler();
+
+		advance(&now, now + IMU_DEFERRED_MIN + rand() % (IMU_DEFERRED_MAX - IMU_DEFERRED_MIN + 1));
+		mpu6500_process();
+
+		/* released tasks run in priority order, the semaphore shows the release */
+		for(g = 0; g < IMU_GROUP_CNT; g++) {
+			rate_group_t *group = &imu_groups[g];
+			imu_group_model_t *m = &model[g];
+			const imu_group_scenario_t *s = &imu_group_scenarios[g];
+
+			if(group->semphr->given == 0) {
+				continue;
+			}
+
+			advance(&now, now + WAKE_CYCLES);
+			float dt = rate_group_wait(group);
+
+			/* every group is released on the same sample as the rate loop */
+			long release_index = m->cycle_cnt * (8000 / s->rate) + (8000 / RATE_CTL_RATE) - 1;
+			m->release_index_error += (imu_sample_index != release_index);
+
+			uint32_t wake_latency = host_dwt.CYCCNT - sample_time;
+			if(m->cycle_cnt == 0) {
+				m->wake_first = now;
+				m->wake_avg = wake_latency;
+			} else {
+				double dt_expected = (double)(uint32_t)(sample_time - m->sample_time_last) / PROFILER_CPU_FREQ;
+				m->dt_sum += dt;
+				m->dt_err_max = fmax(m->dt_err_max, fabs(dt - dt_expected));
+				m->period_err_max = fmax(m->period_err_max,
+				                         fabs((double)(now - m->wake_last) / PROFILER_CPU_FREQ - 1.0 / s->rate));
+				m->wake_avg = wake_latency * 0.01 + m->wake_avg * 0.99;
+			}
+			m->wake_max = (wake_latency > m->wake_max) ? wake_latency : m->wake_max;
+			m->wake_last_latency = wake_latency;
+			m->sample_time_last = sample_time;
+			m->wake_last = now;
+
+			advance(&now, now + US_TO_CYCLES(s->load_us));
+			rate_group_complete(group);
+
+			uint32_t response = host_dwt.CYCCNT - sample_time;
+			m->response_max = (response > m->response_max) ? response : m->response_max;
+			m->cycle_cnt++;
+		}
+	}
+
+	bool pass = (imu_trigger_cnt == IMU_SAMPLE_CNT / (8000 / RATE_CTL_RATE)) && (imu_trigger_misaligned == 0) &&
+	            (overrun_sample_cnt == 0);
+
+	printf("%-44s samples %6d, triggers %6ld, misaligned %ld, late samples %ld %s\n", "imu trigger, divider",
+	       IMU_SAMPLE_CNT, imu_trigger_cnt, imu_trigger_misaligned, overrun_sample_cnt, (pass == true) ? "ok" : "FAIL");
+
+	for(g = 0; g < IMU_GROUP_CNT; g++) {
+		rate_group_t *group = &imu_groups[g];
+		imu_group_model_t *m = &model[g];
+		const imu_group_scenario_t *s = &imu_group_scenarios[g];
+
+		/* whole periods from the first to the last wake up, the jitter averages out */
+		double period = (double)(m->wake_last - m->wake_first) / (m->cycle_cnt - 1) / PROFILER_CPU_FREQ;
+		double dt_mean = m->dt_sum / (m->cycle_cnt - 1);
+		double latency_bound = (double)IMU_ISR_LATENCY_MAX / PROFILER_CPU_FREQ + 1e-7;
+		uint32_t faults = group->deadline_miss + group->overrun + group->skipped;
+
+		bool ok = (m->cycle_cnt == (uint32_t)(IMU_SAMPLE_CNT / (8000 / s->rate))) &&
+		          (group->cycle_cnt == m->cycle_cnt) && (m->release_index_error == 0) && (faults == 0) &&
+		          (fabs(period - 1.0 / s->rate) < 1e-8) &&
+		          (m->dt_err_max < 1e-6 * (1.0 / s->rate)) &&        //float resolution of the dt
+		          (fabs(dt_mean - 1.0 / s->rate) < latency_bound) &&
+		          (m->period_err_max > latency_bound) &&           //the deferred work jitters the wake up
+		          (group->wake_profiler.max == m->wake_max) &&
+		          (group->wake_profiler.last == m->wake_last_latency) &&
+		          (fabs(group->wake_profiler.avg - m->wake_avg) < 1e-3 * m->wake_avg) &&
+		          (group->response_profiler.max == m->response_max);
+
+		printf("%-44s cycles %6u, period %.4fms, dt %.4fms (err %.1e), wake up jitter %.2fus, "
+		       "wake up max %.2f/%.2fus avg %.2f/%.2fus, response max %.2f/%.2fus %s\n",
+		       s->name, group->cycle_cnt, period * 1000.0, dt_mean * 1000.0, m->dt_err_max, m->period_err_max * 1e6,
+		       profiler_cycles_to_us(group->wake_profiler.max), profiler_cycles_to_us(m->wake_max),
+		       profiler_cycles_to_us(group->wake_profiler.avg), profiler_cycles_to_us(m->wake_avg),
+		       profiler_cycles_to_us(group->response_profiler.max), profiler_cycles_to_us(m->response_max),
+		       (ok == true) ? "ok" : "FAIL");
+
+		pass &= ok;
+	}
+
+	return pass;
+}
+
+int main(void)
+{
+	bool pass = true;
+
+	unsigned int i;
+	for(i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+		pass &= run_scenario(&scenarios[i]);
+	}
+
+	int publish_cnt;
+	for(publish_cnt = 0; publish_cnt <= SLOT_PREEMPT_MAX; publish_cnt++) {
+		pass &= run_slot_scenario(publish_cnt);
+	}
+
+	pass &= run_imu_trigger_scenario();
+
+	printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}
@@ -0,0 +1,44 @@
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+#include "FreeRTOS.h"
+
+typedef struct {
+	int given;
+} StaticSemaphore_t;
+
+typedef StaticSemaphore_t *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buf)
+{
+	buf->given = 0;
+	return buf;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semphr)
+{
+	if(semphr->given) {
+		return pdFALSE;
+	}
+	semphr->given = 1;
+	return pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semphr,
+                                               BaseType_t *higher_priority_task_woken)
+{
+	*higher_priority_task_woken = pdTRUE;
+	return xSemaphoreGive(semphr);
+}
+
+/* never blocks, the simulation only wakes the task while the semaphore is given */
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semphr, uint32_t ticks)
+{
+	if(semphr->given == 0) {
+		return pdFALSE;
+	}
+	semphr->given = 0;
+	return pdTRUE;
+}
+
+#endif
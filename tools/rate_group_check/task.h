@@ -0,0 +1,9 @@
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+/* see FreeRTOS.h, the critical sections of the imu driver run in one thread */
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+
+#endif
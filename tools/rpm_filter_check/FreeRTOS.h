@@ -0,0 +1,9 @@
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+/* host replacement of the kernel, isr.h only needs the interrupt priority
+ * of the kernel configuration */
+
+#define configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY 5
+
+#endif
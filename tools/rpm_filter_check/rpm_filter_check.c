@@ -0,0 +1,443 @@
+/* host check of the bidirectional dshot telemetry and the rpm notch bank,
+ * dshot.c, rpm_filter.c and biquad.c of the flight code run against emulated
+ * dma streams and escs.
+ *
+ * usage: make check
+ *
+ * every rate loop period dshot_write() sends the frames, the check reads them
+ * back from the output buffers and raises the frame end interrupts. the
+ * escs then reply: the 12 bit period and its crc are gcr encoded and every
+ * "1" of the code becomes an edge timestamp in the capture buffer, with
+ * jitter and a timer that wraps. the next dshot_write() decodes the replies.
+ *
+ * the decoded motor frequency has to be the one of the period sent, a reply
+ * with a flipped bit or without edges has to be rejected. the notch bank is
+ * tuned with the decoded frequencies like task_rate_ctl() does and has to
+ * attenuate the motor tones on a simulated 8kHz gyro, while a manoeuvre
+ * passes. returns non-zero if any scenario fails */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include "stm32f4xx.h"
+#include "dshot.h"
+#include "rpm_filter.h"
+
+#define SAMPLE_RATE 8000.0   //MPU6500_SAMPLE_RATE [Hz]
+#define RATE_LOOP_PERIOD 4   //RATE_CTL_RATE of fc_task.h [samples]
+
+#define FRAME_BIT_1 112      //DSHOT_BIT_1 of dshot.c
+#define FRAME_BIT_0 56
+#define FRAME_SIZE 18
+#define TELEM_BIT_PERIOD 120 //timer ticks at 90MHz per telemetry bit
+#define TELEM_JITTER 25      //per edge, an interval is rounded to bits within +-60 ticks [ticks]
+#define TELEM_STOPPED 0x0fff
+#define TELEM_QUANTIZATION_MAX 0.005 //whole microseconds and a 9 bit mantissa of the period
+
+#define TELEM_CYCLES 20000
+#define CORRUPT_VALUES 500
+
+DWT_Type host_dwt;
+CoreDebug_Type host_core_debug;
+TIM_TypeDef host_tim1, host_tim4;
+DMA_Stream_TypeDef host_dma1_stream0, host_dma1_stream3, host_dma2_stream4, host_dma2_stream6;
+GPIO_TypeDef host_gpiod, host_gpioe;
+
+extern rpm_filter_t rpm_filter;
+
+void DMA1_Stream0_IRQHandler(void);
+void DMA2_Stream4_IRQHandler(void);
+
+/* streams of motor 1~4 in dshot.c */
+static DMA_Stream_TypeDef *const motor_stream[DSHOT_MOTOR_CNT] = {
+	&host_dma1_stream0, &host_dma1_stream3, &host_dma2_stream4, &host_dma2_stream6
+};
+
+/* 4 bits to 5 bits gcr */
+static const uint8_t gcr_encode_table[16] = {
+	0x19, 0x1b, 0x12, 0x13, 0x1d, 0x15, 0x16, 0x17,
+	0x1a, 0x09, 0x0a, 0x0b, 0x1e, 0x0d, 0x0e, 0x0f
+};
+
+/* the executable is linked below 4GB (-no-pie), so the 32 bit dma address
+ * registers of the driver hold the whole pointer */
+void DMA_Init(DMA_Stream_TypeDef *stream, DMA_InitTypeDef *init)
+{
+	stream->buf = (uint16_t *)(uintptr_t)init->DMA_Memory0BaseAddr;
+	stream->size = init->DMA_BufferSize;
+	stream->remaining = init->DMA_BufferSize;
+	stream->dir = init->DMA_DIR;
+}
+
+void DMA_Cmd(DMA_Stream_TypeDef *stream, FunctionalState state)
+{
+	stream->enabled = state;
+}
+
+FunctionalState DMA_GetCmdStatus(DMA_Stream_TypeDef *stream)
+{
+	return stream->enabled;
+}
+
+uint16_t DMA_GetCurrDataCounter(DMA_Stream_TypeDef *stream)
+{
+	return stream->remaining;
+}
+
+static double uniform(void)
+{
+	return (double)rand() / RAND_MAX - 0.5;
+}
+
+/* throttle of the frame in the output buffer of a motor, -1 if the frame or
+ * its inverted crc is broken */
+static int frame_read(int motor)
+{
+	DMA_Stream_TypeDef *stream = motor_stream[motor];
+	if(stream->dir != DMA_DIR_MemoryToPeripheral || stream->size != FRAME_SIZE) {
+		return -1;
+	}
+
+	uint16_t packet = 0;
+	int i;
+	for(i = 0; i < 16; i++) {
+		if(stream->buf[i] != FRAME_BIT_1 && stream->buf[i] != FRAME_BIT_0) {
+			return -1;
+		}
+		packet = (packet << 1) | (stream->buf[i] == FRAME_BIT_1);
+	}
+	if(stream->buf[16] != 0 || stream->buf[17] != 0) {
+		return -1; //line has to stay idle after the frame
+	}
+
+	uint16_t data = packet >> 4;
+	if(((~(data ^ (data >> 4) ^ (data >> 8))) & 0x0f) != (packet & 0x0f)) {
+		return -1;
+	}
+
+	return data >> 1;
+}
+
+/* 12 bit telemetry value of a motor frequency, the period is truncated to a
+ * 9 bit mantissa like the esc does */
+static uint16_t telem_value(double motor_freq)
+{
+	if(motor_freq <= 0.0) {
+		return TELEM_STOPPED;
+	}
+
+	uint32_t period_us = (uint32_t)(60000000.0 / (motor_freq * 60.0 * DSHOT_MOTOR_POLE_PAIRS));
+	uint32_t exponent = 0;
+	while(period_us > 0x01ff) {
+		period_us >>= 1;
+		exponent++;
+	}
+
+	return (exponent << 9) | period_us;
+}
+
+/* motor frequency the driver has to decode from a telemetry value */
+static double telem_motor_freq(uint16_t value)
+{
+	if(value == TELEM_STOPPED) {
+		return 0.0;
+	}
+
+	uint32_t period_us = (value & 0x01ff) << (value >> 9);
+	return 60000000.0 / period_us / (60.0 * DSHOT_MOTOR_POLE_PAIRS);
+}
+
+/* the driver converts in single precision */
+static bool freq_equal(double decoded, double expected)
+{
+	return fabs(decoded - expected) <= 1e-5 * expected;
+}
+
+/* writes the reply edges into the capture buffer of a motor, flip_bit >= 0
+ * corrupts one bit of the 20 bits gcr code, edges = false gives no reply */
+static void esc_reply(int motor, uint16_t value, int flip_bit, bool edges)
+{
+	DMA_Stream_TypeDef *stream = motor_stream[motor];
+	if(edges == false) {
+		stream->remaining = stream->size;
+		return;
+	}
+
+	uint16_t crc = (~(value ^ (value >> 4) ^ (value >> 8))) & 0x0f;
+	uint16_t data = (value << 4) | crc;
+
+	uint32_t gcr = 1 << 20; //start bit
+	int i;
+	for(i = 0; i < 4; i++) {
+		gcr |= (uint32_t)gcr_encode_table[(data >> (i * 4)) & 0x0f] << (i * 5);
+	}
+	if(flip_bit >= 0) {
+		gcr ^= 1 << flip_bit;
+	}
+
+	/* the timer runs free from the capture start, so the timestamps wrap */
+	uint16_t start = rand();
+	uint32_t edge_cnt = 0;
+	for(i = 20; i >= 0; i--) {
+		if(gcr & (1 << i)) {
+			int jitter = (int)(2.0 * TELEM_JITTER * uniform());
+			stream->buf[edge_cnt++] = (uint16_t)(start + (20 - i) * TELEM_BIT_PERIOD + jitter);
+		}
+	}
+	stream->remaining = stream->size - edge_cnt;
+}
+
+/* one rate loop period: the frames are sent and read back, the previous
+ * replies are decoded. returns false if a frame is broken */
+static bool dshot_cycle(const int *throttle)
+{
+	int i;
+	for(i = 0; i < DSHOT_MOTOR_CNT; i++) {
+		dshot_throttle[i] = throttle[i];
+	}
+	dshot_write();
+
+	bool frames_ok = true;
+	for(i = 0; i < DSHOT_MOTOR_CNT; i++) {
+		frames_ok &= frame_read(i) == throttle[i];
+	}
+
+	/* frame end, the channels switch to capture */
+	DMA1_Stream0_IRQHandler();
+	DMA2_Stream4_IRQHandler();
+
+	return frames_ok;
+}
+
+static bool check_telemetry(void)
+{
+	srand(1);
+
+	int throttle[DSHOT_MOTOR_CNT] = {0};
+	uint16_t value[DSHOT_MOTOR_CNT];
+	long frame_error_cnt = 0, decode_error_cnt = 0;
+	double quantization_max = 0.0;
+
+	int i;
+	for(i = 0; i < DSHOT_MOTOR_CNT; i++) {
+		value[i] = TELEM_STOPPED;
+	}
+	frame_error_cnt += dshot_cycle(throttle) == false;
+
+	long n;
+	for(n = 0; n < TELEM_CYCLES; n++) {
+		/* replies to the frames of the previous period */
+		for(i = 0; i < DSHOT_MOTOR_CNT; i++) {
+			esc_reply(i, value[i], -1, true);
+		}
+
+		double motor_freq[DSHOT_MOTOR_CNT];
+		for(i = 0; i < DSHOT_MOTOR_CNT; i++) {
+			motor_freq[i] = (n % 50 == 0) ? 0.0 : 20.0 + 580.0 * (uniform() + 0.5); //[Hz]
+			throttle[i] = DSHOT_THROTTLE_MIN + rand() % (DSHOT_THROTTLE_MAX - DSHOT_THROTTLE_MIN + 1);
+		}
+		frame_error_cnt += dshot_cycle(throttle) == false;
+
+		for(i = 0; i < DSHOT_MOTOR_CNT; i++) {
+			double decoded = dshot_get_motor_freq(i);
+			double expected = telem_motor_freq(value[i]);
+			if(freq_equal(decoded, expected) == false) {
+				decode_error_cnt++;
+			}
+			if(expected > 0.0) {
+				quantization_max = fmax(quantization_max, fabs(decoded - expected) / expected);
+			}
+
+			value[i] = telem_value(motor_freq[i]);
+			if(motor_freq[i] > 0.0) {
+				quantization_max = fmax(quantization_max,
+				                        fabs(telem_motor_freq(value[i]) - motor_freq[i]) / motor_freq[i]);
+			}
+		}
+	}
+
+	bool pass = frame_error_cnt == 0 && decode_error_cnt == 0 && quantization_max < TELEM_QUANTIZATION_MAX;
+
+	printf("%-22s %d periods, %ld broken frames, %ld wrong frequencies, "
+	       "period quantization %.2f%%/%.1f %s\n", "telemetry", TELEM_CYCLES, frame_error_cnt,
+	       decode_error_cnt, 100.0 * quantization_max, 100.0 * TELEM_QUANTIZATION_MAX, (pass == true) ? "ok" : "FAIL");
+
+	return pass;
+}
+
+/* a flipped gcr bit and a missing reply have to keep the last frequency */
+static bool check_corrupted_replies(void)
+{
+	srand(2);
+
+	int throttle[DSHOT_MOTOR_CNT] = {DSHOT_THROTTLE_MIN, DSHOT_THROTTLE_MIN, DSHOT_THROTTLE_MIN, DSHOT_THROTTLE_MIN};
+	long accepted_cnt = 0, reply_cnt = 0, lost_cnt = 0;
+
+	dshot_cycle(throttle);
+
+	long n;
+	for(n = 0; n < CORRUPT_VALUES; n++) {
+		uint16_t good = telem_value(100.0 + 400.0 * (uniform() + 0.5));
+		uint16_t bad = telem_value(100.0 + 400.0 * (uniform() + 0.5));
+
+		int flip;
+		for(flip = -1; flip < 20; flip++) {
+			int i;
+			for(i = 0; i < DSHOT_MOTOR_CNT; i++) {
+				esc_reply(i, good, -1, true);
+			}
+			dshot_cycle(throttle);
+
+			/* motor 0 replies with a bit error, motor 1 does not reply */
+			esc_reply(0, bad, flip, true);
+			esc_reply(1, bad, -1, false);
+			esc_reply(2, bad, -1, true);
+			esc_reply(3, bad, -1, true);
+			dshot_cycle(throttle);
+
+			if(flip >= 0) {
+				reply_cnt++;
+				accepted_cnt += freq_equal(dshot_get_motor_freq(0), telem_motor_freq(good)) == false;
+			}
+			lost_cnt += freq_equal(dshot_get_motor_freq(1), telem_motor_freq(good)) == false;
+			lost_cnt += freq_equal(dshot_get_motor_freq(2), telem_motor_freq(bad)) == false;
+		}
+	}
+
+	bool pass = accepted_cnt == 0 && lost_cnt == 0;
+
+	printf("%-22s %ld replies with a flipped bit, %ld accepted, %ld wrong missing or intact replies %s\n",
+	       "corrupted replies", reply_cnt, accepted_cnt, lost_cnt, (pass == true) ? "ok" : "FAIL");
+
+	return pass;
+}
+
+typedef struct {
+	const char *name;
+	double freq_start[DSHOT_MOTOR_CNT]; //motor fundamental [Hz]
+	double freq_end[DSHOT_MOTOR_CNT];
+	bool telemetry;                     //false: the escs do not reply
+	double attenuation_min;             //of the tones [dB]
+	double attenuation_max;
+} notch_scenario_t;
+
+#define NOTCH_SIM_TIME 4.0        //[s]
+#define NOTCH_SETTLE_TIME 0.5     //[s]
+#define NOTCH_TONE_AMPLITUDE 5.0  //fundamental of each motor, the 2nd and 3rd harmonics have 1/2 and 1/4 [deg/s]
+#define NOTCH_MOTION_AMPLITUDE 20.0 //[deg/s]
+#define NOTCH_MOTION_ERROR_MAX 0.02 //rms, relative to the manoeuvre, the phase lag of the notches
+
+static const notch_scenario_t notch_scenarios[] = {
+	{"steady motors", {180.0, 190.0, 200.0, 210.0}, {180.0, 190.0, 200.0, 210.0}, true, 30.0, 1e9},
+	{"motor sweep", {120.0, 130.0, 140.0, 150.0}, {300.0, 280.0, 260.0, 240.0}, true, 20.0, 1e9},
+	{"no telemetry", {180.0, 190.0, 200.0, 210.0}, {180.0, 190.0, 200.0, 210.0}, false, -1e9, 1.0}
+};
+
+static bool check_notch(const notch_scenario_t *s)
+{
+	srand(3);
+	dshot_init();
+	rpm_filter_init(SAMPLE_RATE);
+
+	biquad_state_t motion_state[RPM_FILTER_MOTOR_CNT][RPM_FILTER_HARMONIC_CNT];
+	int m, h;
+	for(m = 0; m < RPM_FILTER_MOTOR_CNT; m++) {
+		for(h = 0; h < RPM_FILTER_HARMONIC_CNT; h++) {
+			biquad_reset(&motion_state[m][h]);
+		}
+	}
+
+	int throttle[DSHOT_MOTOR_CNT] = {1000, 1000, 1000, 1000};
+	double phase[DSHOT_MOTOR_CNT] = {0.0};
+	double tone_sq_sum = 0.0, residual_sq_sum = 0.0, motion_sq_sum = 0.0, motion_error_sq_sum = 0.0;
+
+	/* the escs reply to the stopped state first */
+	for(m = 0; m < DSHOT_MOTOR_CNT; m++) {
+		esc_reply(m, TELEM_STOPPED, -1, true);
+	}
+	dshot_cycle(throttle);
+
+	long k;
+	for(k = 0; k < (long)(SAMPLE_RATE * NOTCH_SIM_TIME); k++) {
+		double t = k / SAMPLE_RATE;
+
+		double motor_freq[DSHOT_MOTOR_CNT];
+		for(m = 0; m < DSHOT_MOTOR_CNT; m++) {
+			motor_freq[m] = s->freq_start[m] + (s->freq_end[m] - s->freq_start[m]) * t / NOTCH_SIM_TIME;
+		}
+
+		/* task_rate_ctl(): the motors are written, the notches get the telemetry */
+		if((k % RATE_LOOP_PERIOD) == 0) {
+			for(m = 0; m < DSHOT_MOTOR_CNT; m++) {
+				esc_reply(m, telem_value(motor_freq[m]), -1, s->telemetry);
+			}
+			dshot_cycle(throttle);
+			for(m = 0; m < RPM_FILTER_MOTOR_CNT; m++) {
+				rpm_filter_set_motor_freq(m, dshot_get_motor_freq(m));
+			}
+		}
+
+		double tone = 0.0;
+		for(m = 0; m < DSHOT_MOTOR_CNT; m++) {
+			phase[m] += 2.0 * M_PI * motor_freq[m] / SAMPLE_RATE;
+			tone += NOTCH_TONE_AMPLITUDE * (sin(phase[m]) + 0.5 * sin(2.0 * phase[m]) + 0.25 * sin(3.0 * phase[m]));
+		}
+		double motion = NOTCH_MOTION_AMPLITUDE * sin(2.0 * M_PI * 2.0 * t);
+
+		vector3d_f_t gyro = {motion + tone, motion, tone};
+		rpm_filter_apply(&gyro);
+
+		/* the manoeuvre through the coefficients rpm_filter_apply() just used */
+		double motion_out = motion;
+		for(m = 0; m < RPM_FILTER_MOTOR_CNT; m++) {
+			for(h = 0; h < RPM_FILTER_HARMONIC_CNT; h++) {
+				motion_out = biquad_apply(&rpm_filter.coeff[m][h], &motion_state[m][h], motion_out);
+			}
+		}
+
+		if(t > NOTCH_SETTLE_TIME) {
+			double residual = gyro.x - motion_out;
+			tone_sq_sum += tone * tone;
+			residual_sq_sum += residual * residual;
+			motion_sq_sum += motion * motion;
+			motion_error_sq_sum += (gyro.y - motion) * (gyro.y - motion);
+		}
+	}
+
+	double attenuation = 10.0 * log10(tone_sq_sum / residual_sq_sum);
+	double motion_error = sqrt(motion_error_sq_sum / motion_sq_sum);
+
+	bool pass = attenuation >= s->attenuation_min && attenuation <= s->attenuation_max &&
+	            motion_error <= NOTCH_MOTION_ERROR_MAX;
+
+	printf("%-22s tone attenuation %5.1fdB", s->name, attenuation);
+	if(s->attenuation_min > -1e9) {
+		printf("/%.0f", s->attenuation_min);
+	} else {
+		printf(", at most %.0f", s->attenuation_max);
+	}
+	printf(", manoeuvre error %.2f%%/%.0f %s\n", 100.0 * motion_error, 100.0 * NOTCH_MOTION_ERROR_MAX,
+	       (pass == true) ? "ok" : "FAIL");
+
+	return pass;
+}
+
+int main(void)
+{
+	dshot_init();
+
+	bool pass = true;
+	pass &= check_telemetry();
+	pass &= check_corrupted_replies();
+
+	unsigned int i;
+	for(i = 0; i < sizeof(notch_scenarios) / sizeof(notch_scenarios[0]); i++) {
+		pass &= check_notch(&notch_scenarios[i]);
+	}
+
+	printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}
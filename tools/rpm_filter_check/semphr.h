@@ -0,0 +1,6 @@
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+/* see FreeRTOS.h */
+
+#endif
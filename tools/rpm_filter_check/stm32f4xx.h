@@ -0,0 +1,27 @@
+#ifndef __STM32F4xx_H
+#define __STM32F4xx_H
+
+/* host replacement of the device header, see stm32f4xx_conf.h. the profiler
+ * only needs the dwt cycle counter, which stays at zero on the host */
+
+#include "stm32f4xx_conf.h"
+
+typedef struct {
+	volatile uint32_t CTRL;
+	volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+	volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern DWT_Type host_dwt;
+extern CoreDebug_Type host_core_debug;
+
+#define DWT (&host_dwt)
+#define CoreDebug (&host_core_debug)
+
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+
+#endif
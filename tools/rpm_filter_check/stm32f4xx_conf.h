@@ -0,0 +1,217 @@
+#ifndef __STM32F4xx_CONF_H
+#define __STM32F4xx_CONF_H
+
+/* host replacement of the device headers for dshot.c. the timers, gpios and
+ * nvic are no-ops, the dma streams are emulated by rpm_filter_check.c: a
+ * stream remembers its buffer, the check reads the frames the driver sent
+ * from it and writes the edge timestamps of the esc reply into it */
+
+#include <stdint.h>
+
+typedef enum {DISABLE = 0, ENABLE = !DISABLE} FunctionalState;
+typedef enum {RESET = 0, SET = !RESET} FlagStatus, ITStatus;
+
+typedef struct {
+	volatile uint32_t CCR1;
+	volatile uint32_t CCR2;
+	volatile uint32_t CCR3;
+	volatile uint32_t CCR4;
+} TIM_TypeDef;
+
+typedef struct {
+	uint16_t *buf;       //memory address of the last DMA_Init()
+	uint32_t size;       //transfers configured
+	uint32_t remaining;  //NDTR, written by the check after a capture
+	uint32_t dir;
+	FunctionalState enabled;
+} DMA_Stream_TypeDef;
+
+typedef struct {
+	int unused;
+} GPIO_TypeDef;
+
+typedef struct {
+	uint16_t TIM_OCMode;
+	uint16_t TIM_OutputState;
+	uint32_t TIM_Pulse;
+	uint16_t TIM_OCPolarity;
+	uint16_t TIM_OCIdleState;
+} TIM_OCInitTypeDef;
+
+typedef struct {
+	uint16_t TIM_Channel;
+	uint16_t TIM_ICPolarity;
+	uint16_t TIM_ICSelection;
+	uint16_t TIM_ICPrescaler;
+	uint16_t TIM_ICFilter;
+} TIM_ICInitTypeDef;
+
+typedef struct {
+	uint16_t TIM_Prescaler;
+	uint16_t TIM_CounterMode;
+	uint32_t TIM_Period;
+	uint16_t TIM_ClockDivision;
+} TIM_TimeBaseInitTypeDef;
+
+typedef struct {
+	uint32_t DMA_Channel;
+	uint32_t DMA_PeripheralBaseAddr;
+	uint32_t DMA_Memory0BaseAddr;
+	uint32_t DMA_DIR;
+	uint32_t DMA_BufferSize;
+	uint32_t DMA_PeripheralInc;
+	uint32_t DMA_MemoryInc;
+	uint32_t DMA_PeripheralDataSize;
+	uint32_t DMA_MemoryDataSize;
+	uint32_t DMA_Mode;
+	uint32_t DMA_Priority;
+	uint32_t DMA_FIFOMode;
+	uint32_t DMA_FIFOThreshold;
+	uint32_t DMA_MemoryBurst;
+	uint32_t DMA_PeripheralBurst;
+} DMA_InitTypeDef;
+
+typedef struct {
+	uint32_t GPIO_Pin;
+	uint32_t GPIO_Mode;
+	uint32_t GPIO_Speed;
+	uint32_t GPIO_OType;
+	uint32_t GPIO_PuPd;
+} GPIO_InitTypeDef;
+
+typedef struct {
+	uint8_t NVIC_IRQChannel;
+	uint8_t NVIC_IRQChannelPreemptionPriority;
+	uint8_t NVIC_IRQChannelSubPriority;
+	FunctionalState NVIC_IRQChannelCmd;
+} NVIC_InitTypeDef;
+
+extern TIM_TypeDef host_tim1, host_tim4;
+extern DMA_Stream_TypeDef host_dma1_stream0, host_dma1_stream3, host_dma2_stream4, host_dma2_stream6;
+extern GPIO_TypeDef host_gpiod, host_gpioe;
+
+#define TIM1 (&host_tim1)
+#define TIM4 (&host_tim4)
+#define DMA1_Stream0 (&host_dma1_stream0)
+#define DMA1_Stream3 (&host_dma1_stream3)
+#define DMA2_Stream4 (&host_dma2_stream4)
+#define DMA2_Stream6 (&host_dma2_stream6)
+#define GPIOD (&host_gpiod)
+#define GPIOE (&host_gpioe)
+
+#define DMA1_Stream0_IRQn 11
+#define DMA2_Stream4_IRQn 60
+
+#define TIM_Channel_1 0x0000
+#define TIM_Channel_2 0x0004
+#define TIM_Channel_3 0x0008
+#define TIM_Channel_4 0x000c
+#define TIM_DMA_CC1 0x0200
+#define TIM_DMA_CC2 0x0400
+#define TIM_DMA_CC3 0x0800
+#define TIM_DMA_CC4 0x1000
+#define TIM_OCMode_PWM1 0x0060
+#define TIM_OutputState_Enable 0x0001
+#define TIM_OCPolarity_Low 0x0002
+#define TIM_OCIdleState_Set 0x0100
+#define TIM_OCPreload_Enable 0x0008
+#define TIM_ICPolarity_BothEdge 0x000a
+#define TIM_ICSelection_DirectTI 0x0001
+#define TIM_ICPSC_DIV1 0x0000
+#define TIM_CKD_DIV1 0x0000
+#define TIM_CounterMode_Up 0x0000
+
+#define DMA_Channel_2 0x04000000
+#define DMA_Channel_6 0x0c000000
+#define DMA_DIR_PeripheralToMemory 0x00000000
+#define DMA_DIR_MemoryToPeripheral 0x00000040
+#define DMA_PeripheralInc_Disable 0
+#define DMA_MemoryInc_Enable 0x00000400
+#define DMA_PeripheralDataSize_HalfWord 0x00000800
+#define DMA_MemoryDataSize_HalfWord 0x00002000
+#define DMA_Mode_Normal 0
+#define DMA_Priority_High 0x00020000
+#define DMA_FIFOMode_Disable 0
+#define DMA_FIFOThreshold_Full 0x00000003
+#define DMA_MemoryBurst_Single 0
+#define DMA_PeripheralBurst_Single 0
+#define DMA_IT_TC 0x00000010
+#define DMA_IT_TCIF0 0x10008020
+#define DMA_IT_TCIF4 0x20008020
+
+#define DMA_FLAG_FEIF0 0x10800001
+#define DMA_FLAG_DMEIF0 0x10800004
+#define DMA_FLAG_TEIF0 0x10000008
+#define DMA_FLAG_HTIF0 0x10000010
+#define DMA_FLAG_TCIF0 0x10000020
+#define DMA_FLAG_FEIF3 0x10400000
+#define DMA_FLAG_DMEIF3 0x11000000
+#define DMA_FLAG_TEIF3 0x12000000
+#define DMA_FLAG_HTIF3 0x14000000
+#define DMA_FLAG_TCIF3 0x18000000
+#define DMA_FLAG_FEIF4 0x20000001
+#define DMA_FLAG_DMEIF4 0x20000004
+#define DMA_FLAG_TEIF4 0x20000008
+#define DMA_FLAG_HTIF4 0x20000010
+#define DMA_FLAG_TCIF4 0x20000020
+#define DMA_FLAG_FEIF6 0x20010000
+#define DMA_FLAG_DMEIF6 0x20040000
+#define DMA_FLAG_TEIF6 0x20080000
+#define DMA_FLAG_HTIF6 0x20100000
+#define DMA_FLAG_TCIF6 0x20200000
+
+#define GPIO_Pin_12 0x1000
+#define GPIO_Pin_13 0x2000
+#define GPIO_Pin_14 0x4000
+#define GPIO_PinSource12 12
+#define GPIO_PinSource13 13
+#define GPIO_PinSource14 14
+#define GPIO_AF_TIM1 0x01
+#define GPIO_AF_TIM4 0x02
+#define GPIO_Mode_AF 0x02
+#define GPIO_Speed_100MHz 0x03
+#define GPIO_OType_PP 0x00
+#define GPIO_PuPd_UP 0x01
+
+#define RCC_AHB1Periph_GPIOD 0x00000008
+#define RCC_AHB1Periph_GPIOE 0x00000010
+#define RCC_AHB1Periph_DMA1 0x00200000
+#define RCC_AHB1Periph_DMA2 0x00400000
+#define RCC_APB1Periph_TIM4 0x00000004
+#define RCC_APB2Periph_TIM1 0x00000001
+
+/* emulated by the check */
+void DMA_Init(DMA_Stream_TypeDef *stream, DMA_InitTypeDef *init);
+void DMA_Cmd(DMA_Stream_TypeDef *stream, FunctionalState state);
+FunctionalState DMA_GetCmdStatus(DMA_Stream_TypeDef *stream);
+uint16_t DMA_GetCurrDataCounter(DMA_Stream_TypeDef *stream);
+
+/* no effect on the host, the frame end interrupt is raised by the check */
+static inline void DMA_ClearFlag(DMA_Stream_TypeDef *stream, uint32_t flag) {}
+static inline ITStatus DMA_GetITStatus(DMA_Stream_TypeDef *stream, uint32_t it) {return SET;}
+static inline void DMA_ClearITPendingBit(DMA_Stream_TypeDef *stream, uint32_t it) {}
+static inline void DMA_ITConfig(DMA_Stream_TypeDef *stream, uint32_t it, FunctionalState state) {}
+static inline void TIM_OC1Init(TIM_TypeDef *tim, TIM_OCInitTypeDef *init) {}
+static inline void TIM_OC2Init(TIM_TypeDef *tim, TIM_OCInitTypeDef *init) {}
+static inline void TIM_OC3Init(TIM_TypeDef *tim, TIM_OCInitTypeDef *init) {}
+static inline void TIM_OC4Init(TIM_TypeDef *tim, TIM_OCInitTypeDef *init) {}
+static inline void TIM_OC1PreloadConfig(TIM_TypeDef *tim, uint16_t preload) {}
+static inline void TIM_OC2PreloadConfig(TIM_TypeDef *tim, uint16_t preload) {}
+static inline void TIM_OC3PreloadConfig(TIM_TypeDef *tim, uint16_t preload) {}
+static inline void TIM_OC4PreloadConfig(TIM_TypeDef *tim, uint16_t preload) {}
+static inline void TIM_ICInit(TIM_TypeDef *tim, TIM_ICInitTypeDef *init) {}
+static inline void TIM_TimeBaseInit(TIM_TypeDef *tim, TIM_TimeBaseInitTypeDef *init) {}
+static inline void TIM_Cmd(TIM_TypeDef *tim, FunctionalState state) {}
+static inline void TIM_SelectCCDMA(TIM_TypeDef *tim, FunctionalState state) {}
+static inline void TIM_DMACmd(TIM_TypeDef *tim, uint16_t source, FunctionalState state) {}
+static inline void TIM_SetAutoreload(TIM_TypeDef *tim, uint32_t autoreload) {}
+static inline void TIM_SetCounter(TIM_TypeDef *tim, uint32_t counter) {}
+static inline void TIM_CtrlPWMOutputs(TIM_TypeDef *tim, FunctionalState state) {}
+static inline void GPIO_PinAFConfig(GPIO_TypeDef *gpio, uint16_t source, uint8_t af) {}
+static inline void GPIO_Init(GPIO_TypeDef *gpio, GPIO_InitTypeDef *init) {}
+static inline void RCC_AHB1PeriphClockCmd(uint32_t periph, FunctionalState state) {}
+static inline void RCC_APB1PeriphClockCmd(uint32_t periph, FunctionalState state) {}
+static inline void RCC_APB2PeriphClockCmd(uint32_t periph, FunctionalState state) {}
+static inline void NVIC_Init(NVIC_InitTypeDef *init) {}
+
+#endif
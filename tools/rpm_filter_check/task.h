@@ -0,0 +1,6 @@
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+/* see FreeRTOS.h */
+
+#endif
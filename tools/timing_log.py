@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+# summarizes the timing messages of the debug link over a measurement window
+# and compares two runs, e.g. SELECT_HOT_STATE_MEMORY in sram and in ccm.
+#
+# enable one of these in task_debug_link() before flashing:
+#   send_profiler_debug_message()    (message id 13): last, avg, max [us]
+#   send_rate_group_debug_message()  (message id 16): faults and log2 histograms
+#   send_sys_stats_debug_message()   (message id 15): interrupt worst case [us]
+#   send_boot_timing_debug_message() (message id 17): boot phases [ms]
+#
+# usage:
+#   python3 timing_log.py --port /dev/ttyUSB1 --duration 60 --save sram.json
+#   python3 timing_log.py --file screenlog.0 --save ccm.json
+#   python3 timing_log.py --compare sram.json ccm.json
+
+import argparse
+import json
+import struct
+import sys
+import time
+
+MESSAGE_ID_PROFILER = 13
+MESSAGE_ID_SYS_STATS = 15
+MESSAGE_ID_RATE_GROUP = 16
+MESSAGE_ID_BOOT_TIMING = 17
+
+RATE_GROUP_HIST_BINS = 16
+SYS_STATS_ISR_NAMES = ['exti', 'uart4', 'uart7', 'usart3', 'tim12']
+BOOT_PHASE_NAMES = ['scheduler', 'imu', 'esc', 'gps', 'baro', 'mag', 'armable']
+
+class debug_link_parser:
+    def __init__(self):
+        self.buf = bytearray()
+        self.checksum_errors = 0
+
+    # '@', payload size, message id, float payload, xor checksum of the payload
+    def feed(self, data):
+        self.buf += data
+        messages = []
+        while True:
+            start = self.buf.find(b'@')
+            if start < 0:
+                self.buf.clear()
+                break
+            del self.buf[:start]
+            if len(self.buf) < 3:
+                break
+            size = self.buf[1]
+            if len(self.buf) < size + 4:
+                break
+            message_id = self.buf[2]
+            payload = bytes(self.buf[3:3 + size])
+            checksum = 0
+            for b in payload:
+                checksum ^= b
+            if checksum != self.buf[3 + size] or size % 4 != 0:
+                self.checksum_errors += 1
+                del self.buf[:1]
+                continue
+            messages.append((message_id, struct.unpack('<%df' % (size // 4), payload)))
+            del self.buf[:size + 4]
+        return messages
+
+def percentile(values, p):
+    if len(values) == 0:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p / 100.0 * len(values)))]
+
+# upper edge of the bin that reaches the percentile, bin n is [2^(n-1), 2^n) us
+def hist_percentile(hist, p):
+    total = sum(hist)
+    if total == 0:
+        return 0.0
+    cnt = 0
+    for i, n in enumerate(hist):
+        cnt += n
+        if cnt >= p / 100.0 * total:
+            return float(1 << i)
+    return float(1 << (len(hist) - 1))
+
+def summarize(messages):
+    summary = {}
+
+    last = [m[1][0] for m in messages if m[0] == MESSAGE_ID_PROFILER]
+    if len(last) > 0:
+        final = [m[1] for m in messages if m[0] == MESSAGE_ID_PROFILER][-1]
+        summary['profiler'] = {
+            'samples': len(last),
+            'last_mean_us': sum(last) / len(last),
+            'last_p99_us': percentile(last, 99),
+            'avg_us': final[1],
+            'max_us': final[2]
+        }
+
+    rate_group = [m[1] for m in messages if m[0] == MESSAGE_ID_RATE_GROUP]
+    if len(rate_group) > 0:
+        final = rate_group[-1]
+        jitter = final[3:3 + RATE_GROUP_HIST_BINS]
+        exec_time = final[3 + RATE_GROUP_HIST_BINS:3 + 2 * RATE_GROUP_HIST_BINS]
+        summary['rate_group'] = {
+            'deadline_miss': final[0],
+            'overrun': final[1],
+            'skipped': final[2],
+            'jitter_p99_us': hist_percentile(jitter, 99),
+            'exec_p50_us': hist_percentile(exec_time, 50),
+            'exec_p99_us': hist_percentile(exec_time, 99)
+        }
+
+    sys_stats = [m[1] for m in messages if m[0] == MESSAGE_ID_SYS_STATS]
+    if len(sys_stats) > 0:
+        isr_max = {}
+        for s in sys_stats:
+            task_cnt = int(s[0])
+            offset = 1 + 4 * task_cnt + len(SYS_STATS_ISR_NAMES)
+            for i, name in enumerate(SYS_STATS_ISR_NAMES):
+                isr_max[name] = max(isr_max.get(name, 0.0), s[offset + i])
+        summary['isr_max_us'] = isr_max
+
+    boot = [m[1] for m in messages if m[0] == MESSAGE_ID_BOOT_TIMING]
+    if len(boot) > 0:
+        summary['boot_ms'] = dict(zip(BOOT_PHASE_NAMES, boot[-1]))
+
+    return summary
+
+def flatten(summary, prefix=''):
+    items = {}
+    for key, value in summary.items():
+        if isinstance(value, dict):
+            items.update(flatten(value, prefix + key + '.'))
+        else:
+            items[prefix + key] = value
+    return items
+
+def print_summary(summary):
+    for key, value in sorted(flatten(summary).items()):
+        print('%-28s %12.3f' % (key, value))
+
+def compare(before, after):
+    a = flatten(before)
+    b = flatten(after)
+    print('%-28s %12s %12s %9s' % ('', 'before', 'after', 'change'))
+    for key in sorted(set(a) & set(b)):
+        change = '%+8.1f%%' % ((b[key] - a[key]) / a[key] * 100.0) if a[key] != 0 else '       -'
+        print('%-28s %12.3f %12.3f %9s' % (key, a[key], b[key], change))
+
+def read_serial(port, duration):
+    import serial
+    ser = serial.Serial(port=port, baudrate=115200, timeout=0.1)
+    parser = debug_link_parser()
+    messages = []
+    end = time.time() + duration
+    while time.time() < end:
+        messages += parser.feed(ser.read(256))
+    ser.close()
+    return messages, parser.checksum_errors
+
+def read_file(path):
+    parser = debug_link_parser()
+    with open(path, 'rb') as f:
+        messages = parser.feed(f.read())
+    return messages, parser.checksum_errors
+
+def main():
+    arg_parser = argparse.ArgumentParser(description='debug link timing summary')
+    arg_parser.add_argument('--port', default='/dev/ttyUSB1')
+    arg_parser.add_argument('--duration', type=float, default=30.0, help='measurement window [s]')
+    arg_parser.add_argument('--file', help='captured byte stream instead of the serial port')
+    arg_parser.add_argument('--save', help='write the summary as json')
+    arg_parser.add_argument('--compare', nargs=2, metavar=('BEFORE', 'AFTER'))
+    args = arg_parser.parse_args()
+
+    if args.compare:
+        with open(args.compare[0]) as f:
+            before = json.load(f)
+        with open(args.compare[1]) as f:
+            after = json.load(f)
+        compare(before, after)
+        return 0
+
+    if args.file:
+        messages, checksum_errors = read_file(args.file)
+    else:
+        messages, checksum_errors = read_serial(args.port, args.duration)
+
+    print('%d messages, %d checksum errors' % (len(messages), checksum_errors))
+    if len(messages) == 0:
+        return 1
+
+    summary = summarize(messages)
+    print_summary(summary)
+
+    if args.save:
+        with open(args.save, 'w') as f:
+            json.dump(summary, f, indent=2)
+
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,34 @@
+#ifndef __STM32F4xx_CONF_H
+#define __STM32F4xx_CONF_H
+
+/* host replacement of the device headers, ublox.c only needs the counter of
+ * its receive dma stream and the barrier of the sequence lock. the cmsis
+ * barrier is an arm instruction, so the real headers can not be used */
+
+#include <stdint.h>
+
+typedef struct {
+	int unused;
+} USART_TypeDef;
+
+typedef struct {
+	int unused;
+} DMA_Stream_TypeDef;
+
+typedef struct {
+	volatile uint32_t CYCCNT;
+} DWT_Type;
+
+extern USART_TypeDef host_uart7;
+extern DMA_Stream_TypeDef host_dma1_stream3;
+extern DWT_Type host_dwt;
+
+#define UART7 (&host_uart7)
+#define DMA1_Stream3 (&host_dma1_stream3)
+#define DWT (&host_dwt)
+
+#define __DMB() __sync_synchronize()
+
+uint16_t DMA_GetCurrDataCounter(DMA_Stream_TypeDef *stream);
+
+#endif
@@ -0,0 +1,626 @@
+/* replays ubx byte streams through the gps driver of the flight code on the
+ * host. the uart dma is emulated by writing the stream into ublox_rx_buf in
+ * chunks, the fixes decoded by ublox_rx_handler() must match a linear parser
+ * that sees the whole stream at once.
+ *
+ * usage: ublox_check [-o synthetic.ubx] [log.ubx...]
+ *
+ * logs are the raw receiver output as recorded by u-center or a serial
+ * logger. without logs a synthetic stream is checked: nav-pvt at 10Hz mixed
+ * with nmea sentences, other ubx messages, corrupted checksums, truncated
+ * frames and false sync chars, -o writes it out. the configuration frames
+ * sent by ublox_init() and ublox_init_step() are checked as well.
+ *
+ * every stream is replayed with three chunkings, each one in its own process
+ * since the driver state is static: byte by byte, dma half/full transfer
+ * interrupts only, and random uart idle line interrupts. returns non-zero if
+ * any check fails */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "stm32f4xx_conf.h"
+#include "ublox.h"
+
+#define UBX_SYNC_CHAR_1 0xb5
+#define UBX_SYNC_CHAR_2 0x62
+#define UBX_FRAME_OVERHEAD 8 //sync chars, class, id, length, checksum
+#define UBX_NAV_PVT_SIZE 92
+
+#define UART_BYTE_TIME_MS (10.0f * 1000.0f / UBLOX_BAUDRATE)
+
+#define SYNTHETIC_FIX_CNT 6000 //10 minutes at 10Hz
+#define TX_BUF_SIZE 1024
+
+enum {
+	CHUNK_BYTE,
+	CHUNK_DMA_HALF,
+	CHUNK_IDLE_LINE,
+	CHUNK_MODE_CNT
+};
+
+static const char *chunk_mode_name[CHUNK_MODE_CNT] = {
+	"byte by byte",
+	"dma half/full transfer",
+	"uart idle line"
+};
+
+/* nav-pvt frame found by the linear parser */
+typedef struct {
+	size_t end; //stream position after the checksum
+	uint32_t itow;
+	uint8_t fix_type;
+	uint8_t flags;
+	uint8_t num_sv;
+	int32_t longitude;
+	int32_t latitude;
+	int32_t height_msl;
+	uint32_t h_acc;
+	uint32_t v_acc;
+	int32_t vel[3];
+	uint32_t s_acc;
+	uint16_t pdop;
+} ref_pvt_t;
+
+typedef struct {
+	ref_pvt_t *pvt;
+	int pvt_cnt;
+	int frame_cnt;          //valid frames of any kind
+	int checksum_error_cnt;
+} ref_result_t;
+
+USART_TypeDef host_uart7;
+DMA_Stream_TypeDef host_dma1_stream3;
+DWT_Type host_dwt;
+
+extern uint32_t ubx_checksum_error_cnt;
+
+static const uint8_t *dma_stream;
+static size_t dma_pos; //bytes written into the ring buffer so far
+
+static uint8_t tx_buf[TX_BUF_SIZE];
+static size_t tx_size;
+static int uart7_baudrate[4];
+static int uart7_init_cnt;
+
+/* circular mode counter, reloaded with the buffer size after the last byte */
+uint16_t DMA_GetCurrDataCounter(DMA_Stream_TypeDef *stream)
+{
+	return UBLOX_RX_BUF_SIZE - (dma_pos % UBLOX_RX_BUF_SIZE);
+}
+
+/* the stream arrives at the configured baudrate */
+float get_sys_time_ms(void)
+{
+	return (float)dma_pos * UART_BYTE_TIME_MS;
+}
+
+void uart7_init(int baudrate)
+{
+	if(uart7_init_cnt < 4) {
+		uart7_baudrate[uart7_init_cnt] = baudrate;
+	}
+	uart7_init_cnt++;
+}
+
+void uart_putc(USART_TypeDef *uart, char c)
+{
+	if(tx_size < TX_BUF_SIZE) {
+		tx_buf[tx_size++] = (uint8_t)c;
+	}
+}
+
+void usart_puts(USART_TypeDef *uart, char *s, int size)
+{
+	int i;
+	for(i = 0; i < size; i++) {
+		uart_putc(uart, s[i]);
+	}
+}
+
+/* the configuration waits are skipped */
+bool delay_elapsed_ms(uint32_t start, uint32_t ms)
+{
+	return true;
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+	return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+	return (uint32_t)get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+/*==========================================================*
+ * linear reference parser                                  *
+ *==========================================================*/
+
+static bool ref_checksum_ok(const uint8_t *frame, size_t payload_len)
+{
+	uint8_t ck_a = 0, ck_b = 0;
+
+	size_t i;
+	for(i = 2; i < 6 + payload_len; i++) {
+		ck_a += frame[i];
+		ck_b += ck_a;
+	}
+
+	return (ck_a == frame[6 + payload_len]) && (ck_b == frame[7 + payload_len]);
+}
+
+static void ref_pvt_decode(ref_pvt_t *pvt, const uint8_t *payload, size_t end)
+{
+	pvt->end = end;
+	pvt->itow = get_u32(payload + 0);
+	pvt->fix_type = payload[20];
+	pvt->flags = payload[21];
+	pvt->num_sv = payload[23];
+	pvt->longitude = (int32_t)get_u32(payload + 24);
+	pvt->latitude = (int32_t)get_u32(payload + 28);
+	pvt->height_msl = (int32_t)get_u32(payload + 36);
+	pvt->h_acc = get_u32(payload + 40);
+	pvt->v_acc = get_u32(payload + 44);
+	pvt->vel[0] = (int32_t)get_u32(payload + 48);
+	pvt->vel[1] = (int32_t)get_u32(payload + 52);
+	pvt->vel[2] = (int32_t)get_u32(payload + 56);
+	pvt->s_acc = get_u32(payload + 68);
+	pvt->pdop = get_u16(payload + 76);
+}
+
+/* same resynchronization rules as the driver: a frame longer than half of
+ * the ring buffer or with a wrong checksum only skips its first sync char */
+static void ref_parse(const uint8_t *stream, size_t size, ref_result_t *result)
+{
+	memset(result, 0, sizeof(ref_result_t));
+	result->pvt = malloc(sizeof(ref_pvt_t) * (size / (UBX_NAV_PVT_SIZE + UBX_FRAME_OVERHEAD) + 1));
+
+	size_t pos = 0;
+	while(pos + UBX_FRAME_OVERHEAD <= size) {
+		const uint8_t *frame = stream + pos;
+
+		if(frame[0] != UBX_SYNC_CHAR_1 || frame[1] != UBX_SYNC_CHAR_2) {
+			pos++;
+			continue;
+		}
+
+		size_t payload_len = get_u16(frame + 4);
+		size_t frame_size = payload_len + UBX_FRAME_OVERHEAD;
+		if(frame_size > UBLOX_RX_BUF_SIZE / 2) {
+			pos++;
+			continue;
+		}
+
+		if(pos + frame_size > size) {
+			break; //truncated at the end of the stream
+		}
+
+		if(ref_checksum_ok(frame, payload_len) == false) {
+			result->checksum_error_cnt++;
+			pos++;
+			continue;
+		}
+
+		result->frame_cnt++;
+		if(frame[2] == 0x01 && frame[3] == 0x07 && payload_len == UBX_NAV_PVT_SIZE) {
+			ref_pvt_decode(&result->pvt[result->pvt_cnt++], frame + 6, pos + frame_size);
+		}
+
+		pos += frame_size;
+	}
+}
+
+/*==========================================================*
+ * driver replay                                            *
+ *==========================================================*/
+
+static bool fix_matches(const gps_fix_t *fix, const ref_pvt_t *pvt)
+{
+	return (fix->itow == pvt->itow) &&
+	       (fix->fix_type == pvt->fix_type) &&
+	       (fix->fix_ok == ((pvt->flags & 0x01) ? true : false)) &&
+	       (fix->num_sv == pvt->num_sv) &&
+	       (fix->longitude == pvt->longitude) &&
+	       (fix->latitude == pvt->latitude) &&
+	       (fix->height_msl == (float)pvt->height_msl * 0.001f) &&
+	       (fix->h_acc == (float)pvt->h_acc * 0.001f) &&
+	       (fix->v_acc == (float)pvt->v_acc * 0.001f) &&
+	       (fix->vel_n == (float)pvt->vel[0] * 0.001f) &&
+	       (fix->vel_e == (float)pvt->vel[1] * 0.001f) &&
+	       (fix->vel_d == (float)pvt->vel[2] * 0.001f) &&
+	       (fix->s_acc == (float)pvt->s_acc * 0.001f) &&
+	       (fix->pdop == (float)pvt->pdop * 0.01f);
+}
+
+static size_t chunk_size(int mode)
+{
+	switch(mode) {
+	case CHUNK_BYTE:
+		return 1;
+	case CHUNK_DMA_HALF:
+		return UBLOX_RX_BUF_SIZE / 2;
+	default:
+		/* the idle line fires after every burst of the receiver, bursts are
+		 * kept below a quarter of the ring so no frame is overwritten */
+		return 1 + (size_t)(rand() % (UBLOX_RX_BUF_SIZE / 4));
+	}
+}
+
+/* runs in a forked process, returns the exit status */
+static int replay_stream(const uint8_t *stream, size_t size, const ref_result_t *ref, int mode)
+{
+	dma_stream = stream;
+	dma_pos = 0;
+	srand(1);
+
+	uint32_t update_cnt_last = 0;
+	size_t max_delay = 0; //stream bytes between the end of a frame and its decoding
+	int mismatch_cnt = 0;
+
+	while(dma_pos < size) {
+		size_t n = chunk_size(mode);
+		if(n > size - dma_pos) {
+			n = size - dma_pos;
+		}
+
+		size_t i;
+		for(i = 0; i < n; i++) {
+			ublox_rx_buf[dma_pos % UBLOX_RX_BUF_SIZE] = dma_stream[dma_pos];
+			dma_pos++;
+		}
+
+		ublox_rx_handler();
+
+		gps_fix_t fix;
+		uint32_t update_cnt = ublox_get_fix(&fix);
+		if(update_cnt == update_cnt_last) {
+			continue;
+		}
+		update_cnt_last = update_cnt;
+
+		/* the latest fix is the only one visible, it has to be the frame with
+		 * the same index and must not be decoded before it was received */
+		if(update_cnt > (uint32_t)ref->pvt_cnt) {
+			mismatch_cnt++;
+			break;
+		}
+		const ref_pvt_t *pvt = &ref->pvt[update_cnt - 1];
+		if(fix_matches(&fix, pvt) == false || pvt->end > dma_pos) {
+			mismatch_cnt++;
+		}
+		if(dma_pos - pvt->end > max_delay) {
+			max_delay = dma_pos - pvt->end;
+		}
+	}
+
+	bool pass = (mismatch_cnt == 0) && (update_cnt_last == (uint32_t)ref->pvt_cnt) &&
+	            (ubx_checksum_error_cnt == (uint32_t)ref->checksum_error_cnt);
+
+	printf("  %-24s fixes %u/%d, checksum errors %u/%d, mismatches %d, max delay %zu bytes: %s\n",
+	       chunk_mode_name[mode], update_cnt_last, ref->pvt_cnt, ubx_checksum_error_cnt,
+	       ref->checksum_error_cnt, mismatch_cnt, max_delay, (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}
+
+static bool check_stream(const char *name, const uint8_t *stream, size_t size)
+{
+	ref_result_t ref;
+	ref_parse(stream, size, &ref);
+
+	printf("%s: %zu bytes, %d ubx frames, %d nav-pvt, %d checksum errors\n",
+	       name, size, ref.frame_cnt, ref.pvt_cnt, ref.checksum_error_cnt);
+
+	if(ref.pvt_cnt > 1) {
+		uint32_t period_ms = ref.pvt[1].itow - ref.pvt[0].itow;
+		int fix_3d_cnt = 0;
+		int i;
+		for(i = 0; i < ref.pvt_cnt; i++) {
+			fix_3d_cnt += (ref.pvt[i].fix_type == 3) ? 1 : 0;
+		}
+		printf("  nav-pvt period %ums, %d 3d fixes\n", period_ms, fix_3d_cnt);
+	}
+
+	bool pass = true;
+
+	int mode;
+	for(mode = 0; mode < CHUNK_MODE_CNT; mode++) {
+		fflush(stdout);
+		pid_t pid = fork();
+		if(pid == 0) {
+			exit(replay_stream(stream, size, &ref, mode));
+		}
+
+		int status;
+		waitpid(pid, &status, 0);
+		if(WIFEXITED(status) == 0 || WEXITSTATUS(status) != 0) {
+			pass = false;
+		}
+	}
+
+	free(ref.pvt);
+
+	return pass;
+}
+
+/*==========================================================*
+ * receiver configuration                                   *
+ *==========================================================*/
+
+static const uint8_t *find_frame(const ref_result_t *frames, const uint8_t *stream, size_t size,
+                                 uint8_t class, uint8_t id, int nth)
+{
+	size_t pos;
+	for(pos = 0; pos + UBX_FRAME_OVERHEAD <= size; pos++) {
+		const uint8_t *frame = stream + pos;
+		size_t payload_len = get_u16(frame + 4);
+		if(frame[0] == UBX_SYNC_CHAR_1 && frame[1] == UBX_SYNC_CHAR_2 &&
+		   frame[2] == class && frame[3] == id && pos + payload_len + UBX_FRAME_OVERHEAD <= size &&
+		   ref_checksum_ok(frame, payload_len) == true && nth-- == 0) {
+			return frame;
+		}
+	}
+
+	return NULL;
+}
+
+/* runs in a forked process, the boot sequence is driven to the end */
+static int check_config_process(void)
+{
+	ublox_init();
+
+	int steps = 0;
+	while(ublox_init_step() == false && steps < 10) {
+		steps++;
+	}
+
+	ref_result_t ref;
+	ref_parse(tx_buf, tx_size, &ref);
+
+	const uint8_t *prt_default = find_frame(&ref, tx_buf, tx_size, 0x06, 0x00, 0);
+	const uint8_t *prt_new = find_frame(&ref, tx_buf, tx_size, 0x06, 0x00, 1);
+	const uint8_t *nav5 = find_frame(&ref, tx_buf, tx_size, 0x06, 0x24, 0);
+	const uint8_t *rate = find_frame(&ref, tx_buf, tx_size, 0x06, 0x08, 0);
+	const uint8_t *msg = find_frame(&ref, tx_buf, tx_size, 0x06, 0x01, 0);
+
+	bool pass = (ref.checksum_error_cnt == 0) && (ref.frame_cnt == 5) &&
+	            (uart7_init_cnt == 2) && (uart7_baudrate[0] == UBLOX_DEFAULT_BAUDRATE) &&
+	            (uart7_baudrate[1] == UBLOX_BAUDRATE) &&
+	            (prt_default != NULL) && (get_u32(prt_default + 6 + 8) == UBLOX_BAUDRATE) &&
+	            (get_u16(prt_default + 6 + 14) == 0x01) && //ubx output only
+	            (prt_new != NULL) && (get_u32(prt_new + 6 + 8) == UBLOX_BAUDRATE) &&
+	            (nav5 != NULL) && (nav5[6 + 2] == 8) &&    //airborne <4g
+	            (rate != NULL) && (get_u16(rate + 6) == 1000 / UBLOX_UPDATE_RATE) &&
+	            (msg != NULL) && (msg[6] == 0x01) && (msg[7] == 0x07) && (msg[8] == 1);
+
+	printf("configuration: %zu bytes, %d valid frames, %d checksum errors, %d boot steps: %s\n",
+	       tx_size, ref.frame_cnt, ref.checksum_error_cnt, steps + 1, (pass == true) ? "pass" : "FAIL");
+
+	free(ref.pvt);
+
+	return (pass == true) ? 0 : 1;
+}
+
+static bool check_config(void)
+{
+	fflush(stdout);
+	pid_t pid = fork();
+	if(pid == 0) {
+		exit(check_config_process());
+	}
+
+	int status;
+	waitpid(pid, &status, 0);
+	return (WIFEXITED(status) != 0) && (WEXITSTATUS(status) == 0);
+}
+
+/*==========================================================*
+ * synthetic stream                                         *
+ *==========================================================*/
+
+typedef struct {
+	uint8_t *buf;
+	size_t size;
+	size_t capacity;
+} stream_t;
+
+static void stream_put(stream_t *s, const uint8_t *data, size_t size)
+{
+	if(s->size + size > s->capacity) {
+		s->capacity = (s->size + size) * 2;
+		s->buf = realloc(s->buf, s->capacity);
+	}
+	memcpy(s->buf + s->size, data, size);
+	s->size += size;
+}
+
+static void put_u16(uint8_t *p, uint16_t val)
+{
+	p[0] = val & 0xff;
+	p[1] = val >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t val)
+{
+	put_u16(p, val & 0xffff);
+	put_u16(p + 2, val >> 16);
+}
+
+static size_t ubx_frame(uint8_t *frame, uint8_t class, uint8_t id, const uint8_t *payload, uint16_t len)
+{
+	frame[0] = UBX_SYNC_CHAR_1;
+	frame[1] = UBX_SYNC_CHAR_2;
+	frame[2] = class;
+	frame[3] = id;
+	put_u16(frame + 4, len);
+	memcpy(frame + 6, payload, len);
+
+	uint8_t ck_a = 0, ck_b = 0;
+	int i;
+	for(i = 2; i < 6 + len; i++) {
+		ck_a += frame[i];
+		ck_b += ck_a;
+	}
+	frame[6 + len] = ck_a;
+	frame[7 + len] = ck_b;
+
+	return len + UBX_FRAME_OVERHEAD;
+}
+
+/* a slow circle around the lab with the fix quality changing over time */
+static size_t synthetic_pvt(uint8_t *frame, int n)
+{
+	uint8_t payload[UBX_NAV_PVT_SIZE] = {0};
+
+	float t = (float)n * 0.1f;
+	int32_t vel_n = (int32_t)(2000.0f * (float)((n / 50) % 3) - 2000.0f);
+
+	put_u32(payload + 0, 345600000 + (uint32_t)n * 100);                //itow
+	payload[20] = (n % 1000 < 50) ? 2 : 3;                              //fix type
+	payload[21] = (n % 1000 < 50) ? 0x00 : 0x01;                        //gnss fix ok
+	payload[23] = (uint8_t)(8 + (n / 37) % 10);                         //satellites
+	put_u32(payload + 24, (uint32_t)(1209967000 + (int32_t)(n * 13) - (n % 600) * 7)); //lon
+	put_u32(payload + 28, (uint32_t)(247869000 - (int32_t)(n % 800) * 11));           //lat
+	put_u32(payload + 36, (uint32_t)(52000 + (int32_t)(t * 10.0f) % 3000));          //height msl
+	put_u32(payload + 40, 800 + (uint32_t)(n % 300));                   //h acc
+	put_u32(payload + 44, 1500 + (uint32_t)(n % 500));                  //v acc
+	put_u32(payload + 48, (uint32_t)vel_n);
+	put_u32(payload + 52, (uint32_t)(-vel_n / 2));
+	put_u32(payload + 56, (uint32_t)((n % 40) - 20));
+	put_u32(payload + 68, 150 + (uint32_t)(n % 90));                    //s acc
+	put_u16(payload + 76, (uint16_t)(120 + n % 80));                    //pdop
+
+	return ubx_frame(frame, 0x01, 0x07, payload, UBX_NAV_PVT_SIZE);
+}
+
+static void synthetic_stream(stream_t *s)
+{
+	srand(2);
+
+	int n;
+	for(n = 0; n < SYNTHETIC_FIX_CNT; n++) {
+		uint8_t frame[UBX_NAV_PVT_SIZE + UBX_FRAME_OVERHEAD];
+		size_t size = synthetic_pvt(frame, n);
+
+		switch(n % 17) {
+		case 3:
+			frame[6 + rand() % UBX_NAV_PVT_SIZE] ^= 0x10; //bit error in the payload
+			stream_put(s, frame, size);
+			break;
+		case 7:
+			stream_put(s, frame, 6 + rand() % (size - 6)); //receiver reset mid frame
+			break;
+		default:
+			stream_put(s, frame, size);
+		}
+
+		/* nmea left enabled by an old configuration */
+		if(n % 5 == 0) {
+			char nmea[96];
+			int len = snprintf(nmea, sizeof(nmea), "$GNGGA,%06d.00,2447.21,N,12059.80,E,1,%02d,0.9,52.0,M,17.5,M,,*%02X\r\n",
+			                   n, 8 + n % 10, n & 0xff);
+			stream_put(s, (uint8_t *)nmea, (size_t)len);
+		}
+
+		/* other ubx messages, nav-status and ack-ack */
+		if(n % 10 == 0) {
+			uint8_t payload[16] = {0};
+			put_u32(payload, 345600000 + (uint32_t)n * 100);
+			payload[4] = 3;
+			size = ubx_frame(frame, 0x01, 0x03, payload, 16);
+			stream_put(s, frame, size);
+		}
+		if(n % 250 == 0) {
+			uint8_t payload[2] = {0x06, 0x01};
+			size = ubx_frame(frame, 0x05, 0x01, payload, 2);
+			stream_put(s, frame, size);
+		}
+
+		/* line noise with false sync chars and lengths */
+		if(n % 23 == 0) {
+			uint8_t noise[24];
+			int i;
+			for(i = 0; i < 24; i++) {
+				noise[i] = (uint8_t)rand();
+			}
+			noise[4] = UBX_SYNC_CHAR_1;
+			noise[5] = UBX_SYNC_CHAR_2;
+			stream_put(s, noise, sizeof(noise));
+		}
+	}
+}
+
+static bool load_file(const char *path, stream_t *s)
+{
+	FILE *file = fopen(path, "rb");
+	if(file == NULL) {
+		perror(path);
+		return false;
+	}
+
+	uint8_t buf[4096];
+	size_t n;
+	while((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+		stream_put(s, buf, n);
+	}
+	fclose(file);
+
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	const char *output_path = NULL;
+
+	int opt;
+	while((opt = getopt(argc, argv, "o:")) != -1) {
+		switch(opt) {
+		case 'o':
+			output_path = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-o synthetic.ubx] [log.ubx...]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	bool pass = check_config();
+
+	if(optind == argc) {
+		stream_t s = {0};
+		synthetic_stream(&s);
+
+		if(output_path != NULL) {
+			FILE *file = fopen(output_path, "wb");
+			if(file == NULL) {
+				perror(output_path);
+				return 1;
+			}
+			fwrite(s.buf, 1, s.size, file);
+			fclose(file);
+		}
+
+		pass &= check_stream("synthetic", s.buf, s.size);
+		free(s.buf);
+	}
+
+	int i;
+	for(i = optind; i < argc; i++) {
+		stream_t s = {0};
+		if(load_file(argv[i], &s) == false) {
+			return 1;
+		}
+		pass &= check_stream(argv[i], s.buf, s.size);
+		free(s.buf);
+	}
+
+	printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}
@@ -0,0 +1,279 @@
+/* host check of the ud factorized covariance of ahrs_ekf_ud_estimate(), the
+ * ud_filter.c of the flight code runs next to a double precision kalman
+ * filter with the full covariance.
+ *
+ * usage: make check
+ *
+ * the quaternion model of the attitude ekf is driven by a rotating gyro at
+ * 400Hz for one simulated hour, each step is a thornton time update and four
+ * bierman scalar updates with random innovations. U * D * U' (ud_to_covariance())
+ * and the state have to follow the float64 reference, and the covariance has
+ * to stay positive definite. the plain single precision update
+ * P = P + dt * (F * P + P * F' + Q) of ahrs_ekf_estimate() is reported for
+ * comparison. returns non-zero if any case fails */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include "ud_filter.h"
+
+#define N 4
+#define RATE 400.0f         //[Hz]
+#define STEPS (400L * 3600) //one hour
+#define SAMPLE_INTERVAL 400 //steps between two comparisons
+
+/* same tuning as ahrs.c */
+#define P0 100.0f
+#define Q 0.1f
+
+#define COV_ERROR_MAX 1e-5   //relative frobenius norm
+#define STATE_ERROR_MAX 1e-5
+
+typedef struct {
+	double max_cov_error;
+	double max_state_error;
+	long not_pd_cnt;
+} filter_error_t;
+
+static double uniform(void)
+{
+	return (double)rand() / RAND_MAX - 0.5;
+}
+
+/* double precision reference: P = phi * P * phi' + Q, four scalar updates */
+static void reference_step(double P[N][N], double x[N], float phi[N][N], double q,
+                           double r, const float innovation[N])
+{
+	double T[N][N], Pn[N][N], xn[N];
+	int i, j, k, m;
+
+	for(i = 0; i < N; i++) {
+		xn[i] = 0.0;
+		for(j = 0; j < N; j++) {
+			xn[i] += phi[i][j] * x[j];
+			T[i][j] = 0.0;
+			for(k = 0; k < N; k++) {
+				T[i][j] += phi[i][k] * P[k][j];
+			}
+		}
+	}
+	for(i = 0; i < N; i++) {
+		for(j = 0; j < N; j++) {
+			Pn[i][j] = (i == j) ? q : 0.0;
+			for(k = 0; k < N; k++) {
+				Pn[i][j] += T[i][k] * phi[j][k];
+			}
+		}
+	}
+
+	for(m = 0; m < N; m++) {
+		double s = Pn[m][m] + r, K[N], row[N];
+		for(i = 0; i < N; i++) {
+			K[i] = Pn[i][m] / s;
+			row[i] = Pn[m][i];
+		}
+		for(i = 0; i < N; i++) {
+			xn[i] += K[i] * innovation[m];
+			for(j = 0; j < N; j++) {
+				Pn[i][j] -= K[i] * row[j];
+			}
+		}
+	}
+
+	for(i = 0; i < N; i++) {
+		x[i] = xn[i];
+		for(j = 0; j < N; j++) {
+			P[i][j] = Pn[i][j];
+		}
+	}
+}
+
+/* single precision form of ahrs_ekf_estimate() for comparison */
+static void dense_step(float P[N][N], float F[N][N], float dt, float q, float r)
+{
+	float FP[N][N], Pn[N][N];
+	int i, j, k, m;
+
+	for(i = 0; i < N; i++) {
+		for(j = 0; j < N; j++) {
+			FP[i][j] = 0.0f;
+			for(k = 0; k < N; k++) {
+				FP[i][j] += F[i][k] * P[k][j];
+			}
+		}
+	}
+	for(i = 0; i < N; i++) {
+		for(j = 0; j < N; j++) {
+			Pn[i][j] = P[i][j] + dt * (FP[i][j] + FP[j][i] + ((i == j) ? q : 0.0f));
+		}
+	}
+
+	for(m = 0; m < N; m++) {
+		float s = Pn[m][m] + r, K[N], row[N];
+		for(i = 0; i < N; i++) {
+			K[i] = Pn[i][m] / s;
+			row[i] = Pn[m][i];
+		}
+		for(i = 0; i < N; i++) {
+			for(j = 0; j < N; j++) {
+				Pn[i][j] -= K[i] * row[j];
+			}
+		}
+	}
+
+	for(i = 0; i < N; i++) {
+		for(j = 0; j < N; j++) {
+			P[i][j] = Pn[i][j];
+		}
+	}
+}
+
+static double cov_error(float A[N][N], double B[N][N])
+{
+	double num = 0.0, den = 0.0;
+	int i, j;
+	for(i = 0; i < N; i++) {
+		for(j = 0; j < N; j++) {
+			num += (A[i][j] - B[i][j]) * (A[i][j] - B[i][j]);
+			den += B[i][j] * B[i][j];
+		}
+	}
+	return sqrt(num / den);
+}
+
+/* cholesky in double precision */
+static bool positive_definite(float A[N][N])
+{
+	double L[N][N] = {{0.0}};
+	int i, j, k;
+	for(j = 0; j < N; j++) {
+		double s = A[j][j];
+		for(k = 0; k < j; k++) {
+			s -= L[j][k] * L[j][k];
+		}
+		if(s <= 0.0) {
+			return false;
+		}
+		L[j][j] = sqrt(s);
+		for(i = j + 1; i < N; i++) {
+			double t = A[i][j];
+			for(k = 0; k < j; k++) {
+				t -= L[i][k] * L[j][k];
+			}
+			L[i][j] = t / L[j][j];
+		}
+	}
+	return true;
+}
+
+static bool run_case(float r)
+{
+	const float dt = 1.0f / RATE;
+
+	ud_cov_t ud;
+	float p0[N] = {P0, P0, P0, P0};
+	ud_init(&ud, N, p0);
+
+	double P_ref[N][N] = {{0.0}}, x_ref[N] = {0.0};
+	float P_dense[N][N] = {{0.0f}}, x[N] = {0.0f};
+	int i;
+	for(i = 0; i < N; i++) {
+		P_ref[i][i] = P0;
+		P_dense[i][i] = P0;
+	}
+
+	filter_error_t ud_err = {0}, dense_err = {0};
+
+	srand(1);
+
+	long s;
+	for(s = 0; s < STEPS; s++) {
+		float t = s * dt;
+		float wx = 3.0f * sinf(1.3f * t) + 0.2f * (float)uniform();
+		float wy = 2.0f * cosf(0.7f * t);
+		float wz = 1.5f * sinf(0.2f * t + 1.0f);
+
+		/* phi = I + F * dt as in ahrs_ekf_ud_estimate() */
+		float hx = 0.5f * wx * dt, hy = 0.5f * wy * dt, hz = 0.5f * wz * dt;
+		float phi[UD_MAX_STATES][UD_MAX_STATES] = {
+			{1.0f, -hx,  -hy,  -hz},
+			{hx,   1.0f, hz,   -hy},
+			{hy,   -hz,  1.0f, hx},
+			{hz,   hy,   -hx,  1.0f}
+		};
+		float F[N][N] = {
+			{0.0f,      -0.5f * wx, -0.5f * wy, -0.5f * wz},
+			{0.5f * wx, 0.0f,       0.5f * wz,  -0.5f * wy},
+			{0.5f * wy, -0.5f * wz, 0.0f,       0.5f * wx},
+			{0.5f * wz, 0.5f * wy,  -0.5f * wx, 0.0f}
+		};
+
+		/* the reference state restarts from the filter every step, so only the
+		 * error of the step and not the rounding of the random walk is compared */
+		float x_last[N] = {x[0], x[1], x[2], x[3]};
+		int j;
+		for(i = 0; i < N; i++) {
+			x_ref[i] = x_last[i];
+			x[i] = 0.0f;
+			for(j = 0; j < N; j++) {
+				x[i] += phi[i][j] * x_last[j];
+			}
+		}
+		float innovation[N];
+		for(i = 0; i < N; i++) {
+			innovation[i] = 0.01f * (float)uniform();
+		}
+
+		float q_diag[N] = {Q * dt, Q * dt, Q * dt, Q * dt};
+		ud_predict(&ud, phi, q_diag);
+		for(i = 0; i < N; i++) {
+			float h[N] = {0.0f, 0.0f, 0.0f, 0.0f};
+			h[i] = 1.0f;
+			ud_update(&ud, x, h, r, innovation[i]);
+		}
+
+		reference_step(P_ref, x_ref, phi, Q * dt, r, innovation);
+		dense_step(P_dense, F, dt, Q, r);
+
+		if((s % SAMPLE_INTERVAL) == 0 || s == STEPS - 1) {
+			float P_ud[N][N];
+			ud_to_covariance(&ud, P_ud);
+
+			ud_err.max_cov_error = fmax(ud_err.max_cov_error, cov_error(P_ud, P_ref));
+			dense_err.max_cov_error = fmax(dense_err.max_cov_error, cov_error(P_dense, P_ref));
+			ud_err.not_pd_cnt += (positive_definite(P_ud) == false);
+			dense_err.not_pd_cnt += (positive_definite(P_dense) == false);
+
+			double x_norm = 0.0;
+			for(i = 0; i < N; i++) {
+				x_norm = fmax(x_norm, fabs(x_ref[i]));
+			}
+			for(i = 0; i < N; i++) {
+				ud_err.max_state_error = fmax(ud_err.max_state_error, fabs(x[i] - x_ref[i]) / x_norm);
+			}
+		}
+	}
+
+	bool pass = ud_err.max_cov_error <= COV_ERROR_MAX && ud_err.max_state_error <= STATE_ERROR_MAX &&
+	            ud_err.not_pd_cnt == 0;
+
+	printf("r=%-6g ud: covariance error %.2e, state error %.2e, not pd %ld %s\n", r,
+	       ud_err.max_cov_error, ud_err.max_state_error, ud_err.not_pd_cnt, (pass == true) ? "ok" : "FAIL");
+	printf("r=%-6g single precision P: covariance error %.2e, not pd %ld\n", r,
+	       dense_err.max_cov_error, dense_err.not_pd_cnt);
+
+	return pass;
+}
+
+int main(void)
+{
+	bool pass = true;
+
+	pass &= run_case(0.001f); //AHRS_UD_R
+	pass &= run_case(0.1f);
+
+	printf("%s\n", (pass == true) ? "pass" : "FAIL");
+
+	return (pass == true) ? 0 : 1;
+}